@@ -43,6 +43,18 @@
 
 namespace graphene { namespace app {
 
+    namespace {
+       /** runs a call which only reads the state on the api threads of app, if it has any */
+       template<typename Functor>
+       auto run_read_only( application& app, const char* method, Functor&& f ) -> decltype( f() )
+       {
+          api_thread_pool* pool = app.api_pool();
+          if( pool == nullptr )
+             return f();
+          return pool->run( method, std::forward<Functor>(f) );
+       }
+    }
+
     login_api::login_api(application& a)
     :_app(a)
     {
@@ -78,7 +90,7 @@ namespace graphene { namespace app {
     {
        if( api_name == "database_api" )
        {
-          _database_api = std::make_shared< database_api >( std::ref( *_app.chain_database() ) );
+          _database_api = std::make_shared< database_api >( std::ref( *_app.chain_database() ), _app.api_pool() );
        }
        else if( api_name == "network_broadcast_api" )
        {
@@ -140,8 +152,9 @@ namespace graphene { namespace app {
 
     void network_broadcast_api::broadcast_block( const signed_block& b )
     {
-       _app.chain_database()->push_block(b);
-       _app.p2p_node()->broadcast( net::block_message( b ));
+       const sealed_block sealed( b );
+       _app.chain_database()->push_block(sealed);
+       _app.p2p_node()->broadcast( net::block_message( sealed ));
     }
 
     void network_broadcast_api::broadcast_transaction_with_callback(confirmation_callback cb, const signed_transaction& trx)
@@ -380,27 +393,29 @@ namespace graphene { namespace app {
 
     vector<order_history_object> history_api::get_fill_order_history( asset_id_type a, asset_id_type b, uint32_t limit  )const
     {
-       FC_ASSERT(_app.chain_database());
-       const auto& db = *_app.chain_database();
-       if( a > b ) std::swap(a,b);
-       const auto& history_idx = db.get_index_type<graphene::market_history::history_index>().indices().get<by_key>();
-       history_key hkey;
-       hkey.base = a;
-       hkey.quote = b;
-       hkey.sequence = std::numeric_limits<int64_t>::min();
-
-       uint32_t count = 0;
-       auto itr = history_idx.lower_bound( hkey );
-       vector<order_history_object> result;
-       while( itr != history_idx.end() && count < limit)
-       {
-          if( itr->key.base != a || itr->key.quote != b ) break;
-          result.push_back( *itr );
-          ++itr;
-          ++count;
-       }
+       return run_read_only( _app, "get_fill_order_history", [&]() -> vector<order_history_object> {
+          FC_ASSERT(_app.chain_database());
+          const auto& db = *_app.chain_database();
+          if( a > b ) std::swap(a,b);
+          const auto& history_idx = db.get_index_type<graphene::market_history::history_index>().indices().get<by_key>();
+          history_key hkey;
+          hkey.base = a;
+          hkey.quote = b;
+          hkey.sequence = std::numeric_limits<int64_t>::min();
+
+          uint32_t count = 0;
+          auto itr = history_idx.lower_bound( hkey );
+          vector<order_history_object> result;
+          while( itr != history_idx.end() && count < limit)
+          {
+             if( itr->key.base != a || itr->key.quote != b ) break;
+             result.push_back( *itr );
+             ++itr;
+             ++count;
+          }
 
-       return result;
+          return result;
+       });
     }
 
     vector<operation_history_object> history_api::get_account_history( account_id_type account, 
@@ -408,26 +423,28 @@ namespace graphene { namespace app {
                                                                        unsigned limit, 
                                                                        operation_history_id_type start ) const
     {
-       FC_ASSERT( _app.chain_database() );
-       const auto& db = *_app.chain_database();       
-       FC_ASSERT( limit <= 100 );
-       vector<operation_history_object> result;
-       const auto& stats = account(db).statistics(db);
-       if( stats.most_recent_op == account_transaction_history_id_type() ) return result;
-       const account_transaction_history_object* node = &stats.most_recent_op(db);
-       if( start == operation_history_id_type() )
-          start = node->operation_id;
+       return run_read_only( _app, "get_account_history", [&]() -> vector<operation_history_object> {
+          FC_ASSERT( _app.chain_database() );
+          const auto& db = *_app.chain_database();       
+          FC_ASSERT( limit <= 100 );
+          vector<operation_history_object> result;
+          const auto& stats = account(db).statistics(db);
+          if( stats.most_recent_op == account_transaction_history_id_type() ) return result;
+          const account_transaction_history_object* node = &stats.most_recent_op(db);
+          if( start == operation_history_id_type() )
+             start = node->operation_id;
           
-       while(node && node->operation_id.instance.value > stop.instance.value && result.size() < limit)
-       {
-          if( node->operation_id.instance.value <= start.instance.value )
-             result.push_back( node->operation_id(db) );
-          if( node->next == account_transaction_history_id_type() )
-             node = nullptr;
-          else node = &node->next(db);
-       }
+          while(node && node->operation_id.instance.value > stop.instance.value && result.size() < limit)
+          {
+             if( node->operation_id.instance.value <= start.instance.value )
+                result.push_back( node->operation_id(db) );
+             if( node->next == account_transaction_history_id_type() )
+                node = nullptr;
+             else node = &node->next(db);
+          }
        
-       return result;
+          return result;
+       });
     }
     
     vector<operation_history_object> history_api::get_relative_account_history( account_id_type account, 
@@ -435,27 +452,29 @@ namespace graphene { namespace app {
                                                                                 unsigned limit, 
                                                                                 uint32_t start) const
     {
-       FC_ASSERT( _app.chain_database() );
-       const auto& db = *_app.chain_database();
-       FC_ASSERT(limit <= 100);
-       vector<operation_history_object> result;
-       if( start == 0 )
-         start = account(db).statistics(db).total_ops;
-       else start = min( account(db).statistics(db).total_ops, start );
-       const auto& hist_idx = db.get_index_type<account_transaction_history_index>();
-       const auto& by_seq_idx = hist_idx.indices().get<by_seq>();
+       return run_read_only( _app, "get_relative_account_history", [&]() -> vector<operation_history_object> {
+          FC_ASSERT( _app.chain_database() );
+          const auto& db = *_app.chain_database();
+          FC_ASSERT(limit <= 100);
+          vector<operation_history_object> result;
+          if( start == 0 )
+            start = account(db).statistics(db).total_ops;
+          else start = min( account(db).statistics(db).total_ops, start );
+          const auto& hist_idx = db.get_index_type<account_transaction_history_index>();
+          const auto& by_seq_idx = hist_idx.indices().get<by_seq>();
        
-       auto itr = by_seq_idx.upper_bound( boost::make_tuple( account, start ) );
-       auto itr_stop = by_seq_idx.lower_bound( boost::make_tuple( account, stop ) );
-       --itr;
-       
-       while ( itr != itr_stop && result.size() < limit )
-       {
-          result.push_back( itr->operation_id(db) );
+          auto itr = by_seq_idx.upper_bound( boost::make_tuple( account, start ) );
+          auto itr_stop = by_seq_idx.lower_bound( boost::make_tuple( account, stop ) );
           --itr;
-       }
        
-       return result;
+          while ( itr != itr_stop && result.size() < limit )
+          {
+             result.push_back( itr->operation_id(db) );
+             --itr;
+          }
+       
+          return result;
+       });
     }
 
     flat_set<uint32_t> history_api::get_market_history_buckets()const
@@ -468,27 +487,29 @@ namespace graphene { namespace app {
     vector<bucket_object> history_api::get_market_history( asset_id_type a, asset_id_type b,
                                                            uint32_t bucket_seconds, fc::time_point_sec start, fc::time_point_sec end )const
     { try {
-       FC_ASSERT(_app.chain_database());
-       const auto& db = *_app.chain_database();
-       vector<bucket_object> result;
-       result.reserve(200);
+       return run_read_only( _app, "get_market_history", [&]() -> vector<bucket_object> {
+          FC_ASSERT(_app.chain_database());
+          const auto& db = *_app.chain_database();
+          vector<bucket_object> result;
+          result.reserve(200);
 
-       if( a > b ) std::swap(a,b);
+          if( a > b ) std::swap(a,b);
 
-       const auto& bidx = db.get_index_type<bucket_index>();
-       const auto& by_key_idx = bidx.indices().get<by_key>();
+          const auto& bidx = db.get_index_type<bucket_index>();
+          const auto& by_key_idx = bidx.indices().get<by_key>();
 
-       auto itr = by_key_idx.lower_bound( bucket_key( a, b, bucket_seconds, start ) );
-       while( itr != by_key_idx.end() && itr->key.open <= end && result.size() < 200 )
-       {
-          if( !(itr->key.base == a && itr->key.quote == b && itr->key.seconds == bucket_seconds) )
+          auto itr = by_key_idx.lower_bound( bucket_key( a, b, bucket_seconds, start ) );
+          while( itr != by_key_idx.end() && itr->key.open <= end && result.size() < 200 )
           {
-            return result;
+             if( !(itr->key.base == a && itr->key.quote == b && itr->key.seconds == bucket_seconds) )
+             {
+               return result;
+             }
+             result.push_back(*itr);
+             ++itr;
           }
-          result.push_back(*itr);
-          ++itr;
-       }
-       return result;
+          return result;
+       });
     } FC_CAPTURE_AND_RETHROW( (a)(b)(bucket_seconds)(start)(end) ) }
     
     crypto_api::crypto_api(){};
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/app/api_thread_pool.hpp>
+
+namespace graphene { namespace app {
+
+fc::task_specific_ptr<const api_thread_pool*> api_thread_pool::_inline_pool;
+
+api_thread_pool::api_thread_pool( const graphene::chain::database& db, uint32_t thread_count )
+:_db(db),_next_thread(0)
+{
+   FC_ASSERT( thread_count > 0 );
+   FC_ASSERT( db.concurrent_reads_enabled(), "api threads rely on the database locking out readers while it changes" );
+   for( uint32_t t = 0; t < thread_count; ++t )
+      _threads.emplace_back( new fc::thread( "api_" + fc::to_string(t) ) );
+}
+
+api_thread_pool::~api_thread_pool()
+{
+}
+
+api_call_stats api_thread_pool::get_stats()const
+{
+   api_call_stats result;
+   result.threads = _threads.size();
+   std::lock_guard<std::mutex> guard( _stats_mutex );
+   result.queue_depth = _queue_depth;
+   result.max_queue_depth = _max_queue_depth;
+   result.methods.reserve( _methods.size() );
+   for( const auto& item : _methods )
+      result.methods.push_back( item.second );
+   return result;
+}
+
+bool api_thread_pool::runs_inline()const
+{
+   return _inline_pool.get() && *_inline_pool == this;
+}
+
+api_thread_pool::inline_scope::inline_scope( const api_thread_pool& pool )
+:_previous( _inline_pool.get() ? *_inline_pool : nullptr )
+{
+   _inline_pool.reset( new const api_thread_pool*( &pool ) );
+}
+
+api_thread_pool::inline_scope::~inline_scope()
+{
+   _inline_pool.reset( _previous ? new const api_thread_pool*( _previous ) : nullptr );
+}
+
+api_thread_pool::call_scope::call_scope( api_thread_pool& pool, const char* method )
+:_pool(pool),_method(method),_worker(pool._threads[ pool._next_thread++ % pool._threads.size() ].get()),
+ _queued(fc::time_point::now()),_started(_queued)
+{
+   std::lock_guard<std::mutex> guard( _pool._stats_mutex );
+   ++_pool._queue_depth;
+   _pool._max_queue_depth = std::max( _pool._max_queue_depth, _pool._queue_depth );
+}
+
+api_thread_pool::call_scope::~call_scope()
+{
+   const fc::time_point finished = fc::time_point::now();
+   const uint64_t latency = ( finished - _queued ).count();
+   std::lock_guard<std::mutex> guard( _pool._stats_mutex );
+   --_pool._queue_depth;
+   api_method_stats& stats = _pool._methods[_method];
+   if( stats.method.empty() )
+      stats.method = _method;
+   ++stats.calls;
+   stats.total_latency_us += latency;
+   stats.total_run_us += ( finished - _started ).count();
+   stats.max_latency_us = std::max( stats.max_latency_us, latency );
+}
+
+} } // graphene::app
@@ -24,6 +24,7 @@
 #include <graphene/app/api.hpp>
 #include <graphene/app/api_access.hpp>
 #include <graphene/app/application.hpp>
+#include <graphene/app/batch_websocket_api_connection.hpp>
 #include <graphene/app/plugin.hpp>
 
 #include <graphene/chain/protocol/fee_schedule.hpp>
@@ -52,6 +53,7 @@
 #include <boost/range/algorithm/reverse.hpp>
 
 #include <iostream>
+#include <thread>
 
 #include <fc/log/file_appender.hpp>
 #include <fc/log/logger.hpp>
@@ -264,10 +266,10 @@ namespace detail {
          _websocket_server = std::make_shared<fc::http::websocket_server>(enable_deflate_compression);
 
          _websocket_server->on_connection([&]( const fc::http::websocket_connection_ptr& c ){
-            auto wsc = std::make_shared<fc::rpc::websocket_api_connection>(*c);
+            auto wsc = std::make_shared<batch_websocket_api_connection>( *c, _api_pool.get() );
             auto login = std::make_shared<graphene::app::login_api>( std::ref(*_self) );
-            auto db_api = std::make_shared<graphene::app::database_api>( std::ref(*_self->chain_database()) );
-            wsc->register_api(fc::api<graphene::app::database_api>(db_api));
+            auto db_api = std::make_shared<graphene::app::database_api>( std::ref(*_self->chain_database()), _api_pool.get() );
+            wsc->enable_binary_results( db_api, wsc->register_api(fc::api<graphene::app::database_api>(db_api)) );
             wsc->register_api(fc::api<graphene::app::login_api>(login));
             c->set_session_data( wsc );
          });
@@ -292,10 +294,10 @@ namespace detail {
          _websocket_tls_server = std::make_shared<fc::http::websocket_tls_server>( _options->at("server-pem").as<string>(), password, enable_deflate_compression );
 
          _websocket_tls_server->on_connection([&]( const fc::http::websocket_connection_ptr& c ){
-            auto wsc = std::make_shared<fc::rpc::websocket_api_connection>(*c);
+            auto wsc = std::make_shared<batch_websocket_api_connection>( *c, _api_pool.get() );
             auto login = std::make_shared<graphene::app::login_api>( std::ref(*_self) );
-            auto db_api = std::make_shared<graphene::app::database_api>( std::ref(*_self->chain_database()) );
-            wsc->register_api(fc::api<graphene::app::database_api>(db_api));
+            auto db_api = std::make_shared<graphene::app::database_api>( std::ref(*_self->chain_database()), _api_pool.get() );
+            wsc->enable_binary_results( db_api, wsc->register_api(fc::api<graphene::app::database_api>(db_api)) );
             wsc->register_api(fc::api<graphene::app::login_api>(login));
             c->set_session_data( wsc );
          });
@@ -324,6 +326,31 @@ namespace detail {
          return;
       }
 
+      /** applies the checkpoints and the options tuning the chain database, before it is opened */
+      void configure_chain_db( const flat_map<uint32_t,block_id_type>& checkpoints )
+      {
+         _chain_db->add_checkpoints( checkpoints );
+         if( _options->count("signature-recovery-threads") )
+            _chain_db->set_signature_recovery_threads( _options->at("signature-recovery-threads").as<uint32_t>() );
+         if( _options->count("signature-cache-size") )
+            _chain_db->get_signature_cache().set_capacity( _options->at("signature-cache-size").as<uint32_t>() );
+         if( _options->count("block-cache-size") )
+            _chain_db->get_block_cache().set_capacity( uint64_t( _options->at("block-cache-size").as<uint32_t>() ) * 1024 * 1024 );
+         if( _options->count("pending-transactions-size") )
+            _chain_db->get_pending_transaction_pool().set_capacity( uint64_t( _options->at("pending-transactions-size").as<uint32_t>() ) * 1024 * 1024 );
+         if( _options->count("reindex-reader-threads") && _options->count("reindex-look-ahead") )
+            _chain_db->set_reindex_prefetch( _options->at("reindex-reader-threads").as<uint32_t>(),
+                                             _options->at("reindex-look-ahead").as<uint32_t>() );
+         if( _options->count("reindex-checkpoint-interval") )
+            _chain_db->set_reindex_checkpoint_interval( _options->at("reindex-checkpoint-interval").as<uint32_t>() );
+         if( _options->count("state-persistence-interval") )
+            _chain_db->set_state_persistence_interval( _options->at("state-persistence-interval").as<uint32_t>() );
+         if( _options->count("state-digest-history") )
+            _chain_db->set_state_digest_history( _options->at("state-digest-history").as<uint32_t>() );
+         if( _options->count("object-database-threads") )
+            _chain_db->set_io_threads( _options->at("object-database-threads").as<uint32_t>() );
+      }
+
       void startup()
       { try {
          bool clean = !fc::exists(_data_dir / "blockchain/dblock");
@@ -388,7 +415,7 @@ namespace detail {
                loaded_checkpoints[item.first] = item.second;
             }
          }
-         _chain_db->add_checkpoints( loaded_checkpoints );
+         configure_chain_db( loaded_checkpoints );
 
          if( _options->count("replay-blockchain") )
          {
@@ -451,8 +478,26 @@ namespace detail {
                }
             }
          } else {
-            wlog("Detected unclean shutdown. Replaying blockchain...");
-            _chain_db->reindex(_data_dir / "blockchain", initial_state());
+            wlog("Detected unclean shutdown.");
+            bool opened = false;
+            if( _chain_db->has_persisted_state( _data_dir / "blockchain" ) )
+            {
+               try
+               {
+                  ilog("Opening the persisted state and replaying the blocks after it...");
+                  _chain_db->open(_data_dir / "blockchain", initial_state);
+                  opened = true;
+               }
+               catch( const fc::exception& e )
+               {
+                  wlog( "caught exception ${e} opening the persisted state", ("e", e.to_detail_string()) );
+               }
+            }
+            if( !opened )
+            {
+               wlog("Replaying blockchain...");
+               _chain_db->reindex(_data_dir / "blockchain", initial_state());
+            }
          }
 
          if (!_options->count("genesis-json") &&
@@ -461,7 +506,7 @@ namespace detail {
             _chain_db->wipe(_data_dir / "blockchain", true);
             _chain_db.reset();
             _chain_db = std::make_shared<chain::database>();
-            _chain_db->add_checkpoints(loaded_checkpoints);
+            configure_chain_db( loaded_checkpoints );
             _chain_db->open(_data_dir / "blockchain", initial_state);
          }
 
@@ -491,6 +536,15 @@ namespace detail {
             _apiaccess.permission_map["*"] = wild_access;
          }
 
+         if( _options->count("api-threads") && _options->at("api-threads").as<uint32_t>() > 0 )
+         {
+            const uint32_t api_threads = _options->at("api-threads").as<uint32_t>();
+            _chain_db->enable_concurrent_reads();
+            _chain_db->enable_snapshots( _chain_db->head_block_num() );
+            _api_pool = std::make_shared<api_thread_pool>( std::cref(*_chain_db), api_threads );
+            ilog( "Running read-only API calls on ${n} threads", ("n", api_threads) );
+         }
+
          reset_p2p_node(_data_dir);
          reset_websocket_server();
          reset_websocket_tls_server();
@@ -541,15 +595,15 @@ namespace detail {
                                 std::vector<fc::uint160_t>& contained_transaction_message_ids) override
       { try {
 
-         auto latency = graphene::time::now() - blk_msg.block.timestamp;
+         auto latency = graphene::time::now() - blk_msg.block->timestamp;
          FC_ASSERT( (latency.count()/1000) > -5000, "Rejecting block with timestamp in the future" );
          if (!sync_mode || blk_msg.block.block_num() % 10000 == 0)
          {
-            const auto& witness = blk_msg.block.witness(*_chain_db);
+            const auto& witness = blk_msg.block->witness(*_chain_db);
             const auto& witness_account = witness.witness_account(*_chain_db);
             auto last_irr = _chain_db->get_dynamic_global_properties().last_irreversible_block_num;
             ilog("Got block: #${n} time: ${t} latency: ${l} ms from: ${w}  irreversible: ${i} (-${d})", 
-                 ("t",blk_msg.block.timestamp)
+                 ("t",blk_msg.block->timestamp)
                  ("n", blk_msg.block.block_num())
                  ("l", (latency.count()/1000))
                  ("w",witness_account.name)
@@ -571,7 +625,7 @@ namespace detail {
                // happens, there's no reason to fetch the transactions, so  construct a list of the
                // transaction message ids we no longer need.
                // during sync, it is unlikely that we'll see any old
-               for (const processed_transaction& transaction : blk_msg.block.transactions)
+               for (const processed_transaction& transaction : blk_msg.block->transactions)
                {
                   graphene::net::trx_message transaction_message(transaction);
                   contained_transaction_message_ids.push_back(graphene::net::message(transaction_message).id());
@@ -687,7 +741,14 @@ namespace detail {
         // ilog("Request for item ${id}", ("id", id));
          if( id.item_type == graphene::net::block_message_type )
          {
-            auto opt_block = _chain_db->fetch_block_by_id(id.item_hash);
+            optional<sealed_block> opt_block;
+            // historical blocks are read on an api thread, block application goes on meanwhile
+            if( _api_pool && block_header::num_from_id(id.item_hash) <= _chain_db->get_dynamic_global_properties().last_irreversible_block_num )
+               opt_block = _api_pool->run_unlocked( "p2p_get_item", [&]() {
+                  return _chain_db->get_block_log().fetch_sealed( id.item_hash );
+               });
+            if( !opt_block )
+               opt_block = _chain_db->fetch_sealed_block_by_id(id.item_hash);
             if( !opt_block )
                elog("Couldn't find block ${id} -- corresponding ID in our chain is ${id2}",
                     ("id", id.item_hash)("id2", _chain_db->get_block_id_for_num(block_header::num_from_id(id.item_hash))));
@@ -911,8 +972,8 @@ namespace detail {
        */
       virtual fc::time_point_sec get_block_time(const item_hash_t& block_id) override
       { try {
-         auto opt_block = _chain_db->fetch_block_by_id( block_id );
-         if( opt_block.valid() ) return opt_block->timestamp;
+         auto opt_block = _chain_db->fetch_sealed_block_by_id( block_id );
+         if( opt_block.valid() ) return (*opt_block)->timestamp;
          return fc::time_point_sec::min();
       } FC_CAPTURE_AND_RETHROW( (block_id) ) }
 
@@ -949,6 +1010,7 @@ namespace detail {
       api_access _apiaccess;
 
       std::shared_ptr<graphene::chain::database>            _chain_db;
+      std::shared_ptr<api_thread_pool>                      _api_pool;
       std::shared_ptr<graphene::net::node>                  _p2p_network;
       std::shared_ptr<fc::http::websocket_server>      _websocket_server;
       std::shared_ptr<fc::http::websocket_tls_server>  _websocket_tls_server;
@@ -994,6 +1056,31 @@ void application::set_program_options(boost::program_options::options_descriptio
          ("genesis-json", bpo::value<boost::filesystem::path>(), "File to read Genesis State from")
          ("dbg-init-key", bpo::value<string>(), "Block signing key to use for init witnesses, overrides genesis file")
          ("api-access", bpo::value<boost::filesystem::path>(), "JSON file specifying API permissions")
+         ("signature-recovery-threads", bpo::value<uint32_t>()->default_value(2),
+          "Number of threads recovering transaction signatures of incoming blocks before they are applied, 0 to disable")
+         ("signature-cache-size", bpo::value<uint32_t>()->default_value(100000),
+          "Maximum number of recovered transaction signature keys to remember, 0 to disable")
+         ("block-cache-size", bpo::value<uint32_t>()->default_value(64),
+          "Megabytes of recently read blocks to keep decoded for peers and API clients, 0 to disable")
+         ("pending-transactions-size", bpo::value<uint32_t>()->default_value(128),
+          "Megabytes the pending transactions may take before the lowest paying ones per byte are dropped, 0 for no limit")
+         ("reindex-reader-threads", bpo::value<uint32_t>()->default_value(2),
+          "Number of threads reading and decoding blocks ahead of the replay while reindexing, 0 to disable")
+         ("reindex-look-ahead", bpo::value<uint32_t>()->default_value(256),
+          "Maximum number of blocks read ahead of the block being replayed while reindexing")
+         ("reindex-checkpoint-interval", bpo::value<uint32_t>()->default_value(100000),
+          "Number of blocks between the object database snapshots an interrupted reindex resumes from, 0 to disable")
+         ("state-persistence-interval", bpo::value<uint32_t>()->default_value(0),
+          "Persist the state at the last irreversible block in the background every this many irreversible blocks, "
+          "so that an unclean shutdown does not require a replay of the whole chain, 0 to disable")
+         ("state-digest-history", bpo::value<uint32_t>()->default_value(0),
+          "Number of recent blocks to remember a digest of the object state after, for comparing the state "
+          "of nodes block by block; maintaining it costs a hash of every object change, 0 to disable")
+         ("object-database-threads", bpo::value<uint32_t>()->default_value(std::max(1u, std::thread::hardware_concurrency())),
+          "Number of threads loading and saving the object database indexes at startup and shutdown")
+         ("api-threads", bpo::value<uint32_t>()->default_value(0),
+          "Number of threads running API calls which only read the state, such as most of database_api and "
+          "history_api; blocks and transactions are applied while no such call runs, 0 runs all calls on the main thread")
          ;
    command_line_options.add(configuration_file_options);
    command_line_options.add_options()
@@ -1069,6 +1156,11 @@ std::shared_ptr<chain::database> application::chain_database() const
    return my->_chain_db;
 }
 
+api_thread_pool* application::api_pool() const
+{
+   return my->_api_pool.get();
+}
+
 void application::set_block_production(bool producing_blocks)
 {
    my->_is_block_producer = producing_blocks;
@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/app/batch_websocket_api_connection.hpp>
+#include <graphene/app/database_api.hpp>
+
+#include <fc/crypto/base64.hpp>
+#include <fc/io/json.hpp>
+
+namespace graphene { namespace app {
+
+namespace {
+   bool is_batch( const std::string& message )
+   {
+      for( char c : message )
+      {
+         if( c == '[' )
+            return true;
+         if( c != ' ' && c != '\t' && c != '\r' && c != '\n' )
+            return false;
+      }
+      return false;
+   }
+
+   std::string invalid_request( const std::string& reason, const fc::variant& id = fc::variant() )
+   {
+      fc::mutable_variant_object error;
+      error( "code", -32600 )( "message", reason );
+      fc::mutable_variant_object reply;
+      reply( "jsonrpc", "2.0" )( "id", id )( "error", error );
+      return fc::json::to_string( reply );
+   }
+
+   /** why a batch element is not a request fc::rpc::request can be made of, empty if it is one */
+   std::string check_request( const fc::variant& request )
+   {
+      if( !request.is_object() )
+         return "Request is not an object";
+      const fc::variant_object& call = request.get_object();
+      if( !call.contains( "method" ) || !call["method"].is_string() )
+         return "Request has no method";
+      if( call.contains( "params" ) && !call["params"].is_array() )
+         return "Request params are not an array";
+      if( call.contains( "id" ) && !call["id"].is_numeric() && !call["id"].is_null() )
+         return "Request id is not a number";
+      if( call.contains( "jsonrpc" ) && !call["jsonrpc"].is_string() )
+         return "Request jsonrpc version is not a string";
+      return std::string();
+   }
+
+   /** a reply to request in the form fc::rpc::response takes */
+   std::string make_reply( const fc::variant_object& request, const char* key, const fc::variant& value )
+   {
+      fc::mutable_variant_object reply;
+      reply( "id", request["id"] );
+      if( request.contains( "jsonrpc" ) )
+         reply( "jsonrpc", request["jsonrpc"] );
+      reply( key, value );
+      return fc::json::to_string( reply );
+   }
+
+   std::string error_reply( const fc::variant_object& request, const fc::exception& e )
+   {
+      fc::mutable_variant_object error;
+      error( "code", e.code() )( "message", e.to_string() )( "data", fc::variant( e ) );
+      return make_reply( request, "error", error );
+   }
+
+   template<typename Result, typename Arg>
+   std::function<std::vector<char>( const fc::variants& )> packed( const std::shared_ptr<database_api>& api,
+                                                                    Result (database_api::*method)( Arg )const )
+   {
+      return [api,method]( const fc::variants& args ) -> std::vector<char> {
+         FC_ASSERT( args.size() == 1, "Expected 1 argument, got ${n}", ("n",args.size()) );
+         return fc::raw::pack( ((*api).*method)( args[0].as<typename std::decay<Arg>::type>() ) );
+      };
+   }
+
+   template<typename Result, typename Arg1, typename Arg2>
+   std::function<std::vector<char>( const fc::variants& )> packed( const std::shared_ptr<database_api>& api,
+                                                                    Result (database_api::*method)( Arg1, Arg2 )const )
+   {
+      return [api,method]( const fc::variants& args ) -> std::vector<char> {
+         FC_ASSERT( args.size() == 2, "Expected 2 arguments, got ${n}", ("n",args.size()) );
+         return fc::raw::pack( ((*api).*method)( args[0].as<typename std::decay<Arg1>::type>(),
+                                                 args[1].as<typename std::decay<Arg2>::type>() ) );
+      };
+   }
+}
+
+batch_websocket_api_connection::batch_websocket_api_connection( fc::http::websocket_connection& c, api_thread_pool* pool )
+:fc::rpc::websocket_api_connection( c ), _pool( pool )
+{
+   // take over the handlers the base class installed, single requests are still passed on to it
+   _connection.on_message_handler( [this]( const std::string& msg ) { on_batch_message( msg, true ); } );
+   _connection.on_http_handler( [this]( const std::string& msg ) { return on_batch_message( msg, false ); } );
+}
+
+void batch_websocket_api_connection::enable_binary_results( const std::shared_ptr<database_api>& api, fc::api_id_type api_id )
+{
+   _database_api_id = api_id;
+   _packed_methods["get_block"]        = packed( api, &database_api::get_block );
+   _packed_methods["get_blocks"]       = packed( api, &database_api::get_blocks );
+   _packed_methods["get_block_header"] = packed( api, &database_api::get_block_header );
+   _packed_methods["get_transaction"]  = packed( api, &database_api::get_transaction );
+   _packed_methods["get_objects"]      = packed( api, &database_api::get_packed_objects );
+}
+
+std::string batch_websocket_api_connection::on_batch_message( const std::string& message, bool send_message )
+{
+   std::string result;
+   if( !is_batch( message ) )
+   {
+      result = on_request( message );
+      if( send_message && !result.empty() )
+         _connection.send_message( result );
+      return result;
+   }
+
+   fc::variants requests;
+   try
+   {
+      requests = fc::json::from_string( message ).get_array();
+   }
+   catch( const fc::exception& e )
+   {
+      result = invalid_request( "Parse error: " + e.to_string() );
+   }
+   if( result.empty() && requests.empty() )
+      result = invalid_request( "Empty batch" );
+   else if( result.empty() && requests.size() > max_batch_size )
+      result = invalid_request( "Batch of " + fc::to_string( uint64_t( requests.size() ) ) + " requests exceeds the limit of "
+                                + fc::to_string( uint64_t( max_batch_size ) ) );
+
+   if( result.empty() )
+   {
+      std::vector<std::string> replies( requests.size() );
+      bool reads_only = _pool != nullptr;
+      for( size_t i = 0; i < requests.size(); ++i )
+      {
+         const std::string reason = check_request( requests[i] );
+         if( !reason.empty() )
+         {
+            const fc::variant id = requests[i].is_object() && requests[i].get_object().contains( "id" )
+                                   && requests[i]["id"].is_numeric() ? requests[i]["id"] : fc::variant();
+            replies[i] = invalid_request( reason, id );
+         }
+         else
+            reads_only = reads_only && is_database_read( requests[i] );
+      }
+
+      auto run_requests = [&]() {
+         for( size_t i = 0; i < requests.size(); ++i )
+            if( replies[i].empty() && !on_encoding_request( requests[i], replies[i] ) )
+               replies[i] = on_message( fc::json::to_string( requests[i] ), false );
+      };
+      // a batch of nothing but database reads is a single job of a worker, which sees a single head block
+      if( reads_only )
+         _pool->run_all( "batch", run_requests );
+      else
+         run_requests();
+
+      result = "[";
+      for( const std::string& reply : replies )
+      {
+         if( reply.empty() )
+            continue;
+         if( result.size() > 1 )
+            result += ',';
+         result += reply;
+      }
+      result += "]";
+      if( result.size() == 2 )
+         result.clear();
+   }
+
+   if( send_message && !result.empty() )
+      _connection.send_message( result );
+   return result;
+}
+
+std::string batch_websocket_api_connection::on_request( const std::string& message )
+{
+   // only parse here what may need an answer of ours, the base class parses everything else itself
+   if( _binary || message.find( "set_encoding" ) != std::string::npos )
+   {
+      fc::variant request;
+      try
+      {
+         request = fc::json::from_string( message );
+      }
+      catch( const fc::exception& )
+      {
+         return on_message( message, false );
+      }
+      std::string reply;
+      if( on_encoding_request( request, reply ) )
+         return reply;
+   }
+   return on_message( message, false );
+}
+
+bool batch_websocket_api_connection::is_database_read( const fc::variant& request )const
+{
+   const fc::variant_object& call = request.get_object();
+   if( _packed_methods.empty() || call["method"].as_string() != "call" || !call.contains( "params" ) )
+      return false;
+   const fc::variants& params = call["params"].get_array();
+   return params.size() == 3 && params[0].is_numeric() && params[0].as_uint64() == _database_api_id
+          && params[1].is_string() && database_api::reads_only( params[1].as_string() );
+}
+
+bool batch_websocket_api_connection::on_encoding_request( const fc::variant& request, std::string& reply )
+{
+   if( !request.is_object() )
+      return false;
+   const fc::variant_object& call = request.get_object();
+   if( !call.contains( "id" ) || !call.contains( "method" ) || !call.contains( "params" ) || !call["params"].is_array() )
+      return false;
+   const std::string method = call["method"].as_string();
+   const fc::variants& params = call["params"].get_array();
+
+   if( method == "set_encoding" )
+   {
+      try
+      {
+         FC_ASSERT( params.size() == 1, "Expected 1 argument, got ${n}", ("n",params.size()) );
+         const std::string encoding = params[0].as_string();
+         FC_ASSERT( encoding == "json" || encoding == "binary", "Unknown encoding ${e}", ("e",encoding) );
+         FC_ASSERT( encoding == "json" || !_packed_methods.empty(), "Binary results are not available on this connection" );
+         _binary = encoding == "binary";
+         reply = make_reply( call, "result", encoding );
+      }
+      catch( const fc::exception& e )
+      {
+         reply = error_reply( call, e );
+      }
+      return true;
+   }
+
+   if( !_binary || method != "call" || params.size() != 3 || !params[0].is_numeric() || !params[2].is_array()
+       || params[0].as_uint64() != _database_api_id )
+      return false;
+   auto itr = _packed_methods.find( params[1].as_string() );
+   if( itr == _packed_methods.end() )
+      return false;
+
+   try
+   {
+      const std::vector<char> result = itr->second( params[2].get_array() );
+      reply = make_reply( call, "result", fc::base64_encode( reinterpret_cast<const unsigned char*>( result.data() ),
+                                                             result.size() ) );
+   }
+   catch( const fc::exception& e )
+   {
+      reply = error_reply( call, e );
+   }
+   return true;
+}
+
+} } // graphene::app
@@ -26,6 +26,7 @@
 #include <graphene/chain/get_config.hpp>
 #include <graphene/chain/tournament_object.hpp>
 #include <graphene/chain/account_object.hpp>
+#include <graphene/db/state_snapshot.hpp>
 
 #include <fc/bloom_filter.hpp>
 #include <fc/smart_ref_impl.hpp>
@@ -39,33 +40,42 @@
 #include <cctype>
 
 #include <cfenv>
+#include <deque>
 #include <iostream>
+#include <set>
 
 #define GET_REQUIRED_FEES_MAX_RECURSION 4
+#define GET_BLOCKS_MAX_COUNT 1000
+#define IRREVERSIBLE_BLOCK_CHUNKS_IN_FLIGHT 2
 
 namespace graphene { namespace app {
 
+using graphene::db::state_snapshot;
+
 class database_api_impl;
 
 
 class database_api_impl : public std::enable_shared_from_this<database_api_impl>
 {
    public:
-      database_api_impl( graphene::chain::database& db );
+      database_api_impl( graphene::chain::database& db, api_thread_pool* pool );
       ~database_api_impl();
 
       // Objects
       fc::variants get_objects(const vector<object_id_type>& ids)const;
+      vector<optional<packed_object>> get_packed_objects(const vector<object_id_type>& ids)const;
 
       // Subscriptions
       void set_subscribe_callback( std::function<void(const variant&)> cb, bool clear_filter );
       void set_pending_transaction_callback( std::function<void(const variant&)> cb );
       void set_block_applied_callback( std::function<void(const variant& block_id)> cb );
+      void subscribe_to_irreversible_blocks( std::function<void(const variant&)> cb, uint32_t start_block_num );
       void cancel_all_subscriptions();
 
       // Blocks and transactions
       optional<block_header> get_block_header(uint32_t block_num)const;
       optional<signed_block> get_block(uint32_t block_num)const;
+      vector<signed_block> get_blocks(uint32_t block_num, uint32_t count)const;
       processed_transaction get_transaction( uint32_t block_num, uint32_t trx_in_block )const;
 
       // Globals
@@ -74,13 +84,17 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       fc::variant_object get_config()const;
       chain_id_type get_chain_id()const;
       dynamic_global_property_object get_dynamic_global_properties()const;
+      signature_cache_stats get_signature_cache_stats()const;
+      block_cache_stats get_block_cache_stats()const;
+      vector<node_pool_stats> get_node_pool_stats()const;
+      optional<block_state_digest> get_block_state_digest( uint32_t block_num )const;
 
       // Keys
       vector<vector<account_id_type>> get_key_references( vector<public_key_type> key )const;
 
       // Accounts
       vector<optional<account_object>> get_accounts(const vector<account_id_type>& account_ids)const;
-      std::map<string,full_account> get_full_accounts( const vector<string>& names_or_ids, bool subscribe );
+      std::map<string,full_account> get_full_accounts( const state_snapshot& snapshot, const vector<string>& names_or_ids, bool subscribe );
       optional<account_object> get_account_by_name( string name )const;
       vector<account_id_type> get_account_references( account_id_type account_id )const;
       vector<optional<account_object>> lookup_account_names(const vector<string>& account_names)const;
@@ -97,19 +111,19 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       // Assets
       vector<optional<asset_object>> get_assets(const vector<asset_id_type>& asset_ids)const;
       vector<asset_object>           list_assets(const string& lower_bound_symbol, uint32_t limit)const;
-      vector<optional<asset_object>> lookup_asset_symbols(const vector<string>& symbols_or_ids)const;
+      vector<optional<asset_object>> lookup_asset_symbols( const state_snapshot& snapshot, const vector<string>& symbols_or_ids )const;
 
       // Markets / feeds
-      vector<limit_order_object>         get_limit_orders(asset_id_type a, asset_id_type b, uint32_t limit)const;
+      vector<limit_order_object>         get_limit_orders( const state_snapshot& snapshot, asset_id_type a, asset_id_type b, uint32_t limit )const;
       vector<call_order_object>          get_call_orders(asset_id_type a, uint32_t limit)const;
       vector<force_settlement_object>    get_settle_orders(asset_id_type a, uint32_t limit)const;
       vector<call_order_object>          get_margin_positions( const account_id_type& id )const;
       void subscribe_to_market(std::function<void(const variant&)> callback, asset_id_type a, asset_id_type b);
       void unsubscribe_from_market(asset_id_type a, asset_id_type b);
-      market_ticker                      get_ticker( const string& base, const string& quote )const;
-      market_volume                      get_24_volume( const string& base, const string& quote )const;
-      order_book                         get_order_book( const string& base, const string& quote, unsigned limit = 50 )const;
-      vector<market_trade>               get_trade_history( const string& base, const string& quote, fc::time_point_sec start, fc::time_point_sec stop, unsigned limit = 100 )const;
+      market_ticker                      get_ticker( const state_snapshot& snapshot, const string& base, const string& quote )const;
+      market_volume                      get_24_volume( const state_snapshot& snapshot, const string& base, const string& quote )const;
+      order_book                         get_order_book( const state_snapshot& snapshot, const string& base, const string& quote, unsigned limit = 50 )const;
+      vector<market_trade>               get_trade_history( const state_snapshot& snapshot, const string& base, const string& quote, fc::time_point_sec start, fc::time_point_sec stop, unsigned limit = 100 )const;
 
       // Witnesses
       vector<optional<witness_object>> get_witnesses(const vector<witness_id_type>& witness_ids)const;
@@ -123,7 +137,7 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       map<string, committee_member_id_type> lookup_committee_member_accounts(const string& lower_bound_name, uint32_t limit)const;
 
       // Votes
-      vector<variant> lookup_vote_ids( const vector<vote_id_type>& votes )const;
+      vector<variant> lookup_vote_ids( const state_snapshot& snapshot, const vector<vote_id_type>& votes )const;
 
       // Authority / validation
       std::string get_transaction_hex(const signed_transaction& trx)const;
@@ -149,6 +163,15 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
 
 
    //private:
+      /**
+       * Irreversible blocks are read from the block log on an api thread while blocks keep being applied here,
+       * reversible ones can only be read through the database on this thread.
+       */
+      optional<signed_block> fetch_block( const char* method, uint32_t block_num )const;
+
+      /** subscribes to the objects get_objects() returns unless they never change */
+      void subscribe_to_objects( const vector<object_id_type>& ids )const;
+
       template<typename T>
       void subscribe_to_item( const T& i )const
       {
@@ -174,15 +197,52 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
 
       void broadcast_updates( const vector<variant>& updates );
 
+      /** runs a call which only reads the state on the api threads, if there are any */
+      template<typename Functor>
+      auto run_read_only( const char* method, Functor&& f )const -> decltype( f() )
+      {
+         if( _api_pool == nullptr )
+            return f();
+         return _api_pool->run( method, std::forward<Functor>(f) );
+      }
+
+      /**
+       * runs a call which reads a snapshot of the state on the api threads, if there are any, so that it does
+       * not hold up blocks being applied meanwhile
+       */
+      template<typename Functor>
+      auto run_on_snapshot( const char* method, Functor&& f )const -> decltype( f( std::declval<const state_snapshot&>() ) )
+      {
+         if( _api_pool == nullptr )
+            return f( *_db.create_snapshot() );
+         return _api_pool->run_snapshot( method, std::forward<Functor>(f) );
+      }
+
+      /** the objects of IndexType the snapshot holds whose key in the Tag index equals key, see state_snapshot::select() */
+      template<typename IndexType, typename Tag, typename Key, typename Match>
+      vector<typename IndexType::object_type> select_equal( const state_snapshot& snapshot, const Key& key, Match&& matches )const
+      {
+         typedef typename IndexType::object_type object_type;
+         return snapshot.select<object_type>( [&]( const std::function<bool(const object_type&)>& visit ) {
+            const auto range = _db.get_index_type<IndexType>().indices().template get<Tag>().equal_range( key );
+            for( auto itr = range.first; itr != range.second && visit( *itr ); ++itr );
+         }, std::forward<Match>(matches) );
+      }
+
       /** called every time a block is applied to report the objects that were changed */
       void on_objects_changed(const vector<object_id_type>& ids);
       void on_objects_removed(const vector<const object*>& objs);
       void on_applied_block();
+      /** starts sending the blocks which have become irreversible to their subscriber unless that is underway */
+      void push_irreversible_blocks();
 
       mutable fc::bloom_filter                               _subscribe_filter;
       std::function<void(const fc::variant&)> _subscribe_callback;
       std::function<void(const fc::variant&)> _pending_trx_callback;
       std::function<void(const fc::variant&)> _block_applied_callback;
+      std::function<void(const fc::variant&)> _irreversible_block_callback;
+      uint32_t                                _next_irreversible_block = 0;
+      bool                                    _pushing_irreversible_blocks = false;
 
       boost::signals2::scoped_connection                                                                                           _change_connection;
       boost::signals2::scoped_connection                                                                                           _removed_connection;
@@ -190,6 +250,7 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       boost::signals2::scoped_connection                                                                                           _pending_trx_connection;
       map< pair<asset_id_type,asset_id_type>, std::function<void(const variant&)> >      _market_subscriptions;
       graphene::chain::database&                                                                                                            _db;
+      api_thread_pool*                                                                                                                      _api_pool;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -198,12 +259,22 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
 //                                                                  //
 //////////////////////////////////////////////////////////////////////
 
-database_api::database_api( graphene::chain::database& db )
-   : my( new database_api_impl( db ) ) {}
+database_api::database_api( graphene::chain::database& db, api_thread_pool* pool )
+   : my( new database_api_impl( db, pool ) ) {}
 
 database_api::~database_api() {}
 
-database_api_impl::database_api_impl( graphene::chain::database& db ):_db(db)
+bool database_api::reads_only( const string& method )
+{
+   static const std::set<string> others = {
+      "set_subscribe_callback", "set_pending_transaction_callback", "set_block_applied_callback",
+      "subscribe_to_irreversible_blocks", "cancel_all_subscriptions", "subscribe_to_market",
+      "unsubscribe_from_market", "validate_transaction"
+   };
+   return others.find( method ) == others.end();
+}
+
+database_api_impl::database_api_impl( graphene::chain::database& db, api_thread_pool* pool ):_db(db),_api_pool(pool)
 {
    wlog("creating database api ${x}", ("x",int64_t(this)) );
    _change_connection = _db.changed_objects.connect([this](const vector<object_id_type>& ids) {
@@ -232,10 +303,53 @@ database_api_impl::~database_api_impl()
 
 fc::variants database_api::get_objects(const vector<object_id_type>& ids)const
 {
-   return my->get_objects( ids );
+   return my->run_read_only( "get_objects", [&]() { return my->get_objects( ids ); } );
 }
 
 fc::variants database_api_impl::get_objects(const vector<object_id_type>& ids)const
+{
+   subscribe_to_objects( ids );
+
+   fc::variants result;
+   result.reserve(ids.size());
+
+   std::transform(ids.begin(), ids.end(), std::back_inserter(result),
+                  [this](object_id_type id) -> fc::variant {
+      if(auto obj = _db.find_object(id))
+         return obj->to_variant();
+      return {};
+   });
+
+   return result;
+}
+
+vector<optional<packed_object>> database_api::get_packed_objects(const vector<object_id_type>& ids)const
+{
+   return my->run_read_only( "get_packed_objects", [&]() { return my->get_packed_objects( ids ); } );
+}
+
+vector<optional<packed_object>> database_api_impl::get_packed_objects(const vector<object_id_type>& ids)const
+{
+   subscribe_to_objects( ids );
+
+   vector<optional<packed_object>> result;
+   result.reserve(ids.size());
+
+   for( auto id : ids )
+   {
+      result.emplace_back();
+      if( auto obj = _db.find_object(id) )
+      {
+         result.back() = packed_object();
+         result.back()->id = obj->id;
+         result.back()->data = obj->pack();
+      }
+   }
+
+   return result;
+}
+
+void database_api_impl::subscribe_to_objects( const vector<object_id_type>& ids )const
 {
    if( _subscribe_callback )  {
       for( auto id : ids )
@@ -250,18 +364,6 @@ fc::variants database_api_impl::get_objects(const vector<object_id_type>& ids)co
    {
       elog( "getObjects without subscribe callback??" );
    }
-
-   fc::variants result;
-   result.reserve(ids.size());
-
-   std::transform(ids.begin(), ids.end(), std::back_inserter(result),
-                  [this](object_id_type id) -> fc::variant {
-      if(auto obj = _db.find_object(id))
-         return obj->to_variant();
-      return {};
-   });
-
-   return result;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -310,6 +412,18 @@ void database_api_impl::set_block_applied_callback( std::function<void(const var
    _block_applied_callback = cb;
 }
 
+void database_api::subscribe_to_irreversible_blocks( std::function<void(const variant&)> cb, uint32_t start_block_num )
+{
+   my->subscribe_to_irreversible_blocks( cb, start_block_num );
+}
+
+void database_api_impl::subscribe_to_irreversible_blocks( std::function<void(const variant&)> cb, uint32_t start_block_num )
+{
+   _irreversible_block_callback = cb;
+   _next_irreversible_block = std::max<uint32_t>( start_block_num, 1 );
+   push_irreversible_blocks();
+}
+
 void database_api::cancel_all_subscriptions()
 {
    my->cancel_all_subscriptions();
@@ -318,6 +432,7 @@ void database_api::cancel_all_subscriptions()
 void database_api_impl::cancel_all_subscriptions()
 {
    set_subscribe_callback( std::function<void(const fc::variant&)>(), true);
+   _irreversible_block_callback = std::function<void(const fc::variant&)>();
    _market_subscriptions.clear();
 }
 
@@ -334,7 +449,7 @@ optional<block_header> database_api::get_block_header(uint32_t block_num)const
 
 optional<block_header> database_api_impl::get_block_header(uint32_t block_num) const
 {
-   auto result = _db.fetch_block_by_number(block_num);
+   auto result = fetch_block( "get_block_header", block_num );
    if(result)
       return *result;
    return {};
@@ -347,7 +462,38 @@ optional<signed_block> database_api::get_block(uint32_t block_num)const
 
 optional<signed_block> database_api_impl::get_block(uint32_t block_num)const
 {
-   return _db.fetch_block_by_number(block_num);
+   return fetch_block( "get_block", block_num );
+}
+
+vector<signed_block> database_api::get_blocks(uint32_t block_num, uint32_t count)const
+{
+   return my->get_blocks( block_num, count );
+}
+
+vector<signed_block> database_api_impl::get_blocks(uint32_t block_num, uint32_t count)const
+{
+   FC_ASSERT( count <= GET_BLOCKS_MAX_COUNT );
+   const uint32_t last_irreversible = _db.get_dynamic_global_properties().last_irreversible_block_num;
+   if( _api_pool == nullptr || count == 0 || block_num > last_irreversible )
+      return _db.fetch_blocks_by_number( block_num, count );
+
+   const uint32_t irreversible = std::min( count, last_irreversible - block_num + 1 );
+   vector<signed_block> result = _api_pool->run_unlocked( "get_blocks", [&]() {
+      return _db.get_block_log().fetch_range( block_num, irreversible );
+   });
+   if( result.size() == irreversible && irreversible < count )
+   {
+      vector<signed_block> reversible = _db.fetch_blocks_by_number( block_num + irreversible, count - irreversible );
+      std::move( reversible.begin(), reversible.end(), std::back_inserter( result ) );
+   }
+   return result;
+}
+
+optional<signed_block> database_api_impl::fetch_block( const char* method, uint32_t block_num )const
+{
+   if( _api_pool != nullptr && block_num <= _db.get_dynamic_global_properties().last_irreversible_block_num )
+      return _api_pool->run_unlocked( method, [&]() { return _db.get_block_log().fetch_by_number( block_num ); } );
+   return _db.fetch_block_by_number( block_num );
 }
 
 processed_transaction database_api::get_transaction( uint32_t block_num, uint32_t trx_in_block )const
@@ -366,7 +512,7 @@ optional<signed_transaction> database_api::get_recent_transaction_by_id( const t
 
 processed_transaction database_api_impl::get_transaction(uint32_t block_num, uint32_t trx_num)const
 {
-   auto opt_block = _db.fetch_block_by_number(block_num);
+   auto opt_block = fetch_block( "get_transaction", block_num );
    FC_ASSERT( opt_block );
    FC_ASSERT( opt_block->transactions.size() > trx_num );
    return opt_block->transactions[trx_num];
@@ -380,7 +526,7 @@ processed_transaction database_api_impl::get_transaction(uint32_t block_num, uin
 
 chain_property_object database_api::get_chain_properties()const
 {
-   return my->get_chain_properties();
+   return my->run_read_only( "get_chain_properties", [&]() { return my->get_chain_properties(); } );
 }
 
 chain_property_object database_api_impl::get_chain_properties()const
@@ -390,7 +536,7 @@ chain_property_object database_api_impl::get_chain_properties()const
 
 global_property_object database_api::get_global_properties()const
 {
-   return my->get_global_properties();
+   return my->run_read_only( "get_global_properties", [&]() { return my->get_global_properties(); } );
 }
 
 global_property_object database_api_impl::get_global_properties()const
@@ -420,7 +566,7 @@ chain_id_type database_api_impl::get_chain_id()const
 
 dynamic_global_property_object database_api::get_dynamic_global_properties()const
 {
-   return my->get_dynamic_global_properties();
+   return my->run_read_only( "get_dynamic_global_properties", [&]() { return my->get_dynamic_global_properties(); } );
 }
 
 dynamic_global_property_object database_api_impl::get_dynamic_global_properties()const
@@ -428,6 +574,53 @@ dynamic_global_property_object database_api_impl::get_dynamic_global_properties(
    return _db.get(dynamic_global_property_id_type());
 }
 
+signature_cache_stats database_api::get_signature_cache_stats()const
+{
+   return my->get_signature_cache_stats();
+}
+
+signature_cache_stats database_api_impl::get_signature_cache_stats()const
+{
+   return _db.get_signature_cache().get_stats();
+}
+
+block_cache_stats database_api::get_block_cache_stats()const
+{
+   return my->get_block_cache_stats();
+}
+
+block_cache_stats database_api_impl::get_block_cache_stats()const
+{
+   return _db.get_block_cache().get_stats();
+}
+
+vector<node_pool_stats> database_api::get_node_pool_stats()const
+{
+   return my->get_node_pool_stats();
+}
+
+vector<node_pool_stats> database_api_impl::get_node_pool_stats()const
+{
+   return _db.get_node_pool_stats();
+}
+
+optional<block_state_digest> database_api::get_block_state_digest( uint32_t block_num )const
+{
+   return my->run_read_only( "get_block_state_digest", [&]() { return my->get_block_state_digest( block_num ); } );
+}
+
+api_call_stats database_api::get_api_call_stats()const
+{
+   if( my->_api_pool == nullptr )
+      return api_call_stats();
+   return my->_api_pool->get_stats();
+}
+
+optional<block_state_digest> database_api_impl::get_block_state_digest( uint32_t block_num )const
+{
+   return _db.get_block_state_digest( block_num );
+}
+
 //////////////////////////////////////////////////////////////////////
 //                                                                  //
 // Keys                                                             //
@@ -436,7 +629,7 @@ dynamic_global_property_object database_api_impl::get_dynamic_global_properties(
 
 vector<vector<account_id_type>> database_api::get_key_references( vector<public_key_type> key )const
 {
-   return my->get_key_references( key );
+   return my->run_read_only( "get_key_references", [&]() { return my->get_key_references( key ); } );
 }
 
 /**
@@ -506,7 +699,7 @@ vector<vector<account_id_type>> database_api_impl::get_key_references( vector<pu
 
 vector<optional<account_object>> database_api::get_accounts(const vector<account_id_type>& account_ids)const
 {
-   return my->get_accounts( account_ids );
+   return my->run_read_only( "get_accounts", [&]() { return my->get_accounts( account_ids ); } );
 }
 
 vector<optional<account_object>> database_api_impl::get_accounts(const vector<account_id_type>& account_ids)const
@@ -526,27 +719,29 @@ vector<optional<account_object>> database_api_impl::get_accounts(const vector<ac
 
 std::map<string,full_account> database_api::get_full_accounts( const vector<string>& names_or_ids, bool subscribe )
 {
-   return my->get_full_accounts( names_or_ids, subscribe );
+   return my->run_on_snapshot( "get_full_accounts", [&]( const state_snapshot& snapshot ) {
+      return my->get_full_accounts( snapshot, names_or_ids, subscribe );
+   });
 }
 
-std::map<std::string, full_account> database_api_impl::get_full_accounts( const vector<std::string>& names_or_ids, bool subscribe)
+std::map<std::string, full_account> database_api_impl::get_full_accounts( const state_snapshot& snapshot, const vector<std::string>& names_or_ids, bool subscribe)
 {
    idump((names_or_ids));
    std::map<std::string, full_account> results;
 
    for (const std::string& account_name_or_id : names_or_ids)
    {
-      const account_object* account = nullptr;
+      optional<account_object> account;
       if (std::isdigit(account_name_or_id[0]))
-         account = _db.find(fc::variant(account_name_or_id).as<account_id_type>());
+         account = snapshot.find<account_object>(fc::variant(account_name_or_id).as<account_id_type>());
       else
       {
-         const auto& idx = _db.get_index_type<account_index>().indices().get<by_name>();
-         auto itr = idx.find(account_name_or_id);
-         if (itr != idx.end())
-            account = &*itr;
+         auto accounts = select_equal<account_index, by_name>( snapshot, account_name_or_id,
+                                                              [&]( const account_object& a ) { return a.name == account_name_or_id; } );
+         if( !accounts.empty() )
+            account = std::move( accounts.front() );
       }
-      if (account == nullptr)
+      if (!account)
          continue;
 
       if( subscribe )
@@ -558,11 +753,11 @@ std::map<std::string, full_account> database_api_impl::get_full_accounts( const
       // fc::mutable_variant_object full_account;
       full_account acnt;
       acnt.account = *account;
-      acnt.statistics = account->statistics(_db);
-      acnt.registrar_name = account->registrar(_db).name;
-      acnt.referrer_name = account->referrer(_db).name;
-      acnt.lifetime_referrer_name = account->lifetime_referrer(_db).name;
-      acnt.votes = lookup_vote_ids( vector<vote_id_type>(account->options.votes.begin(),account->options.votes.end()) );
+      acnt.statistics = snapshot.get( account->statistics );
+      acnt.registrar_name = snapshot.get( account->registrar ).name;
+      acnt.referrer_name = snapshot.get( account->referrer ).name;
+      acnt.lifetime_referrer_name = snapshot.get( account->lifetime_referrer ).name;
+      acnt.votes = lookup_vote_ids( snapshot, vector<vote_id_type>(account->options.votes.begin(),account->options.votes.end()) );
 
       // Add the account itself, its statistics object, cashback balance, and referral account names
       /*
@@ -572,52 +767,60 @@ std::map<std::string, full_account> database_api_impl::get_full_accounts( const
             */
       if (account->cashback_vb)
       {
-         acnt.cashback_balance = account->cashback_balance(_db);
-      }
-      // Add the account's proposals
-      const auto& proposal_idx = _db.get_index_type<proposal_index>();
-      const auto& pidx = dynamic_cast<const primary_index<proposal_index>&>(proposal_idx);
-      const auto& proposals_by_account = pidx.get_secondary_index<graphene::chain::required_approval_index>();
-      auto  required_approvals_itr = proposals_by_account._account_to_proposals.find( account->id );
-      if( required_approvals_itr != proposals_by_account._account_to_proposals.end() )
-      {
-         acnt.proposals.reserve( required_approvals_itr->second.size() );
-         for( auto proposal_id : required_approvals_itr->second )
-            acnt.proposals.push_back( proposal_id(_db) );
+         acnt.cashback_balance = snapshot.get( *account->cashback_vb );
       }
-
+      // Add the account's proposals, those it was named in when they were created or since
+      const account_id_type account_id = account->id;
+      acnt.proposals = snapshot.select<proposal_object>( [&]( const std::function<bool(const proposal_object&)>& visit ) {
+         const auto& proposal_idx = _db.get_index_type<proposal_index>();
+         const auto& pidx = dynamic_cast<const primary_index<proposal_index>&>(proposal_idx);
+         const auto& proposals_by_account = pidx.get_secondary_index<graphene::chain::required_approval_index>();
+         auto  required_approvals_itr = proposals_by_account._account_to_proposals.find( account_id );
+         if( required_approvals_itr != proposals_by_account._account_to_proposals.end() )
+            for( auto proposal_id : required_approvals_itr->second )
+               if( !visit( proposal_id(_db) ) )
+                  break;
+      }, [account_id]( const proposal_object& p ) {
+         return p.required_active_approvals.count( account_id ) || p.required_owner_approvals.count( account_id )
+             || p.available_active_approvals.count( account_id ) || p.available_owner_approvals.count( account_id );
+      });
+      std::sort( acnt.proposals.begin(), acnt.proposals.end(), []( const proposal_object& a, const proposal_object& b ) {
+         return a.id < b.id;
+      });
 
       // Add the account's balances
-      auto balance_range = _db.get_index_type<account_balance_index>().indices().get<by_account_asset>().equal_range(boost::make_tuple(account->id));
-      //vector<account_balance_object> balances;
-      std::for_each(balance_range.first, balance_range.second,
-                    [&acnt](const account_balance_object& balance) {
-                       acnt.balances.emplace_back(balance);
-                    });
+      acnt.balances = select_equal<account_balance_index, by_account_asset>( snapshot, boost::make_tuple(account_id),
+                                                                           [account_id]( const account_balance_object& b ) { return b.owner == account_id; } );
+      std::sort( acnt.balances.begin(), acnt.balances.end(), []( const account_balance_object& a, const account_balance_object& b ) {
+         return a.asset_type < b.asset_type;
+      });
 
       // Add the account's vesting balances
-      auto vesting_range = _db.get_index_type<vesting_balance_index>().indices().get<by_account>().equal_range(account->id);
-      std::for_each(vesting_range.first, vesting_range.second,
-                    [&acnt](const vesting_balance_object& balance) {
-                       acnt.vesting_balances.emplace_back(balance);
-                    });
+      acnt.vesting_balances = select_equal<vesting_balance_index, by_account>( snapshot, account_id,
+                                                                             [account_id]( const vesting_balance_object& b ) { return b.owner == account_id; } );
+      std::sort( acnt.vesting_balances.begin(), acnt.vesting_balances.end(), []( const vesting_balance_object& a, const vesting_balance_object& b ) {
+         return a.id < b.id;
+      });
 
       // Add the account's orders
-      auto order_range = _db.get_index_type<limit_order_index>().indices().get<by_account>().equal_range(account->id);
-      std::for_each(order_range.first, order_range.second,
-                    [&acnt] (const limit_order_object& order) {
-                       acnt.limit_orders.emplace_back(order);
-                    });
-      auto call_range = _db.get_index_type<call_order_index>().indices().get<by_account>().equal_range(account->id);
-      std::for_each(call_range.first, call_range.second,
-                    [&acnt] (const call_order_object& call) {
-                       acnt.call_orders.emplace_back(call);
-                    });
-
-      auto pending_payouts_range = 
-         _db.get_index_type<pending_dividend_payout_balance_for_holder_object_index>().indices().get<by_account_dividend_payout>().equal_range(boost::make_tuple(account->id));
+      acnt.limit_orders = select_equal<limit_order_index, by_account>( snapshot, account_id,
+                                                                     [account_id]( const limit_order_object& o ) { return o.seller == account_id; } );
+      std::sort( acnt.limit_orders.begin(), acnt.limit_orders.end(), []( const limit_order_object& a, const limit_order_object& b ) {
+         return a.id < b.id;
+      });
+      acnt.call_orders = select_equal<call_order_index, by_account>( snapshot, account_id,
+                                                                   [account_id]( const call_order_object& c ) { return c.borrower == account_id; } );
+      std::sort( acnt.call_orders.begin(), acnt.call_orders.end(), []( const call_order_object& a, const call_order_object& b ) {
+         return a.debt_type() < b.debt_type();
+      });
 
-      std::copy(pending_payouts_range.first, pending_payouts_range.second, std::back_inserter(acnt.pending_dividend_payments));
+      acnt.pending_dividend_payments =
+         select_equal<pending_dividend_payout_balance_for_holder_object_index, by_account_dividend_payout>( snapshot, boost::make_tuple(account_id),
+            [account_id]( const pending_dividend_payout_balance_for_holder_object& p ) { return p.owner == account_id; } );
+      std::sort( acnt.pending_dividend_payments.begin(), acnt.pending_dividend_payments.end(),
+                 []( const pending_dividend_payout_balance_for_holder_object& a, const pending_dividend_payout_balance_for_holder_object& b ) {
+         return std::tie( a.dividend_holder_asset_type, a.dividend_payout_asset_type ) < std::tie( b.dividend_holder_asset_type, b.dividend_payout_asset_type );
+      });
 
       results[account_name_or_id] = acnt;
    }
@@ -626,7 +829,7 @@ std::map<std::string, full_account> database_api_impl::get_full_accounts( const
 
 optional<account_object> database_api::get_account_by_name( string name )const
 {
-   return my->get_account_by_name( name );
+   return my->run_read_only( "get_account_by_name", [&]() { return my->get_account_by_name( name ); } );
 }
 
 optional<account_object> database_api_impl::get_account_by_name( string name )const
@@ -640,7 +843,7 @@ optional<account_object> database_api_impl::get_account_by_name( string name )co
 
 vector<account_id_type> database_api::get_account_references( account_id_type account_id )const
 {
-   return my->get_account_references( account_id );
+   return my->run_read_only( "get_account_references", [&]() { return my->get_account_references( account_id ); } );
 }
 
 vector<account_id_type> database_api_impl::get_account_references( account_id_type account_id )const
@@ -661,7 +864,7 @@ vector<account_id_type> database_api_impl::get_account_references( account_id_ty
 
 vector<optional<account_object>> database_api::lookup_account_names(const vector<string>& account_names)const
 {
-   return my->lookup_account_names( account_names );
+   return my->run_read_only( "lookup_account_names", [&]() { return my->lookup_account_names( account_names ); } );
 }
 
 vector<optional<account_object>> database_api_impl::lookup_account_names(const vector<string>& account_names)const
@@ -679,7 +882,7 @@ vector<optional<account_object>> database_api_impl::lookup_account_names(const v
 
 map<string,account_id_type> database_api::lookup_accounts(const string& lower_bound_name, uint32_t limit)const
 {
-   return my->lookup_accounts( lower_bound_name, limit );
+   return my->run_read_only( "lookup_accounts", [&]() { return my->lookup_accounts( lower_bound_name, limit ); } );
 }
 
 map<string,account_id_type> database_api_impl::lookup_accounts(const string& lower_bound_name, uint32_t limit)const
@@ -702,7 +905,7 @@ map<string,account_id_type> database_api_impl::lookup_accounts(const string& low
 
 uint64_t database_api::get_account_count()const
 {
-   return my->get_account_count();
+   return my->run_read_only( "get_account_count", [&]() { return my->get_account_count(); } );
 }
 
 uint64_t database_api_impl::get_account_count()const
@@ -718,7 +921,7 @@ uint64_t database_api_impl::get_account_count()const
 
 vector<asset> database_api::get_account_balances(account_id_type id, const flat_set<asset_id_type>& assets)const
 {
-   return my->get_account_balances( id, assets );
+   return my->run_read_only( "get_account_balances", [&]() { return my->get_account_balances( id, assets ); } );
 }
 
 vector<asset> database_api_impl::get_account_balances(account_id_type acnt, const flat_set<asset_id_type>& assets)const
@@ -745,7 +948,7 @@ vector<asset> database_api_impl::get_account_balances(account_id_type acnt, cons
 
 vector<asset> database_api::get_named_account_balances(const std::string& name, const flat_set<asset_id_type>& assets)const
 {
-   return my->get_named_account_balances( name, assets );
+   return my->run_read_only( "get_named_account_balances", [&]() { return my->get_named_account_balances( name, assets ); } );
 }
 
 vector<asset> database_api_impl::get_named_account_balances(const std::string& name, const flat_set<asset_id_type>& assets) const
@@ -758,7 +961,7 @@ vector<asset> database_api_impl::get_named_account_balances(const std::string& n
 
 vector<balance_object> database_api::get_balance_objects( const vector<address>& addrs )const
 {
-   return my->get_balance_objects( addrs );
+   return my->run_read_only( "get_balance_objects", [&]() { return my->get_balance_objects( addrs ); } );
 }
 
 vector<balance_object> database_api_impl::get_balance_objects( const vector<address>& addrs )const
@@ -787,7 +990,7 @@ vector<balance_object> database_api_impl::get_balance_objects( const vector<addr
 
 vector<asset> database_api::get_vested_balances( const vector<balance_id_type>& objs )const
 {
-   return my->get_vested_balances( objs );
+   return my->run_read_only( "get_vested_balances", [&]() { return my->get_vested_balances( objs ); } );
 }
 
 vector<asset> database_api_impl::get_vested_balances( const vector<balance_id_type>& objs )const
@@ -805,7 +1008,7 @@ vector<asset> database_api_impl::get_vested_balances( const vector<balance_id_ty
 
 vector<vesting_balance_object> database_api::get_vesting_balances( account_id_type account_id )const
 {
-   return my->get_vesting_balances( account_id );
+   return my->run_read_only( "get_vesting_balances", [&]() { return my->get_vesting_balances( account_id ); } );
 }
 
 vector<vesting_balance_object> database_api_impl::get_vesting_balances( account_id_type account_id )const
@@ -831,7 +1034,7 @@ vector<vesting_balance_object> database_api_impl::get_vesting_balances( account_
 
 vector<optional<asset_object>> database_api::get_assets(const vector<asset_id_type>& asset_ids)const
 {
-   return my->get_assets( asset_ids );
+   return my->run_read_only( "get_assets", [&]() { return my->get_assets( asset_ids ); } );
 }
 
 vector<optional<asset_object>> database_api_impl::get_assets(const vector<asset_id_type>& asset_ids)const
@@ -851,7 +1054,7 @@ vector<optional<asset_object>> database_api_impl::get_assets(const vector<asset_
 
 vector<asset_object> database_api::list_assets(const string& lower_bound_symbol, uint32_t limit)const
 {
-   return my->list_assets( lower_bound_symbol, limit );
+   return my->run_read_only( "list_assets", [&]() { return my->list_assets( lower_bound_symbol, limit ); } );
 }
 
 vector<asset_object> database_api_impl::list_assets(const string& lower_bound_symbol, uint32_t limit)const
@@ -874,23 +1077,22 @@ vector<asset_object> database_api_impl::list_assets(const string& lower_bound_sy
 
 vector<optional<asset_object>> database_api::lookup_asset_symbols(const vector<string>& symbols_or_ids)const
 {
-   return my->lookup_asset_symbols( symbols_or_ids );
+   return my->run_on_snapshot( "lookup_asset_symbols", [&]( const state_snapshot& snapshot ) {
+      return my->lookup_asset_symbols( snapshot, symbols_or_ids );
+   });
 }
 
-vector<optional<asset_object>> database_api_impl::lookup_asset_symbols(const vector<string>& symbols_or_ids)const
+vector<optional<asset_object>> database_api_impl::lookup_asset_symbols( const state_snapshot& snapshot, const vector<string>& symbols_or_ids )const
 {
-   const auto& assets_by_symbol = _db.get_index_type<asset_index>().indices().get<by_symbol>();
    vector<optional<asset_object> > result;
    result.reserve(symbols_or_ids.size());
    std::transform(symbols_or_ids.begin(), symbols_or_ids.end(), std::back_inserter(result),
-                  [this, &assets_by_symbol](const string& symbol_or_id) -> optional<asset_object> {
+                  [this, &snapshot](const string& symbol_or_id) -> optional<asset_object> {
       if( !symbol_or_id.empty() && std::isdigit(symbol_or_id[0]) )
-      {
-         auto ptr = _db.find(variant(symbol_or_id).as<asset_id_type>());
-         return ptr == nullptr? optional<asset_object>() : *ptr;
-      }
-      auto itr = assets_by_symbol.find(symbol_or_id);
-      return itr == assets_by_symbol.end()? optional<asset_object>() : *itr;
+         return snapshot.find<asset_object>(variant(symbol_or_id).as<asset_id_type>());
+      auto assets = select_equal<asset_index, by_symbol>( snapshot, symbol_or_id,
+                                                        [&symbol_or_id]( const asset_object& a ) { return a.symbol == symbol_or_id; } );
+      return assets.empty()? optional<asset_object>() : assets.front();
    });
    return result;
 }
@@ -903,44 +1105,44 @@ vector<optional<asset_object>> database_api_impl::lookup_asset_symbols(const vec
 
 vector<limit_order_object> database_api::get_limit_orders(asset_id_type a, asset_id_type b, uint32_t limit)const
 {
-   return my->get_limit_orders( a, b, limit );
+   return my->run_on_snapshot( "get_limit_orders", [&]( const state_snapshot& snapshot ) {
+      return my->get_limit_orders( snapshot, a, b, limit );
+   });
 }
 
 /**
  *  @return the limit orders for both sides of the book for the two assets specified up to limit number on each side.
  */
-vector<limit_order_object> database_api_impl::get_limit_orders(asset_id_type a, asset_id_type b, uint32_t limit)const
+vector<limit_order_object> database_api_impl::get_limit_orders( const state_snapshot& snapshot, asset_id_type a, asset_id_type b, uint32_t limit )const
 {
-   const auto& limit_order_idx = _db.get_index_type<limit_order_index>();
-   const auto& limit_price_idx = limit_order_idx.indices().get<by_price>();
-
    vector<limit_order_object> result;
 
-   uint32_t count = 0;
-   auto limit_itr = limit_price_idx.lower_bound(price::max(a,b));
-   auto limit_end = limit_price_idx.upper_bound(price::min(a,b));
-   while(limit_itr != limit_end && count < limit)
-   {
-      result.push_back(*limit_itr);
-      ++limit_itr;
-      ++count;
-   }
-   count = 0;
-   limit_itr = limit_price_idx.lower_bound(price::max(b,a));
-   limit_end = limit_price_idx.upper_bound(price::min(b,a));
-   while(limit_itr != limit_end && count < limit)
-   {
-      result.push_back(*limit_itr);
-      ++limit_itr;
-      ++count;
-   }
+   auto add_side = [&]( asset_id_type sell, asset_id_type receive ) {
+      auto orders = snapshot.select<limit_order_object>( [&]( const std::function<bool(const limit_order_object&)>& visit ) {
+         const auto& limit_price_idx = _db.get_index_type<limit_order_index>().indices().get<by_price>();
+         auto limit_itr = limit_price_idx.lower_bound(price::max(sell,receive));
+         auto limit_end = limit_price_idx.upper_bound(price::min(sell,receive));
+         for( ; limit_itr != limit_end && visit( *limit_itr ); ++limit_itr );
+      }, [&]( const limit_order_object& o ) {
+         return o.sell_price.base.asset_id == sell && o.sell_price.quote.asset_id == receive;
+      }, limit );
+      // best price first, the way the by_price index orders them
+      std::sort( orders.begin(), orders.end(), []( const limit_order_object& x, const limit_order_object& y ) {
+         return x.sell_price > y.sell_price || ( x.sell_price == y.sell_price && x.id < y.id );
+      });
+      if( orders.size() > limit )
+         orders.resize( limit );
+      std::move( orders.begin(), orders.end(), std::back_inserter( result ) );
+   };
+   add_side( a, b );
+   add_side( b, a );
 
    return result;
 }
 
 vector<call_order_object> database_api::get_call_orders(asset_id_type a, uint32_t limit)const
 {
-   return my->get_call_orders( a, limit );
+   return my->run_read_only( "get_call_orders", [&]() { return my->get_call_orders( a, limit ); } );
 }
 
 vector<call_order_object> database_api_impl::get_call_orders(asset_id_type a, uint32_t limit)const
@@ -955,7 +1157,7 @@ vector<call_order_object> database_api_impl::get_call_orders(asset_id_type a, ui
 
 vector<force_settlement_object> database_api::get_settle_orders(asset_id_type a, uint32_t limit)const
 {
-   return my->get_settle_orders( a, limit );
+   return my->run_read_only( "get_settle_orders", [&]() { return my->get_settle_orders( a, limit ); } );
 }
 
 vector<force_settlement_object> database_api_impl::get_settle_orders(asset_id_type a, uint32_t limit)const
@@ -968,7 +1170,7 @@ vector<force_settlement_object> database_api_impl::get_settle_orders(asset_id_ty
 
 vector<call_order_object> database_api::get_margin_positions( const account_id_type& id )const
 {
-   return my->get_margin_positions( id );
+   return my->run_read_only( "get_margin_positions", [&]() { return my->get_margin_positions( id ); } );
 }
 
 vector<call_order_object> database_api_impl::get_margin_positions( const account_id_type& id )const
@@ -1015,12 +1217,14 @@ void database_api_impl::unsubscribe_from_market(asset_id_type a, asset_id_type b
 
 market_ticker database_api::get_ticker( const string& base, const string& quote )const
 {
-   return my->get_ticker( base, quote );
+   return my->run_on_snapshot( "get_ticker", [&]( const state_snapshot& snapshot ) {
+      return my->get_ticker( snapshot, base, quote );
+   });
 }
 
-market_ticker database_api_impl::get_ticker( const string& base, const string& quote )const
+market_ticker database_api_impl::get_ticker( const state_snapshot& snapshot, const string& base, const string& quote )const
 {
-   auto assets = lookup_asset_symbols( {base, quote} );
+   auto assets = lookup_asset_symbols( snapshot, {base, quote} );
    FC_ASSERT( assets[0], "Invalid base asset symbol: ${s}", ("s",base) );
    FC_ASSERT( assets[1], "Invalid quote asset symbol: ${s}", ("s",quote) );
 
@@ -1044,8 +1248,8 @@ market_ticker database_api_impl::get_ticker( const string& base, const string& q
 
       uint32_t day = 86400;
       auto now = fc::time_point_sec( fc::time_point::now() );
-      auto orders = get_order_book( base, quote, 1 );
-      auto trades = get_trade_history( base, quote, now, fc::time_point_sec( now.sec_since_epoch() - day ), 100 );
+      auto orders = get_order_book( snapshot, base, quote, 1 );
+      auto trades = get_trade_history( snapshot, base, quote, now, fc::time_point_sec( now.sec_since_epoch() - day ), 100 );
 
       result.latest = trades[0].price;
 
@@ -1057,7 +1261,7 @@ market_ticker database_api_impl::get_ticker( const string& base, const string& q
 
       while (trades.size() == 100)
       {
-         trades = get_trade_history( base, quote, trades[99].date, fc::time_point_sec( now.sec_since_epoch() - day ), 100 );
+         trades = get_trade_history( snapshot, base, quote, trades[99].date, fc::time_point_sec( now.sec_since_epoch() - day ), 100 );
 
          for ( market_trade t: trades )
          {
@@ -1066,7 +1270,7 @@ market_ticker database_api_impl::get_ticker( const string& base, const string& q
          }
       }
 
-      trades = get_trade_history( base, quote, trades.back().date, fc::time_point_sec(), 1 );
+      trades = get_trade_history( snapshot, base, quote, trades.back().date, fc::time_point_sec(), 1 );
       result.percent_change = trades.size() > 0 ? ( ( result.latest / trades.back().price ) - 1 ) * 100 : 0;
 
       //if (assets[0]->id == base_id)
@@ -1081,12 +1285,14 @@ market_ticker database_api_impl::get_ticker( const string& base, const string& q
 
 market_volume database_api::get_24_volume( const string& base, const string& quote )const
 {
-   return my->get_24_volume( base, quote );
+   return my->run_on_snapshot( "get_24_volume", [&]( const state_snapshot& snapshot ) {
+      return my->get_24_volume( snapshot, base, quote );
+   });
 }
 
-market_volume database_api_impl::get_24_volume( const string& base, const string& quote )const
+market_volume database_api_impl::get_24_volume( const state_snapshot& snapshot, const string& base, const string& quote )const
 {
-   auto assets = lookup_asset_symbols( {base, quote} );
+   auto assets = lookup_asset_symbols( snapshot, {base, quote} );
    FC_ASSERT( assets[0], "Invalid base asset symbol: ${s}", ("s",base) );
    FC_ASSERT( assets[1], "Invalid quote asset symbol: ${s}", ("s",quote) );
 
@@ -1105,7 +1311,7 @@ market_volume database_api_impl::get_24_volume( const string& base, const string
       uint32_t bucket_size = 86400;
       auto now = fc::time_point_sec( fc::time_point::now() );
 
-      auto trades = get_trade_history( base, quote, now, fc::time_point_sec( now.sec_since_epoch() - bucket_size ), 100 );
+      auto trades = get_trade_history( snapshot, base, quote, now, fc::time_point_sec( now.sec_since_epoch() - bucket_size ), 100 );
 
       for ( market_trade t: trades )
       {
@@ -1115,7 +1321,7 @@ market_volume database_api_impl::get_24_volume( const string& base, const string
 
       while (trades.size() == 100)
       {
-         trades = get_trade_history( base, quote, trades[99].date, fc::time_point_sec( now.sec_since_epoch() - bucket_size ), 100 );
+         trades = get_trade_history( snapshot, base, quote, trades[99].date, fc::time_point_sec( now.sec_since_epoch() - bucket_size ), 100 );
 
          for ( market_trade t: trades )
          {
@@ -1130,10 +1336,12 @@ market_volume database_api_impl::get_24_volume( const string& base, const string
 
 order_book database_api::get_order_book( const string& base, const string& quote, unsigned limit )const
 {
-   return my->get_order_book( base, quote, limit);
+   return my->run_on_snapshot( "get_order_book", [&]( const state_snapshot& snapshot ) {
+      return my->get_order_book( snapshot, base, quote, limit );
+   });
 }
 
-order_book database_api_impl::get_order_book( const string& base, const string& quote, unsigned limit )const
+order_book database_api_impl::get_order_book( const state_snapshot& snapshot, const string& base, const string& quote, unsigned limit )const
 {
    using boost::multiprecision::uint128_t;
    FC_ASSERT( limit <= 50 );
@@ -1142,13 +1350,13 @@ order_book database_api_impl::get_order_book( const string& base, const string&
    result.base = base;
    result.quote = quote;
 
-   auto assets = lookup_asset_symbols( {base, quote} );
+   auto assets = lookup_asset_symbols( snapshot, {base, quote} );
    FC_ASSERT( assets[0], "Invalid base asset symbol: ${s}", ("s",base) );
    FC_ASSERT( assets[1], "Invalid quote asset symbol: ${s}", ("s",quote) );
 
    auto base_id = assets[0]->id;
    auto quote_id = assets[1]->id;
-   auto orders = get_limit_orders( base_id, quote_id, limit );
+   auto orders = get_limit_orders( snapshot, base_id, quote_id, limit );
 
 
    auto asset_to_real = [&]( const asset& a, int p ) { return double(a.amount.value)/pow( 10, p ); };
@@ -1189,10 +1397,13 @@ vector<market_trade> database_api::get_trade_history( const string& base,
                                                       fc::time_point_sec stop,
                                                       unsigned limit )const
 {
-   return my->get_trade_history( base, quote, start, stop, limit );
+   return my->run_on_snapshot( "get_trade_history", [&]( const state_snapshot& snapshot ) {
+      return my->get_trade_history( snapshot, base, quote, start, stop, limit );
+   });
 }
 
-vector<market_trade> database_api_impl::get_trade_history( const string& base,
+vector<market_trade> database_api_impl::get_trade_history( const state_snapshot& snapshot,
+                                                           const string& base,
                                                            const string& quote,
                                                            fc::time_point_sec start,
                                                            fc::time_point_sec stop,
@@ -1200,7 +1411,7 @@ vector<market_trade> database_api_impl::get_trade_history( const string& base,
 {
    FC_ASSERT( limit <= 100 );
 
-   auto assets = lookup_asset_symbols( {base, quote} );
+   auto assets = lookup_asset_symbols( snapshot, {base, quote} );
    FC_ASSERT( assets[0], "Invalid base asset symbol: ${s}", ("s",base) );
    FC_ASSERT( assets[1], "Invalid quote asset symbol: ${s}", ("s",quote) );
 
@@ -1208,7 +1419,6 @@ vector<market_trade> database_api_impl::get_trade_history( const string& base,
    auto quote_id = assets[1]->id;
 
    if( base_id > quote_id ) std::swap( base_id, quote_id );
-   const auto& history_idx = _db.get_index_type<graphene::market_history::history_index>().indices().get<by_key>();
    history_key hkey;
    hkey.base = base_id;
    hkey.quote = quote_id;
@@ -1219,37 +1429,40 @@ vector<market_trade> database_api_impl::get_trade_history( const string& base,
    if ( start.sec_since_epoch() == 0 )
       start = fc::time_point_sec( fc::time_point::now() );
 
-   uint32_t count = 0;
-   auto itr = history_idx.lower_bound( hkey );
-   vector<market_trade> result;
+   // Trades are tracked in each direction, both entries of a trade carry the same time.
+   auto history = snapshot.select<order_history_object>( [&]( const std::function<bool(const order_history_object&)>& visit ) {
+      const auto& history_idx = _db.get_index_type<graphene::market_history::history_index>().indices().get<by_key>();
+      for( auto itr = history_idx.lower_bound( hkey );
+           itr != history_idx.end() && itr->key.base == base_id && itr->key.quote == quote_id && itr->time >= stop && visit( *itr );
+           ++itr );
+   }, [&]( const order_history_object& h ) {
+      return h.key.base == base_id && h.key.quote == quote_id && h.time >= stop && h.time < start;
+   }, 2 * limit );
+   std::sort( history.begin(), history.end(), []( const order_history_object& a, const order_history_object& b ) {
+      return a.key < b.key;
+   });
 
-   while( itr != history_idx.end() && count < limit && !( itr->key.base != base_id || itr->key.quote != quote_id || itr->time < stop ) )
+   vector<market_trade> result;
+   for( size_t i = 0; i < history.size() && result.size() < limit; i += 2 )
    {
-      if( itr->time < start )
-      {
-         market_trade trade;
-
-         if( assets[0]->id == itr->op.receives.asset_id )
-         {
-            trade.amount = price_to_real( itr->op.pays.amount, assets[1]->precision );
-            trade.value = price_to_real( itr->op.receives.amount, assets[0]->precision );
-         }
-         else
-         {
-            trade.amount = price_to_real( itr->op.receives.amount, assets[1]->precision );
-            trade.value = price_to_real( itr->op.pays.amount, assets[0]->precision );
-         }
-
-         trade.date = itr->time;
-         trade.price = trade.value / trade.amount;
+      const order_history_object& h = history[i];
+      market_trade trade;
 
-         result.push_back( trade );
-         ++count;
+      if( assets[0]->id == h.op.receives.asset_id )
+      {
+         trade.amount = price_to_real( h.op.pays.amount, assets[1]->precision );
+         trade.value = price_to_real( h.op.receives.amount, assets[0]->precision );
       }
+      else
+      {
+         trade.amount = price_to_real( h.op.receives.amount, assets[1]->precision );
+         trade.value = price_to_real( h.op.pays.amount, assets[0]->precision );
+      }
+
+      trade.date = h.time;
+      trade.price = trade.value / trade.amount;
 
-      // Trades are tracked in each direction.
-      ++itr;
-      ++itr;
+      result.push_back( trade );
    }
 
    return result;
@@ -1263,7 +1476,7 @@ vector<market_trade> database_api_impl::get_trade_history( const string& base,
 
 vector<optional<witness_object>> database_api::get_witnesses(const vector<witness_id_type>& witness_ids)const
 {
-   return my->get_witnesses( witness_ids );
+   return my->run_read_only( "get_witnesses", [&]() { return my->get_witnesses( witness_ids ); } );
 }
 
 vector<worker_object> database_api::get_workers_by_account(account_id_type account)const
@@ -1296,7 +1509,7 @@ vector<optional<witness_object>> database_api_impl::get_witnesses(const vector<w
 
 fc::optional<witness_object> database_api::get_witness_by_account(account_id_type account)const
 {
-   return my->get_witness_by_account( account );
+   return my->run_read_only( "get_witness_by_account", [&]() { return my->get_witness_by_account( account ); } );
 }
 
 fc::optional<witness_object> database_api_impl::get_witness_by_account(account_id_type account) const
@@ -1310,7 +1523,7 @@ fc::optional<witness_object> database_api_impl::get_witness_by_account(account_i
 
 map<string, witness_id_type> database_api::lookup_witness_accounts(const string& lower_bound_name, uint32_t limit)const
 {
-   return my->lookup_witness_accounts( lower_bound_name, limit );
+   return my->run_read_only( "lookup_witness_accounts", [&]() { return my->lookup_witness_accounts( lower_bound_name, limit ); } );
 }
 
 map<string, witness_id_type> database_api_impl::lookup_witness_accounts(const string& lower_bound_name, uint32_t limit)const
@@ -1338,7 +1551,7 @@ map<string, witness_id_type> database_api_impl::lookup_witness_accounts(const st
 
 uint64_t database_api::get_witness_count()const
 {
-   return my->get_witness_count();
+   return my->run_read_only( "get_witness_count", [&]() { return my->get_witness_count(); } );
 }
 
 uint64_t database_api_impl::get_witness_count()const
@@ -1354,7 +1567,7 @@ uint64_t database_api_impl::get_witness_count()const
 
 vector<optional<committee_member_object>> database_api::get_committee_members(const vector<committee_member_id_type>& committee_member_ids)const
 {
-   return my->get_committee_members( committee_member_ids );
+   return my->run_read_only( "get_committee_members", [&]() { return my->get_committee_members( committee_member_ids ); } );
 }
 
 vector<optional<committee_member_object>> database_api_impl::get_committee_members(const vector<committee_member_id_type>& committee_member_ids)const
@@ -1371,7 +1584,7 @@ vector<optional<committee_member_object>> database_api_impl::get_committee_membe
 
 fc::optional<committee_member_object> database_api::get_committee_member_by_account(account_id_type account)const
 {
-   return my->get_committee_member_by_account( account );
+   return my->run_read_only( "get_committee_member_by_account", [&]() { return my->get_committee_member_by_account( account ); } );
 }
 
 fc::optional<committee_member_object> database_api_impl::get_committee_member_by_account(account_id_type account) const
@@ -1385,7 +1598,7 @@ fc::optional<committee_member_object> database_api_impl::get_committee_member_by
 
 map<string, committee_member_id_type> database_api::lookup_committee_member_accounts(const string& lower_bound_name, uint32_t limit)const
 {
-   return my->lookup_committee_member_accounts( lower_bound_name, limit );
+   return my->run_read_only( "lookup_committee_member_accounts", [&]() { return my->lookup_committee_member_accounts( lower_bound_name, limit ); } );
 }
 
 map<string, committee_member_id_type> database_api_impl::lookup_committee_member_accounts(const string& lower_bound_name, uint32_t limit)const
@@ -1419,18 +1632,15 @@ map<string, committee_member_id_type> database_api_impl::lookup_committee_member
 
 vector<variant> database_api::lookup_vote_ids( const vector<vote_id_type>& votes )const
 {
-   return my->lookup_vote_ids( votes );
+   return my->run_on_snapshot( "lookup_vote_ids", [&]( const state_snapshot& snapshot ) {
+      return my->lookup_vote_ids( snapshot, votes );
+   });
 }
 
-vector<variant> database_api_impl::lookup_vote_ids( const vector<vote_id_type>& votes )const
+vector<variant> database_api_impl::lookup_vote_ids( const state_snapshot& snapshot, const vector<vote_id_type>& votes )const
 {
    FC_ASSERT( votes.size() < 1000, "Only 1000 votes can be queried at a time" );
 
-   const auto& witness_idx = _db.get_index_type<witness_index>().indices().get<by_vote_id>();
-   const auto& committee_idx = _db.get_index_type<committee_member_index>().indices().get<by_vote_id>();
-   const auto& for_worker_idx = _db.get_index_type<worker_index>().indices().get<by_vote_for>();
-   const auto& against_worker_idx = _db.get_index_type<worker_index>().indices().get<by_vote_against>();
-
    vector<variant> result;
    result.reserve( votes.size() );
    for( auto id : votes )
@@ -1439,32 +1649,36 @@ vector<variant> database_api_impl::lookup_vote_ids( const vector<vote_id_type>&
       {
          case vote_id_type::committee:
          {
-            auto itr = committee_idx.find( id );
-            if( itr != committee_idx.end() )
-               result.emplace_back( variant( *itr ) );
+            auto found = select_equal<committee_member_index, by_vote_id>( snapshot, id,
+                                                                          [id]( const committee_member_object& c ) { return c.vote_id == id; } );
+            if( !found.empty() )
+               result.emplace_back( variant( found.front() ) );
             else
                result.emplace_back( variant() );
             break;
          }
          case vote_id_type::witness:
          {
-            auto itr = witness_idx.find( id );
-            if( itr != witness_idx.end() )
-               result.emplace_back( variant( *itr ) );
+            auto found = select_equal<witness_index, by_vote_id>( snapshot, id,
+                                                                 [id]( const witness_object& w ) { return w.vote_id == id; } );
+            if( !found.empty() )
+               result.emplace_back( variant( found.front() ) );
             else
                result.emplace_back( variant() );
             break;
          }
          case vote_id_type::worker:
          {
-            auto itr = for_worker_idx.find( id );
-            if( itr != for_worker_idx.end() ) {
-               result.emplace_back( variant( *itr ) );
+            auto found = select_equal<worker_index, by_vote_for>( snapshot, id,
+                                                                 [id]( const worker_object& w ) { return w.vote_for == id; } );
+            if( !found.empty() ) {
+               result.emplace_back( variant( found.front() ) );
             }
             else {
-               auto itr = against_worker_idx.find( id );
-               if( itr != against_worker_idx.end() ) {
-                  result.emplace_back( variant( *itr ) );
+               found = select_equal<worker_index, by_vote_against>( snapshot, id,
+                                                                   [id]( const worker_object& w ) { return w.vote_against == id; } );
+               if( !found.empty() ) {
+                  result.emplace_back( variant( found.front() ) );
                }
                else {
                   result.emplace_back( variant() );
@@ -1496,7 +1710,7 @@ std::string database_api_impl::get_transaction_hex(const signed_transaction& trx
 
 set<public_key_type> database_api::get_required_signatures( const signed_transaction& trx, const flat_set<public_key_type>& available_keys )const
 {
-   return my->get_required_signatures( trx, available_keys );
+   return my->run_read_only( "get_required_signatures", [&]() { return my->get_required_signatures( trx, available_keys ); } );
 }
 
 set<public_key_type> database_api_impl::get_required_signatures( const signed_transaction& trx, const flat_set<public_key_type>& available_keys )const
@@ -1513,11 +1727,11 @@ set<public_key_type> database_api_impl::get_required_signatures( const signed_tr
 
 set<public_key_type> database_api::get_potential_signatures( const signed_transaction& trx )const
 {
-   return my->get_potential_signatures( trx );
+   return my->run_read_only( "get_potential_signatures", [&]() { return my->get_potential_signatures( trx ); } );
 }
 set<address> database_api::get_potential_address_signatures( const signed_transaction& trx )const
 {
-   return my->get_potential_address_signatures( trx );
+   return my->run_read_only( "get_potential_address_signatures", [&]() { return my->get_potential_address_signatures( trx ); } );
 }
 
 set<public_key_type> database_api_impl::get_potential_signatures( const signed_transaction& trx )const
@@ -1575,7 +1789,7 @@ set<address> database_api_impl::get_potential_address_signatures( const signed_t
 
 bool database_api::verify_authority( const signed_transaction& trx )const
 {
-   return my->verify_authority( trx );
+   return my->run_read_only( "verify_authority", [&]() { return my->verify_authority( trx ); } );
 }
 
 bool database_api_impl::verify_authority( const signed_transaction& trx )const
@@ -1589,7 +1803,7 @@ bool database_api_impl::verify_authority( const signed_transaction& trx )const
 
 bool database_api::verify_account_authority( const string& name_or_id, const flat_set<public_key_type>& signers )const
 {
-   return my->verify_account_authority( name_or_id, signers );
+   return my->run_read_only( "verify_account_authority", [&]() { return my->verify_account_authority( name_or_id, signers ); } );
 }
 
 bool database_api_impl::verify_account_authority( const string& name_or_id, const flat_set<public_key_type>& keys )const
@@ -1629,7 +1843,7 @@ processed_transaction database_api_impl::validate_transaction( const signed_tran
 
 vector< fc::variant > database_api::get_required_fees( const vector<operation>& ops, asset_id_type id )const
 {
-   return my->get_required_fees( ops, id );
+   return my->run_read_only( "get_required_fees", [&]() { return my->get_required_fees( ops, id ); } );
 }
 
 /**
@@ -1718,7 +1932,7 @@ vector< fc::variant > database_api_impl::get_required_fees( const vector<operati
 
 vector<proposal_object> database_api::get_proposed_transactions( account_id_type id )const
 {
-   return my->get_proposed_transactions( id );
+   return my->run_read_only( "get_proposed_transactions", [&]() { return my->get_proposed_transactions( id ); } );
 }
 
 /** TODO: add secondary index that will accelerate this process */
@@ -1747,7 +1961,7 @@ vector<proposal_object> database_api_impl::get_proposed_transactions( account_id
 
 vector<blinded_balance_object> database_api::get_blinded_balances( const flat_set<commitment_type>& commitments )const
 {
-   return my->get_blinded_balances( commitments );
+   return my->run_read_only( "get_blinded_balances", [&]() { return my->get_blinded_balances( commitments ); } );
 }
 
 vector<blinded_balance_object> database_api_impl::get_blinded_balances( const flat_set<commitment_type>& commitments )const
@@ -1771,7 +1985,7 @@ vector<blinded_balance_object> database_api_impl::get_blinded_balances( const fl
 //////////////////////////////////////////////////////////////////////
 vector<tournament_object> database_api::get_tournaments_in_state(tournament_state state, uint32_t limit) const
 {
-   return my->get_tournaments_in_state(state, limit);
+   return my->run_read_only( "get_tournaments_in_state", [&]() { return my->get_tournaments_in_state(state, limit); } );
 }
 
 vector<tournament_object> database_api_impl::get_tournaments_in_state(tournament_state state, uint32_t limit) const
@@ -1794,7 +2008,7 @@ vector<tournament_object> database_api::get_tournaments(tournament_id_type stop,
                                                         unsigned limit,
                                                         tournament_id_type start)
 {
-   return my->get_tournaments(stop, limit, start);
+   return my->run_read_only( "get_tournaments", [&]() { return my->get_tournaments(stop, limit, start); } );
 }
 
 vector<tournament_object> database_api_impl::get_tournaments(tournament_id_type stop,
@@ -1819,7 +2033,7 @@ vector<tournament_object> database_api::get_tournaments_by_state(tournament_id_t
                                                                  tournament_id_type start,
                                                                  tournament_state state)
 {
-   return my->get_tournaments_by_state(stop, limit, start, state);
+   return my->run_read_only( "get_tournaments_by_state", [&]() { return my->get_tournaments_by_state(stop, limit, start, state); } );
 }
 
 vector<tournament_object> database_api_impl::get_tournaments_by_state(tournament_id_type stop,
@@ -1842,7 +2056,7 @@ vector<tournament_object> database_api_impl::get_tournaments_by_state(tournament
 
 vector<tournament_id_type> database_api::get_registered_tournaments(account_id_type account_filter, uint32_t limit) const
 {
-   return my->get_registered_tournaments(account_filter, limit);
+   return my->run_read_only( "get_registered_tournaments", [&]() { return my->get_registered_tournaments(account_filter, limit); } );
 }
 
 vector<tournament_id_type> database_api_impl::get_registered_tournaments(account_id_type account_filter, uint32_t limit) const
@@ -1984,6 +2198,8 @@ void database_api_impl::on_applied_block()
       });
    }
 
+   push_irreversible_blocks();
+
    if(_market_subscriptions.size() == 0)
       return;
 
@@ -2026,4 +2242,54 @@ void database_api_impl::on_applied_block()
    });
 }
 
+void database_api_impl::push_irreversible_blocks()
+{
+   if( !_irreversible_block_callback || _pushing_irreversible_blocks
+       || _next_irreversible_block > _db.get_dynamic_global_properties().last_irreversible_block_num )
+      return;
+
+   _pushing_irreversible_blocks = true;
+   auto capture_this = shared_from_this();
+   fc::async([this,capture_this](){
+      // chunks handed to the callback, which serializes and queues them while the next one is read
+      std::deque< fc::future<void> > in_flight;
+      try
+      {
+         // blocks which become irreversible meanwhile are picked up by the next pass
+         while( _irreversible_block_callback )
+         {
+            const uint32_t last = _db.get_dynamic_global_properties().last_irreversible_block_num;
+            if( _next_irreversible_block > last )
+               break;
+            const uint32_t count = std::min<uint32_t>( last - _next_irreversible_block + 1, GET_BLOCKS_MAX_COUNT );
+            // read from the block log on an api thread, if there are any
+            auto blocks = std::make_shared< vector<signed_block> >( get_blocks( _next_irreversible_block, count ) );
+            if( blocks->empty() )
+            {
+               wlog( "Irreversible block ${n} is not available", ("n",_next_irreversible_block) );
+               break;
+            }
+            _next_irreversible_block += blocks->size();
+
+            while( in_flight.size() >= IRREVERSIBLE_BLOCK_CHUNKS_IN_FLIGHT )
+            {
+               in_flight.front().wait();
+               in_flight.pop_front();
+            }
+            auto callback = _irreversible_block_callback;
+            in_flight.push_back( fc::async( [callback,blocks]() { callback( fc::variant(*blocks) ); },
+                                            "irreversible_blocks" ) );
+            fc::yield();
+         }
+         for( auto& chunk : in_flight )
+            chunk.wait();
+      }
+      catch( const fc::exception& e )
+      {
+         elog( "Sending irreversible blocks failed: ${e}", ("e",e.to_detail_string()) );
+      }
+      _pushing_irreversible_blocks = false;
+   });
+}
+
 } } // graphene::app
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/chain/database.hpp>
+#include <graphene/db/state_snapshot.hpp>
+
+#include <fc/thread/thread.hpp>
+#include <fc/thread/thread_specific.hpp>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+namespace graphene { namespace app {
+
+   using std::string;
+   using std::vector;
+
+   struct api_method_stats
+   {
+      string   method;
+      uint64_t calls = 0;
+      uint64_t total_latency_us = 0; ///< from handing the call to the pool until it returned, summed over all calls
+      uint64_t total_run_us = 0;     ///< time spent running, after a worker picked it up and the chain let it read
+      uint64_t max_latency_us = 0;
+   };
+
+   struct api_call_stats
+   {
+      uint32_t                 threads = 0;
+      uint32_t                 queue_depth = 0;     ///< calls handed to the pool which have not returned yet
+      uint32_t                 max_queue_depth = 0;
+      vector<api_method_stats> methods;
+   };
+
+   /**
+    * @class api_thread_pool
+    * @brief runs API calls which only read the chain state on worker threads
+    *
+    * The calling task waits for the result, so the thread it runs on stays free to apply blocks and serve
+    * other connections meanwhile.  A call reads the live state under the database's read_scope; pushing
+    * blocks and transactions takes the lock exclusively, so calls never see a block half applied.
+    *
+    * The flip side is that a block or transaction waits for every call already reading to return: a single
+    * slow call, e.g. a large list query, delays push_block by as long as it runs.  Calls are not cut short,
+    * so methods handed to the pool must keep the work they do bounded, the way the API's limit parameters
+    * do; the per method latencies in get_stats() show which calls hold the chain up.  Calls made through
+    * run_snapshot() read a state_snapshot instead and only keep changes out one lookup at a time.
+    */
+   class api_thread_pool
+   {
+      public:
+         api_thread_pool( const graphene::chain::database& db, uint32_t thread_count );
+         ~api_thread_pool();
+
+         template<typename Functor>
+         auto run( const char* method, Functor&& f ) -> decltype( f() )
+         {
+            typedef decltype( f() ) result_type;
+            if( runs_inline() )
+               return f();
+            call_scope scope( *this, method );
+            return scope.worker().async( [&]() -> result_type {
+               graphene::db::object_database::read_scope lock( _db );
+               scope.started();
+               return f();
+            }, method ).wait();
+         }
+
+         /**
+          * Like run(), but without the database's read_scope: f must not read the chain state, e.g. because it
+          * only reads the block log, and then never holds up a block being applied.
+          */
+         template<typename Functor>
+         auto run_unlocked( const char* method, Functor&& f ) -> decltype( f() )
+         {
+            typedef decltype( f() ) result_type;
+            if( runs_inline() )
+               return f();
+            call_scope scope( *this, method );
+            return scope.worker().async( [&]() -> result_type {
+               scope.started();
+               return f();
+            }, method ).wait();
+         }
+
+         /**
+          * Like run_unlocked(), but hands f the latest snapshot of the chain state, which it reads while blocks
+          * keep being applied.  If the database has no snapshot to give, f reads the live state under a
+          * read_scope the way run() does.
+          */
+         template<typename Functor>
+         auto run_snapshot( const char* method, Functor&& f )
+            -> decltype( f( std::declval<const graphene::db::state_snapshot&>() ) )
+         {
+            typedef decltype( f( std::declval<const graphene::db::state_snapshot&>() ) ) result_type;
+            if( runs_inline() )
+               return f( *_db.create_snapshot() );
+            call_scope scope( *this, method );
+            return scope.worker().async( [&]() -> result_type {
+               const auto snapshot = _db.create_snapshot();
+               if( snapshot->live() )
+               {
+                  graphene::db::object_database::read_scope lock( _db );
+                  scope.started();
+                  return f( *snapshot );
+               }
+               scope.started();
+               return f( *snapshot );
+            }, method ).wait();
+         }
+
+         /**
+          * Runs f as a single job on one worker under a single read_scope.  The calls f makes through run(),
+          * run_unlocked() and run_snapshot() run right there, one after the other, so they all see the same head
+          * block.  f must not change the database, which would wait for the read_scope f itself holds.
+          */
+         template<typename Functor>
+         auto run_all( const char* method, Functor&& f ) -> decltype( f() )
+         {
+            typedef decltype( f() ) result_type;
+            if( runs_inline() )
+               return f();
+            call_scope scope( *this, method );
+            return scope.worker().async( [&]() -> result_type {
+               graphene::db::object_database::read_scope lock( _db );
+               inline_scope calls_inline( *this );
+               scope.started();
+               return f();
+            }, method ).wait();
+         }
+
+         api_call_stats get_stats()const;
+
+      private:
+         bool runs_inline()const;
+
+         /** makes the calls of the current task to this pool run where they are made for as long as it lives */
+         class inline_scope
+         {
+            public:
+               explicit inline_scope( const api_thread_pool& pool );
+               ~inline_scope();
+            private:
+               inline_scope( const inline_scope& ) = delete;
+               inline_scope& operator=( const inline_scope& ) = delete;
+               const api_thread_pool* _previous;
+         };
+
+         /** counts a call from being handed to a worker until it returns */
+         class call_scope
+         {
+            public:
+               call_scope( api_thread_pool& pool, const char* method );
+               ~call_scope();
+
+               fc::thread& worker()const { return *_worker; }
+               void        started() { _started = fc::time_point::now(); }
+
+            private:
+               api_thread_pool&   _pool;
+               const char*        _method;
+               fc::thread*        _worker;
+               fc::time_point     _queued;
+               fc::time_point     _started;
+         };
+
+         const graphene::chain::database&          _db;
+         vector< std::unique_ptr<fc::thread> >     _threads;
+         std::atomic<uint32_t>                     _next_thread;
+         /**
+          * the pool whose calls run inline in the current fc task, if any; kept per task rather than per
+          * thread because the tasks of a worker share its thread and may yield to each other mid-call
+          */
+         static fc::task_specific_ptr<const api_thread_pool*> _inline_pool;
+
+         mutable std::mutex                        _stats_mutex;
+         uint32_t                                  _queue_depth = 0;
+         uint32_t                                  _max_queue_depth = 0;
+         std::map<string, api_method_stats>        _methods;
+   };
+
+} } // graphene::app
+
+FC_REFLECT( graphene::app::api_method_stats, (method)(calls)(total_latency_us)(total_run_us)(max_latency_us) )
+FC_REFLECT( graphene::app::api_call_stats, (threads)(queue_depth)(max_queue_depth)(methods) )
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/app/api_thread_pool.hpp>
+
+#include <fc/rpc/websocket_api.hpp>
+
+#include <map>
+
+namespace graphene { namespace app {
+
+   class database_api;
+
+   /**
+    * @class batch_websocket_api_connection
+    * @brief websocket_api_connection which also accepts JSON-RPC batches and packed results
+    *
+    * A message holding an array of requests is answered with an array of the replies, in request order, in a
+    * single message.  Notifications in the batch get no reply; a batch of nothing but notifications gets no
+    * message at all.  An element which is not a request gets a JSON-RPC invalid request error in its place.
+    *
+    * A batch of nothing but calls to the database api which only read the state runs as a single job on an
+    * api thread, so all of it sees a single head block.  Any other batch runs on the connection's thread one
+    * request after the other, each read going to the api threads on its own.
+    *
+    * A client may switch the connection to binary results by calling set_encoding with "binary", and back with
+    * "json".  In binary mode the database api calls get_block, get_blocks, get_block_header, get_transaction and
+    * get_objects return the fc::raw serialization of their result as a base64 string; get_objects returns that
+    * of get_packed_objects.  Every other call is answered in JSON as before.
+    */
+   class batch_websocket_api_connection : public fc::rpc::websocket_api_connection
+   {
+      public:
+         batch_websocket_api_connection( fc::http::websocket_connection& c, api_thread_pool* pool );
+
+         /** maximum number of requests in a batch, larger batches are rejected as a whole */
+         static const size_t max_batch_size = 1000;
+
+         /** api is the database api registered as api_id: lets clients ask for binary results of its calls and batch its reads */
+         void enable_binary_results( const std::shared_ptr<database_api>& api, fc::api_id_type api_id );
+
+      private:
+         typedef std::function<std::vector<char>( const fc::variants& args )> packed_method;
+
+         std::string on_batch_message( const std::string& message, bool send_message );
+         std::string on_request( const std::string& message );
+         /** whether request, already checked to be one, is a call to the database api which only reads */
+         bool        is_database_read( const fc::variant& request )const;
+         /** answers set_encoding and calls with binary results, returns false for everything left to the base class */
+         bool        on_encoding_request( const fc::variant& request, std::string& reply );
+
+         api_thread_pool*                      _pool;
+         bool                                  _binary = false;
+         fc::api_id_type                       _database_api_id = 0;
+         std::map<std::string, packed_method>  _packed_methods;
+   };
+
+} } // graphene::app
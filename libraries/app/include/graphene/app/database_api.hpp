@@ -23,6 +23,7 @@
  */
 #pragma once
 
+#include <graphene/app/api_thread_pool.hpp>
 #include <graphene/app/full_account.hpp>
 
 #include <graphene/chain/protocol/types.hpp>
@@ -108,6 +109,13 @@ struct market_trade
    double                     value;
 };
 
+/** an object serialized with fc::raw, its id tells the space and type to unpack data as */
+struct packed_object
+{
+   object_id_type             id;
+   vector<char>               data;
+};
+
 /**
  * @brief The database_api class implements the RPC API for the chain database.
  *
@@ -118,9 +126,16 @@ struct market_trade
 class database_api
 {
    public:
-      database_api(graphene::chain::database& db);
+      /** with an api_thread_pool the calls which only read the state run on its threads */
+      database_api(graphene::chain::database& db, api_thread_pool* pool = nullptr);
       ~database_api();
 
+      /**
+       * Whether the call named method does no more than read the chain state, so it may run on an api thread.
+       * The subscription calls and validate_transaction have to run on the thread applying blocks.
+       */
+      static bool reads_only( const string& method );
+
       /////////////
       // Objects //
       /////////////
@@ -134,6 +149,15 @@ class database_api
        */
       fc::variants get_objects(const vector<object_id_type>& ids)const;
 
+      /**
+       * @brief Get the objects corresponding to the provided IDs, serialized with fc::raw
+       * @param ids IDs of the objects to retrieve
+       * @return The objects retrieved, in the order they are mentioned in ids
+       *
+       * This function has semantics identical to @ref get_objects, but skips building a variant of every object.
+       */
+      vector<optional<packed_object>> get_packed_objects(const vector<object_id_type>& ids)const;
+
       ///////////////////
       // Subscriptions //
       ///////////////////
@@ -141,6 +165,17 @@ class database_api
       void set_subscribe_callback( std::function<void(const variant&)> cb, bool clear_filter );
       void set_pending_transaction_callback( std::function<void(const variant&)> cb );
       void set_block_applied_callback( std::function<void(const variant& block_id)> cb );
+      /**
+       * @brief Receive blocks as they become irreversible
+       * @param cb Called with arrays of consecutive blocks, oldest first
+       * @param start_block_num Number of the first block to send
+       *
+       * Every irreversible block from start_block_num on is sent right away, in arrays of up to 1000 blocks, so a
+       * client can catch up and then follow the chain with this one subscription.  Only one such subscription can
+       * be held, subscribing again replaces it.  The blocks are read from the block log on an api thread, and no
+       * more than two arrays wait to be sent at a time.
+       */
+      void subscribe_to_irreversible_blocks( std::function<void(const variant&)> cb, uint32_t start_block_num );
       /**
        * @brief Stop receiving any notifications
        *
@@ -166,6 +201,14 @@ class database_api
        */
       optional<signed_block> get_block(uint32_t block_num)const;
 
+      /**
+       * @brief Retrieve consecutive full, signed blocks
+       * @param block_num Height of the first block to be returned
+       * @param count Maximum number of blocks to return, up to 1000
+       * @return the blocks from block_num on, ending early at the first block not found
+       */
+      vector<signed_block> get_blocks(uint32_t block_num, uint32_t count)const;
+
       /**
        * @brief used to fetch an individual transaction.
        */
@@ -207,6 +250,37 @@ class database_api
        */
       dynamic_global_property_object get_dynamic_global_properties()const;
 
+      /**
+       * @brief Retrieve hit and miss counters of the recovered signature key cache
+       */
+      signature_cache_stats get_signature_cache_stats()const;
+
+      /**
+       * @brief Retrieve hit and miss counters of the cache of decoded blocks read from the block log
+       */
+      block_cache_stats get_block_cache_stats()const;
+
+      /**
+       * @brief Retrieve live nodes, capacity and memory of the node pools object indexes allocate from
+       */
+      vector<node_pool_stats> get_node_pool_stats()const;
+
+      /**
+       * @brief Retrieve the digest of the object state after a recent block was applied
+       * @param block_num Height of the block
+       * @return the digest, or null if the node does not remember one for that block
+       *
+       * Only available on nodes running with a state digest history.
+       */
+      optional<block_state_digest> get_block_state_digest( uint32_t block_num )const;
+
+      /**
+       * @brief Retrieve latency and queue depth counters of the calls run on the api threads
+       *
+       * Empty unless the node runs read-only calls on api threads.
+       */
+      api_call_stats get_api_call_stats()const;
+
       //////////
       // Keys //
       //////////
@@ -589,20 +663,24 @@ FC_REFLECT( graphene::app::order_book, (base)(quote)(bids)(asks) );
 FC_REFLECT( graphene::app::market_ticker, (base)(quote)(latest)(lowest_ask)(highest_bid)(percent_change)(base_volume)(quote_volume) );
 FC_REFLECT( graphene::app::market_volume, (base)(quote)(base_volume)(quote_volume) );
 FC_REFLECT( graphene::app::market_trade, (date)(price)(amount)(value) );
+FC_REFLECT( graphene::app::packed_object, (id)(data) );
 
 FC_API(graphene::app::database_api,
    // Objects
    (get_objects)
+   (get_packed_objects)
 
    // Subscriptions
    (set_subscribe_callback)
    (set_pending_transaction_callback)
    (set_block_applied_callback)
+   (subscribe_to_irreversible_blocks)
    (cancel_all_subscriptions)
 
    // Blocks and transactions
    (get_block_header)
    (get_block)
+   (get_blocks)
    (get_transaction)
    (get_recent_transaction_by_id)
 
@@ -612,6 +690,11 @@ FC_API(graphene::app::database_api,
    (get_config)
    (get_chain_id)
    (get_dynamic_global_properties)
+   (get_signature_cache_stats)
+   (get_block_cache_stats)
+   (get_node_pool_stats)
+   (get_block_state_digest)
+   (get_api_call_stats)
 
    // Keys
    (get_key_references)
@@ -128,7 +128,8 @@ void_result account_create_evaluator::do_evaluate( const account_create_operatio
       evaluate_buyback_account_options( d, *op.extensions.value.buyback_options );
    verify_account_votes( d, op.options );
 
-   auto& acnt_indx = d.get_index_type<account_index>();
+   const string& name = op.name;
+   auto& acnt_indx = d.search_index<account_index>( [name]( const account_object& a ) { return a.name == name; } );
    if( op.name.size() )
    {
       auto current_account_itr = acnt_indx.indices().get<by_name>().find( op.name );
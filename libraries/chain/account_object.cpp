@@ -176,22 +176,38 @@ void account_member_index::object_removed(const object& obj)
        account_to_account_memberships[item].erase( obj.id );
 }
 
-void account_member_index::about_to_modify(const object& before)
+bool account_member_index::pack_fields( const object& obj, vector<char>& data )const
 {
-   before_key_members.clear();
-   before_account_members.clear();
-   assert( dynamic_cast<const account_object*>(&before) ); // for debug only
-   const account_object& a = static_cast<const account_object&>(before);
-   before_key_members     = get_key_members(a);
-   before_address_members = get_address_members(a);
-   before_account_members = get_account_members(a);
+   assert( dynamic_cast<const account_object*>(&obj) ); // for debug only
+   const account_object& a = static_cast<const account_object&>(obj);
+   fc::datastream<size_t> size_stream;
+   fc::raw::pack( size_stream, a.owner );
+   fc::raw::pack( size_stream, a.active );
+   fc::raw::pack( size_stream, a.options.memo_key );
+   data.resize( size_stream.tellp() );
+   fc::datastream<char*> ds( data.data(), data.size() );
+   fc::raw::pack( ds, a.owner );
+   fc::raw::pack( ds, a.active );
+   fc::raw::pack( ds, a.options.memo_key );
+   return true;
 }
 
-void account_member_index::object_modified(const object& after)
+void account_member_index::fields_modified( const vector<char>& before_fields, const object& after )
 {
     assert( dynamic_cast<const account_object*>(&after) ); // for debug only
     const account_object& a = static_cast<const account_object&>(after);
 
+    account_object before;
+    {
+       fc::datastream<const char*> ds( before_fields.data(), before_fields.size() );
+       fc::raw::unpack( ds, before.owner );
+       fc::raw::unpack( ds, before.active );
+       fc::raw::unpack( ds, before.options.memo_key );
+    }
+    const set<account_id_type> before_account_members = get_account_members(before);
+    const set<public_key_type> before_key_members     = get_key_members(before);
+    const set<address>         before_address_members = get_address_members(before);
+
     {
        set<account_id_type> after_account_members = get_account_members(a);
        vector<account_id_type> removed; removed.reserve(before_account_members.size());
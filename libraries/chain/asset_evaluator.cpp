@@ -51,7 +51,9 @@ void_result asset_create_evaluator::do_evaluate( const asset_create_operation& o
    for( auto id : op.common_options.blacklist_authorities )
       d.get_object(id);
 
-   auto& asset_indx = d.get_index_type<asset_index>().indices().get<by_symbol>();
+   const string& symbol = op.symbol;
+   auto& asset_indx = d.search_index<asset_index>( [symbol]( const asset_object& a ) { return a.symbol == symbol; } )
+                       .indices().get<by_symbol>();
    auto asset_symbol_itr = asset_indx.find( op.symbol );
    FC_ASSERT( asset_symbol_itr == asset_indx.end() );
 
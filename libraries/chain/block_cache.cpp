@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/block_cache.hpp>
+
+namespace graphene { namespace chain {
+
+optional<sealed_block> block_cache::find( uint32_t block_num, const block_id_type& id )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   const auto& idx = _entries.get<by_block_num>();
+   auto itr = idx.find( block_num );
+   if( itr == idx.end() || itr->id != id )
+   {
+      ++_misses;
+      return optional<sealed_block>();
+   }
+   ++_hits;
+   _entries.relocate( _entries.begin(), _entries.project<0>( itr ) );
+   return itr->block;
+}
+
+void block_cache::insert( const sealed_block& block )
+{
+   const uint32_t block_num = block.block_num();
+   const uint32_t packed_size = block.packed_size();
+   std::lock_guard<std::mutex> lock( _mutex );
+   if( packed_size > _capacity )
+      return;
+   auto& idx = _entries.get<by_block_num>();
+   auto itr = idx.find( block_num );
+   if( itr != idx.end() )
+   {
+      _bytes -= itr->packed_size;
+      idx.erase( itr );
+   }
+   evict_to( _capacity - packed_size );
+   _entries.push_front( cache_entry{ block_num, block.id(), block, packed_size } );
+   _bytes += packed_size;
+}
+
+void block_cache::remove( uint32_t block_num )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   auto& idx = _entries.get<by_block_num>();
+   auto itr = idx.find( block_num );
+   if( itr == idx.end() )
+      return;
+   _bytes -= itr->packed_size;
+   idx.erase( itr );
+}
+
+void block_cache::set_capacity( uint64_t capacity )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _capacity = capacity;
+   evict_to( capacity );
+}
+
+void block_cache::clear()
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _entries.clear();
+   _bytes = 0;
+}
+
+block_cache_stats block_cache::get_stats()const
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   block_cache_stats result;
+   result.hits = _hits;
+   result.misses = _misses;
+   result.evictions = _evictions;
+   result.size = _entries.size();
+   result.bytes = _bytes;
+   result.capacity = _capacity;
+   return result;
+}
+
+void block_cache::evict_to( uint64_t bytes )
+{
+   while( _bytes > bytes )
+   {
+      _bytes -= _entries.back().packed_size;
+      _entries.pop_back();
+      ++_evictions;
+   }
+}
+
+} } // graphene::chain
@@ -26,90 +26,266 @@
 #include <fc/io/raw.hpp>
 #include <fc/smart_ref_impl.hpp>
 
-namespace graphene { namespace chain {
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <thread>
 
-struct index_entry
-{
-   uint64_t      block_pos = 0;
-   uint32_t      block_size = 0;
-   block_id_type block_id;
-};
- }}
-FC_REFLECT( graphene::chain::index_entry, (block_pos)(block_size)(block_id) );
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace graphene { namespace chain {
 
-void block_database::open( const fc::path& dbdir )
-{ try {
-   fc::create_directories(dbdir);
-   _block_num_to_pos.exceptions(std::ios_base::failbit | std::ios_base::badbit);
-   _blocks.exceptions(std::ios_base::failbit | std::ios_base::badbit);
+namespace {
+   uint64_t file_size( int fd )
+   {
+      struct stat st;
+      FC_ASSERT( fstat( fd, &st ) == 0, "fstat failed: ${e}", ("e", strerror(errno)) );
+      return uint64_t( st.st_size );
+   }
 
-   if( !fc::exists( dbdir/"index" ) )
+   bool is_empty( const index_entry& e )
    {
-     _block_num_to_pos.open( (dbdir/"index").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
+      return e.block_size == 0 && e.block_id == block_id_type();
    }
-   else
+}
+
+block_database::block_database()
+: _segments( new std::atomic<char*>[max_segments] ), _entry_count( 0 ), _readable( false ), _readers( 0 )
+{
+   for( uint32_t i = 0; i < max_segments; ++i )
+      _segments[i].store( nullptr, std::memory_order_relaxed );
+}
+
+block_database::~block_database()
+{
+   close();
+}
+
+void block_database::open( const fc::path& dbdir, bool read_only )
+{ try {
+   FC_ASSERT( !is_open() );
+   _read_only = read_only;
+   const int flags = read_only ? O_RDONLY : O_RDWR | O_CREAT;
+   if( !read_only )
+      fc::create_directories(dbdir);
+
+   _index_fd = ::open( (dbdir/"index").generic_string().c_str(), flags, 0644 );
+   FC_ASSERT( _index_fd >= 0, "Unable to open ${f}: ${e}", ("f", dbdir/"index")("e", strerror(errno)) );
+   _blocks_fd = ::open( (dbdir/"blocks").generic_string().c_str(), flags, 0644 );
+   if( _blocks_fd < 0 )
    {
-     _block_num_to_pos.open( (dbdir/"index").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+      const int error = errno;
+      ::close( _index_fd );
+      _index_fd = -1;
+      FC_THROW( "Unable to open ${f}: ${e}", ("f", dbdir/"blocks")("e", strerror(error)) );
    }
-} FC_CAPTURE_AND_RETHROW( (dbdir) ) }
+   _blocks_end = file_size( _blocks_fd );
+
+   // the index of a block_database which was not closed still has the zeroes the last segment was padded with
+   uint32_t count = uint32_t( std::min<uint64_t>( file_size( _index_fd ) / sizeof(index_entry), (uint64_t(1) << 32) - 1 ) );
+   for( uint32_t segment = 0; uint64_t(segment) * entries_per_segment < count; ++segment )
+      map_segment( segment );
+   _entry_count.store( count, std::memory_order_release );
+   index_entry e;
+   while( count > 0 && read_entry( count - 1, e ) && is_empty( e ) )
+      --count;
+   _entry_count.store( count, std::memory_order_release );
+   _readable.store( true );
+} FC_CAPTURE_AND_RETHROW( (dbdir)(read_only) ) }
 
 bool block_database::is_open()const
 {
-  return _blocks.is_open();
+  return _blocks_fd >= 0;
 }
 
 void block_database::close()
 {
-  _blocks.close();
-  _block_num_to_pos.close();
+   if( !is_open() )
+      return;
+   // a read_guard taken from here on finds the block_database closed, those taken before are waited for
+   _readable.store( false );
+   while( _readers.load() != 0 )
+      std::this_thread::yield();
+   for( uint32_t i = 0; i < max_segments; ++i )
+   {
+      char* segment = _segments[i].exchange( nullptr );
+      if( segment != nullptr )
+         munmap( segment, segment_bytes );
+   }
+   // the padding of the last segment stays, another process may have the index mapped up to its end
+   ::close( _index_fd );
+   ::close( _blocks_fd );
+   _cache.clear();
+   _index_fd = -1;
+   _blocks_fd = -1;
+   _entry_count.store( 0 );
 }
 
 void block_database::flush()
 {
-  _blocks.flush();
-  _block_num_to_pos.flush();
+}
+
+block_database::read_guard::read_guard( const block_database& db )
+:_db( db )
+{
+   _db._readers.fetch_add( 1 );
+   _readable = _db._readable.load();
+}
+
+block_database::read_guard::~read_guard()
+{
+   _db._readers.fetch_sub( 1 );
+}
+
+char* block_database::map_segment( uint32_t segment )
+{
+   FC_ASSERT( segment < max_segments );
+   char* data = _segments[segment].load( std::memory_order_acquire );
+   if( data != nullptr )
+      return data;
+
+   const off_t offset = off_t( segment_bytes * segment );
+   int prot = PROT_READ;
+   if( !_read_only )
+   {
+      // the whole segment must be backed by disk space before it is written to through the mapping, a write to
+      // a page of a sparse file which cannot be allocated raises SIGBUS instead of failing here
+      if( file_size( _index_fd ) < uint64_t(offset) + segment_bytes )
+      {
+         const int error = posix_fallocate( _index_fd, offset, off_t(segment_bytes) );
+         FC_ASSERT( error == 0, "Unable to grow the block index: ${e}", ("e", strerror(error)) );
+      }
+      prot |= PROT_WRITE;
+   }
+   void* mapped = mmap( nullptr, segment_bytes, prot, MAP_SHARED, _index_fd, offset );
+   FC_ASSERT( mapped != MAP_FAILED, "Unable to map the block index: ${e}", ("e", strerror(errno)) );
+   data = static_cast<char*>( mapped );
+   _segments[segment].store( data, std::memory_order_release );
+   return data;
+}
+
+bool block_database::read_entry( uint32_t block_num, index_entry& e )const
+{
+   if( block_num >= _entry_count.load( std::memory_order_acquire ) )
+      return false;
+   const char* segment = _segments[block_num / entries_per_segment].load( std::memory_order_acquire );
+   if( segment == nullptr )
+      return false;
+   memcpy( (char*)&e, segment + sizeof(index_entry) * (block_num % entries_per_segment), sizeof(e) );
+   return true;
+}
+
+void block_database::write_entry( uint32_t block_num, const index_entry& e )
+{
+   FC_ASSERT( !_read_only );
+   char* segment = map_segment( block_num / entries_per_segment );
+   // readers which find the entry must also find the block it points to
+   std::atomic_thread_fence( std::memory_order_release );
+   memcpy( segment + sizeof(index_entry) * (block_num % entries_per_segment), (const char*)&e, sizeof(e) );
+   if( block_num >= _entry_count.load( std::memory_order_relaxed ) )
+      _entry_count.store( block_num + 1, std::memory_order_release );
+}
+
+void block_database::read_blocks( uint64_t pos, char* data, size_t size )const
+{
+   while( size > 0 )
+   {
+      const ssize_t n = pread( _blocks_fd, data, size, off_t(pos) );
+      if( n < 0 && errno == EINTR )
+         continue;
+      FC_ASSERT( n > 0, "Unable to read the blocks file at ${p}: ${e}", ("p", pos)("e", n == 0 ? "end of file" : strerror(errno)) );
+      data += n;
+      pos  += uint64_t(n);
+      size -= size_t(n);
+   }
+}
+
+optional<sealed_block> block_database::read_block( uint32_t block_num, const index_entry& e )const
+{
+   if( e.block_size == 0 )
+      return optional<sealed_block>();
+   optional<sealed_block> cached = _cache.find( block_num, e.block_id );
+   if( cached )
+      return cached;
+   try
+   {
+      vector<char> data( e.block_size );
+      read_blocks( e.block_pos, data.data(), data.size() );
+      signed_block b;
+      fc::raw::unpack( data, b );
+      sealed_block result( std::move(b), std::move(data) );
+      if( result.id() != e.block_id )
+         return optional<sealed_block>();
+      _cache.insert( result );
+      return result;
+   }
+   catch (const fc::exception&)
+   {
+   }
+   catch (const std::exception&)
+   {
+   }
+   return optional<sealed_block>();
 }
 
 void block_database::store( const block_id_type& _id, const signed_block& b )
 {
+   FC_ASSERT( !_read_only );
    block_id_type id = _id;
    if( id == block_id_type() )
    {
       id = b.id();
       elog( "id argument of block_database::store() was not initialized for block ${id}", ("id", id) );
    }
-   auto num = block_header::num_from_id(id);
-   _block_num_to_pos.seekp( sizeof( index_entry ) * num );
+   append( id, fc::raw::pack( b ) );
+   _cache.remove( block_header::num_from_id(id) );
+}
+
+void block_database::store( const sealed_block& b )
+{
+   FC_ASSERT( !_read_only );
+   append( b.id(), b.packed() );
+   _cache.insert( b );
+}
+
+void block_database::append( const block_id_type& id, const vector<char>& vec )
+{
    index_entry e;
-   _blocks.seekp( 0, _blocks.end );
-   auto vec = fc::raw::pack( b );
-   e.block_pos  = _blocks.tellp();
+   e.block_pos  = _blocks_end;
    e.block_size = vec.size();
    e.block_id   = id;
-   _blocks.write( vec.data(), vec.size() );
-   _block_num_to_pos.write( (char*)&e, sizeof(e) );
+
+   const char* data = vec.data();
+   size_t size = vec.size();
+   uint64_t pos = _blocks_end;
+   while( size > 0 )
+   {
+      const ssize_t n = pwrite( _blocks_fd, data, size, off_t(pos) );
+      if( n < 0 && errno == EINTR )
+         continue;
+      FC_ASSERT( n > 0, "Unable to append block ${id}: ${e}", ("id", id)("e", strerror(errno)) );
+      data += n;
+      pos  += uint64_t(n);
+      size -= size_t(n);
+   }
+   _blocks_end = pos;
+   write_entry( block_header::num_from_id(id), e );
 }
 
 void block_database::remove( const block_id_type& id )
 { try {
    index_entry e;
-   auto index_pos = sizeof(e)*block_header::num_from_id(id);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   if( !read_entry( block_header::num_from_id(id), e ) )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block ${id} not contained in block database", ("id", id));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
    if( e.block_id == id )
    {
       e.block_size = 0;
-      _block_num_to_pos.seekp( sizeof(e)*block_header::num_from_id(id) );
-      _block_num_to_pos.write( (char*)&e, sizeof(e) );
+      write_entry( block_header::num_from_id(id), e );
+      _cache.remove( block_header::num_from_id(id) );
    }
 } FC_CAPTURE_AND_RETHROW( (id) ) }
 
@@ -118,165 +294,171 @@ bool block_database::contains( const block_id_type& id )const
    if( id == block_id_type() )
       return false;
 
+   read_guard guard( *this );
    index_entry e;
-   auto index_pos = sizeof(e)*block_header::num_from_id(id);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   if( !guard.readable() || !read_entry( block_header::num_from_id(id), e ) )
       return false;
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
    return e.block_id == id && e.block_size > 0;
 }
 
 block_id_type block_database::fetch_block_id( uint32_t block_num )const
 {
    assert( block_num != 0 );
+   read_guard guard( *this );
    index_entry e;
-   auto index_pos = sizeof(e)*block_num;
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= int64_t(index_pos) )
+   if( !guard.readable() || !read_entry( block_num, e ) )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block number ${block_num} not contained in block database", ("block_num", block_num));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
    FC_ASSERT( e.block_id != block_id_type(), "Empty block_id in block_database (maybe corrupt on disk?)" );
    return e.block_id;
 }
 
 optional<signed_block> block_database::fetch_optional( const block_id_type& id )const
 {
-   try
-   {
-      index_entry e;
-      auto index_pos = sizeof(e)*block_header::num_from_id(id);
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
-         return {};
+   auto block = fetch_sealed( id );
+   if( !block )
+      return optional<signed_block>();
+   return block->block();
+}
 
-      _block_num_to_pos.seekg( index_pos );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
+optional<signed_block> block_database::fetch_by_number( uint32_t block_num )const
+{
+   auto block = fetch_sealed_by_number( block_num );
+   if( !block )
+      return optional<signed_block>();
+   return block->block();
+}
 
-      if( e.block_id != id ) return optional<signed_block>();
+optional<sealed_block> block_database::fetch_sealed( const block_id_type& id )const
+{
+   read_guard guard( *this );
+   index_entry e;
+   if( !guard.readable() || !read_entry( block_header::num_from_id(id), e ) || e.block_id != id )
+      return optional<sealed_block>();
+   return read_block( block_header::num_from_id(id), e );
+}
 
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      if (e.block_size)
-         _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
+optional<sealed_block> block_database::fetch_sealed_by_number( uint32_t block_num )const
+{
+   read_guard guard( *this );
+   index_entry e;
+   if( !guard.readable() || !read_entry( block_num, e ) )
+      return optional<sealed_block>();
+   return read_block( block_num, e );
+}
+
+/**
+ * Reads every run of blocks which lie back to back in the blocks file, which is all of them unless the range
+ * spans a fork switch, with a single pread().
+ */
+vector<signed_block> block_database::fetch_range( uint32_t block_num, uint32_t count )const
+{
+   vector<signed_block> result;
+   read_guard guard( *this );
+   if( !guard.readable() )
       return result;
-   }
-   catch (const fc::exception&)
-   {
-   }
-   catch (const std::exception&)
+   vector<index_entry> entries;
+   entries.reserve( std::min<uint32_t>( count, 1024 ) );
+   index_entry e;
+   for( uint32_t i = 0; i < count && uint64_t(block_num) + i <= std::numeric_limits<uint32_t>::max(); ++i )
    {
+      if( !read_entry( block_num + i, e ) || e.block_size == 0 )
+         break;
+      entries.push_back( e );
    }
-   return optional<signed_block>();
-}
 
-optional<signed_block> block_database::fetch_by_number( uint32_t block_num )const
-{
    try
    {
-      index_entry e;
-      auto index_pos = sizeof(e)*block_num;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
-         return {};
-
-      _block_num_to_pos.seekg( index_pos, _block_num_to_pos.beg );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      result.reserve( entries.size() );
+      vector<char> data;
+      for( size_t first = 0; first < entries.size(); )
+      {
+         size_t end = first + 1;
+         uint64_t run_size = entries[first].block_size;
+         while( end < entries.size() && entries[end].block_pos == entries[end-1].block_pos + entries[end-1].block_size )
+            run_size += entries[end++].block_size;
+
+         data.resize( run_size );
+         read_blocks( entries[first].block_pos, data.data(), data.size() );
+
+         fc::datastream<const char*> ds( data.data(), data.size() );
+         for( ; first < end; ++first )
+         {
+            signed_block b;
+            fc::raw::unpack( ds, b );
+            FC_ASSERT( b.id() == entries[first].block_id );
+            result.push_back( std::move(b) );
+         }
+      }
    }
+   // the blocks read intact up to a failure are still returned
    catch (const fc::exception&)
    {
    }
    catch (const std::exception&)
    {
    }
-   return optional<signed_block>();
+   return result;
 }
 
 optional<signed_block> block_database::last()const
 {
-   try
+   read_guard guard( *this );
+   if( !guard.readable() )
+      return optional<signed_block>();
+   index_entry e;
+   for( uint32_t num = _entry_count.load( std::memory_order_acquire ); num > 0; --num )
    {
-      index_entry e;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-
-      if( _block_num_to_pos.tellp() < sizeof(index_entry) )
-         return optional<signed_block>();
-
-      _block_num_to_pos.seekg( -sizeof(index_entry), _block_num_to_pos.end );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-      uint64_t pos = _block_num_to_pos.tellg();
-      while( e.block_size == 0 && pos > 0 )
+      if( read_entry( num - 1, e ) && e.block_size != 0 )
       {
-         pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
+         auto block = read_block( num - 1, e );
+         if( !block )
+            return optional<signed_block>();
+         return block->block();
       }
-
-      if( e.block_size == 0 )
-         return optional<signed_block>();
-
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      return result;
-   }
-   catch (const fc::exception&)
-   {
-   }
-   catch (const std::exception&)
-   {
    }
    return optional<signed_block>();
 }
 
 optional<block_id_type> block_database::last_id()const
 {
-   try
+   read_guard guard( *this );
+   if( !guard.readable() )
+      return optional<block_id_type>();
+   index_entry e;
+   for( uint32_t num = _entry_count.load( std::memory_order_acquire ); num > 0; --num )
    {
-      index_entry e;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
+      if( read_entry( num - 1, e ) && e.block_size != 0 )
+         return e.block_id;
+   }
+   return optional<block_id_type>();
+}
 
-      if( _block_num_to_pos.tellp() < sizeof(index_entry) )
-         return optional<block_id_type>();
+block_database_reader::block_database_reader( const fc::path& dbdir )
+{
+   // every block is read once at most
+   _blocks.get_cache().set_capacity( 0 );
+   _blocks.open( dbdir, true );
+}
 
-      _block_num_to_pos.seekg( -sizeof(index_entry), _block_num_to_pos.end );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-      uint64_t pos = _block_num_to_pos.tellg();
-      while( e.block_size == 0 && pos > 0 )
-      {
-         pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
-      }
+optional<signed_block> block_database_reader::fetch_by_number( uint32_t block_num )const
+{
+   return _blocks.fetch_by_number( block_num );
+}
 
-      if( e.block_size == 0 )
-         return optional<block_id_type>();
+optional<sealed_block> block_database_reader::fetch_sealed( const block_id_type& id )const
+{
+   return _blocks.fetch_sealed( id );
+}
 
-      return e.block_id;
-   }
-   catch (const fc::exception&)
-   {
-   }
-   catch (const std::exception&)
-   {
-   }
-   return optional<block_id_type>();
+optional<sealed_block> block_database_reader::fetch_sealed_by_number( uint32_t block_num )const
+{
+   return _blocks.fetch_sealed_by_number( block_num );
 }
 
+vector<signed_block> block_database_reader::fetch_range( uint32_t block_num, uint32_t count )const
+{
+   return _blocks.fetch_range( block_num, count );
+}
 
 } }
@@ -33,7 +33,9 @@ namespace graphene { namespace chain {
 
 asset database::get_balance(account_id_type owner, asset_id_type asset_id) const
 {
-   auto& index = get_index_type<account_balance_index>().indices().get<by_account_asset>();
+   auto& index = search_index<account_balance_index>( [owner, asset_id]( const account_balance_object& b ) {
+      return b.owner == owner && b.asset_type == asset_id;
+   } ).indices().get<by_account_asset>();
    auto itr = index.find(boost::make_tuple(owner, asset_id));
    if( itr == index.end() )
       return asset(0, asset_id);
@@ -55,7 +57,10 @@ void database::adjust_balance(account_id_type account, asset delta )
    if( delta.amount == 0 )
       return;
 
-   auto& index = get_index_type<account_balance_index>().indices().get<by_account_asset>();
+   const asset_id_type asset_id = delta.asset_id;
+   auto& index = search_index<account_balance_index>( [account, asset_id]( const account_balance_object& b ) {
+      return b.owner == account && b.asset_type == asset_id;
+   } ).indices().get<by_account_asset>();
    auto itr = index.find(boost::make_tuple(account, delta.asset_id));
    if(itr == index.end())
    {
@@ -63,7 +68,7 @@ void database::adjust_balance(account_id_type account, asset delta )
                  ("a",account(*this).name)
                  ("b",to_pretty_string(asset(0,delta.asset_id)))
                  ("r",to_pretty_string(-delta)));
-      create<account_balance_object>([account,&delta](account_balance_object& b) {
+      create_in<account_balance_index>([account,&delta](account_balance_object& b) {
          b.owner = account;
          b.asset_type = delta.asset_id;
          b.balance = delta.amount.value;
@@ -71,7 +76,7 @@ void database::adjust_balance(account_id_type account, asset delta )
    } else {
       if( delta.amount < 0 )
          FC_ASSERT( itr->get_balance() >= -delta, "Insufficient Balance: ${a}'s balance of ${b} is less than required ${r}", ("a",account(*this).name)("b",to_pretty_string(itr->get_balance()))("r",to_pretty_string(-delta)));
-      modify(*itr, [delta](account_balance_object& b) {
+      modify_in<account_balance_index>(*itr, [delta](account_balance_object& b) {
          b.adjust_balance(delta);
       });
    }
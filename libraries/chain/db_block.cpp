@@ -26,6 +26,7 @@
 #include <graphene/chain/db_with.hpp>
 #include <graphene/chain/hardfork.hpp>
 
+#include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/block_summary_object.hpp>
 #include <graphene/chain/global_property_object.hpp>
 #include <graphene/chain/operation_history_object.hpp>
@@ -38,8 +39,56 @@
 
 #include <fc/smart_ref_impl.hpp>
 
+#include <algorithm>
+#include <future>
+#include <map>
+#include <set>
+#include <unordered_set>
+
 namespace graphene { namespace chain {
 
+namespace {
+   /** records what the database is asked for for as long as it lives */
+   struct read_recording
+   {
+      read_recording( const database& db, graphene::db::read_set& reads ):_db(db) { _db.record_reads( &reads ); }
+      ~read_recording() { _db.record_reads( nullptr ); }
+      const database& _db;
+   };
+
+   /** whether the dynamic globals differ in more than the head block fields, which every block changes */
+   bool globals_differ_beyond_head( dynamic_global_property_object before, const dynamic_global_property_object& after )
+   {
+      before.random = after.random;
+      before.head_block_number = after.head_block_number;
+      before.head_block_id = after.head_block_id;
+      before.time = after.time;
+      before.current_witness = after.current_witness;
+      before.witness_budget = after.witness_budget;
+      before.recently_missed_count = after.recently_missed_count;
+      before.current_aslot = after.current_aslot;
+      before.recent_slots_filled = after.recent_slots_filled;
+      before.dynamic_flags = after.dynamic_flags;
+      before.last_irreversible_block_num = after.last_irreversible_block_num;
+      return fc::raw::pack( before ) != fc::raw::pack( after );
+   }
+
+   struct fee_visitor
+   {
+      typedef void result_type;
+
+      asset            fee;
+      account_id_type  payer;
+
+      template<typename Op>
+      void operator()( const Op& op )
+      {
+         fee = op.fee;
+         payer = op.fee_payer();
+      }
+   };
+}
+
 bool database::is_known_block( const block_id_type& id )const
 {
    return _fork_db.is_known_block(id) || _block_id_to_block.contains(id);
@@ -61,21 +110,50 @@ block_id_type  database::get_block_id_for_num( uint32_t block_num )const
 } FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
 optional<signed_block> database::fetch_block_by_id( const block_id_type& id )const
+{
+   auto b = fetch_sealed_block_by_id( id );
+   if( !b )
+      return optional<signed_block>();
+   return b->block();
+}
+
+optional<signed_block> database::fetch_block_by_number( uint32_t num )const
+{
+   auto b = fetch_sealed_block_by_number( num );
+   if( !b )
+      return optional<signed_block>();
+   return b->block();
+}
+
+optional<sealed_block> database::fetch_sealed_block_by_id( const block_id_type& id )const
 {
    auto b = _fork_db.fetch_block( id );
    if( !b )
-      return _block_id_to_block.fetch_optional(id);
+      return _block_id_to_block.fetch_sealed(id);
    return b->data;
 }
 
-optional<signed_block> database::fetch_block_by_number( uint32_t num )const
+optional<sealed_block> database::fetch_sealed_block_by_number( uint32_t num )const
 {
    auto results = _fork_db.fetch_block_by_number(num);
    if( results.size() == 1 )
       return results[0]->data;
    else
-      return _block_id_to_block.fetch_by_number(num);
-   return optional<signed_block>();
+      return _block_id_to_block.fetch_sealed_by_number(num);
+}
+
+vector<signed_block> database::fetch_blocks_by_number( uint32_t num, uint32_t count )const
+{
+   // the block database holds every applied block, only the ones the fork database alone knows are fetched one by one
+   vector<signed_block> result = _block_id_to_block.fetch_range( num, count );
+   while( result.size() < count )
+   {
+      auto block = fetch_block_by_number( num + uint32_t(result.size()) );
+      if( !block )
+         break;
+      result.push_back( std::move(*block) );
+   }
+   return result;
 }
 
 const signed_transaction& database::get_recent_transaction(const transaction_id_type& trx_id) const
@@ -112,21 +190,38 @@ std::vector<block_id_type> database::get_block_ids_on_fork(block_id_type head_of
  */
 bool database::push_block(const signed_block& new_block, uint32_t skip)
 {
-//   idump((new_block.block_num())(new_block.id())(new_block.timestamp)(new_block.previous));
+   return push_block( sealed_block( new_block ), skip );
+}
+
+bool database::push_block(const sealed_block& new_block, uint32_t skip)
+{
+//   idump((new_block.block_num())(new_block.id())(new_block->timestamp)(new_block->previous));
+   // recover signatures before touching any state
+   if( !(skip & (skip_transaction_signatures | skip_authority_check)) )
+      precompute_signature_keys( new_block.block() );
+
+   // api threads reading the state wait until the block is applied completely
+   write_scope lock( *this );
    bool result;
    detail::with_skip_flags( *this, skip, [&]()
    {
-      detail::without_pending_transactions( *this, std::move(_pending_tx),
+      detail::without_pending_transactions( *this, _pending_tx.release(),
       [&]()
       {
          result = _push_block(new_block);
       });
    });
+   if( _state_persistence_interval > 0 )
+      persist_irreversible_state();
    return result;
 }
 
-bool database::_push_block(const signed_block& new_block)
+bool database::_push_block(const sealed_block& new_block)
 { try {
+   // The candidate was assembled on the current head as part of the pending state, which is rebuilt after the
+   // block without adding to it.  Whether the head changes or not, the witness plugin prepares a new one.
+   _block_candidate.reset();
+
    uint32_t skip = get_node_properties().skip_flags;
    if( !(skip&skip_fork_db) )
    {
@@ -135,7 +230,7 @@ bool database::_push_block(const signed_block& new_block)
 
       shared_ptr<fork_item> new_head = _fork_db.push_block(new_block);
       //If the head block from the longest chain does not build off of the current head, we need to switch forks.
-      if( new_head->data.previous != head_block_id() )
+      if( new_head->previous_id() != head_block_id() )
       {
          //If the newly pushed block is the same height as head, we get head back in new_head
          //Only switch forks if new_head is actually higher than head
@@ -145,7 +240,7 @@ bool database::_push_block(const signed_block& new_block)
             auto branches = _fork_db.fetch_branch_from(new_head->data.id(), head_block_id());
 
             // pop blocks until we hit the forked block
-            while( head_block_id() != branches.second.back()->data.previous )
+            while( head_block_id() != branches.second.back()->previous_id() )
                pop_block();
 
             // push all blocks on the new fork
@@ -156,7 +251,7 @@ bool database::_push_block(const signed_block& new_block)
                 try {
                    undo_database::session session = _undo_db.start_undo_session();
                    apply_block( (*ritr)->data, skip );
-                   _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
+                   _block_id_to_block.store( (*ritr)->data );
                    session.commit();
                 }
                 catch ( const fc::exception& e ) { except = e; }
@@ -172,7 +267,7 @@ bool database::_push_block(const signed_block& new_block)
                    _fork_db.set_head( branches.second.front() );
 
                    // pop all blocks from the bad fork
-                   while( head_block_id() != branches.second.back()->data.previous )
+                   while( head_block_id() != branches.second.back()->previous_id() )
                       pop_block();
 
                    // restore all blocks from the good fork
@@ -180,7 +275,7 @@ bool database::_push_block(const signed_block& new_block)
                    {
                       auto session = _undo_db.start_undo_session();
                       apply_block( (*ritr)->data, skip );
-                      _block_id_to_block.store( new_block.id(), (*ritr)->data );
+                      _block_id_to_block.store( (*ritr)->data );
                       session.commit();
                    }
                    throw *except;
@@ -195,7 +290,7 @@ bool database::_push_block(const signed_block& new_block)
    try {
       auto session = _undo_db.start_undo_session();
       apply_block(new_block, skip);
-      _block_id_to_block.store(new_block.id(), new_block);
+      _block_id_to_block.store(new_block);
       session.commit();
    } catch ( const fc::exception& e ) {
       elog("Failed to push new block:\n${e}", ("e", e.to_detail_string()));
@@ -204,7 +299,7 @@ bool database::_push_block(const signed_block& new_block)
    }
 
    return false;
-} FC_CAPTURE_AND_RETHROW( (new_block) ) }
+} FC_CAPTURE_AND_RETHROW( (new_block.block()) ) }
 
 /**
  * Attempts to push the transaction into the pending queue
@@ -217,6 +312,7 @@ bool database::_push_block(const signed_block& new_block)
  */
 processed_transaction database::push_transaction( const signed_transaction& trx, uint32_t skip )
 { try {
+   write_scope lock( *this );
    processed_transaction result;
    detail::with_skip_flags( *this, skip, [&]()
    {
@@ -226,32 +322,380 @@ processed_transaction database::push_transaction( const signed_transaction& trx,
 } FC_CAPTURE_AND_RETHROW( (trx) ) }
 
 processed_transaction database::_push_transaction( const signed_transaction& trx )
+{
+   return _push_transaction( trx, trx.id() );
+}
+
+processed_transaction database::_push_transaction( const signed_transaction& trx, const transaction_id_type& trx_id )
 {
    // If this is the first transaction pushed after applying a block, start a new undo session.
    // This allows us to quickly rewind to the clean state of the head block, in case a new block arrives.
    if( !_pending_tx_session.valid() )
       _pending_tx_session = _undo_db.start_undo_session();
 
+   pending_transaction_ptr pending = apply_pending_transaction( trx, trx_id, true );
+
+   // notify anyone listening to pending transactions
+   on_pending_transaction( trx );
+   return pending->trx;
+}
+
+pending_transaction_ptr database::apply_pending_transaction( const signed_transaction& trx, const transaction_id_type& trx_id,
+                                                             bool notify )
+{
+   // it could not go into the block being assembled, nor into any block after it
+   if( _block_candidate.valid() )
+      FC_ASSERT( trx.expiration >= _block_candidate->when,
+                 "Transaction expires at ${e}, before the next block at ${w}",
+                 ("e", trx.expiration)("w", _block_candidate->when) );
+
+   auto pending = std::make_shared<pending_transaction>();
+   pending->id = trx_id;
+   pending->packed_size = fc::raw::pack_size( trx );
+   pending->core_fees = get_core_fees( trx, pending->fee_payer );
+   FC_ASSERT( _pending_tx.would_admit( *pending ),
+              "The pending transaction pool is full of transactions paying at least ${f} per kilobyte",
+              ("f", pending_transaction_pool::fee_per_kbyte( pending->core_fees, pending->packed_size )) );
+
    // Create a temporary undo session as a child of _pending_tx_session.
    // The temporary session will be discarded by the destructor if
    // _apply_transaction fails.  If we make it to merge(), we
    // apply the changes.
 
    auto temp_session = _undo_db.start_undo_session();
-   auto processed_trx = _apply_transaction( trx );
-   _pending_tx.push_back(processed_trx);
+   const uint64_t first_seq = _undo_db.journal().next_seq();
+   {
+      read_recording recording( *this, pending->reads );
+      pending->trx = _apply_transaction( trx, trx_id );
+   }
+   record_pending_effects( *pending, first_seq );
 
-   notify_changed_objects();
+   // while a block candidate is being assembled the pending state is that block, what does not fit waits
+   size_t candidate_size = 0;
+   if( _block_candidate.valid() )
+   {
+      candidate_size = _block_candidate->size + fc::raw::pack_size( pending->trx );
+      pending->postponed = candidate_size >= get_global_properties().parameters.maximum_block_size;
+   }
+   // whatever is evicted stays in the pending state until it is rebuilt, the transaction itself must not
+   FC_ASSERT( add_pending_transaction( pending ),
+              "The pending transaction pool is full of transactions paying at least ${f} per kilobyte",
+              ("f", pending->fee_per_kbyte) );
+   if( pending->postponed )
+      return pending;
+   if( _block_candidate.valid() )
+   {
+      _block_candidate->size = candidate_size;
+      _block_candidate->transactions.push_back( pending->trx );
+   }
+
+   if( notify )
+      notify_changed_objects();
    // The transaction applied successfully. Merge its changes into the pending block session.
    temp_session.merge();
+   return pending;
+}
 
-   // notify anyone listening to pending transactions
-   on_pending_transaction( trx );
-   return processed_trx;
+share_type database::get_core_fees( const signed_transaction& trx, account_id_type& fee_payer )const
+{
+   share_type result;
+   for( const operation& op : trx.operations )
+   {
+      fee_visitor v;
+      op.visit( v );
+      if( &op == &trx.operations.front() )
+         fee_payer = v.payer;
+      if( v.fee.amount <= 0 )
+         continue;
+      if( v.fee.asset_id == asset_id_type() )
+         result += v.fee.amount;
+      else if( const asset_object* fee_asset = find( v.fee.asset_id ) )
+         result += ( v.fee * fee_asset->options.core_exchange_rate ).amount;
+   }
+   return result;
+}
+
+bool database::add_pending_transaction( const pending_transaction_ptr& pending )
+{
+   vector<pending_transaction_ptr> evicted = _pending_tx.insert( pending );
+   _pending_tx_stats.evicted += evicted.size();
+   auto itr = std::find( evicted.begin(), evicted.end(), pending );
+   const bool admitted = itr == evicted.end();
+   if( !admitted )
+      evicted.erase( itr );
+   drop_pending_transactions( evicted );
+   return admitted;
+}
+
+void database::drop_pending_transactions( const vector<pending_transaction_ptr>& dropped )
+{
+   // the effects stay in the pending state until it is rebuilt, nothing may be replayed on top of them then
+   for( const pending_transaction_ptr& tx : dropped )
+   {
+      if( tx->postponed )
+         continue;
+      for( const auto& effect : tx->writes )
+         _dropped_writes.push_back( effect );
+      if( !tx->replayable )
+         _dropped_unrecorded = true;
+   }
+}
+
+void database::record_pending_effects( pending_transaction& pending, uint64_t first_seq )const
+{
+   auto& objects = pending.reads.objects;
+   std::sort( objects.begin(), objects.end() );
+   objects.erase( std::unique( objects.begin(), objects.end() ), objects.end() );
+   // the duplicate check searches the transactions, is_known_transaction() decides about those instead
+   auto& indexes = pending.reads.indexes;
+   indexes.erase( std::remove( indexes.begin(), indexes.end(),
+                               std::make_pair( uint8_t(transaction_object::space_id), uint8_t(transaction_object::type_id) ) ),
+                  indexes.end() );
+   std::sort( indexes.begin(), indexes.end() );
+   indexes.erase( std::unique( indexes.begin(), indexes.end() ), indexes.end() );
+
+   pending.replayable = _undo_db.enabled();
+   if( !pending.replayable )
+      return;
+
+   vector<const graphene::db::undo_record*> records;
+   _undo_db.journal().first_records_since( first_seq, records );
+   pending.writes.reserve( records.size() );
+   for( const graphene::db::undo_record* rec : records )
+   {
+      // a replayed transaction gets a transaction_object of its own
+      if( rec->id.space() == transaction_object::space_id && rec->id.type() == transaction_object::type_id )
+         continue;
+      // an object which was created and removed again only advanced the next id of its index
+      if( rec->kind == graphene::db::undo_record_kind::id_reserved )
+      {
+         pending.replayable = false;
+         pending.writes.clear();
+         return;
+      }
+
+      pending_object_effect effect;
+      effect.id = rec->id;
+      const object* obj = find_object( rec->id );
+      if( obj == nullptr )
+         effect.kind = graphene::db::undo_record_kind::removed;
+      else
+      {
+         effect.kind = rec->kind == graphene::db::undo_record_kind::created ? graphene::db::undo_record_kind::created
+                                                                            : graphene::db::undo_record_kind::modified;
+         effect.value.resize( obj->packed_size() );
+         obj->pack_to( effect.value.data(), effect.value.size() );
+      }
+      pending.writes.push_back( std::move(effect) );
+   }
+}
+
+bool database::replay_pending_transaction( const pending_transaction& pending )
+{
+   const uint32_t skip = get_node_properties().skip_flags;
+   try {
+      auto temp_session = _undo_db.start_undo_session();
+      if( !(skip & skip_transaction_dupe_check) )
+      {
+         create_in<transaction_index>([&pending](transaction_object& transaction) {
+            transaction.trx_id = pending.id;
+            transaction.trx = pending.trx;
+         });
+      }
+      for( const pending_object_effect& effect : pending.writes )
+      {
+         switch( effect.kind )
+         {
+            case graphene::db::undo_record_kind::created:
+            {
+               index& idx = get_mutable_index( effect.id );
+               // ids are handed out in order, someone else got this one
+               FC_ASSERT( idx.get_next_id() == effect.id );
+               idx.create( [&effect]( object& o ) { o.unpack_from( effect.value.data(), effect.value.size() ); } );
+               break;
+            }
+            case graphene::db::undo_record_kind::modified:
+               modify( get_object( effect.id ), [&effect]( object& o ) { o.unpack_from( effect.value.data(), effect.value.size() ); } );
+               break;
+            default:
+               remove( get_object( effect.id ) );
+               break;
+         }
+      }
+      temp_session.merge();
+      return true;
+   } catch ( const fc::exception& ) {
+      return false;
+   }
+}
+
+void database::restore_pending_transactions( vector<pending_transaction_ptr>&& pending, uint64_t undo_seq, uint64_t popped_blocks )
+{
+   // what was dropped from the pool since the last rebuild, what is dropped from here on is seen below and by
+   // the next rebuild
+   vector<pending_object_effect> dropped_writes;
+   dropped_writes.swap( _dropped_writes );
+   const bool dropped_unrecorded = _dropped_unrecorded;
+   _dropped_unrecorded = false;
+
+   for( const auto& tx : _popped_tx )
+   {
+      try {
+         const transaction_id_type trx_id = tx.id();
+         if( !is_known_transaction( trx_id ) )
+            _push_transaction( tx, trx_id );
+      } catch ( const fc::exception& ) {
+      }
+   }
+   _popped_tx.clear();
+
+   // The objects which may differ from what the pending transactions saw: those changed by the blocks applied
+   // and the popped transactions pushed since, and those written by every transaction dropped or evaluated again.
+   // A search by key is affected if it covers either the value a transaction saw or the value there is now, so
+   // both are kept for every index.  Once a transaction whose effects are unknown is left behind, nothing after
+   // it can be replayed.
+   const auto& journal = _undo_db.journal();
+   bool incremental = _undo_db.enabled() && popped_blocks == _popped_block_count && !dropped_unrecorded
+                      && undo_seq >= journal.first_seq() && undo_seq <= journal.next_seq();
+   std::unordered_set<object_id_type> changed;
+   std::set< std::pair<uint8_t,uint8_t> > changed_indexes;
+   std::map< std::pair<uint8_t,uint8_t>, vector< vector<char> > > changed_values;
+   // every transaction reads the dynamic globals and every block changes their head block fields, expiration and
+   // TaPoS are checked against the new head below instead
+   const object_id_type globals_id = dynamic_global_property_id_type();
+   bool globals_changed = false;
+   auto mark_changed = [&]( object_id_type id, const char* data, size_t size ) {
+      changed.insert( id );
+      const auto idx = std::make_pair( id.space(), id.type() );
+      changed_indexes.insert( idx );
+      auto& values = changed_values[idx];
+      if( size > 0 )
+         values.emplace_back( data, data + size );
+      if( const object* obj = find_object( id ) )
+      {
+         values.emplace_back( obj->packed_size() );
+         obj->pack_to( values.back().data(), values.back().size() );
+      }
+   };
+   auto mark_written = [&]( const pending_object_effect& effect ) {
+      mark_changed( effect.id, effect.value.data(), effect.value.size() );
+      if( effect.id == globals_id )
+         globals_changed = true;
+   };
+   for( const pending_object_effect& effect : dropped_writes )
+      mark_written( effect );
+   if( incremental )
+   {
+      vector<const graphene::db::undo_record*> records;
+      journal.first_records_since( undo_seq, records );
+      for( const graphene::db::undo_record* rec : records )
+      {
+         const bool existed = rec->kind == graphene::db::undo_record_kind::modified
+                              || rec->kind == graphene::db::undo_record_kind::removed;
+         mark_changed( rec->id, rec->data, existed ? rec->size : 0 );
+         if( rec->id == globals_id )
+         {
+            dynamic_global_property_object before;
+            if( existed )
+            {
+               fc::datastream<const char*> ds( rec->data, rec->size );
+               fc::raw::unpack( ds, before );
+            }
+            globals_changed |= !existed || globals_differ_beyond_head( before, get_dynamic_global_properties() );
+         }
+      }
+   }
+   size_t drops_seen = 0;
+   auto see_drops = [&]() {
+      for( ; drops_seen < _dropped_writes.size(); ++drops_seen )
+         mark_written( _dropped_writes[drops_seen] );
+      if( _dropped_unrecorded )
+         incremental = false;
+   };
+   auto is_changed = [&]( object_id_type id ) {
+      return changed.find( id ) != changed.end() && ( id != globals_id || globals_changed );
+   };
+   auto search_affected = [&changed_values]( const graphene::db::index_search& search ) {
+      auto itr = changed_values.find( std::make_pair( search.space_id, search.type_id ) );
+      return itr != changed_values.end()
+             && std::any_of( itr->second.begin(), itr->second.end(), [&search]( const vector<char>& value ) {
+                   return search.covers( value.data(), value.size() );
+                } );
+   };
+   auto index_changed = [&changed_indexes]( const std::pair<uint8_t,uint8_t>& idx ) {
+      return changed_indexes.find( idx ) != changed_indexes.end();
+   };
+   // the globals written back would undo the head block fields, so a transaction writing them is never replayed
+   auto effect_changed = [&changed]( const pending_object_effect& effect ) { return changed.find( effect.id ) != changed.end(); };
+
+   // what _apply_transaction() checks against the head block
+   const fc::time_point_sec now = head_block_time();
+   const fc::time_point_sec latest_expiration = now + get_global_properties().parameters.maximum_time_until_expiration;
+   const bool check_tapos = !(get_node_properties().skip_flags & skip_tapos_check);
+   auto tapos_holds = [&]( const transaction& trx ) {
+      if( !check_tapos )
+         return true;
+      const block_summary_object* summary = find( block_summary_id_type( trx.ref_block_num ) );
+      return summary != nullptr && trx.ref_block_prefix == summary->block_id._hash[1];
+   };
+
+   bool replayed = false;
+   for( const pending_transaction_ptr& tx : pending )
+   {
+      try {
+         see_drops();
+         const bool obsolete = is_known_transaction( tx->id ) || now > tx->expiration();
+         if( !obsolete && incremental && tx->replayable && !tx->postponed
+             && tx->expiration() <= latest_expiration && tapos_holds( tx->trx )
+             && std::none_of( tx->reads.objects.begin(), tx->reads.objects.end(), is_changed )
+             && std::none_of( tx->reads.searches.begin(), tx->reads.searches.end(), search_affected )
+             && std::none_of( tx->reads.indexes.begin(), tx->reads.indexes.end(), index_changed )
+             && std::none_of( tx->writes.begin(), tx->writes.end(), effect_changed )
+             && _pending_tx.would_admit( *tx ) )
+         {
+            if( !_pending_tx_session.valid() )
+               _pending_tx_session = _undo_db.start_undo_session();
+            if( replay_pending_transaction( *tx ) )
+            {
+               ++_pending_tx_stats.replayed;
+               replayed = true;
+               on_pending_transaction( tx->trx );
+               if( !add_pending_transaction( tx ) )
+                  drop_pending_transactions( { tx } );
+               continue;
+            }
+         }
+
+         if( !tx->postponed )
+         {
+            for( const auto& effect : tx->writes )
+               mark_written( effect );
+            if( !tx->replayable )
+               incremental = false;
+         }
+         if( obsolete )
+            continue;
+         ++_pending_tx_stats.reevaluated;
+         _push_transaction( tx->trx, tx->id );
+         if( pending_transaction_ptr reevaluated = _pending_tx.find( tx->id ) )
+            for( const auto& effect : reevaluated->writes )
+            {
+               mark_changed( effect.id, nullptr, 0 );
+               if( effect.id == globals_id )
+                  globals_changed = true;
+            }
+      } catch ( const fc::exception& ) {
+      }
+   }
+
+   if( replayed )
+      notify_changed_objects();
 }
 
 processed_transaction database::validate_transaction( const signed_transaction& trx )
 {
+   // declared first so the undo session is rolled back before api threads may read again
+   write_scope lock( *this );
    auto session = _undo_db.start_undo_session();
    return _apply_transaction( trx );
 }
@@ -300,6 +744,7 @@ signed_block database::generate_block(
    uint32_t skip /* = 0 */
    )
 { try {
+   write_scope lock( *this );
    signed_block result;
    detail::with_skip_flags( *this, skip, [&]()
    {
@@ -308,29 +753,31 @@ signed_block database::generate_block(
    return result;
 } FC_CAPTURE_AND_RETHROW() }
 
-signed_block database::_generate_block(
-   fc::time_point_sec when,
-   witness_id_type witness_id,
-   const fc::ecc::private_key& block_signing_private_key
-   )
+void database::prepare_block( fc::time_point_sec when, witness_id_type witness_id, uint32_t skip )
+{ try {
+   write_scope lock( *this );
+   detail::with_skip_flags( *this, skip, [&]()
+   {
+      _prepare_block( when, witness_id );
+   } );
+   // the transactions were applied without notifying, the rebuilt pending state is announced at once
+   notify_changed_objects();
+} FC_CAPTURE_AND_RETHROW( (when)(witness_id) ) }
+
+bool database::has_block_candidate( fc::time_point_sec when, witness_id_type witness_id )const
+{
+   return _block_candidate.valid() && _block_candidate->previous == head_block_id()
+          && _block_candidate->when == when && _block_candidate->witness == witness_id;
+}
+
+void database::_prepare_block( fc::time_point_sec when, witness_id_type witness_id )
 {
-   try {
-   uint32_t skip = get_node_properties().skip_flags;
    uint32_t slot_num = get_slot_at_time( when );
    FC_ASSERT( slot_num > 0 );
-   witness_id_type scheduled_witness = get_scheduled_witness( slot_num );
-   FC_ASSERT( scheduled_witness == witness_id );
-
-   const auto& witness_obj = witness_id(*this);
-
-   if( !(skip & skip_witness_signature) )
-      FC_ASSERT( witness_obj.signing_key == block_signing_private_key.get_public_key() );
+   FC_ASSERT( get_scheduled_witness( slot_num ) == witness_id );
 
    static const size_t max_block_header_size = fc::raw::pack_size( signed_block_header() ) + 4;
    auto maximum_block_size = get_global_properties().parameters.maximum_block_size;
-   size_t total_block_size = max_block_header_size;
-
-   signed_block pending_block;
 
    //
    // The following code throws away existing pending_tx_session and
@@ -343,51 +790,108 @@ signed_block database::_generate_block(
    // the value of the "when" variable is known, which means we need to
    // re-apply pending transactions in this method.
    //
+
+   // those expiring before the block cannot go in
+   _pending_tx.remove_expired( when );
+   vector<pending_transaction_ptr> pending = _pending_tx.release();
    _pending_tx_session.reset();
    _pending_tx_session = _undo_db.start_undo_session();
+   // nothing dropped before is part of the rebuilt pending state
+   _dropped_writes.clear();
+   _dropped_unrecorded = false;
+
+   _block_candidate = block_candidate();
+   _block_candidate->previous = head_block_id();
+   _block_candidate->when = when;
+   _block_candidate->witness = witness_id;
+   _block_candidate->size = max_block_header_size;
 
    uint64_t postponed_tx_count = 0;
-   // pop pending state (reset to head block state)
-   for( const processed_transaction& tx : _pending_tx )
+   vector<pending_transaction_ptr> failed;
+   auto include = [&]( const pending_transaction_ptr& tx, bool last_attempt )
    {
-      size_t new_total_size = total_block_size + fc::raw::pack_size( tx );
-
       // postpone transaction if it would make block too big
-      if( new_total_size >= maximum_block_size )
+      if( _block_candidate->size + fc::raw::pack_size( tx->trx ) >= maximum_block_size )
       {
          postponed_tx_count++;
-         continue;
+         tx->postponed = true;
+         add_pending_transaction( tx );
+         return;
       }
 
       try
       {
-         auto temp_session = _undo_db.start_undo_session();
-         processed_transaction ptx = _apply_transaction( tx );
-         temp_session.merge();
-
-         // We have to recompute pack_size(ptx) because it may be different
-         // than pack_size(tx) (i.e. if one or more results increased
-         // their size)
-         total_block_size += fc::raw::pack_size( ptx );
-         pending_block.transactions.push_back( ptx );
+         apply_pending_transaction( tx->trx, tx->id, false );
       }
       catch ( const fc::exception& e )
       {
-         // Do nothing, transaction will not be re-applied
-         wlog( "Transaction was not processed while generating block due to ${e}", ("e", e) );
-         wlog( "The transaction was ${t}", ("t", tx) );
+         if( !last_attempt )
+         {
+            failed.push_back( tx );
+            return;
+         }
+         // it may depend on a transaction which did not fit, then it may fit into a later block along with that one
+         if( postponed_tx_count > 0 )
+         {
+            postponed_tx_count++;
+            tx->postponed = true;
+            add_pending_transaction( tx );
+            return;
+         }
+         ++_pending_tx_stats.failed;
+         wlog( "Dropping transaction ${id} which failed while generating block due to ${e}", ("id", tx->id)("e", e) );
+         wlog( "The transaction was ${t}", ("t", tx->trx) );
       }
-   }
+   };
+
+   // the best paying transactions go first; one failing may depend on a transaction paying less which arrived
+   // before it, so those are tried again in the order they arrived once the others are in
+   std::stable_sort( pending.begin(), pending.end(), []( const pending_transaction_ptr& a, const pending_transaction_ptr& b ) {
+      return a->fee_per_kbyte > b->fee_per_kbyte;
+   });
+   for( const pending_transaction_ptr& tx : pending )
+      include( tx, false );
+   std::sort( failed.begin(), failed.end(), []( const pending_transaction_ptr& a, const pending_transaction_ptr& b ) {
+      return a->sequence < b->sequence;
+   });
+   for( const pending_transaction_ptr& tx : failed )
+      include( tx, true );
    if( postponed_tx_count > 0 )
    {
       wlog( "Postponed ${n} transactions due to block size limit", ("n", postponed_tx_count) );
    }
+}
+
+signed_block database::_generate_block(
+   fc::time_point_sec when,
+   witness_id_type witness_id,
+   const fc::ecc::private_key& block_signing_private_key
+   )
+{
+   try {
+   uint32_t skip = get_node_properties().skip_flags;
+   uint32_t slot_num = get_slot_at_time( when );
+   FC_ASSERT( slot_num > 0 );
+   witness_id_type scheduled_witness = get_scheduled_witness( slot_num );
+   FC_ASSERT( scheduled_witness == witness_id );
+
+   const auto& witness_obj = witness_id(*this);
 
+   if( !(skip & skip_witness_signature) )
+      FC_ASSERT( witness_obj.signing_key == block_signing_private_key.get_public_key() );
+
+   if( !has_block_candidate( when, witness_id ) )
+      _prepare_block( when, witness_id );
+
+   signed_block pending_block;
+   pending_block.transactions = std::move( _block_candidate->transactions );
+   _block_candidate.reset();
    _pending_tx_session.reset();
 
    // We have temporarily broken the invariant that
    // _pending_tx_session is the result of applying _pending_tx, as
-   // _pending_tx now consists of the set of postponed transactions.
+   // _pending_tx now consists of the transactions of the block, which
+   // are known once it is pushed, and the postponed transactions.
    // However, the push_block() call below will re-create the
    // _pending_tx_session.
 
@@ -415,15 +919,17 @@ signed_block database::_generate_block(
    if( !(skip & skip_witness_signature) )
       pending_block.sign( block_signing_private_key );
 
+   const sealed_block sealed( std::move(pending_block) );
+
    // TODO:  Move this to _push_block() so session is restored.
    if( !(skip & skip_block_size_check) )
    {
-      FC_ASSERT( fc::raw::pack_size(pending_block) <= get_global_properties().parameters.maximum_block_size );
+      FC_ASSERT( sealed.packed_size() <= get_global_properties().parameters.maximum_block_size );
    }
 
-   push_block( pending_block, skip );
+   push_block( sealed, skip );
 
-   return pending_block;
+   return sealed.block();
 } FC_CAPTURE_AND_RETHROW( (witness_id) ) }
 
 /**
@@ -432,23 +938,73 @@ signed_block database::_generate_block(
  */
 void database::pop_block()
 { try {
+   write_scope lock( *this );
    _pending_tx_session.reset();
+   _block_candidate.reset();
    auto head_id = head_block_id();
-   optional<signed_block> head_block = fetch_block_by_id( head_id );
+   optional<sealed_block> head_block = fetch_sealed_block_by_id( head_id );
    GRAPHENE_ASSERT( head_block.valid(), pop_empty_chain, "there are no blocks to pop" );
 
    _fork_db.pop_block();
+   ++_popped_block_count;
    _block_id_to_block.remove( head_id );
    pop_undo();
+   _block_state_digests.erase( _block_state_digests.lower_bound( head_block->block_num() ), _block_state_digests.end() );
 
-   _popped_tx.insert( _popped_tx.begin(), head_block->transactions.begin(), head_block->transactions.end() );
+   const auto& transactions = head_block->block().transactions;
+   _popped_tx.insert( _popped_tx.begin(), transactions.begin(), transactions.end() );
 
 } FC_CAPTURE_AND_RETHROW() }
 
+void database::set_signature_recovery_threads( uint32_t thread_count )
+{
+   for( auto& thread : _signature_threads )
+      thread->quit();
+   _signature_threads.clear();
+   for( uint32_t i = 0; i < thread_count; ++i )
+      _signature_threads.emplace_back( new fc::thread( "signature_recovery_" + fc::to_string(i) ) );
+}
+
+void database::precompute_signature_keys( const signed_block& next_block )
+{ try {
+   const auto& transactions = next_block.transactions;
+   const size_t thread_count = std::min( _signature_threads.size(), transactions.size() );
+   if( thread_count == 0 || transactions.size() < 2 )
+      return;
+
+   const chain_id_type chain_id = get_chain_id();
+   signature_cache* cache = &_signature_cache;
+   // Waiting on an fc::future would let the chain thread run other tasks, e.g. push another block or transaction,
+   // before push_block() takes the write lock.  A std::future blocks the thread instead.
+   vector< std::future<void> > recovered;
+   recovered.reserve( thread_count );
+   for( size_t t = 0; t < thread_count; ++t )
+   {
+      auto finished = std::make_shared< std::promise<void> >();
+      recovered.push_back( finished->get_future() );
+      _signature_threads[t]->async( [&transactions,&chain_id,cache,finished,t,thread_count]()
+      {
+         for( size_t i = t; i < transactions.size(); i += thread_count )
+         {
+            try {
+               transactions[i].precompute_signature_keys( chain_id, cache );
+            } catch( ... ) {
+               // _apply_transaction() recovers the keys again and reports the error
+            }
+         }
+         finished->set_value();
+      }, "precompute_signature_keys" );
+   }
+   for( auto& f : recovered )
+      f.wait();
+} FC_CAPTURE_AND_RETHROW( (next_block.block_num()) ) }
+
 void database::clear_pending()
 { try {
-   assert( (_pending_tx.size() == 0) || _pending_tx_session.valid() );
+   write_scope lock( *this );
+   assert( _pending_tx.empty() || _pending_tx_session.valid() );
    _pending_tx.clear();
+   _block_candidate.reset();
    _pending_tx_session.reset();
 } FC_CAPTURE_AND_RETHROW() }
 
@@ -480,7 +1036,7 @@ const vector<optional< operation_history_object > >& database::get_applied_opera
 
 //////////////////// private methods ////////////////////
 
-void database::apply_block( const signed_block& next_block, uint32_t skip )
+void database::apply_block( const sealed_block& next_block, uint32_t skip )
 {
    auto block_num = next_block.block_num();
    if( _checkpoints.size() && _checkpoints.rbegin()->second != block_id_type() )
@@ -500,23 +1056,23 @@ void database::apply_block( const signed_block& next_block, uint32_t skip )
    return;
 }
 
-void database::_apply_block( const signed_block& next_block )
+void database::_apply_block( const sealed_block& next_block )
 { try {
    uint32_t next_block_num = next_block.block_num();
    uint32_t skip = get_node_properties().skip_flags;
    _applied_ops.clear();
 
-   FC_ASSERT( (skip & skip_merkle_check) || next_block.transaction_merkle_root == next_block.calculate_merkle_root(), "", ("next_block.transaction_merkle_root",next_block.transaction_merkle_root)("calc",next_block.calculate_merkle_root())("next_block",next_block)("id",next_block.id()) );
+   FC_ASSERT( (skip & skip_merkle_check) || next_block->transaction_merkle_root == next_block->calculate_merkle_root(), "", ("next_block.transaction_merkle_root",next_block->transaction_merkle_root)("calc",next_block->calculate_merkle_root())("next_block",next_block.block())("id",next_block.id()) );
 
    const witness_object& signing_witness = validate_block_header(skip, next_block);
    const auto& global_props = get_global_properties();
    const auto& dynamic_global_props = get<dynamic_global_property_object>(dynamic_global_property_id_type());
-   bool maint_needed = (dynamic_global_props.next_maintenance_time <= next_block.timestamp);
+   bool maint_needed = (dynamic_global_props.next_maintenance_time <= next_block->timestamp);
 
    _current_block_num    = next_block_num;
    _current_trx_in_block = 0;
 
-   for( const auto& trx : next_block.transactions )
+   for( const auto& trx : next_block->transactions )
    {
       /* We do not need to push the undo state for each transaction
        * because they either all apply and are valid or the
@@ -524,19 +1080,19 @@ void database::_apply_block( const signed_block& next_block )
        * for transactions when validating broadcast transactions or
        * when building a block.
        */
-      apply_transaction( trx, skip );
+      _apply_transaction( trx, next_block.transaction_id( _current_trx_in_block ) );
       ++_current_trx_in_block;
    }
 
    if (global_props.parameters.witness_schedule_algorithm == GRAPHENE_WITNESS_SCHEDULED_ALGORITHM)
-       update_witness_schedule(next_block);
+       update_witness_schedule(next_block.block());
    update_global_dynamic_data(next_block);
-   update_signing_witness(signing_witness, next_block);
+   update_signing_witness(signing_witness, next_block.block());
    update_last_irreversible_block();
 
    // Are we at the maintenance interval?
    if( maint_needed )
-      perform_chain_maintenance(next_block, global_props);
+      perform_chain_maintenance(next_block.block(), global_props);
 
    create_block_summary(next_block);
    clear_expired_transactions();
@@ -558,28 +1114,49 @@ void database::_apply_block( const signed_block& next_block )
       apply_debug_updates();
 
    // notify observers that the block has been applied
-   applied_block( next_block ); //emit
+   applied_block( next_block.block() ); //emit
    _applied_ops.clear();
 
    notify_changed_objects();
 
+   if( snapshots_enabled() )
+      mark_snapshot_point( next_block_num );
+
+   if( _state_persistence_interval > 0 && _undo_db.enabled() )
+   {
+      // everything recorded from here on happened after this block, a replaced block overwrites its entry
+      const uint32_t last_irreversible = get_dynamic_global_properties().last_irreversible_block_num;
+      _block_end_undo_seq.erase( _block_end_undo_seq.lower_bound( next_block_num ), _block_end_undo_seq.end() );
+      _block_end_undo_seq.erase( _block_end_undo_seq.begin(), _block_end_undo_seq.lower_bound( last_irreversible ) );
+      _block_end_undo_seq[next_block_num] = _undo_db.journal().next_seq();
+   }
+
+   if( _state_digest_history > 0 )
+   {
+      _block_state_digests.erase( _block_state_digests.lower_bound( next_block_num ), _block_state_digests.end() );
+      block_state_digest& d = _block_state_digests[next_block_num];
+      d.block_num = next_block_num;
+      d.block_id = next_block.id();
+      d.digest = compute_state_digest();
+      while( _block_state_digests.size() > _state_digest_history )
+         _block_state_digests.erase( _block_state_digests.begin() );
+   }
+
 } FC_CAPTURE_AND_RETHROW( (next_block.block_num()) )  }
 
+fc::sha256 database::compute_state_digest()const
+{
+   FC_ASSERT( tracks_state_hash(), "state hashes are not being tracked" );
+   fc::sha256::encoder enc;
+   fc::raw::pack( enc, get_state_hashes() );
+   return enc.result();
+}
+
 void database::notify_changed_objects()
 { try {
    if( _undo_db.enabled() ) 
    {
-      const auto& head_undo = _undo_db.head();
-      vector<object_id_type> changed_ids;  changed_ids.reserve(head_undo.old_values.size());
-      for( const auto& item : head_undo.old_values ) changed_ids.push_back(item.first);
-      for( const auto& item : head_undo.new_ids ) changed_ids.push_back(item);
-      vector<const object*> removed;
-      removed.reserve( head_undo.removed.size() );
-      for( const auto& item : head_undo.removed )
-      {
-         changed_ids.push_back( item.first );
-         removed.emplace_back( item.second.get() );
-      }
+      vector<object_id_type> changed_ids = _undo_db.head_changed_ids();
       changed_objects(changed_ids);
    }
 } FC_CAPTURE_AND_RETHROW() }
@@ -595,6 +1172,11 @@ processed_transaction database::apply_transaction(const signed_transaction& trx,
 }
 
 processed_transaction database::_apply_transaction(const signed_transaction& trx)
+{
+   return _apply_transaction( trx, trx.id() );
+}
+
+processed_transaction database::_apply_transaction(const signed_transaction& trx, const transaction_id_type& trx_id)
 { try {
    uint32_t skip = get_node_properties().skip_flags;
 
@@ -603,7 +1185,6 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
 
    auto& trx_idx = get_mutable_index_type<transaction_index>();
    const chain_id_type& chain_id = get_chain_id();
-   auto trx_id = trx.id();
    FC_ASSERT( (skip & skip_transaction_dupe_check) ||
               trx_idx.indices().get<by_trx_id>().find(trx_id) == trx_idx.indices().get<by_trx_id>().end() );
    transaction_evaluation_state eval_state(this);
@@ -614,7 +1195,8 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
    {
       auto get_active = [&]( account_id_type id ) { return &id(*this).active; };
       auto get_owner  = [&]( account_id_type id ) { return &id(*this).owner;  };
-      trx.verify_authority( chain_id, get_active, get_owner, get_global_properties().parameters.max_authority_depth );
+      trx.verify_authority( chain_id, get_active, get_owner, get_global_properties().parameters.max_authority_depth,
+                            &_signature_cache );
    }
 
    //Skip all manner of expiration and TaPoS checking if we're on block 1; It's impossible that the transaction is
@@ -639,7 +1221,7 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
    //Insert transaction into unique transactions database.
    if( !(skip & skip_transaction_dupe_check) )
    {
-      create<transaction_object>([&](transaction_object& transaction) {
+      create_in<transaction_index>([&](transaction_object& transaction) {
          transaction.trx_id = trx_id;
          transaction.trx = trx;
       });
@@ -658,7 +1240,9 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
    ptrx.operation_results = std::move(eval_state.operation_results);
 
    //Make sure the temp account has no non-zero balances
-   const auto& index = get_index_type<account_balance_index>().indices().get<by_account_asset>();
+   const auto& index = search_index<account_balance_index>( []( const account_balance_object& b ) {
+      return b.owner == GRAPHENE_TEMP_ACCOUNT;
+   } ).indices().get<by_account_asset>();
    auto range = index.equal_range( boost::make_tuple( GRAPHENE_TEMP_ACCOUNT ) );
    std::for_each(range.first, range.second, [](const account_balance_object& b) { FC_ASSERT(b.balance == 0); });
 
@@ -682,11 +1266,11 @@ operation_result database::apply_operation(transaction_evaluation_state& eval_st
    return result;
 } FC_CAPTURE_AND_RETHROW( (op) ) }
 
-const witness_object& database::validate_block_header( uint32_t skip, const signed_block& next_block )const
+const witness_object& database::validate_block_header( uint32_t skip, const sealed_block& next_block )const
 {
-   FC_ASSERT( head_block_id() == next_block.previous, "", ("head_block_id",head_block_id())("next.prev",next_block.previous) );
-   FC_ASSERT( head_block_time() < next_block.timestamp, "", ("head_block_time",head_block_time())("next",next_block.timestamp)("blocknum",next_block.block_num()) );
-   const witness_object& witness = next_block.witness(*this);
+   FC_ASSERT( head_block_id() == next_block->previous, "", ("head_block_id",head_block_id())("next.prev",next_block->previous) );
+   FC_ASSERT( head_block_time() < next_block->timestamp, "", ("head_block_time",head_block_time())("next",next_block->timestamp)("blocknum",next_block.block_num()) );
+   const witness_object& witness = next_block->witness(*this);
 //DLN: TODO: Temporarily commented out to test shuffle vs RNG scheduling algorithm for witnesses, this was causing shuffle agorithm to fail during create_witness test. This should be re-enabled for RNG, and maybe for shuffle too, don't really know for sure.
 //   FC_ASSERT( secret_hash_type::hash( next_block.previous_secret ) == witness.next_secret_hash, "",        
 //              ("previous_secret", next_block.previous_secret)("next_secret_hash", witness.next_secret_hash)("null_secret_hash", secret_hash_type::hash( secret_hash_type())));
@@ -696,19 +1280,19 @@ const witness_object& database::validate_block_header( uint32_t skip, const sign
 
    if( !(skip&skip_witness_schedule_check) )
    {
-      uint32_t slot_num = get_slot_at_time( next_block.timestamp );
+      uint32_t slot_num = get_slot_at_time( next_block->timestamp );
       FC_ASSERT( slot_num > 0 );
 
       witness_id_type scheduled_witness = get_scheduled_witness( slot_num );
 
-      FC_ASSERT( next_block.witness == scheduled_witness, "Witness produced block at wrong time",
-                 ("block witness",next_block.witness)("scheduled",scheduled_witness)("slot_num",slot_num) );
+      FC_ASSERT( next_block->witness == scheduled_witness, "Witness produced block at wrong time",
+                 ("block witness",next_block->witness)("scheduled",scheduled_witness)("slot_num",slot_num) );
    }
 
    return witness;
 }
 
-void database::create_block_summary(const signed_block& next_block)
+void database::create_block_summary(const sealed_block& next_block)
 {
    block_summary_id_type sid(next_block.block_num() & 0xffff );
    modify( sid(*this), [&](block_summary_object& p) {
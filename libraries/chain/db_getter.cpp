@@ -62,6 +62,14 @@ time_point_sec database::head_block_time()const
    return get( dynamic_global_property_id_type() ).time;
 }
 
+optional<block_state_digest> database::get_block_state_digest( uint32_t block_num )const
+{
+   auto itr = _block_state_digests.find( block_num );
+   if( itr == _block_state_digests.end() )
+      return optional<block_state_digest>();
+   return itr->second;
+}
+
 uint32_t database::head_block_num()const
 {
    return get( dynamic_global_property_id_type() ).head_block_number;
@@ -28,13 +28,239 @@
 #include <graphene/chain/protocol/fee_schedule.hpp>
 
 #include <fc/io/fstream.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/thread/thread.hpp>
 
+#include <cerrno>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <set>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace graphene { namespace chain {
 
+namespace {
+   /**
+    *  Reads blocks ahead of the replay loop: every reader thread has a block_database_reader of its
+    *  own, block numbers are handed out round-robin and at most look_ahead blocks are in flight.
+    */
+   class block_prefetcher
+   {
+      public:
+         block_prefetcher( const fc::path& block_dir, uint32_t first_block_num, uint32_t last_block_num,
+                           uint32_t reader_threads, uint32_t look_ahead )
+         : _last_block_num( last_block_num ), _look_ahead( look_ahead ), _next_block_num( first_block_num )
+         {
+            for( uint32_t t = 0; t < reader_threads; ++t )
+            {
+               _readers.emplace_back( new block_database_reader( block_dir ) );
+               _threads.emplace_back( new fc::thread( "reindex_reader_" + fc::to_string(t) ) );
+            }
+         }
+
+         ~block_prefetcher()
+         {
+            cancel();
+         }
+
+         /** @return block number block_num, must be called in ascending order starting at first_block_num */
+         optional<sealed_block> fetch( uint32_t block_num )
+         {
+            prefetch();
+            FC_ASSERT( !_pending.empty() && _next_block_num - _pending.size() == block_num );
+            optional<sealed_block> result = _pending.front().wait();
+            _pending.pop_front();
+            prefetch();
+            return result;
+         }
+
+         /** waits for the blocks still being read, the block log may be modified afterwards */
+         void cancel()
+         {
+            for( auto& f : _pending )
+            {
+               try { f.wait(); } catch( ... ) {}
+            }
+            _pending.clear();
+            _next_block_num = _last_block_num + 1;
+         }
+
+      private:
+         void prefetch()
+         {
+            while( _next_block_num <= _last_block_num && _pending.size() < _look_ahead )
+            {
+               const size_t t = _next_block_num % _threads.size();
+               const block_database_reader* reader = _readers[t].get();
+               const uint32_t block_num = _next_block_num++;
+               _pending.push_back( _threads[t]->async( [reader,block_num]() {
+                  return reader->fetch_sealed_by_number( block_num );
+               }, "reindex_prefetch" ) );
+            }
+         }
+
+         const uint32_t                                     _last_block_num;
+         const uint32_t                                     _look_ahead;
+         uint32_t                                           _next_block_num;
+         vector< std::unique_ptr<block_database_reader> >   _readers;
+         vector< std::unique_ptr<fc::thread> >              _threads;
+         std::deque< fc::future< optional<sealed_block> > > _pending;
+   };
+
+   /** forces what was written to the file or directory at path onto the disk */
+   void sync_path( const fc::path& path )
+   {
+      const int fd = ::open( path.generic_string().c_str(), O_RDONLY );
+      FC_ASSERT( fd >= 0, "Unable to open ${f}: ${e}", ("f", path)("e", strerror(errno)) );
+      const int result = fsync( fd );
+      const int error = errno;
+      ::close( fd );
+      FC_ASSERT( result == 0, "Unable to sync ${f}: ${e}", ("f", path)("e", strerror(error)) );
+   }
+
+   /**
+    *  Saved object database states are accompanied by a marker naming the block they belong to.
+    *  The marker is written last, so a state with a valid marker is always complete.
+    */
+   void write_state_marker( const fc::path& file, uint32_t block_num, const block_id_type& block_id )
+   {
+      const fc::path tmp = file.generic_string() + ".tmp";
+      {
+         std::ofstream out( tmp.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+         FC_ASSERT( out );
+         fc::raw::pack( out, std::string( GRAPHENE_CURRENT_DB_VERSION ) );
+         fc::raw::pack( out, block_num );
+         fc::raw::pack( out, block_id );
+         out.flush();
+         FC_ASSERT( out );
+      }
+      fc::rename( tmp, file );
+   }
+
+   /** @return the block number named by the marker, or 0 if it is missing or does not match the block log */
+   uint32_t read_state_marker( const fc::path& file, const fc::path& block_dir )
+   {
+      try
+      {
+         if( !fc::exists( file ) )
+            return 0;
+         std::string data;
+         fc::read_file_contents( file, data );
+         fc::datastream<const char*> ds( data.data(), data.size() );
+         std::string version;
+         uint32_t block_num = 0;
+         block_id_type block_id;
+         fc::raw::unpack( ds, version );
+         fc::raw::unpack( ds, block_num );
+         fc::raw::unpack( ds, block_id );
+         if( version != GRAPHENE_CURRENT_DB_VERSION || block_num == 0 )
+            return 0;
+         optional<signed_block> block = block_database_reader( block_dir ).fetch_by_number( block_num );
+         if( !block.valid() || block->id() != block_id )
+            return 0;
+         return block_num;
+      }
+      catch( const fc::exception& e )
+      {
+         wlog( "Ignoring saved state ${f}: ${e}", ("f", file)("e", e.to_detail_string()) );
+      }
+      return 0;
+   }
+
+   /**
+    *  A reindex checkpoint is a copy of the object database saved while replaying.  It is written to a
+    *  new directory which is renamed into place once its marker exists.
+    */
+   const char* const reindex_checkpoint_dir     = "reindex_checkpoint";
+   const char* const reindex_checkpoint_new_dir = "reindex_checkpoint.new";
+   const char* const reindex_checkpoint_marker  = "checkpoint";
+
+   void save_reindex_checkpoint( database& db, const fc::path& data_dir )
+   {
+      const fc::path new_dir = data_dir / reindex_checkpoint_new_dir;
+      fc::remove_all( new_dir );
+      db.flush( new_dir / "object_database" );
+      write_state_marker( new_dir / reindex_checkpoint_marker, db.head_block_num(), db.head_block_id() );
+      fc::remove_all( data_dir / reindex_checkpoint_dir );
+      fc::rename( new_dir, data_dir / reindex_checkpoint_dir );
+   }
+
+   /** @return the block number of the checkpoint in dir, or 0 if it is incomplete or does not belong to the block log */
+   uint32_t read_reindex_checkpoint( const fc::path& dir, const fc::path& block_dir )
+   {
+      return read_state_marker( dir / reindex_checkpoint_marker, block_dir );
+   }
+
+   void remove_reindex_checkpoints( const fc::path& data_dir )
+   {
+      fc::remove_all( data_dir / reindex_checkpoint_new_dir );
+      fc::remove_all( data_dir / reindex_checkpoint_dir );
+   }
+
+   /**
+    *  The persisted state lives in state/<block number>/, next to a manifest naming that block.  Every
+    *  index file is written to a temporary file and renamed, and the manifest is replaced last, once the
+    *  files and the directories holding them are on the disk.
+    */
+   const char* const persisted_state_dir      = "state";
+   const char* const persisted_state_manifest = "manifest";
+
+   /** runs on the state persistence thread, pack hands every index file to the function it is called with */
+   void write_persisted_state( const fc::path& state_dir, uint32_t block_num, const block_id_type& block_id,
+                               const std::function< void( const std::function< void( const fc::path&, const vector<char>& ) >& ) >& pack )
+   {
+      const fc::path snapshot_dir = state_dir / fc::to_string( block_num );
+      std::set<fc::path> dirs;
+      pack( [&snapshot_dir,&dirs]( const fc::path& file, const vector<char>& data )
+      {
+         const fc::path path = snapshot_dir / file;
+         const fc::path tmp = path.generic_string() + ".tmp";
+         fc::create_directories( path.parent_path() );
+         {
+            std::ofstream out( tmp.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+            FC_ASSERT( out, "Unable to create ${f}", ("f", tmp) );
+            out.write( data.data(), data.size() );
+            out.flush();
+            FC_ASSERT( out, "Unable to write ${f}", ("f", tmp) );
+         }
+         sync_path( tmp );
+         fc::rename( tmp, path );
+         dirs.insert( path.parent_path() );
+      } );
+      // the renames and the new directories have to be durable before the manifest names them
+      for( const fc::path& dir : dirs )
+         sync_path( dir );
+      sync_path( snapshot_dir );
+      sync_path( state_dir );
+
+      const fc::path manifest = state_dir / persisted_state_manifest;
+      write_state_marker( manifest, block_num, block_id );
+      sync_path( manifest );
+      sync_path( state_dir );
+
+      // older states are no longer referenced by the manifest
+      vector<fc::path> stale;
+      for( fc::directory_iterator itr( state_dir ); itr != fc::directory_iterator(); ++itr )
+         if( fc::is_directory( *itr ) && (*itr).filename().generic_string() != fc::to_string( block_num ) )
+            stale.push_back( *itr );
+      for( const auto& dir : stale )
+         fc::remove_all( dir );
+   }
+
+   /** checks skipped when replaying blocks from the block database, they were validated when first applied */
+   const uint32_t replay_skip_flags = database::skip_witness_signature |
+                                      database::skip_transaction_signatures |
+                                      database::skip_transaction_dupe_check |
+                                      database::skip_tapos_check |
+                                      database::skip_witness_schedule_check |
+                                      database::skip_authority_check;
+}
+
 database::database() :
    _random_number_generator(fc::ripemd160().data())
 {
@@ -44,14 +270,48 @@ database::database() :
 
 database::~database()
 {
+   wait_for_state_persistence();
    clear_pending();
+   set_signature_recovery_threads( 0 );
 }
 
 void database::reindex(fc::path data_dir, const genesis_state_type& initial_allocation)
 { try {
    ilog( "reindexing blockchain" );
    wipe(data_dir, false);
-   open(data_dir, [&initial_allocation]{return initial_allocation;});
+
+   // resume from the newest checkpoint of an interrupted reindex which matches the block log
+   const fc::path block_dir = data_dir / "database" / "block_num_to_block";
+   fc::path checkpoint_dir;
+   uint32_t checkpoint_num = 0;
+   for( const char* dir : { reindex_checkpoint_dir, reindex_checkpoint_new_dir } )
+   {
+      const uint32_t num = read_reindex_checkpoint( data_dir / dir, block_dir );
+      if( num > checkpoint_num )
+      {
+         checkpoint_num = num;
+         checkpoint_dir = data_dir / dir;
+      }
+   }
+
+   if( checkpoint_num > 0 )
+   {
+      ilog( "Resuming reindex from checkpoint at block ${n}", ("n", checkpoint_num) );
+      try
+      {
+         object_database::open( data_dir, checkpoint_dir / "object_database" );
+         FC_ASSERT( head_block_num() == checkpoint_num, "Checkpoint state does not match its marker" );
+      }
+      catch( const fc::exception& )
+      {
+         // the next attempt starts over from genesis
+         remove_reindex_checkpoints( data_dir );
+         throw;
+      }
+      _block_id_to_block.open( block_dir );
+   }
+   else
+      open(data_dir, [&initial_allocation]{return initial_allocation;});
 
    auto start = fc::time_point::now();
    auto last_block = _block_id_to_block.last();
@@ -60,18 +320,28 @@ void database::reindex(fc::path data_dir, const genesis_state_type& initial_allo
       edump((last_block));
       return;
    }
+   if( checkpoint_num > 0 )
+      _fork_db.start_block( sealed_block( *last_block ) );
 
    const auto last_block_num = last_block->block_num();
 
    ilog( "Replaying blocks..." );
    _undo_db.disable();
-   for( uint32_t i = 1; i <= last_block_num; ++i )
+
+   std::unique_ptr<block_prefetcher> prefetcher;
+   if( _reindex_reader_threads > 0 && _reindex_look_ahead > 0 )
+      prefetcher.reset( new block_prefetcher( block_dir, checkpoint_num + 1, last_block_num,
+                                              _reindex_reader_threads, _reindex_look_ahead ) );
+
+   for( uint32_t i = checkpoint_num + 1; i <= last_block_num; ++i )
    {
       if( i % 2000 == 0 ) std::cerr << "   " << double(i*100)/last_block_num << "%   "<<i << " of " <<last_block_num<<"   \n";
-      fc::optional< signed_block > block = _block_id_to_block.fetch_by_number(i);
+      // the blocks keep the bytes they were read as, so they need not be packed again to be applied
+      optional<sealed_block> block = prefetcher ? prefetcher->fetch( i ) : _block_id_to_block.fetch_sealed_by_number( i );
       if( !block.valid() )
       {
          wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", i) );
+         prefetcher.reset();
          uint32_t dropped_count = 0;
          while( true )
          {
@@ -88,25 +358,131 @@ void database::reindex(fc::path data_dir, const genesis_state_type& initial_allo
          wlog( "Dropped ${n} blocks from after the gap", ("n", dropped_count) );
          break;
       }
-      apply_block(*block, skip_witness_signature |
-                          skip_transaction_signatures |
-                          skip_transaction_dupe_check |
-                          skip_tapos_check |
-                          skip_witness_schedule_check |
-                          skip_authority_check);
+      apply_block( *block, replay_skip_flags );
+      if( _reindex_checkpoint_interval > 0 && i % _reindex_checkpoint_interval == 0 && i < last_block_num )
+         save_reindex_checkpoint( *this, data_dir );
    }
+   // the readers go before anything can close the block database, an exception unwinding past here drops them too
+   prefetcher.reset();
+   remove_reindex_checkpoints( data_dir );
    _undo_db.enable();
+   _last_persisted_block = head_block_num();
    auto end = fc::time_point::now();
    ilog( "Done reindexing, elapsed time: ${t} sec", ("t",double((end-start).count())/1000000.0 ) );
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
 
+void database::set_reindex_prefetch( uint32_t reader_threads, uint32_t look_ahead )
+{
+   _reindex_reader_threads = reader_threads;
+   _reindex_look_ahead = look_ahead;
+}
+
+void database::set_reindex_checkpoint_interval( uint32_t interval )
+{
+   _reindex_checkpoint_interval = interval;
+}
+
+void database::set_state_persistence_interval( uint32_t interval )
+{
+   _state_persistence_interval = interval;
+   // the state is serialized on a thread of its own while this one goes on
+   if( interval > 0 )
+      enable_concurrent_reads();
+}
+
+void database::set_state_digest_history( uint32_t blocks )
+{
+   _state_digest_history = blocks;
+   if( blocks == 0 )
+      _block_state_digests.clear();
+   else if( !tracks_state_hash() )
+      enable_state_hash();
+}
+
+bool database::has_persisted_state( const fc::path& data_dir )const
+{
+   return read_state_marker( data_dir / persisted_state_dir / persisted_state_manifest,
+                             data_dir / "database" / "block_num_to_block" ) > 0;
+}
+
+void database::persist_irreversible_state()
+{
+   try
+   {
+      // the journal stays retained until the previous state is written
+      if( _state_persistence_done.valid() )
+      {
+         if( !_state_persistence_done.ready() )
+            return;
+         _state_persistence_done = fc::future<void>();
+         _undo_db.release_journal();
+      }
+      if( get_dynamic_global_properties().last_irreversible_block_num < _last_persisted_block + _state_persistence_interval )
+         return;
+
+      const uint32_t block_num = get_dynamic_global_properties().last_irreversible_block_num;
+      auto itr = _block_end_undo_seq.find( block_num );
+      if( itr == _block_end_undo_seq.end() )
+         return;
+      const uint64_t undo_seq = itr->second;
+
+      const block_id_type block_id = _block_id_to_block.fetch_block_id( block_num );
+      _last_persisted_block = block_num;
+
+      // the state at block_num is read back through the journal from whatever the state is when an index is
+      // packed, so the journal must keep every record from undo_seq on until all of them are written
+      _undo_db.retain_journal();
+      if( !_state_persistence_thread )
+         _state_persistence_thread.reset( new fc::thread( "state_persistence" ) );
+      const fc::path state_dir = get_data_dir() / persisted_state_dir;
+      _state_persistence_done = _state_persistence_thread->async( [this,state_dir,block_num,block_id,undo_seq]()
+      {
+         try
+         {
+            write_persisted_state( state_dir, block_num, block_id,
+               [this,undo_seq]( const std::function< void( const fc::path&, const vector<char>& ) >& write ) {
+                  pack_state_before( undo_seq, write );
+               } );
+         }
+         catch( const fc::exception& e )
+         {
+            elog( "Unable to persist the state at block ${n}: ${e}", ("n", block_num)("e", e.to_detail_string()) );
+         }
+      }, "persist_state" );
+   }
+   catch( const fc::exception& e )
+   {
+      elog( "Unable to persist the irreversible state: ${e}", ("e", e.to_detail_string()) );
+   }
+}
+
+void database::wait_for_state_persistence()
+{
+   if( !_state_persistence_done.valid() )
+      return;
+   try
+   {
+      _state_persistence_done.wait();
+   }
+   catch( ... )
+   {
+   }
+   _state_persistence_done = fc::future<void>();
+   _undo_db.release_journal();
+}
+
 void database::wipe(const fc::path& data_dir, bool include_blocks)
 {
    ilog("Wiping database", ("include_blocks", include_blocks));
    close();
    object_database::wipe(data_dir);
+   // the persisted state is a copy of the object database, open() would load it again
+   fc::remove_all( data_dir / persisted_state_dir );
    if( include_blocks )
+   {
       fc::remove_all( data_dir / "database" );
+      remove_reindex_checkpoints( data_dir );
+   }
 }
 
 void database::open(
@@ -115,9 +491,19 @@ void database::open(
 {
    try
    {
-      object_database::open(data_dir);
+      // after an unclean shutdown the newest state is the one persisted while running
+      const fc::path block_dir = data_dir / "database" / "block_num_to_block";
+      const uint32_t persisted_num = read_state_marker( data_dir / persisted_state_dir / persisted_state_manifest, block_dir );
+      if( persisted_num > 0 )
+      {
+         ilog( "Opening the state persisted at block ${n}", ("n", persisted_num) );
+         object_database::open( data_dir, data_dir / persisted_state_dir / fc::to_string( persisted_num ) );
+         FC_ASSERT( head_block_num() == persisted_num, "Persisted state does not match its manifest" );
+      }
+      else
+         object_database::open(data_dir);
 
-      _block_id_to_block.open(data_dir / "database" / "block_num_to_block");
+      _block_id_to_block.open( block_dir );
 
       if( !find(global_property_id_type()) )
          init_genesis(genesis_loader());
@@ -125,7 +511,20 @@ void database::open(
       fc::optional<signed_block> last_block = _block_id_to_block.last();
       if( last_block.valid() )
       {
-         _fork_db.start_block( *last_block );
+         if( persisted_num > 0 && head_block_num() < last_block->block_num() )
+         {
+            ilog( "Replaying blocks ${f} to ${l}", ("f", head_block_num() + 1)("l", last_block->block_num()) );
+            _undo_db.disable();
+            for( uint32_t i = head_block_num() + 1; i <= last_block->block_num(); ++i )
+            {
+               fc::optional<sealed_block> block = _block_id_to_block.fetch_sealed_by_number( i );
+               FC_ASSERT( block.valid(), "Block ${i} is missing from the block database", ("i", i) );
+               apply_block( *block, replay_skip_flags );
+            }
+            _undo_db.enable();
+         }
+
+         _fork_db.start_block( sealed_block( *last_block ) );
          idump((last_block->id())(last_block->block_num()));
          idump((head_block_id())(head_block_num()));
          if( last_block->id() != head_block_id() )
@@ -134,12 +533,15 @@ void database::open(
                          ("last_block->id", last_block->id())("head_block_num",head_block_num()) );
          }
       }
+      _last_persisted_block = head_block_num();
    }
    FC_CAPTURE_LOG_AND_RETHROW( (data_dir) )
 }
 
 void database::close(bool rewind)
 {
+   wait_for_state_persistence();
+
    // TODO:  Save pending tx's on close()
    clear_pending();
 
@@ -179,6 +581,10 @@ void database::close(bool rewind)
    object_database::flush();
    object_database::close();
 
+   // the state just saved supersedes the persisted one
+   if( get_data_dir() != fc::path() )
+      fc::remove_all( get_data_dir() / persisted_state_dir );
+
    if( _block_id_to_block.is_open() )
       _block_id_to_block.close();
 
@@ -167,14 +167,16 @@ bool database::apply_order(const limit_order_object& new_order_object, bool allo
    if( called_some && !find_object(order_id) ) // then we were filled by call order
       return true;
 
-   const auto& limit_price_idx = get_index_type<limit_order_index>().indices().get<by_price>();
-
    // TODO: it should be possible to simply check the NEXT/PREV iterator after new_order_object to
    // determine whether or not this order has "changed the book" in a way that requires us to
    // check orders. For now I just lookup the lower bound and check for equality... this is log(n) vs
    // constant time check. Potential optimization.
 
    auto max_price = ~new_order_object.sell_price;
+   const auto& limit_price_idx = search_index<limit_order_index>( [max_price]( const limit_order_object& o ) {
+      return o.sell_price.base.asset_id == max_price.base.asset_id
+             && o.sell_price.quote.asset_id == max_price.quote.asset_id && o.sell_price >= max_price;
+   } ).indices().get<by_price>();
    auto limit_itr = limit_price_idx.lower_bound(max_price.max());
    auto limit_end = limit_price_idx.upper_bound(max_price);
 
@@ -437,10 +439,18 @@ bool database::check_call_orders(const asset_object& mia, bool enable_black_swan
     if( bitasset.is_prediction_market ) return false;
     if( bitasset.current_feed.settlement_price.is_null() ) return false;
 
-    const call_order_index& call_index = get_index_type<call_order_index>();
+    const asset_id_type debt_id = mia.id;
+    const asset_id_type collateral_id = bitasset.options.short_backing_asset;
+    const call_order_index& call_index = search_index<call_order_index>(
+       [debt_id, collateral_id]( const call_order_object& o ) {
+          return o.debt_type() == debt_id && o.call_price.base.asset_id == collateral_id;
+       } );
     const auto& call_price_index = call_index.indices().get<by_price>();
 
-    const limit_order_index& limit_index = get_index_type<limit_order_index>();
+    const limit_order_index& limit_index = search_index<limit_order_index>(
+       [debt_id, collateral_id]( const limit_order_object& o ) {
+          return o.sell_price.base.asset_id == debt_id && o.sell_price.quote.asset_id == collateral_id;
+       } );
     const auto& limit_price_index = limit_index.indices().get<by_price>();
 
     // looking for limit orders selling the most USD for the least CORE
@@ -42,12 +42,12 @@
 
 namespace graphene { namespace chain {
 
-void database::update_global_dynamic_data( const signed_block& b )
+void database::update_global_dynamic_data( const sealed_block& b )
 {
    const dynamic_global_property_object& _dgp = dynamic_global_property_id_type(0)(*this);
    const global_property_object& gpo = get_global_properties();
 
-   uint32_t missed_blocks = get_slot_at_time( b.timestamp );
+   uint32_t missed_blocks = get_slot_at_time( b->timestamp );
 
 //#define DIRTY_TRICK // problem with missed_blocks can occur when "maintenance_interval" set to few minutes
 #ifdef DIRTY_TRICK
@@ -61,11 +61,11 @@ void database::update_global_dynamic_data( const signed_block& b )
        missed_blocks--;
        for( uint32_t i = 0; i < missed_blocks; ++i ) {
           const auto& witness_missed = get_scheduled_witness( i+1 )(*this);
-          if(  witness_missed.id != b.witness ) {
+          if(  witness_missed.id != b->witness ) {
              /*
              const auto& witness_account = witness_missed.witness_account(*this);
-             if( (fc::time_point::now() - b.timestamp) < fc::seconds(30) )
-                wlog( "Witness ${name} missed block ${n} around ${t}", ("name",witness_account.name)("n",b.block_num())("t",b.timestamp) );
+             if( (fc::time_point::now() - b->timestamp) < fc::seconds(30) )
+                wlog( "Witness ${name} missed block ${n} around ${t}", ("name",witness_account.name)("n",b.block_num())("t",b->timestamp) );
                 */
 
              modify( witness_missed, [&]( witness_object& w ) {
@@ -81,7 +81,7 @@ void database::update_global_dynamic_data( const signed_block& b )
    modify( _dgp, [&]( dynamic_global_property_object& dgp ){
       secret_hash_type::encoder enc;       
       fc::raw::pack( enc, dgp.random );       
-      fc::raw::pack( enc, b.previous_secret );        
+      fc::raw::pack( enc, b->previous_secret );        
       dgp.random = enc.result();
 
       _random_number_generator = fc::hash_ctr_rng<secret_hash_type, 20>(dgp.random.data());
@@ -99,8 +99,8 @@ void database::update_global_dynamic_data( const signed_block& b )
 
       dgp.head_block_number = b.block_num();
       dgp.head_block_id = b.id();
-      dgp.time = b.timestamp;
-      dgp.current_witness = b.witness;
+      dgp.time = b->timestamp;
+      dgp.current_witness = b->witness;
       dgp.recent_slots_filled = (
            (dgp.recent_slots_filled << 1)
            + 1) << missed_blocks;
@@ -186,6 +186,7 @@ void database::clear_expired_transactions()
    const auto& dedupe_index = transaction_idx.indices().get<by_expiration>();
    while( (!dedupe_index.empty()) && (head_block_time() > dedupe_index.begin()->trx.expiration) )
       transaction_idx.remove(*dedupe_index.begin());
+   _signature_cache.remove_expired( head_block_time() );
 } FC_CAPTURE_AND_RETHROW() }
 
 void database::clear_expired_proposals()
@@ -84,7 +84,7 @@ database& generic_evaluator::db()const { return trx_state->db(); }
       if( !trx_state->skip_fee ) {
          if( fee_asset->get_id() != asset_id_type() )
          {
-            db().modify(*fee_asset_dyn_data, [this](asset_dynamic_data_object& d) {
+            db().modify_in< simple_index<asset_dynamic_data_object> >(*fee_asset_dyn_data, [this](asset_dynamic_data_object& d) {
                d.accumulated_fees += fee_from_account.amount;
                d.fee_pool -= core_fee_paid;
             });
@@ -97,7 +97,7 @@ database& generic_evaluator::db()const { return trx_state->db(); }
       if( !trx_state->skip_fee ) {
          database& d = db();
          /// TODO: db().pay_fee( account_id, core_fee );
-         d.modify(*fee_paying_account_statistics, [&](account_statistics_object& s)
+         d.modify_in< simple_index<account_statistics_object> >(*fee_paying_account_statistics, [&](account_statistics_object& s)
          {
             s.pay_fee( core_fee_paid, d.get_global_properties().parameters.cashback_vesting_threshold );
          });
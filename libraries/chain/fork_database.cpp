@@ -44,7 +44,7 @@ void fork_database::pop_block()
     _head = prev;
 }
 
-void     fork_database::start_block(signed_block b)
+void     fork_database::start_block(sealed_block b)
 {
    auto item = std::make_shared<fork_item>(std::move(b));
    _index.insert(item);
@@ -55,7 +55,7 @@ void     fork_database::start_block(signed_block b)
  * Pushes the block into the fork database and caches it if it doesn't link
  *
  */
-shared_ptr<fork_item>  fork_database::push_block(const signed_block& b)
+shared_ptr<fork_item>  fork_database::push_block(const sealed_block& b)
 {
    auto item = std::make_shared<fork_item>(b);
    try {
@@ -64,7 +64,7 @@ shared_ptr<fork_item>  fork_database::push_block(const signed_block& b)
    catch ( const unlinkable_block_exception& e )
    {
       wlog( "Pushing block to fork database that failed to link: ${id}, ${num}", ("id",b.id())("num",b.block_num()) );
-      wlog( "Head: ${num}, ${id}", ("num",_head->data.block_num())("id",_head->data.id()) );
+      wlog( "Head: ${num}, ${id}", ("num",_head->num)("id",_head->id) );
       throw;
       _unlinked_index.insert( item );
    }
@@ -211,19 +211,19 @@ pair<fork_database::branch_type,fork_database::branch_type>
    auto second_branch = *second_branch_itr;
 
 
-   while( first_branch->data.block_num() > second_branch->data.block_num() )
+   while( first_branch->num > second_branch->num )
    {
       result.first.push_back(first_branch);
       first_branch = first_branch->prev.lock();
       FC_ASSERT(first_branch);
    }
-   while( second_branch->data.block_num() > first_branch->data.block_num() )
+   while( second_branch->num > first_branch->num )
    {
       result.second.push_back( second_branch );
       second_branch = second_branch->prev.lock();
       FC_ASSERT(second_branch);
    }
-   while( first_branch->data.previous != second_branch->data.previous )
+   while( first_branch->previous_id() != second_branch->previous_id() )
    {
       result.first.push_back(first_branch);
       result.second.push_back(second_branch);
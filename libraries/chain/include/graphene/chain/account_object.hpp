@@ -271,8 +271,9 @@ namespace graphene { namespace chain {
       public:
          virtual void object_inserted( const object& obj ) override;
          virtual void object_removed( const object& obj ) override;
-         virtual void about_to_modify( const object& before ) override;
-         virtual void object_modified( const object& after  ) override;
+         /** packs the owner and active authorities and the memo key, nothing else affects the memberships */
+         virtual bool pack_fields( const object& obj, vector<char>& data )const override;
+         virtual void fields_modified( const vector<char>& before, const object& after ) override;
 
 
          /** given an account or key, map it to the set of accounts that reference it in an active or owner authority */
@@ -286,10 +287,6 @@ namespace graphene { namespace chain {
          set<account_id_type>  get_account_members( const account_object& a )const;
          set<public_key_type>  get_key_members( const account_object& a )const;
          set<address>          get_address_members( const account_object& a )const;
-
-         set<account_id_type>  before_account_members;
-         set<public_key_type>  before_key_members;
-         set<address>          before_address_members;
    };
 
 
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/chain/protocol/block.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+
+#include <memory>
+#include <mutex>
+
+namespace graphene { namespace chain {
+   using boost::multi_index_container;
+   using namespace boost::multi_index;
+
+   struct block_cache_stats
+   {
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+      uint64_t evictions = 0;
+      uint32_t size = 0;       ///< number of blocks held
+      uint64_t bytes = 0;      ///< packed size of the blocks held
+      uint64_t capacity = 0;   ///< maximum packed size of the blocks held
+   };
+
+   /**
+    *  @class block_cache
+    *  @brief remembers recently read and stored blocks of the block log in sealed form
+    *
+    *  Peers syncing from this node and API clients tend to ask for the same recent blocks over and over.
+    *  Entries are keyed by block number and checked against the block id, so a block which was replaced
+    *  by a fork switch is never returned for the new one.  The least recently used blocks are evicted once
+    *  the packed size of all blocks held exceeds the capacity.
+    *
+    *  All methods may be called concurrently from several threads.
+    */
+   class block_cache
+   {
+      public:
+         explicit block_cache( uint64_t capacity = 64*1024*1024 ):_capacity(capacity){}
+
+         optional<sealed_block> find( uint32_t block_num, const block_id_type& id );
+         void insert( const sealed_block& block );
+         /** forgets the block numbered block_num, because it was removed or replaced */
+         void remove( uint32_t block_num );
+
+         void set_capacity( uint64_t capacity );
+         void clear();
+
+         block_cache_stats get_stats()const;
+
+      private:
+         struct cache_entry
+         {
+            uint32_t                              block_num;
+            block_id_type                         id;
+            sealed_block                          block;
+            uint32_t                              packed_size;
+         };
+         struct by_block_num;
+         typedef multi_index_container<
+            cache_entry,
+            indexed_by<
+               sequenced<>,
+               hashed_unique< tag<by_block_num>, member< cache_entry, uint32_t, &cache_entry::block_num > >
+            >
+         > cache_index_type;
+
+         void evict_to( uint64_t bytes );
+
+         mutable std::mutex  _mutex;
+         cache_index_type    _entries; ///< most recently used first
+         uint64_t            _capacity;
+         uint64_t            _bytes = 0;
+         uint64_t            _hits = 0;
+         uint64_t            _misses = 0;
+         uint64_t            _evictions = 0;
+   };
+
+} } // graphene::chain
+
+FC_REFLECT( graphene::chain::block_cache_stats, (hits)(misses)(evictions)(size)(bytes)(capacity) )
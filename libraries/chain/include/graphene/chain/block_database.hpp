@@ -22,29 +22,125 @@
  * THE SOFTWARE.
  */
 #pragma once
-#include <fstream>
+#include <graphene/chain/block_cache.hpp>
 #include <graphene/chain/protocol/block.hpp>
 
+#include <atomic>
+
 namespace graphene { namespace chain {
+   /** fixed size record of the index file, the one of block number n is stored at offset n*sizeof(index_entry) */
+   struct index_entry
+   {
+      uint64_t      block_pos = 0;
+      uint32_t      block_size = 0;
+      block_id_type block_id;
+   };
+
+   /**
+    *  Block log made of the blocks file, which blocks are appended to, and the index file mapping block numbers
+    *  to their position.  The index is memory mapped and blocks are read with pread(), so the const methods may
+    *  be called from any number of threads at once, also while another thread stores or removes blocks.  Only
+    *  one thread at a time may modify the block_database.  close() waits for the reads in progress, reads made
+    *  while it is closed find nothing.
+    *
+    *  A reader racing with the replacement of an index entry may see it half written; every block read is
+    *  checked against the id in the entry it was found through, so it then finds no block rather than a wrong one.
+    */
    class block_database 
    {
       public:
-         void open( const fc::path& dbdir );
+         block_database();
+         ~block_database();
+
+         /** a read only block_database does not see blocks stored after it was opened */
+         void open( const fc::path& dbdir, bool read_only = false );
          bool is_open()const;
+         /** blocks are handed to the operating system as they are stored, this only exists for symmetry */
          void flush();
+         /**
+          * Waits for the reads in progress and unmaps the index.  The index file keeps the zeroes its last segment
+          * is padded with, which the mappings of a block_database_reader may cover, open() skips those.
+          */
          void close();
 
          void store( const block_id_type& id, const signed_block& b );
+         /** appends the bytes b was sealed with, b is kept in the cache as the next reader likely wants it */
+         void store( const sealed_block& b );
          void remove( const block_id_type& id );
 
          bool                   contains( const block_id_type& id )const;
          block_id_type          fetch_block_id( uint32_t block_num )const;
          optional<signed_block> fetch_optional( const block_id_type& id )const;
          optional<signed_block> fetch_by_number( uint32_t block_num )const;
+         optional<sealed_block> fetch_sealed( const block_id_type& id )const;
+         optional<sealed_block> fetch_sealed_by_number( uint32_t block_num )const;
+         /** blocks numbered block_num onwards, at most count of them and up to the first one missing */
+         vector<signed_block>   fetch_range( uint32_t block_num, uint32_t count )const;
          optional<signed_block> last()const;
          optional<block_id_type> last_id()const;
+
+         /** blocks stored or fetched by number or id are kept here, fetch_range() bypasses it */
+         block_cache&           get_cache()      { return _cache; }
+         const block_cache&     get_cache()const { return _cache; }
       private:
-         mutable std::fstream _blocks;
-         mutable std::fstream _block_num_to_pos;
+         /** the index file is mapped in segments of this many entries, a mapped segment stays until close() */
+         static const uint32_t entries_per_segment = 1 << 20;
+         static const uint64_t segment_bytes = sizeof(index_entry) * uint64_t(entries_per_segment);
+         static const uint32_t max_segments = uint32_t( (uint64_t(1) << 32) / entries_per_segment );
+
+         /** taken by every const method, which finds nothing unless the block_database is open */
+         class read_guard
+         {
+            public:
+               explicit read_guard( const block_database& db );
+               ~read_guard();
+               bool readable()const { return _readable; }
+            private:
+               read_guard( const read_guard& ) = delete;
+               read_guard& operator=( const read_guard& ) = delete;
+               const block_database& _db;
+               bool                  _readable;
+         };
+
+         bool                   read_entry( uint32_t block_num, index_entry& e )const;
+         void                   write_entry( uint32_t block_num, const index_entry& e );
+         char*                  map_segment( uint32_t segment );
+         /** @return the block e points to if it has the id e names, from the cache if it is there */
+         optional<sealed_block> read_block( uint32_t block_num, const index_entry& e )const;
+         void                   read_blocks( uint64_t pos, char* data, size_t size )const;
+         void                   append( const block_id_type& id, const vector<char>& data );
+
+         int                                         _blocks_fd = -1;
+         int                                         _index_fd = -1;
+         bool                                        _read_only = false;
+         uint64_t                                    _blocks_end = 0;  ///< only used by the writer
+         std::unique_ptr< std::atomic<char*>[] >     _segments;
+         std::atomic<uint32_t>                       _entry_count;     ///< entries in the index, stored or not
+         /** cleared by close() before it waits for _readers to drop to 0 */
+         std::atomic<bool>                           _readable;
+         mutable std::atomic<uint32_t>               _readers;
+         mutable block_cache                         _cache;
+   };
+
+   /**
+    *  Read only view of the files of a block_database with a mapping of its own, for readers which must not
+    *  depend on the block_database of the chain being open.
+    *
+    *  The mapping covers the index as it was when the reader was created.  A block_database writing the same
+    *  files only ever grows the index, so the reader may outlive it.
+    */
+   class block_database_reader
+   {
+      public:
+         explicit block_database_reader( const fc::path& dbdir );
+
+         optional<signed_block> fetch_by_number( uint32_t block_num )const;
+         optional<sealed_block> fetch_sealed( const block_id_type& id )const;
+         optional<sealed_block> fetch_sealed_by_number( uint32_t block_num )const;
+         vector<signed_block>   fetch_range( uint32_t block_num, uint32_t count )const;
+      private:
+         block_database _blocks;
    };
 } }
+
+FC_REFLECT( graphene::chain::index_entry, (block_pos)(block_size)(block_id) );
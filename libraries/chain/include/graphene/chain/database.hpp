@@ -29,12 +29,15 @@
 #include <graphene/chain/fork_database.hpp>
 #include <graphene/chain/block_database.hpp>
 #include <graphene/chain/genesis_state.hpp>
+#include <graphene/chain/pending_transaction_pool.hpp>
+#include <graphene/chain/signature_cache.hpp>
 #include <graphene/chain/evaluator.hpp>
 
 #include <graphene/db/object_database.hpp>
 #include <graphene/db/object.hpp>
 #include <graphene/db/simple_index.hpp>
 #include <fc/signals.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <fc/crypto/hash_ctr_rng.hpp>
 
@@ -52,6 +55,14 @@ namespace graphene { namespace chain {
 
    struct budget_record;
 
+   /** digest of the complete object state as it was after a block was applied */
+   struct block_state_digest
+   {
+      uint32_t       block_num = 0;
+      block_id_type  block_id;
+      fc::sha256     digest;
+   };
+
    /**
     *   @class database
     *   @brief tracks the blockchain state in an extensible manner
@@ -104,6 +115,35 @@ namespace graphene { namespace chain {
           */
          void reindex(fc::path data_dir, const genesis_state_type& initial_allocation = genesis_state_type());
 
+         /**
+          *  Configures how @ref reindex reads the block log: reader_threads threads fetch and decode up to
+          *  look_ahead blocks ahead of the block being applied.  With either set to 0 blocks are read on the
+          *  applying thread.
+          */
+         void set_reindex_prefetch( uint32_t reader_threads, uint32_t look_ahead );
+
+         /**
+          *  Makes @ref reindex save the object database every interval blocks, so that a reindex which is
+          *  interrupted resumes from the newest checkpoint instead of genesis.  0 disables checkpoints.
+          */
+         void set_reindex_checkpoint_interval( uint32_t interval );
+
+         /**
+          *  Persists the state at the last irreversible block in the background whenever it has advanced by
+          *  interval blocks.  After an unclean shutdown @ref open starts from the persisted state and replays
+          *  only the blocks after it.  0 disables persistence, the state is then only saved by @ref close.
+          *  The state is serialized on a thread of its own, so any other interval enables concurrent reads.
+          */
+         void set_state_persistence_interval( uint32_t interval );
+         /** @return true if data_dir holds a persisted state @ref open can start from */
+         bool has_persisted_state( const fc::path& data_dir )const;
+
+         /**
+          *  Remembers the state digest after each of the last blocks applied, see get_block_state_digest().
+          *  Enables the running state hashes of the object database.  0 disables the history.
+          */
+         void set_state_digest_history( uint32_t blocks );
+
          /**
           * @brief wipe Delete database from disk, and potentially the raw chain as well.
           * @param include_blocks If true, delete the raw chain as well as the database.
@@ -124,6 +164,16 @@ namespace graphene { namespace chain {
          block_id_type              get_block_id_for_num( uint32_t block_num )const;
          optional<signed_block>     fetch_block_by_id( const block_id_type& id )const;
          optional<signed_block>     fetch_block_by_number( uint32_t num )const;
+         /** like the above, but share the block the database holds instead of copying it */
+         optional<sealed_block>     fetch_sealed_block_by_id( const block_id_type& id )const;
+         optional<sealed_block>     fetch_sealed_block_by_number( uint32_t num )const;
+         /** blocks numbered num onwards, at most count of them and up to the first one missing */
+         vector<signed_block>       fetch_blocks_by_number( uint32_t num, uint32_t count )const;
+         /**
+          *  The log of applied blocks.  Unlike the methods above it may be read from any thread while blocks are
+          *  applied; blocks up to the last irreversible one are in it for good.
+          */
+         const block_database&      get_block_log()const { return _block_id_to_block; }
          const signed_transaction&  get_recent_transaction( const transaction_id_type& trx_id )const;
          std::vector<block_id_type> get_block_ids_on_fork(block_id_type head_of_fork) const;
 
@@ -133,14 +183,35 @@ namespace graphene { namespace chain {
           */
          uint32_t witness_participation_rate()const;
 
+         /**
+          *  Digest over the state hashes of all indexes.  Nodes which applied the same blocks and store the same
+          *  objects, i.e. run the same plugins, produce the same digest.  Requires set_state_digest_history().
+          */
+         fc::sha256 compute_state_digest()const;
+         /** @return the state digest after block_num was applied, if it is still in the history */
+         optional<block_state_digest> get_block_state_digest( uint32_t block_num )const;
+
          void                              add_checkpoints( const flat_map<uint32_t,block_id_type>& checkpts );
          const flat_map<uint32_t,block_id_type> get_checkpoints()const { return _checkpoints; }
          bool before_last_checkpoint()const;
 
          bool push_block( const signed_block& b, uint32_t skip = skip_nothing );
+         bool push_block( const sealed_block& b, uint32_t skip = skip_nothing );
          processed_transaction push_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
-         bool _push_block( const signed_block& b );
+         bool _push_block( const sealed_block& b );
          processed_transaction _push_transaction( const signed_transaction& trx );
+         /** trx_id must be trx.id(), callers which already know it save hashing the transaction again */
+         processed_transaction _push_transaction( const signed_transaction& trx, const transaction_id_type& trx_id );
+         /**
+          * Rebuilds the pending state on top of the head block.  The popped transactions are pushed again, then the
+          * ones of pending which are not in a block yet.  Those whose objects did not change since the undo journal
+          * wrote its record number undo_seq are replayed from their recorded effects, the others are evaluated again.
+          * Everything is evaluated again if blocks were popped since popped_block_count() returned popped_blocks.
+          * pending must be in the order the transactions were applied, see pending_transaction_pool::release().
+          */
+         void restore_pending_transactions( vector<pending_transaction_ptr>&& pending, uint64_t undo_seq, uint64_t popped_blocks );
+         uint64_t popped_block_count()const { return _popped_block_count; }
+         const pending_transaction_stats& get_pending_transaction_stats()const { return _pending_tx_stats; }
 
          ///@throws fc::exception if the proposed transaction fails to apply.
          processed_transaction push_proposal( const proposal_object& proposal );
@@ -156,10 +227,35 @@ namespace graphene { namespace chain {
             witness_id_type witness_id,
             const fc::ecc::private_key& block_signing_private_key
             );
+         /**
+          *  Assembles the block witness_id is to produce at when ahead of its slot.  The pending state is rebuilt
+          *  from the best paying transactions which fit in the block, in the order they go in, the others wait.
+          *  Transactions pushed afterwards join the candidate while they fit, so generate_block() for the same
+          *  slot only has to sign and push it, those expiring before when are rejected.  The candidate is dropped
+          *  once the head block changes.
+          */
+         void prepare_block( fc::time_point_sec when, witness_id_type witness_id, uint32_t skip = skip_nothing );
+         bool has_block_candidate( fc::time_point_sec when, witness_id_type witness_id )const;
+         void _prepare_block( fc::time_point_sec when, witness_id_type witness_id );
 
          void pop_block();
          void clear_pending();
 
+         /**
+          *  Sets the number of worker threads which recover the signing keys of all transactions in
+          *  a block before push_block() applies it.  With 0 threads the keys are recovered one
+          *  transaction at a time while the block is applied.
+          */
+         void set_signature_recovery_threads( uint32_t thread_count );
+
+         /** Public keys recovered while validating transactions, shared by the pending state and block application */
+         signature_cache&       get_signature_cache()       { return _signature_cache; }
+         const signature_cache& get_signature_cache()const  { return _signature_cache; }
+         block_cache&           get_block_cache()           { return _block_id_to_block.get_cache(); }
+         const block_cache&     get_block_cache()const      { return _block_id_to_block.get_cache(); }
+         pending_transaction_pool&       get_pending_transaction_pool()       { return _pending_tx; }
+         const pending_transaction_pool& get_pending_transaction_pool()const  { return _pending_tx; }
+
          /**
           *  This method is used to track appied operations during the evaluation of a block, these
           *  operations should include any operation actually included in a transaction as well
@@ -407,6 +503,18 @@ namespace graphene { namespace chain {
 
       private:
          optional<undo_database::session>       _pending_tx_session;
+
+         /** the block prepare_block() is assembling in the pending state */
+         struct block_candidate
+         {
+            block_id_type                  previous;
+            fc::time_point_sec             when;
+            witness_id_type                witness;
+            vector<processed_transaction>  transactions;
+            size_t                         size = 0;
+         };
+         optional<block_candidate>              _block_candidate;
+
          vector< unique_ptr<op_evaluator> >     _operation_evaluators;
 
          template<class Index>
@@ -416,22 +524,46 @@ namespace graphene { namespace chain {
 
        public:
          // these were formerly private, but they have a fairly well-defined API, so let's make them public
-         void                  apply_block( const signed_block& next_block, uint32_t skip = skip_nothing );
+         void                  apply_block( const sealed_block& next_block, uint32_t skip = skip_nothing );
          processed_transaction apply_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
          operation_result      apply_operation( transaction_evaluation_state& eval_state, const operation& op );
       private:
-         void                  _apply_block( const signed_block& next_block );
+         void                  _apply_block( const sealed_block& next_block );
+         /** fills in the objects applying pending changed since the undo journal wrote record number first_seq */
+         void                  record_pending_effects( pending_transaction& pending, uint64_t first_seq )const;
+         /** @return false if the recorded effects no longer apply, the state is then left as it was */
+         bool                  replay_pending_transaction( const pending_transaction& pending );
+         /** @return the fees of trx converted to the core asset, fee_payer is set to the payer of the first operation */
+         share_type            get_core_fees( const signed_transaction& trx, account_id_type& fee_payer )const;
+         /**
+          * Applies trx to the pending state and adds it to the pool, or only to the pool if it has to wait for a
+          * later block than the candidate.  Changed objects are notified if notify is set.
+          */
+         pending_transaction_ptr apply_pending_transaction( const signed_transaction& trx, const transaction_id_type& trx_id,
+                                                            bool notify );
+         /**
+          * adds pending to the pool, see drop_pending_transactions() for those evicted
+          * @return false if pending was evicted itself, it is then left to the caller to drop
+          */
+         bool                  add_pending_transaction( const pending_transaction_ptr& pending );
+         /** notes transactions taken out of the pool while their effects stay in the pending state */
+         void                  drop_pending_transactions( const vector<pending_transaction_ptr>& dropped );
          processed_transaction _apply_transaction( const signed_transaction& trx );
+         processed_transaction _apply_transaction( const signed_transaction& trx, const transaction_id_type& trx_id );
 
          ///Steps involved in applying a new block
          ///@{
 
-         const witness_object& validate_block_header( uint32_t skip, const signed_block& next_block )const;
+         void precompute_signature_keys( const signed_block& next_block );
+         void persist_irreversible_state();
+         void wait_for_state_persistence();
+
+         const witness_object& validate_block_header( uint32_t skip, const sealed_block& next_block )const;
          const witness_object& _validate_block_header( const signed_block& next_block )const;
-         void create_block_summary(const signed_block& next_block);
+         void create_block_summary(const sealed_block& next_block);
 
          //////////////////// db_update.cpp ////////////////////
-         void update_global_dynamic_data( const signed_block& b );
+         void update_global_dynamic_data( const sealed_block& b );
          void update_signing_witness(const witness_object& signing_witness, const signed_block& new_block);
          void update_last_irreversible_block();
          void clear_expired_transactions();
@@ -461,7 +593,13 @@ namespace graphene { namespace chain {
          ///@}
          ///@}
 
-         vector< processed_transaction >        _pending_tx;
+         pending_transaction_pool               _pending_tx;
+         pending_transaction_stats              _pending_tx_stats;
+         /** what the transactions dropped from the pool since the pending state was last rebuilt wrote */
+         vector< pending_object_effect >        _dropped_writes;
+         /** whether one of those had effects which were not recorded */
+         bool                                   _dropped_unrecorded = false;
+         uint64_t                               _popped_block_count = 0;
          fork_database                          _fork_db;
 
          /**
@@ -496,6 +634,22 @@ namespace graphene { namespace chain {
          flat_map<uint32_t,block_id_type>  _checkpoints;
 
          node_property_object              _node_property_object;
+
+         vector< std::unique_ptr<fc::thread> > _signature_threads;
+         uint32_t                              _reindex_reader_threads = 2;
+         uint32_t                              _reindex_look_ahead = 256;
+         uint32_t                              _reindex_checkpoint_interval = 0;
+
+         uint32_t                              _state_persistence_interval = 0;
+         uint32_t                              _last_persisted_block = 0;
+         /** position of the undo journal after each reversible block, see persist_irreversible_state() */
+         std::map<uint32_t,uint64_t>           _block_end_undo_seq;
+         std::unique_ptr<fc::thread>           _state_persistence_thread;
+         fc::future<void>                      _state_persistence_done;
+
+         uint32_t                              _state_digest_history = 0;
+         std::map<uint32_t,block_state_digest> _block_state_digests;
+         signature_cache                       _signature_cache;
          fc::hash_ctr_rng<secret_hash_type, 20> _random_number_generator;
    };
 
@@ -519,3 +673,5 @@ namespace graphene { namespace chain {
    }
 
 } }
+
+FC_REFLECT( graphene::chain::block_state_digest, (block_num)(block_id)(digest) )
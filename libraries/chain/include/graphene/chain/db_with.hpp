@@ -68,48 +68,30 @@ struct skip_flags_restorer
  */
 struct pending_transactions_restorer
 {
-   pending_transactions_restorer( database& db, std::vector<processed_transaction>&& pending_transactions )
+   pending_transactions_restorer( database& db, std::vector<pending_transaction_ptr>&& pending_transactions )
       : _db(db), _pending_transactions( std::move(pending_transactions) )
    {
       _db.clear_pending();
+      _undo_seq = _db._undo_db.journal().next_seq();
+      _popped_blocks = _db.popped_block_count();
    }
 
    ~pending_transactions_restorer()
    {
-      for( const auto& tx : _db._popped_tx )
+      try
       {
-         try {
-            if( !_db.is_known_transaction( tx.id() ) ) {
-               // since push_transaction() takes a signed_transaction,
-               // the operation_results field will be ignored.
-               _db._push_transaction( tx );
-            }
-         } catch ( const fc::exception&  ) {
-         }
+         _db.restore_pending_transactions( std::move(_pending_transactions), _undo_seq, _popped_blocks );
       }
-      _db._popped_tx.clear();
-      for( const processed_transaction& tx : _pending_transactions )
+      catch( const fc::exception& e )
       {
-         try
-         {
-            if( !_db.is_known_transaction( tx.id() ) ) {
-               // since push_transaction() takes a signed_transaction,
-               // the operation_results field will be ignored.
-               _db._push_transaction( tx );
-            }
-         }
-         catch( const fc::exception& e )
-         {
-            /*
-            wlog( "Pending transaction became invalid after switching to block ${b}  ${t}", ("b", _db.head_block_id())("t",_db.head_block_time()) );
-            wlog( "The invalid pending transaction caused exception ${e}", ("e", e.to_detail_string() ) );
-            */
-         }
+         elog( "Unable to restore the pending transactions: ${e}", ("e", e.to_detail_string()) );
       }
    }
 
    database& _db;
-   std::vector< processed_transaction > _pending_transactions;
+   std::vector< pending_transaction_ptr > _pending_transactions;
+   uint64_t _undo_seq = 0;
+   uint64_t _popped_blocks = 0;
 };
 
 /**
@@ -139,7 +121,7 @@ void with_skip_flags(
 template< typename Lambda >
 void without_pending_transactions(
    database& db,
-   std::vector<processed_transaction>&& pending_transactions,
+   std::vector<pending_transaction_ptr>&& pending_transactions,
    Lambda callback )
 {
     pending_transactions_restorer restorer( db, std::move(pending_transactions) );
@@ -37,10 +37,10 @@ namespace graphene { namespace chain {
 
    struct fork_item
    {
-      fork_item( signed_block d )
+      fork_item( sealed_block d )
       :num(d.block_num()),id(d.id()),data( std::move(d) ){}
 
-      block_id_type previous_id()const { return data.previous; }
+      block_id_type previous_id()const { return data->previous; }
 
       weak_ptr< fork_item > prev;
       uint32_t              num;    // initialized in ctor
@@ -50,7 +50,7 @@ namespace graphene { namespace chain {
        */
       bool                  invalid = false;
       block_id_type         id;
-      signed_block          data;
+      sealed_block          data;
    };
    typedef shared_ptr<fork_item> item_ptr;
 
@@ -75,7 +75,7 @@ namespace graphene { namespace chain {
          fork_database();
          void reset();
 
-         void                             start_block(signed_block b);
+         void                             start_block(sealed_block b);
          void                             remove(block_id_type b);
          void                             set_head(shared_ptr<fork_item> h);
          bool                             is_known_block(const block_id_type& id)const;
@@ -85,7 +85,7 @@ namespace graphene { namespace chain {
          /**
           *  @return the new head block ( the longest fork )
           */
-         shared_ptr<fork_item>            push_block(const signed_block& b);
+         shared_ptr<fork_item>            push_block(const sealed_block& b);
          shared_ptr<fork_item>            head()const { return _head; }
          void                             pop_block();
 
@@ -86,7 +86,8 @@ namespace graphene { namespace chain {
          ordered_unique< tag<by_next_timeout>, 
             composite_key<game_object, 
                member<game_object, optional<time_point_sec>, &game_object::next_timeout>,
-               member<object, object_id_type, &object::id> > > >
+               member<object, object_id_type, &object::id> > > >,
+      node_allocator<game_object>
    > game_object_multi_index_type;
    typedef generic_index<game_object, game_object_multi_index_type> game_index;
 
@@ -92,7 +92,8 @@ typedef multi_index_container<
             member<object, object_id_type, &object::id>
          >
       >
-   >
+   >,
+   node_allocator<limit_order_object>
 > limit_order_multi_index_type;
 
 typedef generic_index<limit_order_object, limit_order_multi_index_type> limit_order_index;
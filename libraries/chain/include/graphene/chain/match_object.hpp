@@ -100,7 +100,8 @@ namespace graphene { namespace chain {
    typedef multi_index_container<
       match_object,
       indexed_by<
-         ordered_unique< tag<by_id>, member< object, object_id_type, &object::id > >      >
+         ordered_unique< tag<by_id>, member< object, object_id_type, &object::id > >      >,
+      node_allocator<match_object>
    > match_object_multi_index_type;
    typedef generic_index<match_object, match_object_multi_index_type> match_index;
 
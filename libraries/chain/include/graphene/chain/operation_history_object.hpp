@@ -118,7 +118,8 @@ typedef multi_index_container<
             member< account_transaction_history_object, operation_history_id_type, &account_transaction_history_object::operation_id>
          >
       >
-   >
+   >,
+   node_allocator<account_transaction_history_object>
 > account_transaction_history_multi_index_type;
 
 typedef generic_index<account_transaction_history_object, account_transaction_history_multi_index_type> account_transaction_history_index;
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/chain/protocol/transaction.hpp>
+#include <graphene/db/object_database.hpp>
+#include <graphene/db/undo_journal.hpp>
+
+namespace graphene { namespace chain {
+
+   /** the value one object was left with by a pending transaction */
+   struct pending_object_effect
+   {
+      object_id_type                  id;
+      graphene::db::undo_record_kind  kind;   ///< created, modified or removed
+      vector<char>                    value;  ///< packed value of the object, empty if it was removed
+   };
+
+   /**
+    *  A transaction of the pending state together with what applying it read and wrote.  When the pending state is
+    *  rebuilt, a transaction none of whose objects, searched keys or searched indexes changed since it was applied
+    *  is replayed by writing back the values it left instead of evaluating it again.
+    *
+    *  Every transaction reads the dynamic globals, of which every block changes the head block fields.  A change
+    *  to only those does not count, the expiration and TaPoS of a replayed transaction are checked against the new
+    *  head block instead.  What an evaluator derives from the head block time is thus as of the block the
+    *  transaction was applied on, blocks are still generated by evaluating every transaction.
+    */
+   struct pending_transaction
+   {
+      processed_transaction           trx;
+      transaction_id_type             id;
+      /** objects, keys and indexes read while the transaction was evaluated, except for the transaction index */
+      graphene::db::read_set          reads;
+      /** in the order the transaction first touched them, except for its transaction_object */
+      vector<pending_object_effect>   writes;
+      /** false if the effects could not be recorded, the transaction is then always evaluated again */
+      bool                            replayable = false;
+      /** waiting for a later block while a block candidate is the pending state, the effects are not part of it */
+      bool                            postponed = false;
+
+      /** fee payer of the first operation */
+      account_id_type                 fee_payer;
+      /** fees of all operations, converted to the core asset */
+      share_type                      core_fees;
+      /** size of the signed transaction */
+      uint32_t                        packed_size = 0;
+
+      /** @name set by pending_transaction_pool::insert() */
+      /// @{
+      uint64_t                        sequence = 0;
+      uint64_t                        fee_per_kbyte = 0;
+      uint64_t                        memory_size = 0;
+      /// @}
+
+      fc::time_point_sec              expiration()const { return trx.expiration; }
+   };
+   typedef std::shared_ptr<pending_transaction> pending_transaction_ptr;
+
+   struct pending_transaction_stats
+   {
+      uint64_t replayed = 0;     ///< pending transactions restored from their recorded effects after a block
+      uint64_t reevaluated = 0;  ///< pending transactions evaluated again after a block, successfully or not
+      uint64_t evicted = 0;      ///< pending transactions dropped to keep the pool within its capacity
+      uint64_t failed = 0;       ///< pending transactions dropped as they failed while a block was assembled
+   };
+
+} } // graphene::chain
+
+FC_REFLECT( graphene::chain::pending_transaction_stats, (replayed)(reevaluated)(evicted)(failed) )
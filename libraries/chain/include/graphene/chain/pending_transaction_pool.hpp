@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/chain/pending_transaction.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/mem_fun.hpp>
+#include <boost/multi_index/composite_key.hpp>
+
+namespace graphene { namespace chain {
+   using boost::multi_index_container;
+   using namespace boost::multi_index;
+
+   /**
+    *  Holds the transactions of the pending state.  They are kept in the order they were applied to it, which
+    *  the pending state is rebuilt in, and are indexed by the core fee they pay per kilobyte, which blocks are
+    *  assembled in, by expiration and by fee payer.
+    *
+    *  The memory the transactions take, including their recorded effects, is bounded by the capacity.  Once it
+    *  is exceeded the lowest paying transactions are evicted, the most recent first among those paying the same.
+    */
+   class pending_transaction_pool
+   {
+      public:
+         struct by_arrival;
+         struct by_id;
+         struct by_priority;
+         struct by_expiration;
+         struct by_fee_payer;
+         typedef multi_index_container<
+            pending_transaction_ptr,
+            indexed_by<
+               ordered_unique< tag<by_arrival>, member<pending_transaction, uint64_t, &pending_transaction::sequence> >,
+               hashed_unique< tag<by_id>, member<pending_transaction, transaction_id_type, &pending_transaction::id>, std::hash<fc::ripemd160> >,
+               ordered_unique< tag<by_priority>,
+                  composite_key< pending_transaction,
+                     member<pending_transaction, uint64_t, &pending_transaction::fee_per_kbyte>,
+                     member<pending_transaction, uint64_t, &pending_transaction::sequence>
+                  >,
+                  composite_key_compare< std::greater<uint64_t>, std::less<uint64_t> >
+               >,
+               ordered_non_unique< tag<by_expiration>, const_mem_fun<pending_transaction, fc::time_point_sec, &pending_transaction::expiration> >,
+               ordered_non_unique< tag<by_fee_payer>, member<pending_transaction, account_id_type, &pending_transaction::fee_payer> >
+            >
+         > pending_multi_index_type;
+
+         /** Sets the number of bytes the transactions may take, 0 for no limit */
+         void                             set_capacity( uint64_t bytes );
+         uint64_t                         capacity()const { return _capacity; }
+         uint64_t                         memory_size()const { return _memory_size; }
+         size_t                           size()const { return _index.size(); }
+         bool                             empty()const { return _index.empty(); }
+
+         static uint64_t                  fee_per_kbyte( share_type core_fees, uint32_t packed_size );
+         /** @return false if the pool is full of transactions paying at least as much per kilobyte as trx */
+         bool                             would_admit( const pending_transaction& trx )const;
+         /**
+          *  Adds trx, then evicts the lowest paying transactions until the pool is within its capacity again,
+          *  which may include trx itself.
+          *  @return the evicted transactions
+          */
+         vector<pending_transaction_ptr>  insert( const pending_transaction_ptr& trx );
+         pending_transaction_ptr          find( const transaction_id_type& id )const;
+         vector<pending_transaction_ptr>  find_by_fee_payer( account_id_type payer )const;
+         /** removes and returns the transactions which expire before now */
+         vector<pending_transaction_ptr>  remove_expired( fc::time_point_sec now );
+         /** removes every transaction and returns them in the order they arrived */
+         vector<pending_transaction_ptr>  release();
+         void                             clear();
+
+         const pending_multi_index_type&  index()const { return _index; }
+
+      private:
+         pending_multi_index_type         _index;
+         uint64_t                         _capacity = 0;
+         uint64_t                         _memory_size = 0;
+         uint64_t                         _next_sequence = 0;
+   };
+
+} } // graphene::chain
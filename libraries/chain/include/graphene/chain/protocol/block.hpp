@@ -24,6 +24,8 @@
 #pragma once
 #include <graphene/chain/protocol/transaction.hpp>
 
+#include <mutex>
+
 namespace graphene { namespace chain {
 
    struct block_header
@@ -57,6 +59,73 @@ namespace graphene { namespace chain {
       vector<processed_transaction> transactions;
    };
 
+   /**
+    * An immutable signed_block together with what the chain derives from it over and over: its serialized
+    * bytes, the block id, the digest the witness signed and the id of every transaction.  All but the
+    * transaction ids are computed once when the block is sealed, those when they are first asked for.  Copies
+    * share the block, so a sealed_block is cheap to pass around and may be read from any thread.
+    *
+    * A sealed_block packs to the bytes it keeps without serializing the block again.  A default constructed
+    * one holds no block and may only be assigned to or unpacked into.
+    */
+   class sealed_block
+   {
+      public:
+         sealed_block() {}
+         explicit sealed_block( signed_block b );
+         /** packed must be the serialized b, e.g. the bytes b was unpacked from */
+         sealed_block( signed_block b, vector<char> packed );
+
+         const signed_block&         block()const       { return _content->block; }
+         const signed_block*         operator->()const  { return &_content->block; }
+
+         const block_id_type&        id()const          { return _content->id; }
+         uint32_t                    block_num()const   { return _content->block.block_num(); }
+         const digest_type&          digest()const      { return _content->digest; }
+         const vector<char>&         packed()const      { return _content->packed; }
+         uint32_t                    packed_size()const { return uint32_t( _content->packed.size() ); }
+         /** @return the id of the transaction at position i of the block */
+         const transaction_id_type&  transaction_id( size_t i )const;
+
+         fc::ecc::public_key         signee()const;
+         bool                        validate_signee( const fc::ecc::public_key& expected_signee )const;
+
+      private:
+         struct content
+         {
+            signed_block                          block;
+            vector<char>                          packed;
+            block_id_type                         id;
+            digest_type                           digest;
+            mutable std::once_flag                transaction_ids_computed;
+            mutable vector<transaction_id_type>   transaction_ids;
+         };
+
+         void seal( signed_block&& b, vector<char>&& packed );
+
+         std::shared_ptr<const content>  _content;
+   };
+
+   template<typename Stream>
+   inline Stream& operator<<( Stream& s, const sealed_block& b )
+   {
+      s.write( b.packed().data(), b.packed().size() );
+      return s;
+   }
+
+   /**
+    * Packs the block again rather than keeping the bytes it was unpacked from: those may unpack to the block
+    * without being what it packs to, e.g. with varints longer than needed, and must not be stored or relayed.
+    */
+   template<typename Stream>
+   inline Stream& operator>>( Stream& s, sealed_block& b )
+   {
+      signed_block tmp;
+      fc::raw::unpack( s, tmp );
+      b = sealed_block( std::move(tmp) );
+      return s;
+   }
+
 } } // graphene::chain
 
 FC_REFLECT( graphene::chain::block_header, 
@@ -69,3 +138,8 @@ FC_REFLECT( graphene::chain::block_header,
             (extensions) )
 FC_REFLECT_DERIVED( graphene::chain::signed_block_header, (graphene::chain::block_header), (witness_signature) )
 FC_REFLECT_DERIVED( graphene::chain::signed_block, (graphene::chain::signed_block_header), (transactions) )
+
+namespace fc {
+   void to_variant( const graphene::chain::sealed_block& b, fc::variant& v );
+   void from_variant( const fc::variant& v, graphene::chain::sealed_block& b );
+}
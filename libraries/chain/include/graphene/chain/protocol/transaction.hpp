@@ -29,6 +29,8 @@
 
 namespace graphene { namespace chain {
 
+   class signature_cache;
+
    /**
     * @defgroup transactions Transactions
     *
@@ -148,7 +150,8 @@ namespace graphene { namespace chain {
          const chain_id_type& chain_id,
          const std::function<const authority*(account_id_type)>& get_active,
          const std::function<const authority*(account_id_type)>& get_owner,
-         uint32_t max_recursion = GRAPHENE_MAX_SIG_CHECK_DEPTH )const;
+         uint32_t max_recursion = GRAPHENE_MAX_SIG_CHECK_DEPTH,
+         signature_cache* cache = nullptr )const;
 
       /**
        * This is a slower replacement for get_required_signatures()
@@ -165,12 +168,30 @@ namespace graphene { namespace chain {
          uint32_t max_recursion = GRAPHENE_MAX_SIG_CHECK_DEPTH
          ) const;
 
-      flat_set<public_key_type> get_signature_keys( const chain_id_type& chain_id )const;
+      /**
+       *  Returns the keys recovered by the last call to precompute_signature_keys() if the
+       *  transaction and its signatures did not change since, otherwise recovers them.
+       *  If a cache is given, keys found in it are not recovered and recovered keys are added to it.
+       */
+      flat_set<public_key_type> get_signature_keys( const chain_id_type& chain_id, signature_cache* cache = nullptr )const;
+
+      /**
+       *  Recovers the signing keys and keeps them with the transaction so that a later
+       *  get_signature_keys() does not have to.  This allows signature recovery to run on a
+       *  different thread than the one applying the transaction.
+       */
+      void precompute_signature_keys( const chain_id_type& chain_id, signature_cache* cache = nullptr )const;
 
       vector<signature_type> signatures;
 
       /// Removes all operations and signatures
       void clear() { operations.clear(); signatures.clear(); }
+
+   private:
+      /// not serialized, set by precompute_signature_keys()
+      mutable flat_set<public_key_type> _signees;
+      mutable digest_type               _signees_digest;
+      mutable vector<signature_type>    _signees_signatures;
    };
 
    void verify_authority( const vector<operation>& ops, const flat_set<public_key_type>& sigs,
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/chain/protocol/types.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+
+#include <mutex>
+
+namespace graphene { namespace chain {
+   using boost::multi_index_container;
+   using namespace boost::multi_index;
+
+   struct signature_cache_stats
+   {
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+      uint64_t evictions = 0;
+      uint32_t size = 0;
+      uint32_t capacity = 0;
+   };
+
+   /**
+    *  @class signature_cache
+    *  @brief remembers the public keys recovered from transaction signatures
+    *
+    *  A transaction is usually validated when it is pushed to the pending state and again when the
+    *  block containing it is applied, and again whenever the pending state is rebuilt.  Entries are
+    *  keyed by the signature digest and the signature, so a hit is exactly the key recovery would
+    *  produce.  They are dropped once the transaction has expired, and the entries expiring first
+    *  are evicted when the cache is full.
+    *
+    *  All methods may be called concurrently from several threads.
+    */
+   class signature_cache
+   {
+      public:
+         explicit signature_cache( uint32_t capacity = 100000 ):_capacity(capacity){}
+
+         optional<public_key_type> find( const digest_type& digest, const signature_type& signature );
+         void insert( const digest_type& digest, const signature_type& signature,
+                      const public_key_type& key, time_point_sec expiration );
+
+         /** removes the entries of all transactions which expired before now */
+         void remove_expired( time_point_sec now );
+         void set_capacity( uint32_t capacity );
+         void clear();
+
+         signature_cache_stats get_stats()const;
+
+      private:
+         struct cache_key
+         {
+            digest_type    digest;
+            signature_type signature;
+
+            friend bool operator == ( const cache_key& a, const cache_key& b )
+            { return a.digest == b.digest && a.signature == b.signature; }
+         };
+         struct cache_key_hash
+         {
+            size_t operator()( const cache_key& k )const;
+         };
+         struct cache_entry
+         {
+            cache_key         key;
+            public_key_type   public_key;
+            time_point_sec    expiration;
+         };
+         struct by_signature;
+         struct by_expiration;
+         typedef multi_index_container<
+            cache_entry,
+            indexed_by<
+               hashed_unique< tag<by_signature>, member< cache_entry, cache_key, &cache_entry::key >, cache_key_hash >,
+               ordered_non_unique< tag<by_expiration>, member< cache_entry, time_point_sec, &cache_entry::expiration > >
+            >
+         > cache_index_type;
+
+         void evict_to( uint32_t size );
+
+         mutable std::mutex  _mutex;
+         cache_index_type    _entries;
+         uint32_t            _capacity;
+         uint64_t            _hits = 0;
+         uint64_t            _misses = 0;
+         uint64_t            _evictions = 0;
+   };
+
+} } // graphene::chain
+
+FC_REFLECT( graphene::chain::signature_cache_stats, (hits)(misses)(evictions)(size)(capacity) )
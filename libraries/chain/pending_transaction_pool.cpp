@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/pending_transaction_pool.hpp>
+
+namespace graphene { namespace chain {
+
+void pending_transaction_pool::set_capacity( uint64_t bytes )
+{
+   _capacity = bytes;
+}
+
+uint64_t pending_transaction_pool::fee_per_kbyte( share_type core_fees, uint32_t packed_size )
+{
+   if( core_fees <= 0 )
+      return 0;
+   return uint64_t( core_fees.value ) * 1024 / std::max<uint32_t>( packed_size, 1 );
+}
+
+bool pending_transaction_pool::would_admit( const pending_transaction& trx )const
+{
+   if( _capacity == 0 || _memory_size < _capacity || _index.empty() )
+      return true;
+   const auto& lowest = **_index.get<by_priority>().rbegin();
+   return fee_per_kbyte( trx.core_fees, trx.packed_size ) > lowest.fee_per_kbyte;
+}
+
+vector<pending_transaction_ptr> pending_transaction_pool::insert( const pending_transaction_ptr& trx )
+{
+   trx->sequence = _next_sequence++;
+   trx->fee_per_kbyte = fee_per_kbyte( trx->core_fees, trx->packed_size );
+   trx->memory_size = sizeof( pending_transaction ) + trx->packed_size
+                      + trx->reads.objects.size() * sizeof( object_id_type )
+                      + trx->reads.indexes.size() * sizeof( std::pair<uint8_t,uint8_t> )
+                      + trx->writes.size() * sizeof( pending_object_effect );
+   for( const auto& effect : trx->writes )
+      trx->memory_size += effect.value.size();
+
+   FC_ASSERT( _index.insert( trx ).second, "transaction ${id} is already pending", ("id", trx->id) );
+   _memory_size += trx->memory_size;
+
+   vector<pending_transaction_ptr> evicted;
+   auto& by_prio = _index.get<by_priority>();
+   while( _capacity > 0 && _memory_size > _capacity && !by_prio.empty() )
+   {
+      auto lowest = std::prev( by_prio.end() );
+      _memory_size -= (*lowest)->memory_size;
+      evicted.push_back( *lowest );
+      by_prio.erase( lowest );
+   }
+   return evicted;
+}
+
+pending_transaction_ptr pending_transaction_pool::find( const transaction_id_type& id )const
+{
+   const auto& by_trx_id = _index.get<by_id>();
+   auto itr = by_trx_id.find( id );
+   if( itr == by_trx_id.end() )
+      return pending_transaction_ptr();
+   return *itr;
+}
+
+vector<pending_transaction_ptr> pending_transaction_pool::find_by_fee_payer( account_id_type payer )const
+{
+   const auto& by_payer = _index.get<by_fee_payer>();
+   auto range = by_payer.equal_range( payer );
+   return vector<pending_transaction_ptr>( range.first, range.second );
+}
+
+vector<pending_transaction_ptr> pending_transaction_pool::remove_expired( fc::time_point_sec now )
+{
+   auto& by_exp = _index.get<by_expiration>();
+   vector<pending_transaction_ptr> expired;
+   while( !by_exp.empty() && (*by_exp.begin())->expiration() < now )
+   {
+      _memory_size -= (*by_exp.begin())->memory_size;
+      expired.push_back( *by_exp.begin() );
+      by_exp.erase( by_exp.begin() );
+   }
+   return expired;
+}
+
+vector<pending_transaction_ptr> pending_transaction_pool::release()
+{
+   const auto& by_seq = _index.get<by_arrival>();
+   vector<pending_transaction_ptr> result( by_seq.begin(), by_seq.end() );
+   clear();
+   return result;
+}
+
+void pending_transaction_pool::clear()
+{
+   _index.clear();
+   _memory_size = 0;
+}
+
+} } // graphene::chain
@@ -89,4 +89,60 @@ namespace graphene { namespace chain {
       return checksum_type::hash( ids[0] );
    }
 
+   sealed_block::sealed_block( signed_block b )
+   {
+      vector<char> packed = fc::raw::pack( b );
+      seal( std::move(b), std::move(packed) );
+   }
+
+   sealed_block::sealed_block( signed_block b, vector<char> packed )
+   {
+      seal( std::move(b), std::move(packed) );
+   }
+
+   void sealed_block::seal( signed_block&& b, vector<char>&& packed )
+   {
+      auto c = std::make_shared<content>();
+      c->block = std::move( b );
+      c->packed = std::move( packed );
+      c->id = c->block.id();
+      c->digest = c->block.digest();
+      _content = std::move( c );
+   }
+
+   const transaction_id_type& sealed_block::transaction_id( size_t i )const
+   {
+      const content& c = *_content;
+      std::call_once( c.transaction_ids_computed, [&c]() {
+         c.transaction_ids.reserve( c.block.transactions.size() );
+         for( const auto& trx : c.block.transactions )
+            c.transaction_ids.push_back( trx.id() );
+      });
+      return c.transaction_ids[i];
+   }
+
+   fc::ecc::public_key sealed_block::signee()const
+   {
+      return fc::ecc::public_key( _content->block.witness_signature, _content->digest, true/*enforce canonical*/ );
+   }
+
+   bool sealed_block::validate_signee( const fc::ecc::public_key& expected_signee )const
+   {
+      return signee() == expected_signee;
+   }
+
 } }
+
+namespace fc {
+   void to_variant( const graphene::chain::sealed_block& b, fc::variant& v )
+   {
+      to_variant( b.block(), v );
+   }
+
+   void from_variant( const fc::variant& v, graphene::chain::sealed_block& b )
+   {
+      graphene::chain::signed_block tmp;
+      from_variant( v, tmp );
+      b = graphene::chain::sealed_block( std::move(tmp) );
+   }
+}
@@ -22,6 +22,7 @@
  * THE SOFTWARE.
  */
 #include <graphene/chain/exceptions.hpp>
+#include <graphene/chain/signature_cache.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/bitutil.hpp>
@@ -297,20 +298,40 @@ void verify_authority( const vector<operation>& ops, const flat_set<public_key_t
 } FC_CAPTURE_AND_RETHROW( (ops)(sigs) ) }
 
 
-flat_set<public_key_type> signed_transaction::get_signature_keys( const chain_id_type& chain_id )const
+flat_set<public_key_type> signed_transaction::get_signature_keys( const chain_id_type& chain_id, signature_cache* cache )const
 { try {
    auto d = sig_digest( chain_id );
+   if( !signatures.empty() && d == _signees_digest && signatures == _signees_signatures )
+      return _signees;
    flat_set<public_key_type> result;
    for( const auto&  sig : signatures )
    {
+      optional<public_key_type> key;
+      if( cache != nullptr )
+         key = cache->find( d, sig );
+      if( !key.valid() )
+      {
+         key = public_key_type( fc::ecc::public_key(sig,d) );
+         if( cache != nullptr )
+            cache->insert( d, sig, *key, expiration );
+      }
       GRAPHENE_ASSERT(
-         result.insert( fc::ecc::public_key(sig,d) ).second,
+         result.insert( *key ).second,
          tx_duplicate_sig,
          "Duplicate Signature detected" );
    }
    return result;
 } FC_CAPTURE_AND_RETHROW() }
 
+void signed_transaction::precompute_signature_keys( const chain_id_type& chain_id, signature_cache* cache )const
+{
+   _signees_signatures.clear();
+   auto keys = get_signature_keys( chain_id, cache );
+   _signees = std::move( keys );
+   _signees_digest = sig_digest( chain_id );
+   _signees_signatures = signatures;
+}
+
 
 
 set<public_key_type> signed_transaction::get_required_signatures(
@@ -378,9 +399,10 @@ void signed_transaction::verify_authority(
    const chain_id_type& chain_id,
    const std::function<const authority*(account_id_type)>& get_active,
    const std::function<const authority*(account_id_type)>& get_owner,
-   uint32_t max_recursion )const
+   uint32_t max_recursion,
+   signature_cache* cache )const
 { try {
-   graphene::chain::verify_authority( operations, get_signature_keys( chain_id ), get_active, get_owner, max_recursion );
+   graphene::chain::verify_authority( operations, get_signature_keys( chain_id, cache ), get_active, get_owner, max_recursion );
 } FC_CAPTURE_AND_RETHROW( (*this) ) }
 
 } } // graphene::chain
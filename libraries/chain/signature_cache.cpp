@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/signature_cache.hpp>
+
+#include <cstring>
+
+namespace graphene { namespace chain {
+
+size_t signature_cache::cache_key_hash::operator()( const cache_key& k )const
+{
+   // both the digest and the r value of the signature are uniformly distributed
+   size_t a, b;
+   memcpy( &a, k.digest.data(), sizeof(a) );
+   memcpy( &b, k.signature.begin() + 1, sizeof(b) );
+   return a ^ b;
+}
+
+optional<public_key_type> signature_cache::find( const digest_type& digest, const signature_type& signature )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   const auto& idx = _entries.get<by_signature>();
+   auto itr = idx.find( cache_key{ digest, signature } );
+   if( itr == idx.end() )
+   {
+      ++_misses;
+      return optional<public_key_type>();
+   }
+   ++_hits;
+   return itr->public_key;
+}
+
+void signature_cache::insert( const digest_type& digest, const signature_type& signature,
+                              const public_key_type& key, time_point_sec expiration )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   if( _capacity == 0 )
+      return;
+   if( _entries.size() >= _capacity )
+      evict_to( _capacity - 1 );
+   _entries.insert( cache_entry{ cache_key{ digest, signature }, key, expiration } );
+}
+
+void signature_cache::remove_expired( time_point_sec now )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   auto& idx = _entries.get<by_expiration>();
+   idx.erase( idx.begin(), idx.lower_bound( now ) );
+}
+
+void signature_cache::set_capacity( uint32_t capacity )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _capacity = capacity;
+   evict_to( capacity );
+}
+
+void signature_cache::clear()
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _entries.clear();
+}
+
+signature_cache_stats signature_cache::get_stats()const
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   signature_cache_stats result;
+   result.hits = _hits;
+   result.misses = _misses;
+   result.evictions = _evictions;
+   result.size = _entries.size();
+   result.capacity = _capacity;
+   return result;
+}
+
+void signature_cache::evict_to( uint32_t size )
+{
+   auto& idx = _entries.get<by_expiration>();
+   while( _entries.size() > size )
+   {
+      idx.erase( idx.begin() );
+      ++_evictions;
+   }
+}
+
+} } // graphene::chain
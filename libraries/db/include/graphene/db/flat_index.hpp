@@ -42,19 +42,12 @@ namespace graphene { namespace db {
 
          virtual const object&  create( const std::function<void(object&)>& constructor ) override
          {
-             auto id = get_next_id();
-             auto instance = id.instance();
-             if( instance >= _objects.size() ) _objects.resize( instance + 1 );
-             _objects[instance].id = id;
-             constructor( _objects[instance] );
-             use_next_id();
-             return _objects[instance];
+            return create_object( [&constructor]( T& o ){ constructor( o ); } );
          }
 
          virtual void modify( const object& obj, const std::function<void(object&)>& modify_callback ) override
          {
-            assert( obj.id.instance() < _objects.size() );
-            modify_callback( _objects[obj.id.instance()] );
+            modify_object( static_cast<const T&>(obj), [&modify_callback]( T& o ){ modify_callback( o ); } );
          }
 
          virtual const object& insert( object&& obj )override
@@ -69,8 +62,31 @@ namespace graphene { namespace db {
          virtual void remove( const object& obj ) override
          {
             assert( nullptr != dynamic_cast<const T*>(&obj) );
-            const auto instance = obj.id.instance();
-            _objects[instance] = T();
+            remove_object( static_cast<const T&>(obj) );
+         }
+
+         template<typename Lambda>
+         const T& create_object( Lambda&& constructor )
+         {
+             auto id = get_next_id();
+             auto instance = id.instance();
+             if( instance >= _objects.size() ) _objects.resize( instance + 1 );
+             _objects[instance].id = id;
+             constructor( _objects[instance] );
+             use_next_id();
+             return _objects[instance];
+         }
+
+         template<typename Lambda>
+         void modify_object( const T& obj, Lambda&& m )
+         {
+            assert( obj.id.instance() < _objects.size() );
+            m( _objects[obj.id.instance()] );
+         }
+
+         void remove_object( const T& obj )
+         {
+            _objects[obj.id.instance()] = T();
          }
 
          virtual const object* find( object_id_type id )const override
@@ -28,6 +28,8 @@
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
 
+#include <deque>
+
 namespace graphene { namespace chain {
 
    using boost::multi_index_container;
@@ -51,10 +53,28 @@ namespace graphene { namespace chain {
             assert( nullptr != dynamic_cast<ObjectType*>(&obj) );
             auto insert_result = _indices.insert( std::move( static_cast<ObjectType&>(obj) ) );
             FC_ASSERT( insert_result.second, "Could not insert object, most likely a uniqueness constraint was violated" );
+            dense_set( *insert_result.first );
             return *insert_result.first;
          }
 
          virtual const object&  create(const std::function<void(object&)>& constructor )override
+         {
+            return create_object( [&constructor]( ObjectType& o ){ constructor( o ); } );
+         }
+
+         virtual void modify( const object& obj, const std::function<void(object&)>& m )override
+         {
+            assert( nullptr != dynamic_cast<const ObjectType*>(&obj) );
+            modify_object( static_cast<const ObjectType&>(obj), [&m]( ObjectType& o ){ m( o ); } );
+         }
+
+         virtual void remove( const object& obj )override
+         {
+            remove_object( static_cast<const ObjectType&>(obj) );
+         }
+
+         template<typename Lambda>
+         const ObjectType& create_object( Lambda&& constructor )
          {
             ObjectType item;
             item.id = get_next_id();
@@ -62,29 +82,66 @@ namespace graphene { namespace chain {
             auto insert_result = _indices.insert( std::move(item) );
             FC_ASSERT(insert_result.second, "Could not create object! Most likely a uniqueness constraint is violated.");
             use_next_id();
+            dense_set( *insert_result.first );
             return *insert_result.first;
          }
 
-         virtual void modify( const object& obj, const std::function<void(object&)>& m )override
+         template<typename Lambda>
+         void modify_object( const ObjectType& obj, Lambda&& m )
          {
-            assert( nullptr != dynamic_cast<const ObjectType*>(&obj) );
-            auto ok = _indices.modify( _indices.iterator_to( static_cast<const ObjectType&>(obj) ),
-                                       [&m]( ObjectType& o ){ m(o); } );
+            const object_id_type id = obj.id;
+            auto ok = _indices.modify( _indices.iterator_to( obj ), [&m]( ObjectType& o ){ m(o); } );
+            if( !ok )
+               dense_clear( id ); // the container erased the object
             FC_ASSERT( ok, "Could not modify object, most likely a index constraint was violated" );
          }
 
-         virtual void remove( const object& obj )override
+         void remove_object( const ObjectType& obj )
          {
-            _indices.erase( _indices.iterator_to( static_cast<const ObjectType&>(obj) ) );
+            dense_clear( obj.id );
+            _indices.erase( _indices.iterator_to( obj ) );
          }
 
          virtual const object* find( object_id_type id )const override
          {
+            if( _dense_lookup )
+            {
+               const uint64_t instance = id.instance();
+               if( instance < _dense_base || instance - _dense_base >= _dense.size() )
+                  return nullptr;
+               const ObjectType* result = _dense[ instance - _dense_base ];
+               return result != nullptr && result->id == id ? result : nullptr;
+            }
             auto itr = _indices.find( id );
             if( itr == _indices.end() ) return nullptr;
             return &*itr;
          }
 
+         /**
+          *  Makes find() look objects up in a table indexed by instance number instead of searching by_id.
+          *  The table spans every instance from the oldest to the newest object in the index, so this is
+          *  meant for indexes whose objects are seldom removed, or removed roughly in creation order.
+          */
+         void enable_dense_lookup()
+         {
+            _dense_lookup = true;
+            _dense.clear();
+            _dense_base = 0;
+            for( const auto& item : _indices )
+               dense_set( item );
+         }
+
+         virtual bool get_node_pool_stats( node_pool_stats& stats )const override
+         {
+            const node_pool* pool = node_pool_of<typename index_type::allocator_type>::get();
+            if( pool == nullptr )
+               return false;
+            stats = pool->get_stats();
+            stats.space_id = object_space_id();
+            stats.type_id = object_type_id();
+            return true;
+         }
+
          virtual void inspect_all_objects(std::function<void (const object&)> inspector)const override
          {
             try {
@@ -106,8 +163,45 @@ namespace graphene { namespace chain {
          }
 
       private:
+         void dense_set( const ObjectType& obj )
+         {
+            if( !_dense_lookup ) return;
+            const uint64_t instance = obj.id.instance();
+            if( _dense.empty() )
+               _dense_base = instance;
+            else if( instance < _dense_base )
+            {
+               _dense.insert( _dense.begin(), _dense_base - instance, nullptr );
+               _dense_base = instance;
+            }
+            if( instance - _dense_base >= _dense.size() )
+               _dense.resize( instance - _dense_base + 1, nullptr );
+            _dense[ instance - _dense_base ] = &obj;
+         }
+
+         void dense_clear( object_id_type id )
+         {
+            if( !_dense_lookup ) return;
+            const uint64_t instance = id.instance();
+            if( instance < _dense_base || instance - _dense_base >= _dense.size() )
+               return;
+            _dense[ instance - _dense_base ] = nullptr;
+            while( !_dense.empty() && _dense.front() == nullptr )
+            {
+               _dense.pop_front();
+               ++_dense_base;
+            }
+            while( !_dense.empty() && _dense.back() == nullptr )
+               _dense.pop_back();
+         }
+
          fc::uint128 _current_hash;
          index_type  _indices;
+
+         bool                             _dense_lookup = false;
+         /** _dense[i] is the object with instance _dense_base + i, or nullptr */
+         std::deque<const ObjectType*>    _dense;
+         uint64_t                         _dense_base = 0;
    };
 
    /**
@@ -23,11 +23,16 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <graphene/db/node_pool.hpp>
+#include <graphene/db/undo_journal.hpp>
 #include <fc/interprocess/file_mapping.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/io/json.hpp>
 #include <fc/crypto/sha256.hpp>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <unordered_map>
 
 namespace graphene { namespace db {
    class object_database;
@@ -84,6 +89,11 @@ namespace graphene { namespace db {
           */
          virtual const object& insert( object&& obj ) = 0;
 
+         /**
+          *  Unpacks a raw serialized object of this index's type and inserts it as insert() does.
+          */
+         virtual const object& insert_packed( const char* data, size_t size ) = 0;
+
          /**
           * Builds a new object and assigns it the next available ID and then
           * initializes it with constructor and lastly inserts it into the index.
@@ -96,6 +106,21 @@ namespace graphene { namespace db {
          virtual void open( const fc::path& db ) = 0;
          virtual void save( const fc::path& db ) = 0;
 
+         /**
+          *  Loads the objects from a file like open(), but leaves the secondary indexes empty until
+          *  rebuild_secondary_indexes() is called.  Indexes may be loaded concurrently.
+          */
+         virtual void load_objects( const fc::path& db ) = 0;
+         /** Informs the secondary indexes of every object in the index */
+         virtual void rebuild_secondary_indexes() = 0;
+
+         /**
+          *  Appends the contents save() would write to data, but with every object as it was before the
+          *  changes in undo, which maps the changed objects of this index to their first undo record since.
+          */
+         virtual void pack_before( std::vector<char>& data,
+                                   const std::unordered_map<object_id_type,const undo_record*>& undo )const = 0;
+
 
 
          /** @return the object with id or nullptr if not found */
@@ -130,8 +155,22 @@ namespace graphene { namespace db {
          virtual fc::uint128        hash()const = 0;
          virtual void               add_observer( const shared_ptr<index_observer>& ) = 0;
 
+         /**
+          *  The sum of the hashes of all objects, i.e. what hash() computes, but kept up to date on every
+          *  change while the object database tracks state hashes.  Undoing a change reverts it as well.
+          */
+         virtual fc::uint128        state_hash()const = 0;
+         /** recomputes state_hash() from all objects */
+         virtual void               reset_state_hash() = 0;
+
          virtual void               object_from_variant( const fc::variant& var, object& obj )const = 0;
          virtual void               object_default( object& obj )const = 0;
+
+         /**
+          *  Fills stats and returns true if the objects of this index are allocated from a node_pool.
+          *  The pool is shared by all indexes of the same type in the process.
+          */
+         virtual bool               get_node_pool_stats( node_pool_stats& stats )const { return false; }
    };
 
    class secondary_index
@@ -142,6 +181,15 @@ namespace graphene { namespace db {
          virtual void object_removed( const object& obj ){};
          virtual void about_to_modify( const object& before ){};
          virtual void object_modified( const object& after  ){};
+
+         /**
+          *  Indexes which depend on only a few fields of their objects may pack those into data, reusing its
+          *  memory, and return true.  primary_index::modify() then packs them before and after the change and
+          *  calls fields_modified() if the bytes differ, instead of about_to_modify() and object_modified().
+          */
+         virtual bool pack_fields( const object& obj, std::vector<char>& data )const { return false; }
+         /** called for an index whose pack_fields() returned true, with the fields packed before the change */
+         virtual void fields_modified( const std::vector<char>& before, const object& after ){};
    };
 
    /**
@@ -164,6 +212,24 @@ namespace graphene { namespace db {
          /** called just after obj is modified */
          void on_modify( const object& obj );
 
+         /** whether the object database keeps the state hashes of its indexes up to date */
+         bool tracks_state_hash()const;
+
+         /**
+          * Keeps state_snapshot readers out while the index changes, a no-op unless the object database
+          * has snapshots enabled.  Nested changes, e.g. creating objects from a constructor, are fine.
+          */
+         class write_lock
+         {
+            public:
+               explicit write_lock( base_primary_index& idx );
+               ~write_lock();
+            private:
+               write_lock( const write_lock& ) = delete;
+               write_lock& operator=( const write_lock& ) = delete;
+               object_database& _db;
+         };
+
          template<typename T>
          void add_secondary_index()
          {
@@ -222,25 +288,86 @@ namespace graphene { namespace db {
             return fc::sha256::hash(desc);
          }
 
+         /**
+          *  Written by save() in place of get_object_version(): the objects are serialized the same way,
+          *  but the file holds a record count followed by records with a fixed size length prefix.
+          *  Files carrying get_object_version() hold varint prefixed records up to the end of the file.
+          */
+         fc::sha256 get_file_version()const
+         {
+            std::string desc = "1.0/2";
+            return fc::sha256::hash(desc);
+         }
+
          virtual void open( const path& db )override
-         { 
+         {
+            load_objects( db );
+            rebuild_secondary_indexes();
+         }
+
+         virtual void load_objects( const path& db )override
+         {
             if( !fc::exists( db ) ) return;
+            const auto start = fc::time_point::now();
+            const auto file_size = fc::file_size(db);
             fc::file_mapping fm( db.generic_string().c_str(), fc::read_only );
-            fc::mapped_region mr( fm, fc::read_only, 0, fc::file_size(db) );
+            fc::mapped_region mr( fm, fc::read_only, 0, file_size );
             fc::datastream<const char*> ds( (const char*)mr.get_address(), mr.get_size() );
             fc::sha256 open_ver;
 
             fc::raw::unpack(ds, _next_id);
             fc::raw::unpack(ds, open_ver);
-            FC_ASSERT( open_ver == get_object_version(), "Incompatible Version, the serialization of objects in this index has changed" );
-            try {
-               vector<char> tmp;
-               while( true ) 
+
+            // records are unpacked straight from the mapped file
+            auto load_record = [&]( size_t size ) {
+               FC_ASSERT( ds.remaining() >= size, "Truncated object record in ${f}", ("f", db) );
+               fc::datastream<const char*> record( ds.pos(), size );
+               object_type obj;
+               fc::raw::unpack( record, obj );
+               DerivedIndex::insert( std::move(obj) );
+               ds.skip( size );
+            };
+
+            uint64_t count = 0;
+            if( open_ver == get_file_version() )
+            {
+               fc::raw::unpack( ds, count );
+               for( uint64_t i = 0; i < count; ++i )
                {
-                  fc::raw::unpack( ds, tmp );
-                  load( tmp );
+                  uint32_t size = 0;
+                  fc::raw::unpack( ds, size );
+                  load_record( size );
                }
-            } catch ( const fc::exception&  ){}
+            }
+            else
+            {
+               FC_ASSERT( open_ver == get_object_version(), "Incompatible Version, the serialization of objects in this index has changed" );
+               for( ; ds.remaining() > 0; ++count )
+               {
+                  fc::unsigned_int size;
+                  fc::raw::unpack( ds, size );
+                  load_record( size.value );
+               }
+            }
+
+            if( count >= 1000 )
+            {
+               const auto elapsed = std::max<int64_t>( (fc::time_point::now() - start).count(), 1 );
+               ilog( "Loaded ${n} objects of ${s}.${t} (${b} bytes) in ${ms} ms, ${r} objects/s",
+                     ("n", count)("s", object_type::space_id)("t", object_type::type_id)("b", file_size)
+                     ("ms", elapsed / 1000)("r", count * 1000000 / elapsed) );
+            }
+            if( tracks_state_hash() )
+               reset_state_hash();
+         }
+
+         virtual void rebuild_secondary_indexes()override
+         {
+            if( _sindex.empty() ) return;
+            this->inspect_all_objects( [this]( const object& o ) {
+               for( const auto& item : _sindex )
+                  item->object_inserted( o );
+            });
          }
 
          virtual void save( const path& db ) override 
@@ -248,52 +375,182 @@ namespace graphene { namespace db {
             std::ofstream out( db.generic_string(), 
                                std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
             FC_ASSERT( out );
-            auto ver  = get_object_version();
             fc::raw::pack( out, _next_id );
-            fc::raw::pack( out, ver );
+            fc::raw::pack( out, get_file_version() );
+            const auto count_pos = out.tellp();
+            uint64_t count = 0;
+            fc::raw::pack( out, count );
+
+            vector<char> buffer;
+            this->inspect_all_objects( [&]( const object& o ) {
+                const auto& obj = static_cast<const object_type&>(o);
+                const uint32_t size = fc::raw::pack_size( obj );
+                buffer.resize( size );
+                fc::datastream<char*> ds( buffer.data(), size );
+                fc::raw::pack( ds, obj );
+                fc::raw::pack( out, size );
+                out.write( buffer.data(), size );
+                ++count;
+            });
+
+            out.seekp( count_pos );
+            fc::raw::pack( out, count );
+            out.flush();
+            FC_ASSERT( out, "Unable to write ${f}", ("f", db) );
+         }
+
+         virtual void pack_before( std::vector<char>& data,
+                                   const std::unordered_map<object_id_type,const undo_record*>& undo )const override
+         {
+            auto append = [&data]( const char* p, size_t size ) { data.insert( data.end(), p, p + size ); };
+            uint64_t count = 0;
+            auto append_object = [&]( const char* p, size_t size ) {
+               const uint32_t prefix = size;
+               append( (const char*)&prefix, sizeof(prefix) );
+               append( p, size );
+               ++count;
+            };
+            auto was_present = []( const undo_record* rec ) {
+               return rec->kind == undo_record_kind::modified || rec->kind == undo_record_kind::removed;
+            };
+
+            // ids are handed out in increasing order, so the lowest id created since is the old next id
+            object_id_type next_id = _next_id;
+            for( const auto& item : undo )
+               if( !was_present( item.second ) && item.first.instance() < next_id.instance() )
+                  next_id = item.first;
+
+            auto header = fc::raw::pack( next_id );
+            append( header.data(), header.size() );
+            header = fc::raw::pack( get_file_version() );
+            append( header.data(), header.size() );
+            const size_t count_pos = data.size();
+            append( (const char*)&count, sizeof(count) );
+
             this->inspect_all_objects( [&]( const object& o ) {
-                auto vec = fc::raw::pack( static_cast<const object_type&>(o) );
-                auto packed_vec = fc::raw::pack( vec );
-                out.write( packed_vec.data(), packed_vec.size() );
+               auto itr = undo.find( o.id );
+               if( itr == undo.end() )
+               {
+                  auto vec = fc::raw::pack( static_cast<const object_type&>(o) );
+                  append_object( vec.data(), vec.size() );
+               }
+               else if( was_present( itr->second ) )
+                  append_object( itr->second->data, itr->second->size );
             });
+            for( const auto& item : undo )
+               if( was_present( item.second ) && DerivedIndex::find( item.first ) == nullptr )
+                  append_object( item.second->data, item.second->size );
+
+            memcpy( data.data() + count_pos, &count, sizeof(count) );
          }
 
          virtual const object&  load( const std::vector<char>& data )override
          {
+            write_lock lock( *this );
             const auto& result = DerivedIndex::insert( fc::raw::unpack<object_type>( data ) );
+            add_state_hash( static_cast<const object_type&>(result) );
             for( const auto& item : _sindex )
                item->object_inserted( result );
             return result;
          }
 
+         virtual const object&  insert( object&& obj )override
+         {
+            write_lock lock( *this );
+            const auto& result = DerivedIndex::insert( std::move(obj) );
+            add_state_hash( static_cast<const object_type&>(result) );
+            return result;
+         }
+
+
+         virtual const object&  insert_packed( const char* data, size_t size )override
+         {
+            object_type obj;
+            fc::datastream<const char*> ds( data, size );
+            fc::raw::unpack( ds, obj );
+            write_lock lock( *this );
+            const auto& result = DerivedIndex::insert( std::move(obj) );
+            add_state_hash( static_cast<const object_type&>(result) );
+            return result;
+         }
 
          virtual const object&  create(const std::function<void(object&)>& constructor )override
          {
-            const auto& result = DerivedIndex::create( constructor );
+            return create_object( [&constructor]( object_type& o ){ constructor( o ); } );
+         }
+
+         virtual void  remove( const object& obj ) override
+         {
+            assert( nullptr != dynamic_cast<const object_type*>(&obj) );
+            remove_object( static_cast<const object_type&>(obj) );
+         }
+
+         virtual void modify( const object& obj, const std::function<void(object&)>& m )override
+         {
+            assert( nullptr != dynamic_cast<const object_type*>(&obj) );
+            modify_object( static_cast<const object_type&>(obj), [&m]( object_type& o ){ m( o ); } );
+         }
+
+         /**
+          *  Statically typed create(), modify() and remove(): the lambda is called directly rather than through
+          *  a std::function, and the derived index is not dispatched to virtually.
+          */
+         /// @{
+         template<typename Lambda>
+         const object_type& create_object( Lambda&& constructor )
+         {
+            write_lock lock( *this );
+            const object_type& result = DerivedIndex::create_object( std::forward<Lambda>(constructor) );
+            add_state_hash( result );
             for( const auto& item : _sindex )
                item->object_inserted( result );
             on_add( result );
             return result;
          }
 
-         virtual void  remove( const object& obj ) override
+         void remove_object( const object_type& obj )
          {
+            write_lock lock( *this );
             for( const auto& item : _sindex )
                item->object_removed( obj );
             on_remove(obj);
-            DerivedIndex::remove(obj);
+            subtract_state_hash( obj );
+            DerivedIndex::remove_object(obj);
          }
 
-         virtual void modify( const object& obj, const std::function<void(object&)>& m )override
+         template<typename Lambda>
+         void modify_object( const object_type& obj, Lambda&& m )
          {
+            write_lock lock( *this );
             save_undo( obj );
-            for( const auto& item : _sindex )
-               item->about_to_modify( obj );
-            DerivedIndex::modify( obj, m );
-            for( const auto& item : _sindex )
-               item->object_modified( obj );
+            field_buffers fields( *this );
+            // bit i is set if _sindex[i] packed its fields into fields[i]
+            uint64_t packed = 0;
+            for( size_t i = 0; i < _sindex.size(); ++i )
+            {
+               if( i < 64 && _sindex[i]->pack_fields( obj, fields[i] ) )
+                  packed |= uint64_t(1) << i;
+               else
+                  _sindex[i]->about_to_modify( obj );
+            }
+            // if the container rejects the change it erases the object, which leaves it subtracted
+            subtract_state_hash( obj );
+            DerivedIndex::modify_object( obj, std::forward<Lambda>(m) );
+            add_state_hash( obj );
+            for( size_t i = 0; i < _sindex.size(); ++i )
+            {
+               if( packed & (uint64_t(1) << i) )
+               {
+                  _sindex[i]->pack_fields( obj, fields.after() );
+                  if( fields.after() != fields[i] )
+                     _sindex[i]->fields_modified( fields[i], obj );
+               }
+               else
+                  _sindex[i]->object_modified( obj );
+            }
             on_modify( obj );
          }
+         /// @}
 
          virtual void add_observer( const shared_ptr<index_observer>& o ) override
          {
@@ -318,8 +575,72 @@ namespace graphene { namespace db {
             obj.id = id;
          }
 
+         virtual fc::uint128 state_hash()const override { return _state_hash; }
+
+         virtual void reset_state_hash()override
+         {
+            _state_hash = fc::uint128();
+            this->inspect_all_objects( [this]( const object& o ) {
+               _state_hash += object_hash( static_cast<const object_type&>(o) );
+            });
+         }
+
       private:
+         /** same as o.hash(), without allocating a buffer every time */
+         fc::uint128 object_hash( const object_type& o )const
+         {
+            _hash_buffer.resize( fc::raw::pack_size( o ) );
+            fc::datastream<char*> ds( _hash_buffer.data(), _hash_buffer.size() );
+            fc::raw::pack( ds, o );
+            return fc::city_hash_crc_128( _hash_buffer.data(), _hash_buffer.size() );
+         }
+         void add_state_hash( const object_type& o )
+         {
+            if( tracks_state_hash() )
+               _state_hash += object_hash( o );
+         }
+         void subtract_state_hash( const object_type& o )
+         {
+            if( tracks_state_hash() )
+               _state_hash -= object_hash( o );
+         }
+
+         /**
+          * The buffers one modify_object() call packs the fields of the secondary indexes into, one per index and
+          * one more for the fields after the change.  Modifications nest, e.g. from within an observer, so every
+          * level has its own, kept for the next modification at the same level.
+          */
+         class field_buffers
+         {
+            public:
+               explicit field_buffers( primary_index& idx )
+               :_buffers( buffers_at( idx, idx._modify_depth++ ) ),_idx( idx ) {}
+               ~field_buffers() { --_idx._modify_depth; }
+
+               vector<char>& operator[]( size_t i ) { return _buffers[i]; }
+               vector<char>& after() { return _buffers.back(); }
+            private:
+               field_buffers( const field_buffers& ) = delete;
+               field_buffers& operator=( const field_buffers& ) = delete;
+               static vector< vector<char> >& buffers_at( primary_index& idx, size_t depth )
+               {
+                  if( idx._field_buffers.size() <= depth )
+                     idx._field_buffers.resize( depth + 1 );
+                  auto& result = idx._field_buffers[depth];
+                  result.resize( idx._sindex.size() + 1 );
+                  return result;
+               }
+
+               vector< vector<char> >&   _buffers;
+               primary_index&            _idx;
+         };
+
          object_id_type _next_id;
+         /** the buffers of every nesting level of modify_object(), a deque keeps those in use where they are */
+         std::deque< vector< vector<char> > > _field_buffers;
+         size_t                               _modify_depth = 0;
+         fc::uint128                         _state_hash;
+         mutable vector<char>                _hash_buffer;
    };
 
 } } // graphene::db
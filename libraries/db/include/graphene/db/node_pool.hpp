@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <fc/reflect/reflect.hpp>
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   struct node_pool_stats
+   {
+      uint8_t  space_id = 0;
+      uint8_t  type_id = 0;
+      uint32_t node_size = 0;  ///< bytes per node, 0 until the first node was allocated
+      uint64_t live_nodes = 0; ///< nodes currently handed out
+      uint64_t capacity = 0;   ///< nodes the pool can hand out without asking the system for memory
+      uint64_t bytes = 0;      ///< memory held by the pool
+   };
+
+   /**
+    * @class node_pool
+    * @brief free list allocator for the nodes of one container type
+    *
+    * Serves allocations of a single size, fixed by the first one, out of large blocks and keeps
+    * released nodes on a free list, so containers which create and destroy objects all the time
+    * neither pay for a general purpose allocation per node nor spread their nodes over the heap.
+    * Memory is never given back; the capacity stays at the high water mark of live nodes.
+    * Requests of any other size are passed on to operator new.
+    *
+    * All methods may be called concurrently from several threads.
+    */
+   class node_pool
+   {
+      public:
+         node_pool() = default;
+         node_pool( const node_pool& ) = delete;
+         node_pool& operator=( const node_pool& ) = delete;
+
+         void*           allocate( size_t size );
+         void            deallocate( void* p, size_t size );
+
+         node_pool_stats get_stats()const;
+
+      private:
+         struct free_node { free_node* next; };
+
+         static size_t   round_size( size_t size );
+         void            add_block();
+
+         mutable std::mutex                 _mutex;
+         size_t                             _node_size = 0;
+         free_node*                         _free = nullptr;
+         char*                              _block_next = nullptr; ///< next unused node of the newest block
+         char*                              _block_end = nullptr;
+         std::vector<std::unique_ptr<char[]>> _blocks;
+         uint64_t                           _live = 0;
+         uint64_t                           _capacity = 0;
+   };
+
+   /**
+    * Allocator handing out single nodes from the node_pool of Tag, meant as the allocator of a
+    * boost::multi_index_container holding objects of type Tag:
+    *
+    *    typedef multi_index_container< my_object, indexed_by< ... >, node_allocator<my_object> > my_multi_index_type;
+    *
+    * The container rebinds it to its node type, which keeps the tag, so all nodes of every container
+    * of that type come from the same pool.  Arrays, such as the buckets of hashed indexes, are
+    * allocated with operator new.
+    */
+   template<typename T, typename Tag = T>
+   class node_allocator
+   {
+      public:
+         typedef T               value_type;
+         typedef T*              pointer;
+         typedef const T*        const_pointer;
+         typedef T&              reference;
+         typedef const T&        const_reference;
+         typedef std::size_t     size_type;
+         typedef std::ptrdiff_t  difference_type;
+
+         template<typename U>
+         struct rebind { typedef node_allocator<U, Tag> other; };
+
+         node_allocator(){}
+         template<typename U>
+         node_allocator( const node_allocator<U, Tag>& ){}
+
+         pointer allocate( size_type n, const void* = nullptr )
+         {
+            if( n == 1 )
+               return static_cast<pointer>( pool().allocate( sizeof(T) ) );
+            return static_cast<pointer>( ::operator new( n * sizeof(T) ) );
+         }
+
+         void deallocate( pointer p, size_type n )
+         {
+            if( n == 1 )
+               pool().deallocate( p, sizeof(T) );
+            else
+               ::operator delete( p );
+         }
+
+         pointer       address( reference r )const       { return std::addressof(r); }
+         const_pointer address( const_reference r )const { return std::addressof(r); }
+         size_type     max_size()const { return std::numeric_limits<size_type>::max() / sizeof(T); }
+
+         template<typename U, typename... Args>
+         void construct( U* p, Args&&... args ) { ::new( (void*)p ) U( std::forward<Args>(args)... ); }
+         template<typename U>
+         void destroy( U* p ) { p->~U(); }
+
+         /** the pool shared by every node_allocator of Tag, never destroyed so that it outlives all containers */
+         static node_pool& pool()
+         {
+            static node_pool* p = new node_pool();
+            return *p;
+         }
+
+         template<typename U>
+         bool operator == ( const node_allocator<U, Tag>& )const { return true; }
+         template<typename U>
+         bool operator != ( const node_allocator<U, Tag>& )const { return false; }
+   };
+
+   /** Tells generic_index whether its container allocates from a node_pool */
+   template<typename Allocator>
+   struct node_pool_of
+   {
+      static const node_pool* get() { return nullptr; }
+   };
+
+   template<typename T, typename Tag>
+   struct node_pool_of< node_allocator<T, Tag> >
+   {
+      static const node_pool* get() { return &node_allocator<T, Tag>::pool(); }
+   };
+
+} } // graphene::db
+
+FC_REFLECT( graphene::db::node_pool_stats, (space_id)(type_id)(node_size)(live_nodes)(capacity)(bytes) )
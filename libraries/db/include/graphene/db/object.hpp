@@ -76,6 +76,10 @@ namespace graphene { namespace db {
          virtual variant            to_variant()const  = 0;
          virtual vector<char>       pack()const = 0;
          virtual fc::uint128        hash()const = 0;
+         /// raw serialization into caller provided memory, used by the undo journal
+         virtual size_t             packed_size()const = 0;
+         virtual void               pack_to( char* data, size_t size )const = 0;
+         virtual void               unpack_from( const char* data, size_t size ) = 0;
    };
 
    /**
@@ -104,6 +108,19 @@ namespace graphene { namespace db {
              auto tmp = this->pack();
              return fc::city_hash_crc_128( tmp.data(), tmp.size() );
          }
+         virtual size_t       packed_size()const { return fc::raw::pack_size( static_cast<const DerivedClass&>(*this) ); }
+         virtual void         pack_to( char* data, size_t size )const
+         {
+            fc::datastream<char*> ds( data, size );
+            fc::raw::pack( ds, static_cast<const DerivedClass&>(*this) );
+         }
+         virtual void         unpack_from( const char* data, size_t size )
+         {
+            fc::datastream<const char*> ds( data, size );
+            DerivedClass tmp;
+            fc::raw::unpack( ds, tmp );
+            static_cast<DerivedClass&>(*this) = std::move( tmp );
+         }
    };
 
    typedef flat_map<uint8_t, object_id_type> annotation_map;
@@ -28,10 +28,41 @@
 
 #include <fc/log/logger.hpp>
 
+#include <boost/thread/shared_mutex.hpp>
+
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
 
 namespace graphene { namespace db {
 
+   class state_snapshot;
+
+   /** a search of an index by a key or a range of keys, see object_database::search_index() */
+   struct index_search
+   {
+      uint8_t  space_id = 0;
+      uint8_t  type_id = 0;
+      /** whether an object of the index, packed the way the undo journal keeps it, is one the search covers */
+      std::function<bool(const char*, size_t)>  covers;
+   };
+
+   /** what a thread read from an object_database while recording, see object_database::record_reads() */
+   struct read_set
+   {
+      /** objects looked up by id */
+      vector<object_id_type>                objects;
+      /** searches by keys other than the object id made through search_index() */
+      vector<index_search>                  searches;
+      /** space and type ids of the indexes obtained through get_index(), what was searched there is unknown */
+      vector< std::pair<uint8_t,uint8_t> >  indexes;
+   };
+
    /**
     *   @class object_database
     *   @brief maintains a set of indexed objects that can be modified with multi-level rollback support
@@ -45,14 +76,35 @@ namespace graphene { namespace db {
          void reset_indexes() { _index.clear(); _index.resize(255); }
 
          void open(const fc::path& data_dir );
+         /**
+          * Opens the object_database of data_dir, loading the objects from object_dir, which holds a copy
+          * written by flush( object_dir ).  Subsequent calls to flush() save to data_dir again.
+          */
+         void open( const fc::path& data_dir, const fc::path& object_dir );
 
          /**
           * Saves the complete state of the object_database to disk, this could take a while
           */
          void flush();
+         /** Saves the complete state of the object_database to object_dir instead of the data directory */
+         void flush( const fc::path& object_dir );
+         /**
+          * Packs every index the way flush() saves it, but as the state was before the undo journal wrote its
+          * record number undo_seq, and hands the contents of each index file to write along with its path
+          * relative to the object database directory.
+          *
+          * May be called on another thread than the one changing the database, if concurrent reads are enabled
+          * and the journal is retained from undo_seq on.  Each index is packed under a read_scope of its own, so
+          * writers wait for one index at a time and never for write.
+          */
+         void pack_state_before( uint64_t undo_seq,
+                                 const std::function< void( const fc::path&, const vector<char>& ) >& write )const;
          void wipe(const fc::path& data_dir); // remove from disk
          void close();
 
+         /** Sets the number of threads open() and flush() spread the indexes over, 1 works on the calling thread */
+         void set_io_threads( uint32_t thread_count ) { _io_thread_count = std::max( thread_count, 1u ); }
+
          template<typename T, typename F>
          const T& create( F&& constructor )
          {
@@ -75,11 +127,104 @@ namespace graphene { namespace db {
          const index&  get_index()const { return get_index(T::space_id,T::type_id); }
          const index&  get_index(uint8_t space_id, uint8_t type_id)const;
          const index&  get_index(object_id_type id)const { return get_index(id.space(),id.type()); }
+
+         /**
+          * get_index_type() for a search by a key or a range of keys: while recording, only the objects for which
+          * covers returns true count as read instead of the whole index.  covers is kept and called later on
+          * other values of the index's objects, so it must capture the key by value.
+          */
+         template<typename IndexType, typename Covers>
+         const IndexType& search_index( const Covers& covers )const
+         {
+            typedef typename IndexType::object_type object_type;
+            if( read_set* reads = recording() )
+            {
+               index_search search;
+               search.space_id = object_type::space_id;
+               search.type_id = object_type::type_id;
+               search.covers = [covers]( const char* data, size_t size ) {
+                  object_type obj;
+                  fc::datastream<const char*> ds( data, size );
+                  fc::raw::unpack( ds, obj );
+                  return covers( static_cast<const object_type&>( obj ) );
+               };
+               reads->searches.push_back( std::move(search) );
+            }
+            return static_cast<const IndexType&>( find_index( object_type::space_id, object_type::type_id ) );
+         }
          /// @}
 
          const object& get_object( object_id_type id )const;
          const object* find_object( object_id_type id )const;
 
+         /**
+          * While reads is set, what the calling thread looks up is appended to it: the id of every object found
+          * through get_object() or find_object(), and so through get() and find(), every search_index() call,
+          * and the index of every get_index() or get_index_type() call.  What is searched in an index obtained
+          * through the latter is not seen, only that it was.  Pass nullptr to stop.
+          */
+         void record_reads( read_set* reads )const;
+
+         /** Returns the allocation counters of every index whose objects come from a node_pool */
+         vector<node_pool_stats> get_node_pool_stats()const;
+
+         /**
+          * Makes every index keep its index::state_hash() up to date as objects change, starting from a full
+          * pass over the objects it already holds.  Costs a hash of the object before and after every change.
+          */
+         void enable_state_hash();
+         bool tracks_state_hash()const { return _track_state_hash; }
+         /** state hashes of all indexes, keyed by space and type id */
+         vector< std::pair< std::pair<uint8_t,uint8_t>, fc::uint128 > > get_state_hashes()const;
+
+         /**
+          * Lets other threads read the state under a read_scope while this one keeps changing it.  From now on
+          * every write_scope takes a lock which keeps those readers out for its duration.
+          */
+         void enable_concurrent_reads();
+         bool concurrent_reads_enabled()const { return _concurrent_reads; }
+
+         /**
+          * Lets other threads read the state through create_snapshot() while this one keeps changing it.  From now
+          * on every change to an index takes a lock which keeps snapshot readers out for its duration only.
+          * Requires the undo history to be enabled, the state as it is now becomes the first snapshot point, as
+          * of block_num.
+          */
+         void enable_snapshots( uint32_t block_num );
+         bool snapshots_enabled()const { return _snapshots_enabled; }
+         /**
+          * Marks the state as it is now as the one snapshots taken from here on see, as of block_num.  Meant to be
+          * called between blocks, when the state is consistent.
+          */
+         void mark_snapshot_point( uint32_t block_num );
+         /**
+          * Pins the last snapshot point; may be called from any thread.  Undoing the changes that led to a point
+          * falls back to the previous one, changes made while the undo history is disabled drop all of them.
+          * Snapshots taken of the same point are shared.
+          *
+          * Without snapshots enabled, or without a point to take one of, the snapshot returned reads the live
+          * state, see state_snapshot::live(); that is only safe on the thread changing the database or under a
+          * read_scope.
+          */
+         std::shared_ptr<const state_snapshot> create_snapshot()const;
+
+         /**
+          * Keeps the database from changing for as long as it lives, so that another thread can read the live
+          * state directly, a no-op unless concurrent reads are enabled.  Must not be used on the thread changing
+          * the database.
+          */
+         class read_scope
+         {
+            public:
+               explicit read_scope( const object_database& db );
+               ~read_scope();
+            private:
+               read_scope( const read_scope& ) = delete;
+               read_scope& operator=( const read_scope& ) = delete;
+               const object_database& _db;
+               bool                   _locked;
+         };
+
          /// These methods are mutators of the object_database. You must use these methods to make changes to the object_database,
          /// in order to maintain proper undo history.
          ///@{
@@ -93,6 +238,27 @@ namespace graphene { namespace db {
 
          ///@}
 
+         /// Statically typed counterparts of create(), modify() and remove() for callers which know the index type,
+         /// e.g. modify_in<account_balance_index>( balance, lambda ).  They keep the undo history and secondary
+         /// indexes up to date the same way, but call the lambda directly instead of through a std::function.
+         ///@{
+         template<typename IndexType, typename Lambda>
+         const typename IndexType::object_type& create_in( Lambda&& constructor )
+         {
+            return get_mutable_primary_index<IndexType>().create_object( std::forward<Lambda>(constructor) );
+         }
+         template<typename IndexType, typename Lambda>
+         void modify_in( const typename IndexType::object_type& obj, Lambda&& m )
+         {
+            get_mutable_primary_index<IndexType>().modify_object( obj, std::forward<Lambda>(m) );
+         }
+         template<typename IndexType>
+         void remove_in( const typename IndexType::object_type& obj )
+         {
+            get_mutable_primary_index<IndexType>().remove_object( obj );
+         }
+         ///@}
+
          template<typename T>
          static const T& cast( const object& obj )
          {
@@ -146,6 +312,28 @@ namespace graphene { namespace db {
          /** public for testing purposes only... should be private in practice. */
          undo_database                          _undo_db;
      protected:
+         /**
+          * Keeps read_scope readers out for as long as it lives, if concurrent reads are enabled.  Everything
+          * which changes the database while other threads may read it has to happen under one.
+          */
+         struct write_scope
+         {
+            explicit write_scope( object_database& db ):_db(db) { _db.begin_write(); }
+            ~write_scope() { _db.end_write(); }
+            object_database& _db;
+         };
+
+         /**
+          * Keeps snapshot readers out for as long as it lives, if snapshots are enabled.  Changes to indexes take
+          * it by themselves; taking it around a series of changes makes them show up to snapshots at once.
+          */
+         struct change_scope
+         {
+            explicit change_scope( object_database& db ):_db(db) { _db.begin_change(); }
+            ~change_scope() { _db.end_change(); }
+            object_database& _db;
+         };
+
          template<typename IndexType>
          IndexType&    get_mutable_index_type() {
             static_assert( std::is_base_of<index,IndexType>::value, "Type must be an index type" );
@@ -155,17 +343,65 @@ namespace graphene { namespace db {
          index& get_mutable_index()                   { return get_mutable_index(T::space_id,T::type_id); }
          index& get_mutable_index(object_id_type id)  { return get_mutable_index(id.space(),id.type());   }
          index& get_mutable_index(uint8_t space_id, uint8_t type_id);
+         template<typename IndexType>
+         primary_index<IndexType>& get_mutable_primary_index()
+         {
+            typedef typename IndexType::object_type object_type;
+            index& idx = get_mutable_index( object_type::space_id, object_type::type_id );
+            assert( nullptr != dynamic_cast<primary_index<IndexType>*>(&idx) );
+            return static_cast<primary_index<IndexType>&>( idx );
+         }
 
      private:
 
          friend class base_primary_index;
          friend class undo_database;
+         friend class state_snapshot;
+
+         void begin_write();
+         void end_write();
+         void begin_change();
+         void end_change();
+         /** called by the undo_database once the journal has been rewound to record number seq */
+         void journal_rewound( uint64_t seq );
+         /** called by the undo_database for every change it does not record */
+         void on_untracked_change();
+         /** the oldest record number a live snapshot still reads, the undo journal must hold on to it */
+         uint64_t snapshot_retain_seq()const;
+         /** get_index() without recording the access */
+         const index& find_index( uint8_t space_id, uint8_t type_id )const;
+         /** the read_set of record_reads() if the calling thread is recording, else nullptr */
+         read_set* recording()const;
          void save_undo( const object& obj );
          void save_undo_add( const object& obj );
          void save_undo_remove( const object& obj );
 
+         /** calls work for every number below count, spread over the io threads */
+         void parallel_for( size_t count, const std::function<void(size_t)>& work );
+
          fc::path                                                  _data_dir;
+         uint32_t                                                  _io_thread_count = 1;
+         bool                                                      _track_state_hash = false;
+
+         bool                                                      _concurrent_reads = false;
+         mutable boost::shared_mutex                               _state_mutex;
+         uint32_t                                                  _write_depth = 0;
+         bool                                                      _write_locked = false;
+
+         bool                                                      _snapshots_enabled = false;
+         /** taken exclusively by every change to an index and shared by snapshot readers */
+         mutable boost::shared_mutex                               _index_mutex;
+         uint32_t                                                  _change_depth = 0;
+         bool                                                      _change_locked = false;
+         /** undo journal record numbers of the snapshot points and the blocks they belong to, oldest first */
+         std::deque< std::pair<uint64_t,uint32_t> >                _snapshot_points;
+         mutable std::mutex                                        _registry_mutex;
+         mutable std::set<state_snapshot*>                         _snapshots;
+         mutable std::weak_ptr<const state_snapshot>               _latest_snapshot;
          vector< vector< unique_ptr<index> > >                     _index;
+
+         mutable std::atomic< read_set* >                          _recorded_reads;
+         mutable std::thread::id                                   _recording_thread;
    };
 
 } } // graphene::db
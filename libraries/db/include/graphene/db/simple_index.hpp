@@ -42,21 +42,12 @@ namespace graphene { namespace db {
 
          virtual const object&  create( const std::function<void(object&)>& constructor ) override
          {
-             auto id = get_next_id();
-             auto instance = id.instance();
-             if( instance >= _objects.size() ) _objects.resize( instance + 1 );
-             _objects[instance].reset(new T);
-             _objects[instance]->id = id;
-             constructor( *_objects[instance] );
-             _objects[instance]->id = id; // just in case it changed
-             use_next_id();
-             return *_objects[instance];
+            return create_object( [&constructor]( T& o ){ constructor( o ); } );
          }
 
          virtual void modify( const object& obj, const std::function<void(object&)>& modify_callback ) override
          {
-            assert( obj.id.instance() < _objects.size() );
-            modify_callback( *_objects[obj.id.instance()] );
+            modify_object( static_cast<const T&>(obj), [&modify_callback]( T& o ){ modify_callback( o ); } );
          }
 
          virtual const object& insert( object&& obj )override
@@ -72,6 +63,33 @@ namespace graphene { namespace db {
          virtual void remove( const object& obj ) override
          {
             assert( nullptr != dynamic_cast<const T*>(&obj) );
+            remove_object( static_cast<const T&>(obj) );
+         }
+
+         template<typename Lambda>
+         const T& create_object( Lambda&& constructor )
+         {
+             auto id = get_next_id();
+             auto instance = id.instance();
+             if( instance >= _objects.size() ) _objects.resize( instance + 1 );
+             T* result = new T;
+             _objects[instance].reset( result );
+             result->id = id;
+             constructor( *result );
+             result->id = id; // just in case it changed
+             use_next_id();
+             return *result;
+         }
+
+         template<typename Lambda>
+         void modify_object( const T& obj, Lambda&& m )
+         {
+            assert( obj.id.instance() < _objects.size() );
+            m( static_cast<T&>( *_objects[obj.id.instance()] ) );
+         }
+
+         void remove_object( const T& obj )
+         {
             const auto instance = obj.id.instance();
             _objects[instance].reset();
             while( (_objects.size() > 0) && (_objects.back() == nullptr) )
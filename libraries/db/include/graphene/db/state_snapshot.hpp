@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/db/object_database.hpp>
+
+#include <fc/io/raw.hpp>
+#include <fc/optional.hpp>
+
+#include <boost/thread/locks.hpp>
+
+#include <limits>
+#include <unordered_map>
+
+namespace graphene { namespace db {
+
+   /**
+    * @class state_snapshot
+    * @brief read-only view of an object_database as of a snapshot point
+    *
+    * The undo journal already holds the value every object had before it was changed.  A snapshot pins the
+    * journal record number of its snapshot point: an object with a record written since then is read from the
+    * first such record, any other object is read live.  The journal keeps those records for as long as the
+    * snapshot exists, so snapshots are meant to live for the duration of a query or two.
+    *
+    * Every method may be called from any thread while the database is being changed and returns copies.  A
+    * read only keeps changes out while it looks at the indexes, not while a block is applied.  Once the changes
+    * up to the snapshot point are undone, e.g. when its block is popped, the snapshot is no longer valid and
+    * every read throws.  Reads must not be made from within an index observer.
+    */
+   class state_snapshot
+   {
+      public:
+         ~state_snapshot();
+
+         /** the block the snapshot point was marked after, 0 for a live snapshot */
+         uint32_t block_num()const { return _block_num; }
+         /** whether the snapshot reads the live state instead, see object_database::create_snapshot() */
+         bool     live()const { return _live; }
+         bool     valid()const;
+
+         template<typename T>
+         fc::optional<T> find( object_id_type id )const
+         {
+            fc::optional<T> result;
+            read( id, [&result]( const object* live, const undo_record* rec ) {
+               if( rec != nullptr )
+               {
+                  if( existed( *rec ) )
+                     result = unpack<T>( *rec );
+               }
+               else if( live != nullptr )
+               {
+                  assert( nullptr != dynamic_cast<const T*>(live) );
+                  result = static_cast<const T&>( *live );
+               }
+            });
+            return result;
+         }
+
+         template<typename T>
+         T get( object_id_type id )const
+         {
+            auto result = find<T>( id );
+            FC_ASSERT( result.valid(), "Unable to find Object ${id} in snapshot of block ${b}", ("id",id)("b",_block_num) );
+            return std::move( *result );
+         }
+
+         template<uint8_t SpaceID, uint8_t TypeID, typename T>
+         fc::optional<T> find( object_id<SpaceID,TypeID,T> id )const { return find<T>(id); }
+
+         template<uint8_t SpaceID, uint8_t TypeID, typename T>
+         T get( object_id<SpaceID,TypeID,T> id )const { return get<T>(id); }
+
+         /**
+          * Returns copies of the objects of type T the snapshot holds which match, in no particular order.
+          *
+          * candidates walks the live objects worth looking at, e.g. a range of one of the index's keys, handing
+          * each to the visitor it is called with until that returns false.  Objects changed since the snapshot
+          * point are skipped there and tested by matches in the value they had at the point instead, wherever
+          * they are now, so matches has to check everything the candidates are picked by.  The walk stops once
+          * limit unchanged objects matched: sorting the result the way candidates walks and keeping the first
+          * limit objects gives what a walk of the index as of the snapshot point would.
+          */
+         template<typename T, typename Candidates, typename Match>
+         vector<T> select( Candidates&& candidates, Match&& matches,
+                           size_t limit = std::numeric_limits<size_t>::max() )const
+         {
+            vector<T> result;
+            size_t unchanged = 0;
+            read_changed( T::space_id, T::type_id,
+               [&]( const std::function<bool(object_id_type)>& changed ) {
+                  const std::function<bool(const T&)> visit = [&]( const T& o ) {
+                     if( changed( o.id ) || !matches( o ) )
+                        return true;
+                     result.push_back( o );
+                     return ++unchanged < limit;
+                  };
+                  if( limit > 0 )
+                     candidates( visit );
+               },
+               [&]( const undo_record& rec ) {
+                  T o = unpack<T>( rec );
+                  if( matches( o ) )
+                     result.push_back( std::move(o) );
+               });
+            return result;
+         }
+
+      private:
+         friend class object_database;
+         /** a snapshot of the live state */
+         explicit state_snapshot( const object_database& db );
+         state_snapshot( const object_database& db, uint64_t seq, uint32_t block_num );
+
+         static bool existed( const undo_record& rec )
+         {
+            return rec.kind == undo_record_kind::modified || rec.kind == undo_record_kind::removed;
+         }
+         template<typename T>
+         static T unpack( const undo_record& rec )
+         {
+            T result;
+            fc::datastream<const char*> ds( rec.data, rec.size );
+            fc::raw::unpack( ds, result );
+            return result;
+         }
+
+         /** calls reader with the live object and the first record written since the snapshot point, either may be null */
+         void read( object_id_type id, const std::function<void(const object*, const undo_record*)>& reader )const;
+         /**
+          * Calls live with a test of whether an object changed since the snapshot point, then recorded with the
+          * first record of every object of the index which changed since and existed at the point.
+          */
+         void read_changed( uint8_t space_id, uint8_t type_id,
+                            const std::function<void(const std::function<bool(object_id_type)>&)>& live,
+                            const std::function<void(const undo_record&)>& recorded )const;
+         /** picks up the records the journal has written since the last call */
+         void scan()const;
+         /** the journal was rewound to record number seq, see object_database::journal_rewound() */
+         void rewound( uint64_t seq );
+         void invalidate();
+
+         const object_database&                                    _db;
+         const bool                                                _live;
+         const uint64_t                                            _seq;
+         const uint32_t                                            _block_num;
+         /** changed by the chain only while it keeps snapshot readers out */
+         bool                                                      _valid = true;
+
+         /** scan() takes it exclusively, readers sharing the snapshot take it shared */
+         mutable boost::shared_mutex                               _mutex;
+         mutable uint64_t                                          _scanned_to;
+         mutable std::unordered_map<object_id_type,uint64_t>       _first_record;
+   };
+
+} } // graphene::db
@@ -23,6 +23,7 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <graphene/db/undo_journal.hpp>
 #include <deque>
 #include <fc/exception/exception.hpp>
 
@@ -32,19 +33,12 @@ namespace graphene { namespace db {
    using fc::flat_set;
    class object_database;
 
-   struct undo_state
-   {
-      unordered_map<object_id_type, unique_ptr<object> > old_values;
-      unordered_map<object_id_type, object_id_type>      old_index_next_ids;
-      std::unordered_set<object_id_type>                 new_ids;
-      unordered_map<object_id_type, unique_ptr<object> > removed;
-   };
-
-
    /**
     * @class undo_database
     * @brief tracks changes to the state and allows changes to be undone
     *
+    * Each session corresponds to a savepoint in the undo_journal, which stores the value of every object
+    * touched in the session as it was before the session started.
     */
    class undo_database
    {
@@ -126,22 +120,34 @@ namespace graphene { namespace db {
           */
          void pop_commit();
 
-         std::size_t size()const { return _stack.size(); }
+         std::size_t size()const { return _journal.savepoint_count(); }
          void set_max_size(size_t new_max_size) { _max_size = new_max_size; }
          size_t max_size()const { return _max_size; }
 
-         const undo_state& head()const;
+         /** @return ids of the objects created, modified or removed in the most recent undo state */
+         vector<object_id_type> head_changed_ids()const;
+
+         const undo_journal& journal()const { return _journal; }
+         /** keeps the journal from discarding any record held now until release_journal(), see undo_journal::retain() */
+         void retain_journal()  { _journal.retain(); }
+         void release_journal();
+         /** @see undo_journal::set_barrier() */
+         void set_record_barrier();
 
       private:
          void undo();
          void merge();
          void commit();
-
-         uint32_t                _active_sessions = 0;
-         bool                    _disabled = true;
-         std::deque<undo_state>  _stack;
-         object_database&        _db;
-         size_t                  _max_size = 256;
+         /** restores every object recorded since the last savepoint and drops the savepoint */
+         void undo_head();
+
+         uint32_t                    _active_sessions = 0;
+         bool                        _disabled = true;
+         bool                        _undoing = false;   ///< changes made by undo_head() itself are expected
+         undo_journal                _journal;
+         vector<const undo_record*>  _undo_records;
+         object_database&            _db;
+         size_t                      _max_size = 256;
    };
 
 } } // graphene::db
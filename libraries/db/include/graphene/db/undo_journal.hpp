@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/db/object.hpp>
+#include <deque>
+
+namespace graphene { namespace db {
+
+   /**
+    * @class undo_arena
+    * @brief chunked bump allocator holding the packed pre-images of an undo_journal
+    *
+    * Memory is only ever released from the back (when a savepoint is undone) or from the front
+    * (when the oldest savepoint falls out of the undo history), so a pair of counters per chunk
+    * is all the bookkeeping needed.  Released chunks of the default size are kept for reuse.
+    */
+   class undo_arena
+   {
+      public:
+         /** identifies a position in the arena; everything allocated after it can be released with rewind() */
+         struct mark
+         {
+            uint64_t chunk = 0; ///< absolute number of chunks in use
+            size_t   used  = 0; ///< bytes used in the last of those chunks
+         };
+
+         static const size_t default_chunk_size = 256*1024;
+
+         char*    allocate( size_t size );
+         mark     get_mark()const;
+         void     rewind( const mark& m );
+         /** releases every chunk which lies entirely before m */
+         void     release_before( const mark& m );
+         void     clear();
+
+         size_t   capacity()const { return _capacity; }
+
+      private:
+         struct chunk
+         {
+            std::unique_ptr<char[]> data;
+            size_t                  capacity = 0;
+            size_t                  used = 0;
+         };
+
+         void recycle( chunk&& c );
+
+         std::deque<chunk>   _chunks;
+         vector<chunk>       _spare;
+         uint64_t            _first_chunk = 0; ///< absolute number of _chunks.front()
+         size_t              _capacity = 0;
+   };
+
+   enum class undo_record_kind : uint8_t
+   {
+      created,     ///< object was created, undo removes it and rewinds the next id of its index
+      id_reserved, ///< object was created and removed again, undo only rewinds the next id of its index
+      modified,    ///< data holds the packed value of the object before it was modified
+      removed      ///< data holds the packed value of the object before it was removed
+   };
+
+   struct undo_record
+   {
+      object_id_type    id;
+      undo_record_kind  kind = undo_record_kind::created;
+      uint32_t          size = 0;
+      const char*       data = nullptr;
+   };
+
+   /**
+    * @class undo_journal
+    * @brief append-only log of object pre-images separated by savepoints
+    *
+    * Every undo session pushes a savepoint; the records written after it belong to that session.
+    * The first change to an object within a session appends one record, later changes to the same
+    * object are detected through an open-addressed id -> record table and skipped.  Merging a session
+    * into its parent only drops the savepoint, so the parent may end up with more than one record
+    * per object; first_records() resolves that when the session is undone.
+    */
+   class undo_journal
+   {
+      public:
+         void     push_savepoint();
+         /** drops the most recent savepoint, its records now belong to the previous one */
+         void     merge_savepoint();
+         /** discards the most recent savepoint together with its records */
+         void     pop_savepoint();
+         /**
+          * Discards the oldest savepoint together with its records, unless the records are retained.  Records
+          * numbered retain_from or later are still being read elsewhere; while any would go, all of them stay
+          * until a later call.
+          */
+         void     pop_front_savepoint( uint64_t retain_from = uint64_t(-1) );
+         void     clear();
+         /**
+          * Makes the next change to every object write a record of its own even if the object already has one
+          * in the current savepoint, so that the records written from here on tell the state as of now.
+          */
+         void     set_barrier() { _barrier = end_seq(); }
+
+         /**
+          * Keeps every record held now, and those written later, when older savepoints are discarded, so that
+          * first_records_since() still works for the current positions.  release() discards what the
+          * savepoints dropped meanwhile no longer need, apart from the records numbered retain_from or later.
+          */
+         void     retain();
+         void     release( uint64_t retain_from = uint64_t(-1) );
+
+         size_t   savepoint_count()const { return _savepoints.size(); }
+         size_t   record_count()const    { return _records.size(); }
+         size_t   arena_capacity()const  { return _arena.capacity(); }
+
+         /** sequence number the next record will get; records are numbered in the order they are written */
+         uint64_t next_seq()const  { return end_seq(); }
+         /** sequence number of the oldest record still held */
+         uint64_t first_seq()const { return _first_seq; }
+         /** sequence number the most recent savepoint starts at, pop_savepoint() rewinds the journal to it */
+         uint64_t top_savepoint_seq()const;
+         /** the record numbered seq, which must still be held */
+         const undo_record& record( uint64_t seq )const;
+
+         void     on_create( const object& obj );
+         void     on_modify( const object& obj );
+         void     on_remove( const object& obj );
+
+         /**
+          * Fills result with the first record of every object touched since the most recent savepoint,
+          * in the order they were written.  The first record alone determines the value the object had
+          * when the savepoint was pushed.
+          */
+         void     first_records( vector<const undo_record*>& result )const;
+         /** like first_records(), but for every object touched since the record numbered seq was written */
+         void     first_records_since( uint64_t seq, vector<const undo_record*>& result )const;
+
+      private:
+         static const uint64_t empty_slot = uint64_t(-1);
+
+         struct slot
+         {
+            uint64_t key = 0;
+            uint64_t seq = empty_slot;
+         };
+
+         struct savepoint
+         {
+            uint64_t           first_seq = 0;
+            undo_arena::mark   arena_mark;
+         };
+
+         undo_record*  find_in_top( object_id_type id );
+         undo_record&  append( object_id_type id, undo_record_kind kind );
+         void          append_packed( const object& obj, undo_record_kind kind );
+         void          index_record( object_id_type id, uint64_t seq );
+         void          rebuild_table();
+         /** discards the records and arena chunks before the oldest savepoint, see pop_front_savepoint() */
+         void          drop_before_front( uint64_t retain_from );
+         uint64_t      end_seq()const { return _first_seq + _records.size(); }
+
+         std::deque<undo_record>  _records;
+         std::deque<savepoint>    _savepoints;
+         uint64_t                 _first_seq = 0; ///< sequence number of _records.front()
+         uint64_t                 _barrier = 0;   ///< find_in_top() ignores records written before it
+         bool                     _retained = false;
+         undo_arena               _arena;
+
+         /** maps object ids to the sequence number of their latest record, stale entries are tolerated */
+         vector<slot>             _table;
+         size_t                   _table_used = 0;
+
+         /** scratch space for first_records() */
+         mutable vector<slot>     _scratch;
+   };
+
+} } // graphene::db
@@ -40,4 +40,14 @@ namespace graphene { namespace db {
 
    void base_primary_index::on_modify( const object& obj )
    {for( auto ob : _observers ) ob->on_modify(  obj ); }
+
+   bool base_primary_index::tracks_state_hash()const
+   { return _db._track_state_hash; }
+
+   base_primary_index::write_lock::write_lock( base_primary_index& idx )
+   :_db( idx._db )
+   { _db.begin_change(); }
+
+   base_primary_index::write_lock::~write_lock()
+   { _db.end_change(); }
 } } // graphene::chain
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/db/node_pool.hpp>
+
+#include <algorithm>
+
+namespace graphene { namespace db {
+
+namespace {
+   const size_t block_bytes = 64*1024;
+   const size_t min_block_nodes = 32;
+}
+
+size_t node_pool::round_size( size_t size )
+{
+   const size_t align = alignof(std::max_align_t);
+   size = std::max( size, sizeof(free_node) );
+   return (size + align - 1) / align * align;
+}
+
+void* node_pool::allocate( size_t size )
+{
+   const size_t rounded = round_size( size );
+   {
+      std::lock_guard<std::mutex> guard( _mutex );
+      if( _node_size == 0 )
+         _node_size = rounded;
+      if( rounded == _node_size )
+      {
+         ++_live;
+         if( _free != nullptr )
+         {
+            free_node* result = _free;
+            _free = result->next;
+            return result;
+         }
+         if( _block_next == _block_end )
+            add_block();
+         char* result = _block_next;
+         _block_next += _node_size;
+         return result;
+      }
+   }
+   return ::operator new( size );
+}
+
+void node_pool::deallocate( void* p, size_t size )
+{
+   if( p == nullptr )
+      return;
+   {
+      std::lock_guard<std::mutex> guard( _mutex );
+      if( round_size( size ) == _node_size )
+      {
+         free_node* node = static_cast<free_node*>( p );
+         node->next = _free;
+         _free = node;
+         --_live;
+         return;
+      }
+   }
+   ::operator delete( p );
+}
+
+void node_pool::add_block()
+{
+   const size_t nodes = std::max( min_block_nodes, block_bytes / _node_size );
+   _blocks.emplace_back( new char[ nodes * _node_size ] );
+   _block_next = _blocks.back().get();
+   _block_end = _block_next + nodes * _node_size;
+   _capacity += nodes;
+}
+
+node_pool_stats node_pool::get_stats()const
+{
+   std::lock_guard<std::mutex> guard( _mutex );
+   node_pool_stats result;
+   result.node_size = uint32_t( _node_size );
+   result.live_nodes = _live;
+   result.capacity = _capacity;
+   result.bytes = _capacity * _node_size;
+   return result;
+}
+
+} } // graphene::db
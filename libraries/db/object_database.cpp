@@ -22,15 +22,20 @@
  * THE SOFTWARE.
  */
 #include <graphene/db/object_database.hpp>
+#include <graphene/db/state_snapshot.hpp>
 
 #include <fc/io/raw.hpp>
 #include <fc/container/flat.hpp>
+#include <fc/thread/thread.hpp>
 #include <fc/uint128.hpp>
 
+#include <algorithm>
+#include <atomic>
+
 namespace graphene { namespace db {
 
 object_database::object_database()
-:_undo_db(*this)
+:_undo_db(*this),_recorded_reads(nullptr)
 {
    _index.resize(255);
    _undo_db.enable();
@@ -44,14 +49,40 @@ void object_database::close()
 
 const object* object_database::find_object( object_id_type id )const
 {
-   return get_index(id.space(),id.type()).find( id );
+   if( read_set* reads = recording() )
+      reads->objects.push_back( id );
+   return find_index(id.space(),id.type()).find( id );
 }
 const object& object_database::get_object( object_id_type id )const
 {
-   return get_index(id.space(),id.type()).get( id );
+   if( read_set* reads = recording() )
+      reads->objects.push_back( id );
+   return find_index(id.space(),id.type()).get( id );
+}
+
+void object_database::record_reads( read_set* reads )const
+{
+   _recording_thread = std::this_thread::get_id();
+   _recorded_reads.store( reads, std::memory_order_release );
+}
+
+read_set* object_database::recording()const
+{
+   read_set* reads = _recorded_reads.load( std::memory_order_acquire );
+   if( reads != nullptr && _recording_thread == std::this_thread::get_id() )
+      return reads;
+   return nullptr;
 }
 
 const index& object_database::get_index(uint8_t space_id, uint8_t type_id)const
+{
+   const index& result = find_index( space_id, type_id );
+   if( read_set* reads = recording() )
+      reads->indexes.emplace_back( space_id, type_id );
+   return result;
+}
+
+const index& object_database::find_index(uint8_t space_id, uint8_t type_id)const
 {
    FC_ASSERT( _index.size() > space_id, "", ("space_id",space_id)("type_id",type_id)("index.size",_index.size()) );
    FC_ASSERT( _index[space_id].size() > type_id, "", ("space_id",space_id)("type_id",type_id)("index[space_id].size",_index[space_id].size()) );
@@ -71,16 +102,183 @@ index& object_database::get_mutable_index(uint8_t space_id, uint8_t type_id)
 void object_database::flush()
 {
 //   ilog("Save object_database in ${d}", ("d", _data_dir));
+   flush( _data_dir / "object_database" );
+}
+
+void object_database::flush( const fc::path& object_dir )
+{
+   vector< std::pair< fc::path, index* > > indexes;
    for( uint32_t space = 0; space < _index.size(); ++space )
    {
-      fc::create_directories( _data_dir / "object_database" / fc::to_string(space) );
+      fc::create_directories( object_dir / fc::to_string(space) );
       const auto types = _index[space].size();
       for( uint32_t type = 0; type  <  types; ++type )
          if( _index[space][type] )
-            _index[space][type]->save( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+            indexes.emplace_back( object_dir / fc::to_string(space)/fc::to_string(type), _index[space][type].get() );
+   }
+   parallel_for( indexes.size(), [&indexes]( size_t i ) {
+      indexes[i].second->save( indexes[i].first );
+   });
+}
+
+void object_database::pack_state_before( uint64_t undo_seq,
+                                         const std::function< void( const fc::path&, const vector<char>& ) >& write )const
+{
+   vector<const undo_record*> records;
+   std::unordered_map<object_id_type,const undo_record*> changes;
+   vector<char> data;
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type < _index[space].size(); ++type )
+      {
+         if( !_index[space][type] )
+            continue;
+         {
+            // the journal may have changed since the last index, what it holds from undo_seq on still leads back
+            read_scope lock( *this );
+            _undo_db.journal().first_records_since( undo_seq, records );
+            changes.clear();
+            for( const undo_record* rec : records )
+               if( rec->id.space() == space && rec->id.type() == type )
+                  changes[ rec->id ] = rec;
+            data.clear();
+            _index[space][type]->pack_before( data, changes );
+         }
+         write( fc::path( fc::to_string(space) ) / fc::to_string(type), data );
+      }
+}
+
+void object_database::enable_concurrent_reads()
+{
+   FC_ASSERT( _write_depth == 0 );
+   _concurrent_reads = true;
+}
+
+void object_database::enable_snapshots( uint32_t block_num )
+{
+   FC_ASSERT( _undo_db.enabled(), "snapshots are built on the undo history" );
+   FC_ASSERT( _change_depth == 0 );
+   _snapshots_enabled = true;
+   mark_snapshot_point( block_num );
+}
+
+void object_database::mark_snapshot_point( uint32_t block_num )
+{
+   FC_ASSERT( _snapshots_enabled );
+   change_scope lock( *this );
+   // whatever is written from here on records the state as of this point
+   _undo_db.set_record_barrier();
+   const uint64_t seq = _undo_db.journal().next_seq();
+   while( !_snapshot_points.empty() && _snapshot_points.back().second >= block_num )
+      _snapshot_points.pop_back();
+   _snapshot_points.emplace_back( seq, block_num );
+   while( _snapshot_points.size() > std::max<size_t>( _undo_db.max_size(), 1 ) )
+      _snapshot_points.pop_front();
+}
+
+std::shared_ptr<const state_snapshot> object_database::create_snapshot()const
+{
+   if( !_snapshots_enabled )
+      return std::shared_ptr<const state_snapshot>( new state_snapshot( *this ) );
+
+   boost::shared_lock<boost::shared_mutex> lock( _index_mutex );
+   if( _snapshot_points.empty() || _snapshot_points.back().first < _undo_db.journal().first_seq() )
+      return std::shared_ptr<const state_snapshot>( new state_snapshot( *this ) );
+   const uint64_t seq = _snapshot_points.back().first;
+   const uint32_t block_num = _snapshot_points.back().second;
+
+   // released after the registry, a snapshot unregisters itself when its last reference goes
+   std::shared_ptr<const state_snapshot> cached;
+   std::lock_guard<std::mutex> guard( _registry_mutex );
+   cached = _latest_snapshot.lock();
+   if( cached && cached->_seq == seq && cached->_valid )
+      return cached;
+   state_snapshot* snapshot = new state_snapshot( *this, seq, block_num );
+   _snapshots.insert( snapshot );
+   std::shared_ptr<const state_snapshot> result( snapshot );
+   _latest_snapshot = result;
+   return result;
+}
+
+object_database::read_scope::read_scope( const object_database& db )
+:_db(db),_locked(db._concurrent_reads)
+{
+   if( _locked )
+      _db._state_mutex.lock_shared();
+}
+
+object_database::read_scope::~read_scope()
+{
+   if( _locked )
+      _db._state_mutex.unlock_shared();
+}
+
+void object_database::begin_write()
+{
+   if( _write_depth++ == 0 && _concurrent_reads )
+   {
+      _state_mutex.lock();
+      _write_locked = true;
+   }
+}
+
+void object_database::end_write()
+{
+   if( --_write_depth == 0 && _write_locked )
+   {
+      _write_locked = false;
+      _state_mutex.unlock();
+   }
+}
+
+void object_database::begin_change()
+{
+   if( _change_depth++ == 0 && _snapshots_enabled )
+   {
+      _index_mutex.lock();
+      _change_locked = true;
+   }
+}
+
+void object_database::end_change()
+{
+   if( --_change_depth == 0 && _change_locked )
+   {
+      _change_locked = false;
+      _index_mutex.unlock();
    }
 }
 
+void object_database::journal_rewound( uint64_t seq )
+{
+   if( !_snapshots_enabled )
+      return;
+   while( !_snapshot_points.empty() && _snapshot_points.back().first > seq )
+      _snapshot_points.pop_back();
+   std::lock_guard<std::mutex> guard( _registry_mutex );
+   for( state_snapshot* snapshot : _snapshots )
+      snapshot->rewound( seq );
+}
+
+void object_database::on_untracked_change()
+{
+   if( !_snapshots_enabled )
+      return;
+   _snapshot_points.clear();
+   std::lock_guard<std::mutex> guard( _registry_mutex );
+   for( state_snapshot* snapshot : _snapshots )
+      snapshot->invalidate();
+}
+
+uint64_t object_database::snapshot_retain_seq()const
+{
+   uint64_t result = uint64_t(-1);
+   std::lock_guard<std::mutex> guard( _registry_mutex );
+   for( const state_snapshot* snapshot : _snapshots )
+      if( snapshot->_valid )
+         result = std::min( result, snapshot->_seq );
+   return result;
+}
+
 void object_database::wipe(const fc::path& data_dir)
 {
    close();
@@ -90,17 +288,112 @@ void object_database::wipe(const fc::path& data_dir)
 }
 
 void object_database::open(const fc::path& data_dir)
+{
+   open( data_dir, data_dir / "object_database" );
+}
+
+void object_database::open( const fc::path& data_dir, const fc::path& object_dir )
 { try {
-   ilog("Opening object database from ${d} ...", ("d", data_dir));
+   ilog("Opening object database from ${d} ...", ("d", object_dir));
    _data_dir = data_dir;
+   vector< std::pair< fc::path, index* > > indexes;
    for( uint32_t space = 0; space < _index.size(); ++space )
       for( uint32_t type = 0; type  < _index[space].size(); ++type )
          if( _index[space][type] )
-            _index[space][type]->open( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+            indexes.emplace_back( object_dir / fc::to_string(space)/fc::to_string(type), _index[space][type].get() );
+
+   // the threads take the indexes in order, start with the largest ones so they do not finish last
+   auto file_size = []( const fc::path& p ) -> uint64_t { return fc::exists( p ) ? fc::file_size( p ) : 0; };
+   std::stable_sort( indexes.begin(), indexes.end(), [&file_size]( const std::pair< fc::path, index* >& a,
+                                                                   const std::pair< fc::path, index* >& b ) {
+      return file_size( a.first ) > file_size( b.first );
+   });
+
+   parallel_for( indexes.size(), [&indexes]( size_t i ) {
+      indexes[i].second->load_objects( indexes[i].first );
+   });
+   parallel_for( indexes.size(), [&indexes]( size_t i ) {
+      indexes[i].second->rebuild_secondary_indexes();
+   });
    ilog( "Done opening object database." );
 
-} FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+} FC_CAPTURE_AND_RETHROW( (data_dir)(object_dir) ) }
+
+void object_database::parallel_for( size_t count, const std::function<void(size_t)>& work )
+{
+   const size_t thread_count = std::min<size_t>( _io_thread_count, count );
+   if( thread_count <= 1 )
+   {
+      for( size_t i = 0; i < count; ++i )
+         work( i );
+      return;
+   }
+
+   std::atomic<size_t> next( 0 );
+   vector< std::unique_ptr<fc::thread> > threads;
+   vector< fc::future<void> > done;
+   for( size_t t = 0; t < thread_count; ++t )
+   {
+      threads.emplace_back( new fc::thread( "object_database_" + fc::to_string(t) ) );
+      done.push_back( threads.back()->async( [&next,&work,count]() {
+         for( size_t i = next++; i < count; i = next++ )
+            work( i );
+      }, "object_database_io" ) );
+   }
+
+   // wait for every thread before reporting the first failure
+   fc::exception_ptr error;
+   for( auto& f : done )
+   {
+      try
+      {
+         f.wait();
+      }
+      catch( const fc::exception& e )
+      {
+         if( !error )
+            error = e.dynamic_copy_exception();
+      }
+   }
+   if( error )
+      error->dynamic_rethrow_exception();
+}
+
+vector<node_pool_stats> object_database::get_node_pool_stats()const
+{
+   vector<node_pool_stats> result;
+   for( const auto& space : _index )
+      for( const auto& idx : space )
+      {
+         node_pool_stats stats;
+         if( idx && idx->get_node_pool_stats( stats ) )
+            result.push_back( stats );
+      }
+   return result;
+}
 
+void object_database::enable_state_hash()
+{
+   _track_state_hash = true;
+   vector<index*> indexes;
+   for( auto& space : _index )
+      for( auto& idx : space )
+         if( idx )
+            indexes.push_back( idx.get() );
+   parallel_for( indexes.size(), [&indexes]( size_t i ) {
+      indexes[i]->reset_state_hash();
+   });
+}
+
+vector< std::pair< std::pair<uint8_t,uint8_t>, fc::uint128 > > object_database::get_state_hashes()const
+{
+   vector< std::pair< std::pair<uint8_t,uint8_t>, fc::uint128 > > result;
+   for( const auto& space : _index )
+      for( const auto& idx : space )
+         if( idx )
+            result.emplace_back( std::make_pair( idx->object_space_id(), idx->object_type_id() ), idx->state_hash() );
+   return result;
+}
 
 void object_database::pop_undo()
 { try {
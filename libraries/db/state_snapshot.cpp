@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/db/state_snapshot.hpp>
+
+namespace graphene { namespace db {
+
+state_snapshot::state_snapshot( const object_database& db )
+:_db(db),_live(true),_seq(0),_block_num(0),_scanned_to(0)
+{
+}
+
+state_snapshot::state_snapshot( const object_database& db, uint64_t seq, uint32_t block_num )
+:_db(db),_live(false),_seq(seq),_block_num(block_num),_scanned_to(seq)
+{
+}
+
+state_snapshot::~state_snapshot()
+{
+   if( _live )
+      return;
+   std::lock_guard<std::mutex> guard( _db._registry_mutex );
+   _db._snapshots.erase( this );
+}
+
+bool state_snapshot::valid()const
+{
+   if( _live )
+      return true;
+   boost::shared_lock<boost::shared_mutex> lock( _db._index_mutex );
+   return _valid;
+}
+
+void state_snapshot::read( object_id_type id, const std::function<void(const object*, const undo_record*)>& reader )const
+{
+   const index& idx = _db.find_index( id.space(), id.type() );
+   if( _live )
+   {
+      reader( idx.find( id ), nullptr );
+      return;
+   }
+
+   boost::shared_lock<boost::shared_mutex> lock( _db._index_mutex );
+   FC_ASSERT( _valid, "The snapshot of block ${b} has been undone", ("b", _block_num) );
+   scan();
+   boost::shared_lock<boost::shared_mutex> guard( _mutex );
+
+   auto itr = _first_record.find( id );
+   reader( idx.find( id ), itr == _first_record.end() ? nullptr : &_db._undo_db.journal().record( itr->second ) );
+}
+
+void state_snapshot::read_changed( uint8_t space_id, uint8_t type_id,
+                                   const std::function<void(const std::function<bool(object_id_type)>&)>& live,
+                                   const std::function<void(const undo_record&)>& recorded )const
+{
+   if( _live )
+   {
+      live( []( object_id_type ) { return false; } );
+      return;
+   }
+
+   boost::shared_lock<boost::shared_mutex> lock( _db._index_mutex );
+   FC_ASSERT( _valid, "The snapshot of block ${b} has been undone", ("b", _block_num) );
+   scan();
+   boost::shared_lock<boost::shared_mutex> guard( _mutex );
+
+   live( [this]( object_id_type id ) { return _first_record.find( id ) != _first_record.end(); } );
+
+   // objects changed since the snapshot point, wherever the live walk did or did not find them
+   const undo_journal& journal = _db._undo_db.journal();
+   for( const auto& item : _first_record )
+   {
+      if( item.first.space() != space_id || item.first.type() != type_id )
+         continue;
+      const undo_record& rec = journal.record( item.second );
+      if( existed( rec ) )
+         recorded( rec );
+   }
+}
+
+void state_snapshot::scan()const
+{
+   // the journal cannot grow while the caller keeps changes out, so the map is complete once this returns
+   const undo_journal& journal = _db._undo_db.journal();
+   const uint64_t end = journal.next_seq();
+   boost::unique_lock<boost::shared_mutex> guard( _mutex );
+   for( ; _scanned_to < end; ++_scanned_to )
+      _first_record.emplace( journal.record( _scanned_to ).id, _scanned_to );
+}
+
+void state_snapshot::rewound( uint64_t seq )
+{
+   if( seq < _seq )
+   {
+      invalidate();
+      return;
+   }
+   if( seq >= _scanned_to )
+      return;
+   for( auto itr = _first_record.begin(); itr != _first_record.end(); )
+   {
+      if( itr->second >= seq )
+         itr = _first_record.erase( itr );
+      else
+         ++itr;
+   }
+   _scanned_to = seq;
+}
+
+void state_snapshot::invalidate()
+{
+   _valid = false;
+   _first_record.clear();
+}
+
+} } // graphene::db
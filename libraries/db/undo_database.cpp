@@ -37,59 +37,52 @@ undo_database::session undo_database::start_undo_session( bool force_enable )
    if( force_enable ) 
       _disabled = false;
 
-   while( size() > max_size() )
-      _stack.pop_front();
+   if( size() > max_size() )
+   {
+      object_database::change_scope lock( _db );
+      while( size() > max_size() )
+         _journal.pop_front_savepoint( _db.snapshot_retain_seq() );
+   }
 
-   _stack.emplace_back();
+   _journal.push_savepoint();
    ++_active_sessions;
    return session(*this, disable_on_exit );
 }
 void undo_database::on_create( const object& obj )
 {
-   if( _disabled ) return;
+   if( _disabled )
+   {
+      if( !_undoing ) _db.on_untracked_change();
+      return;
+   }
 
-   if( _stack.empty() )
-      _stack.emplace_back();
-   auto& state = _stack.back();
-   auto index_id = object_id_type( obj.id.space(), obj.id.type(), 0 );
-   auto itr = state.old_index_next_ids.find( index_id );
-   if( itr == state.old_index_next_ids.end() )
-      state.old_index_next_ids[index_id] = obj.id;
-   state.new_ids.insert(obj.id);
+   if( _journal.savepoint_count() == 0 )
+      _journal.push_savepoint();
+   _journal.on_create( obj );
 }
 void undo_database::on_modify( const object& obj )
 {
-   if( _disabled ) return;
-
-   if( _stack.empty() )
-      _stack.emplace_back();
-   auto& state = _stack.back();
-   if( state.new_ids.find(obj.id) != state.new_ids.end() )
+   if( _disabled )
+   {
+      if( !_undoing ) _db.on_untracked_change();
       return;
-   auto itr =  state.old_values.find(obj.id);
-   if( itr != state.old_values.end() ) return;
-   state.old_values[obj.id] = obj.clone();
+   }
+
+   if( _journal.savepoint_count() == 0 )
+      _journal.push_savepoint();
+   _journal.on_modify( obj );
 }
 void undo_database::on_remove( const object& obj )
 {
-   if( _disabled ) return;
-
-   if( _stack.empty() )
-      _stack.emplace_back();
-   undo_state& state = _stack.back();
-   if( state.new_ids.count(obj.id) )
+   if( _disabled )
    {
-      state.new_ids.erase(obj.id);
+      if( !_undoing ) _db.on_untracked_change();
       return;
    }
-   if( state.old_values.count(obj.id) )
-   {
-      state.removed[obj.id] = std::move(state.old_values[obj.id]);
-      state.old_values.erase(obj.id);
-      return;
-   }
-   if( state.removed.count(obj.id) ) return;
-   state.removed[obj.id] = obj.clone();
+
+   if( _journal.savepoint_count() == 0 )
+      _journal.push_savepoint();
+   _journal.on_remove( obj );
 }
 
 void undo_database::undo()
@@ -98,28 +91,10 @@ void undo_database::undo()
    FC_ASSERT( _active_sessions > 0 );
    disable();
 
-   auto& state = _stack.back();
-   for( auto& item : state.old_values )
-   {
-      _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
-   }
-
-   for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
-   {
-      _db.remove( _db.get_object(*ritr) );
-   }
-
-   for( auto& item : state.old_index_next_ids )
-   {
-      _db.get_mutable_index( item.first.space(), item.first.type() ).set_next_id( item.second );
-   }
+   undo_head();
 
-   for( auto& item : state.removed )
-      _db.insert( std::move(*item.second) );
-
-   _stack.pop_back();
-   if( _stack.empty() )
-      _stack.emplace_back();
+   if( _journal.savepoint_count() == 0 )
+      _journal.push_savepoint();
    enable();
    --_active_sessions;
 } FC_CAPTURE_AND_RETHROW() }
@@ -127,115 +102,12 @@ void undo_database::undo()
 void undo_database::merge()
 {
    FC_ASSERT( _active_sessions > 0 );
-   FC_ASSERT( _stack.size() >=2 );
-   auto& state = _stack.back();
-   auto& prev_state = _stack[_stack.size()-2];
-
-   // An object's relationship to a state can be:
-   // in new_ids            : new
-   // in old_values (was=X) : upd(was=X)
-   // in removed (was=X)    : del(was=X)
-   // not in any of above   : nop
-   //
-   // When merging A=prev_state and B=state we have a 4x4 matrix of all possibilities:
-   //
-   //                   |--------------------- B ----------------------|
-   //
-   //                +------------+------------+------------+------------+
-   //                | new        | upd(was=Y) | del(was=Y) | nop        |
-   //   +------------+------------+------------+------------+------------+
-   // / | new        | N/A        | new       A| nop       C| new       A|
-   // | +------------+------------+------------+------------+------------+
-   // | | upd(was=X) | N/A        | upd(was=X)A| del(was=X)C| upd(was=X)A|
-   // A +------------+------------+------------+------------+------------+
-   // | | del(was=X) | N/A        | N/A        | N/A        | del(was=X)A|
-   // | +------------+------------+------------+------------+------------+
-   // \ | nop        | new       B| upd(was=Y)B| del(was=Y)B| nop      AB|
-   //   +------------+------------+------------+------------+------------+
-   //
-   // Each entry was composed by labelling what should occur in the given case.
-   //
-   // Type A means the composition of states contains the same entry as the first of the two merged states for that object.
-   // Type B means the composition of states contains the same entry as the second of the two merged states for that object.
-   // Type C means the composition of states contains an entry different from either of the merged states for that object.
-   // Type N/A means the composition of states violates causal timing.
-   // Type AB means both type A and type B simultaneously.
-   //
-   // The merge() operation is defined as modifying prev_state in-place to be the state object which represents the composition of
-   // state A and B.
-   //
-   // Type A (and AB) can be implemented as a no-op; prev_state already contains the correct value for the merged state.
-   // Type B (and AB) can be implemented by copying from state to prev_state.
-   // Type C needs special case-by-case logic.
-   // Type N/A can be ignored or assert(false) as it can only occur if prev_state and state have illegal values
-   // (a serious logic error which should never happen).
-   //
+   FC_ASSERT( size() >= 2 );
 
-   // We can only be outside type A/AB (the nop path) if B is not nop, so it suffices to iterate through B's three containers.
-
-   // *+upd
-   for( auto& obj : state.old_values )
-   {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
-      {
-         // new+upd -> new, type A
-         continue;
-      }
-      if( prev_state.old_values.find(obj.second->id) != prev_state.old_values.end() )
-      {
-         // upd(was=X) + upd(was=Y) -> upd(was=X), type A
-         continue;
-      }
-      // del+upd -> N/A
-      assert( prev_state.removed.find(obj.second->id) == prev_state.removed.end() );
-      // nop+upd(was=Y) -> upd(was=Y), type B
-      prev_state.old_values[obj.second->id] = std::move(obj.second);
-   }
-
-   // *+new, but we assume the N/A cases don't happen, leaving type B nop+new -> new
-   for( auto id : state.new_ids )
-      prev_state.new_ids.insert(id);
-
-   // old_index_next_ids can only be updated, iterate over *+upd cases
-   for( auto& item : state.old_index_next_ids )
-   {
-      if( prev_state.old_index_next_ids.find( item.first ) == prev_state.old_index_next_ids.end() )
-      {
-         // nop+upd(was=Y) -> upd(was=Y), type B
-         prev_state.old_index_next_ids[item.first] = item.second;
-         continue;
-      }
-      else
-      {
-         // upd(was=X)+upd(was=Y) -> upd(was=X), type A
-         // type A implementation is a no-op, as discussed above, so there is no code here
-         continue;
-      }
-   }
-
-   // *+del
-   for( auto& obj : state.removed )
-   {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
-      {
-         // new + del -> nop (type C)
-         prev_state.new_ids.erase(obj.second->id);
-         continue;
-      }
-      auto it = prev_state.old_values.find(obj.second->id);
-      if( it != prev_state.old_values.end() )
-      {
-         // upd(was=X) + del(was=Y) -> del(was=X)
-         prev_state.removed[obj.second->id] = std::move(it->second);
-         prev_state.old_values.erase(obj.second->id);
-         continue;
-      }
-      // del + del -> N/A
-      assert( prev_state.removed.find( obj.second->id ) == prev_state.removed.end() );
-      // nop + del(was=Y) -> del(was=Y)
-      prev_state.removed[obj.second->id] = std::move(obj.second);
-   }
-   _stack.pop_back();
+   // The records of the merged session simply become part of the previous one.  An object may now
+   // have several records in the previous savepoint; only the first of them matters when undoing,
+   // see undo_head().
+   _journal.merge_savepoint();
    --_active_sessions;
 }
 void undo_database::commit()
@@ -247,31 +119,11 @@ void undo_database::commit()
 void undo_database::pop_commit()
 {
    FC_ASSERT( _active_sessions == 0 );
-   FC_ASSERT( !_stack.empty() );
+   FC_ASSERT( size() > 0 );
 
    disable();
    try {
-      auto& state = _stack.back();
-
-      for( auto& item : state.old_values )
-      {
-         _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
-      }
-
-      for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
-      {
-         _db.remove( _db.get_object(*ritr) );
-      }
-
-      for( auto& item : state.old_index_next_ids )
-      {
-         _db.get_mutable_index( item.first.space(), item.first.type() ).set_next_id( item.second );
-      }
-
-      for( auto& item : state.removed )
-         _db.insert( std::move(*item.second) );
-
-      _stack.pop_back();
+      undo_head();
    }
    catch ( const fc::exception& e )
    {
@@ -281,10 +133,94 @@ void undo_database::pop_commit()
    }
    enable();
 }
-const undo_state& undo_database::head()const
+
+void undo_database::undo_head()
 {
-   FC_ASSERT( !_stack.empty() );
-   return _stack.back();
+   // the restored objects and the rewound journal have to show up to concurrent and snapshot readers at once
+   object_database::write_scope lock( _db );
+   object_database::change_scope change( _db );
+   struct undoing_scope
+   {
+      undoing_scope( bool& flag ):_flag(flag) { _flag = true; }
+      ~undoing_scope() { _flag = false; }
+      bool& _flag;
+   } undoing( _undoing );
+
+   // The first record of an object tells what it looked like when the savepoint was pushed:
+   //   created, id_reserved : it did not exist
+   //   modified, removed    : it existed with the recorded value
+   // Restore modified objects first, then remove new ones, then re-insert removed ones, so that
+   // no intermediate state violates a uniqueness constraint.
+   _journal.first_records( _undo_records );
+
+   for( const undo_record* rec : _undo_records )
+   {
+      if( rec->kind != undo_record_kind::modified )
+         continue;
+      const object* obj = _db.find_object( rec->id );
+      if( obj != nullptr )
+         _db.modify( *obj, [rec]( object& o ){ o.unpack_from( rec->data, rec->size ); } );
+   }
+
+   for( const undo_record* rec : _undo_records )
+   {
+      if( rec->kind != undo_record_kind::created )
+         continue;
+      const object* obj = _db.find_object( rec->id );
+      if( obj != nullptr )
+         _db.remove( *obj );
+   }
+
+   // ids are handed out in increasing order, so the first new id of an index is its old next_id
+   for( auto ritr = _undo_records.rbegin(); ritr != _undo_records.rend(); ++ritr )
+   {
+      const undo_record* rec = *ritr;
+      if( rec->kind == undo_record_kind::created || rec->kind == undo_record_kind::id_reserved )
+         _db.get_mutable_index( rec->id.space(), rec->id.type() ).set_next_id( rec->id );
+   }
+
+   for( const undo_record* rec : _undo_records )
+   {
+      if( rec->kind == undo_record_kind::removed
+          || ( rec->kind == undo_record_kind::modified && _db.find_object( rec->id ) == nullptr ) )
+         _db.get_mutable_index( rec->id.space(), rec->id.type() ).insert_packed( rec->data, rec->size );
+   }
+
+   _undo_records.clear();
+   const uint64_t rewound_to = _journal.top_savepoint_seq();
+   _journal.pop_savepoint();
+   _db.journal_rewound( rewound_to );
+}
+
+void undo_database::release_journal()
+{
+   object_database::change_scope lock( _db );
+   _journal.release( _db.snapshot_retain_seq() );
+}
+
+void undo_database::set_record_barrier()
+{
+   _journal.set_barrier();
+}
+
+vector<object_id_type> undo_database::head_changed_ids()const
+{
+   FC_ASSERT( size() > 0 );
+   vector<const undo_record*> records;
+   _journal.first_records( records );
+
+   vector<object_id_type> result;
+   result.reserve( records.size() );
+   for( const undo_record* rec : records )
+   {
+      if( rec->kind == undo_record_kind::id_reserved )
+         continue;
+      // created and removed again after a merge
+      if( rec->kind == undo_record_kind::created && _db.find_object( rec->id ) == nullptr )
+         continue;
+      result.push_back( rec->id );
+   }
+   return result;
 }
 
 } } // graphene::db
@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/db/undo_journal.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace graphene { namespace db {
+
+namespace {
+   inline size_t slot_hash( uint64_t key )
+   {
+      key ^= key >> 33;
+      key *= 0xff51afd7ed558ccdULL;
+      key ^= key >> 33;
+      return size_t(key);
+   }
+}
+
+char* undo_arena::allocate( size_t size )
+{
+   if( !_chunks.empty() )
+   {
+      chunk& last = _chunks.back();
+      if( last.capacity - last.used >= size )
+      {
+         char* result = last.data.get() + last.used;
+         last.used += size;
+         return result;
+      }
+   }
+
+   chunk c;
+   if( size <= default_chunk_size && !_spare.empty() )
+   {
+      c = std::move( _spare.back() );
+      _spare.pop_back();
+   }
+   else
+   {
+      c.capacity = std::max( size, default_chunk_size );
+      c.data.reset( new char[c.capacity] );
+      _capacity += c.capacity;
+   }
+   c.used = size;
+   _chunks.push_back( std::move(c) );
+   return _chunks.back().data.get();
+}
+
+undo_arena::mark undo_arena::get_mark()const
+{
+   mark result;
+   result.chunk = _first_chunk + _chunks.size();
+   result.used  = _chunks.empty() ? 0 : _chunks.back().used;
+   return result;
+}
+
+void undo_arena::rewind( const mark& m )
+{
+   while( !_chunks.empty() && _first_chunk + _chunks.size() > m.chunk )
+   {
+      recycle( std::move( _chunks.back() ) );
+      _chunks.pop_back();
+   }
+   if( !_chunks.empty() && _first_chunk + _chunks.size() == m.chunk )
+      _chunks.back().used = m.used;
+}
+
+void undo_arena::release_before( const mark& m )
+{
+   // the chunk numbered m.chunk-1 holds the data written right after m, keep it
+   while( !_chunks.empty() && _first_chunk + 1 < m.chunk )
+   {
+      recycle( std::move( _chunks.front() ) );
+      _chunks.pop_front();
+      ++_first_chunk;
+   }
+}
+
+void undo_arena::clear()
+{
+   _first_chunk += _chunks.size();
+   for( auto& c : _chunks )
+      recycle( std::move(c) );
+   _chunks.clear();
+}
+
+void undo_arena::recycle( chunk&& c )
+{
+   if( c.capacity == default_chunk_size && _spare.size() < 4 )
+   {
+      c.used = 0;
+      _spare.push_back( std::move(c) );
+      return;
+   }
+   _capacity -= c.capacity;
+   c.data.reset();
+}
+
+void undo_journal::push_savepoint()
+{
+   savepoint sp;
+   sp.first_seq  = end_seq();
+   sp.arena_mark = _arena.get_mark();
+   _savepoints.push_back( sp );
+}
+
+void undo_journal::merge_savepoint()
+{
+   FC_ASSERT( _savepoints.size() >= 2 );
+   _savepoints.pop_back();
+}
+
+void undo_journal::pop_savepoint()
+{
+   FC_ASSERT( !_savepoints.empty() );
+   const savepoint sp = _savepoints.back();
+   _savepoints.pop_back();
+   _records.resize( sp.first_seq - _first_seq );
+   _arena.rewind( sp.arena_mark );
+   _barrier = std::min( _barrier, end_seq() );
+   if( _records.empty() && _savepoints.empty() )
+   {
+      _arena.clear();
+      _table.clear();
+      _table_used = 0;
+   }
+}
+
+void undo_journal::pop_front_savepoint( uint64_t retain_from )
+{
+   FC_ASSERT( !_savepoints.empty() );
+   _savepoints.pop_front();
+   if( !_retained )
+      drop_before_front( retain_from );
+}
+
+void undo_journal::retain()
+{
+   _retained = true;
+}
+
+void undo_journal::release( uint64_t retain_from )
+{
+   if( !_retained )
+      return;
+   _retained = false;
+   drop_before_front( retain_from );
+}
+
+void undo_journal::drop_before_front( uint64_t retain_from )
+{
+   if( _savepoints.empty() )
+   {
+      if( retain_from >= end_seq() )
+         clear();
+      return;
+   }
+   const savepoint& front = _savepoints.front();
+   // the records stay until whoever reads them lets go, a later call releases them
+   if( retain_from < front.first_seq )
+      return;
+   _records.erase( _records.begin(), _records.begin() + (front.first_seq - _first_seq) );
+   _first_seq = front.first_seq;
+   _arena.release_before( front.arena_mark );
+}
+
+void undo_journal::clear()
+{
+   _first_seq = end_seq();
+   _records.clear();
+   _savepoints.clear();
+   _arena.clear();
+   _table.clear();
+   _table_used = 0;
+}
+
+void undo_journal::on_create( const object& obj )
+{
+   append( obj.id, undo_record_kind::created );
+}
+
+void undo_journal::on_modify( const object& obj )
+{
+   // whatever happened to the object first in this savepoint already preserves its prior value
+   if( find_in_top( obj.id ) != nullptr )
+      return;
+   append_packed( obj, undo_record_kind::modified );
+}
+
+void undo_journal::on_remove( const object& obj )
+{
+   undo_record* rec = find_in_top( obj.id );
+   if( rec == nullptr )
+   {
+      append_packed( obj, undo_record_kind::removed );
+      return;
+   }
+   switch( rec->kind )
+   {
+      case undo_record_kind::created:
+         rec->kind = undo_record_kind::id_reserved;
+         break;
+      case undo_record_kind::modified:
+         rec->kind = undo_record_kind::removed;
+         break;
+      default:
+         break;
+   }
+}
+
+void undo_journal::first_records( vector<const undo_record*>& result )const
+{
+   result.clear();
+   if( _savepoints.empty() )
+      return;
+   first_records_since( _savepoints.back().first_seq, result );
+}
+
+void undo_journal::first_records_since( uint64_t first, vector<const undo_record*>& result )const
+{
+   FC_ASSERT( first >= _first_seq && first <= end_seq(), "records since ${s} are no longer held", ("s", first) );
+   result.clear();
+
+   const uint64_t count = end_seq() - first;
+   size_t capacity = 16;
+   while( capacity < count * 2 )
+      capacity <<= 1;
+   _scratch.assign( capacity, slot() );
+   const size_t mask = capacity - 1;
+
+   for( uint64_t seq = first; seq < end_seq(); ++seq )
+   {
+      const undo_record& rec = _records[seq - _first_seq];
+      size_t i = slot_hash( rec.id.number ) & mask;
+      while( _scratch[i].seq != empty_slot && _scratch[i].key != rec.id.number )
+         i = (i + 1) & mask;
+      if( _scratch[i].seq != empty_slot )
+         continue;
+      _scratch[i].key = rec.id.number;
+      _scratch[i].seq = seq;
+      result.push_back( &rec );
+   }
+}
+
+uint64_t undo_journal::top_savepoint_seq()const
+{
+   FC_ASSERT( !_savepoints.empty() );
+   return _savepoints.back().first_seq;
+}
+
+const undo_record& undo_journal::record( uint64_t seq )const
+{
+   FC_ASSERT( seq >= _first_seq && seq < end_seq(), "record ${s} is no longer held", ("s", seq) );
+   return _records[seq - _first_seq];
+}
+
+undo_record* undo_journal::find_in_top( object_id_type id )
+{
+   if( _table.empty() || _savepoints.empty() )
+      return nullptr;
+
+   const size_t mask = _table.size() - 1;
+   size_t i = slot_hash( id.number ) & mask;
+   while( _table[i].seq != empty_slot )
+   {
+      if( _table[i].key == id.number )
+      {
+         const uint64_t seq = _table[i].seq;
+         if( seq < std::max( _savepoints.back().first_seq, _barrier ) || seq >= end_seq() )
+            return nullptr;
+         undo_record& rec = _records[seq - _first_seq];
+         return rec.id == id ? &rec : nullptr;
+      }
+      i = (i + 1) & mask;
+   }
+   return nullptr;
+}
+
+undo_record& undo_journal::append( object_id_type id, undo_record_kind kind )
+{
+   FC_ASSERT( !_savepoints.empty() );
+   const uint64_t seq = end_seq();
+   _records.emplace_back();
+   undo_record& rec = _records.back();
+   rec.id   = id;
+   rec.kind = kind;
+   index_record( id, seq );
+   return rec;
+}
+
+void undo_journal::append_packed( const object& obj, undo_record_kind kind )
+{
+   const size_t size = obj.packed_size();
+   FC_ASSERT( size <= std::numeric_limits<uint32_t>::max() );
+   char* data = _arena.allocate( size );
+   obj.pack_to( data, size );
+   undo_record& rec = append( obj.id, kind );
+   rec.size = uint32_t(size);
+   rec.data = data;
+}
+
+void undo_journal::index_record( object_id_type id, uint64_t seq )
+{
+   if( _table.empty() )
+      rebuild_table();
+
+   const size_t mask = _table.size() - 1;
+   size_t i = slot_hash( id.number ) & mask;
+   while( _table[i].seq != empty_slot && _table[i].key != id.number )
+      i = (i + 1) & mask;
+   if( _table[i].seq == empty_slot )
+   {
+      _table[i].key = id.number;
+      ++_table_used;
+   }
+   _table[i].seq = seq;
+
+   if( _table_used * 4 > _table.size() * 3 )
+      rebuild_table();
+}
+
+void undo_journal::rebuild_table()
+{
+   // only records of the most recent savepoint are ever looked up, everything else is stale
+   const uint64_t first = _savepoints.empty() ? end_seq() : std::max( _savepoints.back().first_seq, _barrier );
+   size_t capacity = 1024;
+   while( capacity < (end_seq() - first) * 4 )
+      capacity <<= 1;
+   _table.assign( capacity, slot() );
+   _table_used = 0;
+
+   const size_t mask = capacity - 1;
+   for( uint64_t seq = first; seq < end_seq(); ++seq )
+   {
+      const uint64_t key = _records[seq - _first_seq].id.number;
+      size_t i = slot_hash( key ) & mask;
+      while( _table[i].seq != empty_slot && _table[i].key != key )
+         i = (i + 1) & mask;
+      if( _table[i].seq == empty_slot )
+      {
+         _table[i].key = key;
+         ++_table_used;
+      }
+      _table[i].seq = seq;
+   }
+}
+
+} } // graphene::db
@@ -44,6 +44,7 @@ namespace graphene { namespace net {
   using graphene::chain::block_id_type;
   using graphene::chain::transaction_id_type;
   using graphene::chain::signed_block;
+  using graphene::chain::sealed_block;
 
   typedef fc::ecc::public_key_data node_id_t;
   typedef fc::ripemd160 item_hash_t;
@@ -108,9 +109,12 @@ namespace graphene { namespace net {
 
       block_message(){}
       block_message(const signed_block& blk )
-      :block(blk),block_id(blk.id()){}
+      :block(blk),block_id(block.id()){}
+      block_message(sealed_block blk )
+      :block(std::move(blk)),block_id(block.id()){}
 
-      signed_block    block;
+      /** shared with everyone the block is handed to, and sent as the bytes it was received as */
+      sealed_block    block;
       block_id_type   block_id;
 
    };
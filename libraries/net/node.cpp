@@ -3112,7 +3112,7 @@ namespace graphene { namespace net { namespace detail {
             if (items_being_processed_iter != peer->ids_of_items_being_processed.end())
             {
               peer->last_block_delegate_has_seen = block_message_to_send.block_id;
-              peer->last_block_time_delegate_has_seen = block_message_to_send.block.timestamp;
+              peer->last_block_time_delegate_has_seen = block_message_to_send.block->timestamp;
 
               peer->ids_of_items_being_processed.erase(items_being_processed_iter);
               dlog("Removed item from ${endpoint}'s list of items being processed, still processing ${len} blocks",
@@ -3369,7 +3369,7 @@ namespace graphene { namespace net { namespace detail {
 
         item_id block_message_item_id(core_message_type_enum::block_message_type, message_hash);
         uint32_t block_number = block_message_to_process.block.block_num();
-        fc::time_point_sec block_time = block_message_to_process.block.timestamp;
+        fc::time_point_sec block_time = block_message_to_process.block->timestamp;
 
         for (const peer_connection_ptr& peer : _active_connections)
         {
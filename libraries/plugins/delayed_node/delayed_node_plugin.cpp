@@ -100,11 +100,15 @@ void delayed_node_plugin::sync_with_trusted_node()
       pass_count++;
       while( remote_dpo.last_irreversible_block_num > db.head_block_num() )
       {
-         fc::optional<graphene::chain::signed_block> block = my->database_api->get_block( db.head_block_num()+1 );
-         FC_ASSERT(block, "Trusted node claims it has blocks it doesn't actually have.");
-         ilog("Pushing block #${n}", ("n", block->block_num()));
-         db.push_block(*block);
-         synced_blocks++;
+         const uint32_t count = std::min<uint32_t>( remote_dpo.last_irreversible_block_num - db.head_block_num(), 1000 );
+         vector<graphene::chain::signed_block> blocks = my->database_api->get_blocks( db.head_block_num()+1, count );
+         FC_ASSERT(!blocks.empty(), "Trusted node claims it has blocks it doesn't actually have.");
+         for( const graphene::chain::signed_block& block : blocks )
+         {
+            ilog("Pushing block #${n}", ("n", block.block_num()));
+            db.push_block(block);
+            synced_blocks++;
+         }
       }
    }
 }
@@ -76,6 +76,10 @@ private:
    void schedule_production_loop();
    block_production_condition::block_production_condition_enum block_production_loop();
    block_production_condition::block_production_condition_enum maybe_produce_block( fc::mutable_variant_object& capture );
+   /** runs maybe_prepare_block() as a task of its own unless the last one is still running */
+   void schedule_block_preparation();
+   /** assembles the next block ahead of its slot if one of our witnesses is to produce it */
+   void maybe_prepare_block();
 
    boost::program_options::variables_map _options;
    bool _production_enabled = false;
@@ -86,6 +90,7 @@ private:
    std::map<chain::public_key_type, fc::ecc::private_key> _private_keys;
    std::set<chain::witness_id_type> _witnesses;
    fc::future<void> _block_production_task;
+   fc::future<void> _block_preparation_task;
 };
 
 } } //graphene::witness_plugin
@@ -221,9 +221,56 @@ block_production_condition::block_production_condition_enum witness_plugin::bloc
    }
 
    schedule_production_loop();
+   schedule_block_preparation();
    return result;
 }
 
+void witness_plugin::schedule_block_preparation()
+{
+   // rebuilding the pending state may take a while, it runs as a task of its own so that the next tick is not
+   // held up by it
+   if( _block_preparation_task.valid() && !_block_preparation_task.ready() )
+      return;
+   _block_preparation_task = fc::async( [this]
+   {
+      try
+      {
+         maybe_prepare_block();
+      }
+      catch( const fc::canceled_exception& )
+      {
+         throw;
+      }
+      catch( const fc::exception& e )
+      {
+         elog("Got exception while preparing block:\n${e}", ("e", e.to_detail_string()));
+      }
+   }, "Witness Block Preparation" );
+}
+
+void witness_plugin::maybe_prepare_block()
+{
+   chain::database& db = database();
+   if( !_production_enabled )
+      return;
+
+   // a slot due within the next half second is produced by the next tick without waiting for a candidate
+   fc::time_point_sec now = graphene::time::now() + fc::microseconds( 500000 );
+   fc::time_point_sec next_time = db.get_slot_time( 1 );
+   if( next_time <= now )
+      return;
+
+   graphene::chain::witness_id_type next_witness = db.get_scheduled_witness( 1 );
+   if( _witnesses.find( next_witness ) == _witnesses.end() )
+      return;
+   if( _private_keys.find( next_witness( db ).signing_key ) == _private_keys.end() )
+      return;
+
+   // transactions arriving from now on join the candidate by themselves
+   if( !db.has_block_candidate( next_time, next_witness ) )
+      db.prepare_block( next_time, next_witness, _production_skip_flags );
+}
+
 block_production_condition::block_production_condition_enum witness_plugin::maybe_produce_block( fc::mutable_variant_object& capture )
 {
    chain::database& db = database();
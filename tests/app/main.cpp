@@ -22,6 +22,7 @@
  * THE SOFTWARE.
  */
 #include <graphene/app/application.hpp>
+#include <graphene/app/database_api.hpp>
 #include <graphene/app/plugin.hpp>
 
 #include <graphene/chain/balance_object.hpp>
@@ -32,6 +33,9 @@
 
 #include <graphene/account_history/account_history_plugin.hpp>
 
+#include <fc/crypto/base64.hpp>
+#include <fc/io/json.hpp>
+#include <fc/network/http/websocket.hpp>
 #include <fc/thread/thread.hpp>
 #include <fc/smart_ref_impl.hpp>
 
@@ -152,3 +156,114 @@ BOOST_AUTO_TEST_CASE( two_node_network )
       throw;
    }
 }
+
+BOOST_AUTO_TEST_CASE( batch_requests )
+{
+   using namespace graphene::chain;
+   using namespace graphene::app;
+   try {
+      fc::temp_directory app_dir( graphene::utilities::temp_directory_path() );
+
+      graphene::app::application app;
+      boost::program_options::variables_map cfg;
+      cfg.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:4141"), false));
+      cfg.emplace("rpc-endpoint", boost::program_options::variable_value(string("127.0.0.1:8093"), false));
+      cfg.emplace("api-threads", boost::program_options::variable_value(uint32_t(2), false));
+      app.initialize(app_dir.path(), cfg);
+      app.startup();
+
+      fc::http::websocket_client client;
+      auto con = client.connect( "ws://127.0.0.1:8093" );
+      fc::promise<std::string>::ptr reply;
+      con->on_message_handler( [&]( const std::string& msg ) { reply->set_value( msg ); } );
+      auto call = [&]( const std::string& request ) -> fc::variant {
+         reply.reset( new fc::promise<std::string>( "batch_requests reply" ) );
+         con->send_message( request );
+         return fc::json::from_string( fc::future<std::string>( reply ).wait( fc::seconds(5) ) );
+      };
+
+      // the database api is the first one registered on a connection
+      const fc::variants replies = call( "[{\"id\":1,\"method\":\"call\",\"params\":[0,\"get_chain_id\",[]]},"
+                                         " {\"id\":2,\"method\":\"call\",\"params\":[0,\"get_dynamic_global_properties\",[]]},"
+                                         " {\"id\":3,\"method\":\"call\",\"params\":[0,\"no_such_method\",[]]}]" ).get_array();
+      BOOST_REQUIRE_EQUAL( replies.size(), 3u );
+      BOOST_CHECK_EQUAL( replies[0]["id"].as_uint64(), 1u );
+      BOOST_CHECK( replies[0]["result"].as<chain_id_type>() == app.chain_database()->get_chain_id() );
+      BOOST_CHECK_EQUAL( replies[1]["id"].as_uint64(), 2u );
+      BOOST_CHECK_EQUAL( replies[1]["result"]["head_block_number"].as_uint64(), app.chain_database()->head_block_num() );
+      BOOST_CHECK_EQUAL( replies[2]["id"].as_uint64(), 3u );
+      BOOST_CHECK( replies[2].get_object().contains( "error" ) );
+
+      // a single request is answered as before
+      const fc::variant single = call( "{\"id\":4,\"method\":\"call\",\"params\":[0,\"get_chain_id\",[]]}" );
+      BOOST_CHECK_EQUAL( single["id"].as_uint64(), 4u );
+
+      const fc::variant empty = call( "[]" );
+      BOOST_CHECK( empty.get_object().contains( "error" ) );
+
+      // elements which are not requests get an invalid request error each, the rest is answered as usual
+      const fc::variants mixed = call( "[42, {\"id\":5,\"params\":[]},"
+                                       " {\"id\":6,\"method\":\"call\",\"params\":[0,\"get_chain_id\",[]]}]" ).get_array();
+      BOOST_REQUIRE_EQUAL( mixed.size(), 3u );
+      BOOST_CHECK( mixed[0]["id"].is_null() );
+      BOOST_CHECK_EQUAL( mixed[0]["error"]["code"].as_int64(), -32600 );
+      BOOST_CHECK_EQUAL( mixed[1]["id"].as_uint64(), 5u );
+      BOOST_CHECK_EQUAL( mixed[1]["error"]["code"].as_int64(), -32600 );
+      BOOST_CHECK_EQUAL( mixed[2]["id"].as_uint64(), 6u );
+      BOOST_CHECK( mixed[2]["result"].as<chain_id_type>() == app.chain_database()->get_chain_id() );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( binary_results )
+{
+   using namespace graphene::chain;
+   using namespace graphene::app;
+   try {
+      fc::temp_directory app_dir( graphene::utilities::temp_directory_path() );
+
+      graphene::app::application app;
+      boost::program_options::variables_map cfg;
+      cfg.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:4142"), false));
+      cfg.emplace("rpc-endpoint", boost::program_options::variable_value(string("127.0.0.1:8094"), false));
+      app.initialize(app_dir.path(), cfg);
+      app.startup();
+
+      fc::http::websocket_client client;
+      auto con = client.connect( "ws://127.0.0.1:8094" );
+      fc::promise<std::string>::ptr reply;
+      con->on_message_handler( [&]( const std::string& msg ) { reply->set_value( msg ); } );
+      auto call = [&]( const std::string& request ) -> fc::variant {
+         reply.reset( new fc::promise<std::string>( "binary_results reply" ) );
+         con->send_message( request );
+         return fc::json::from_string( fc::future<std::string>( reply ).wait( fc::seconds(5) ) );
+      };
+      const std::string get_objects = "{\"id\":3,\"method\":\"call\",\"params\":[0,\"get_objects\",[[\"2.0.0\",\"2.0.100\"]]]}";
+
+      BOOST_CHECK( call( "{\"id\":1,\"method\":\"set_encoding\",\"params\":[\"xml\"]}" ).get_object().contains( "error" ) );
+      BOOST_CHECK_EQUAL( call( "{\"id\":2,\"method\":\"set_encoding\",\"params\":[\"binary\"]}" )["result"].as_string(), "binary" );
+
+      const fc::variant packed = call( get_objects );
+      BOOST_CHECK_EQUAL( packed["id"].as_uint64(), 3u );
+      const std::string data = fc::base64_decode( packed["result"].as_string() );
+      const auto objects = fc::raw::unpack< vector<optional<packed_object>> >( vector<char>( data.begin(), data.end() ) );
+      BOOST_REQUIRE_EQUAL( objects.size(), 2u );
+      BOOST_REQUIRE( objects[0].valid() );
+      BOOST_CHECK( objects[0]->id == object_id_type( global_property_id_type() ) );
+      const auto gpo = fc::raw::unpack<global_property_object>( objects[0]->data );
+      BOOST_CHECK_EQUAL( gpo.parameters.block_interval, app.chain_database()->get_global_properties().parameters.block_interval );
+      BOOST_CHECK( !objects[1].valid() );
+
+      // calls without a binary form are still answered in JSON
+      BOOST_CHECK( call( "{\"id\":4,\"method\":\"call\",\"params\":[0,\"get_chain_id\",[]]}" )["result"].as<chain_id_type>()
+                   == app.chain_database()->get_chain_id() );
+
+      BOOST_CHECK_EQUAL( call( "{\"id\":5,\"method\":\"set_encoding\",\"params\":[\"json\"]}" )["result"].as_string(), "json" );
+      BOOST_CHECK( call( get_objects )["result"].get_array()[0]["id"].as<object_id_type>() == object_id_type( global_property_id_type() ) );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/account_object.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace graphene::chain;
+
+namespace {
+
+/** modifies every balance once per round, each round in an undo session like a block, so undo capture is part of the cost */
+template<typename Modify>
+void run_modify_bench( database& db, const char* name, const vector<const account_balance_object*>& balances,
+                       uint32_t rounds, Modify&& modify )
+{
+   const uint64_t modify_count = uint64_t(balances.size()) * rounds;
+   auto start_time = fc::time_point::now();
+   for( uint32_t r = 0; r < rounds; ++r )
+   {
+      auto session = db._undo_db.start_undo_session();
+      for( const auto* b : balances )
+         modify( *b );
+      session.undo();
+   }
+   auto elapsed = fc::time_point::now() - start_time;
+   ilog( "${n}: ${c} modifications in ${t} ms, ${r} per second",
+         ("n", name)("c", modify_count)("t", elapsed.count() / 1000)
+         ("r", modify_count * 1000000 / std::max<int64_t>( elapsed.count(), 1 )) );
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( typed_modify_bench )
+{
+   try {
+#ifdef NDEBUG
+      const uint32_t object_count = 100000;
+      const uint32_t rounds = 100;
+#else
+      const uint32_t object_count = 10000;
+      const uint32_t rounds = 10;
+#endif
+      database db;
+      vector<const account_balance_object*> balances;
+      for( uint32_t i = 0; i < object_count; ++i )
+         balances.push_back( &db.create_in<account_balance_index>( [i]( account_balance_object& b ) {
+            b.owner = account_id_type( i );
+            b.balance = i;
+         }));
+      run_modify_bench( db, "database::modify", balances, rounds, [&]( const account_balance_object& b ) {
+         db.modify( b, []( account_balance_object& o ) { o.balance += 1; } );
+      });
+      run_modify_bench( db, "database::modify_in", balances, rounds, [&]( const account_balance_object& b ) {
+         db.modify_in<account_balance_index>( b, []( account_balance_object& o ) { o.balance += 1; } );
+      });
+
+      for( uint32_t i = 0; i < object_count; ++i )
+         BOOST_CHECK_EQUAL( balances[i]->balance.value, int64_t(i) );
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
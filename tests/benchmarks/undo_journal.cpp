@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/account_object.hpp>
+#include <graphene/db/undo_journal.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace graphene::chain;
+
+namespace {
+
+/**
+ * The map based undo state undo_database used before the undo_journal, reduced to the parts which run
+ * while transactions are pushed: capturing pre-images and merging sessions.
+ */
+struct legacy_undo_stack
+{
+   struct state
+   {
+      std::unordered_map<object_id_type, unique_ptr<object> > old_values;
+      std::unordered_map<object_id_type, object_id_type>      old_index_next_ids;
+      std::unordered_set<object_id_type>                      new_ids;
+      std::unordered_map<object_id_type, unique_ptr<object> > removed;
+   };
+
+   std::deque<state> stack;
+
+   void on_create( const object& obj )
+   {
+      auto& s = stack.back();
+      auto index_id = object_id_type( obj.id.space(), obj.id.type(), 0 );
+      if( s.old_index_next_ids.find( index_id ) == s.old_index_next_ids.end() )
+         s.old_index_next_ids[index_id] = obj.id;
+      s.new_ids.insert( obj.id );
+   }
+
+   void on_modify( const object& obj )
+   {
+      auto& s = stack.back();
+      if( s.new_ids.find( obj.id ) != s.new_ids.end() ) return;
+      if( s.old_values.find( obj.id ) != s.old_values.end() ) return;
+      s.old_values[obj.id] = obj.clone();
+   }
+
+   void merge()
+   {
+      auto& s = stack.back();
+      auto& prev = stack[stack.size()-2];
+      for( auto& item : s.old_values )
+      {
+         if( prev.new_ids.find( item.first ) != prev.new_ids.end() ) continue;
+         if( prev.old_values.find( item.first ) != prev.old_values.end() ) continue;
+         prev.old_values[item.first] = std::move( item.second );
+      }
+      for( auto id : s.new_ids )
+         prev.new_ids.insert( id );
+      for( auto& item : s.old_index_next_ids )
+         if( prev.old_index_next_ids.find( item.first ) == prev.old_index_next_ids.end() )
+            prev.old_index_next_ids[item.first] = item.second;
+      stack.pop_back();
+   }
+};
+
+struct undo_workload
+{
+   vector<account_statistics_object> statistics;
+   vector<account_balance_object>    balances;
+   vector<account_balance_object>    created;
+   uint32_t                          transactions;
+   uint32_t                          blocks;
+
+   undo_workload( uint32_t account_count, uint32_t trx_per_block, uint32_t block_count )
+   : transactions( trx_per_block ), blocks( block_count )
+   {
+      for( uint32_t i = 0; i < account_count; ++i )
+      {
+         account_statistics_object stats;
+         stats.id = object_id_type( stats.space_id, stats.type_id, i );
+         stats.owner = account_id_type( i );
+         stats.total_ops = i;
+         statistics.push_back( stats );
+
+         account_balance_object bal;
+         bal.id = object_id_type( bal.space_id, bal.type_id, i );
+         bal.owner = account_id_type( i );
+         bal.balance = i;
+         balances.push_back( bal );
+      }
+      for( uint32_t i = 0; i < trx_per_block; ++i )
+      {
+         account_balance_object bal;
+         bal.id = object_id_type( bal.space_id, bal.type_id, account_count + i );
+         created.push_back( bal );
+      }
+   }
+
+   /**
+    * Replays what a block worth of transfers does to the undo history: one session per transaction,
+    * touching the statistics and balances of two accounts and creating one object, merged into the
+    * pending state session.
+    */
+   template<typename Start, typename Create, typename Modify, typename Merge, typename Discard>
+   void run( Start&& start, Create&& create, Modify&& modify, Merge&& merge, Discard&& discard )const
+   {
+      const size_t n = statistics.size();
+      for( uint32_t b = 0; b < blocks; ++b )
+      {
+         start();
+         for( uint32_t t = 0; t < transactions; ++t )
+         {
+            const size_t from = ( size_t(b) * 7919 + size_t(t) * 104729 ) % n;
+            const size_t to   = ( from * 31 + 17 ) % n;
+            start();
+            modify( statistics[from] );
+            modify( balances[from] );
+            modify( balances[to] );
+            modify( statistics[from] );
+            create( created[t] );
+            merge();
+         }
+         discard();
+      }
+   }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( undo_journal_bench )
+{
+   try {
+#ifdef NDEBUG
+      const uint32_t account_count = 200000;
+      const uint32_t trx_per_block = 2000;
+      const uint32_t block_count = 200;
+#else
+      const uint32_t account_count = 20000;
+      const uint32_t trx_per_block = 200;
+      const uint32_t block_count = 20;
+#endif
+      const undo_workload workload( account_count, trx_per_block, block_count );
+      const uint64_t trx_count = uint64_t(trx_per_block) * block_count;
+
+      {
+         legacy_undo_stack legacy;
+         auto start_time = fc::time_point::now();
+         workload.run( [&]{ legacy.stack.emplace_back(); },
+                       [&]( const object& o ){ legacy.on_create( o ); },
+                       [&]( const object& o ){ legacy.on_modify( o ); },
+                       [&]{ legacy.merge(); },
+                       [&]{ legacy.stack.pop_back(); } );
+         auto elapsed = fc::time_point::now() - start_time;
+         ilog( "Map based undo state: ${c} transactions in ${t} ms, ${r} trx/s",
+               ("c", trx_count)("t", elapsed.count() / 1000)
+               ("r", trx_count * 1000000 / std::max<int64_t>( elapsed.count(), 1 )) );
+      }
+      {
+         graphene::db::undo_journal journal;
+         auto start_time = fc::time_point::now();
+         workload.run( [&]{ journal.push_savepoint(); },
+                       [&]( const object& o ){ journal.on_create( o ); },
+                       [&]( const object& o ){ journal.on_modify( o ); },
+                       [&]{ journal.merge_savepoint(); },
+                       [&]{ journal.pop_savepoint(); } );
+         auto elapsed = fc::time_point::now() - start_time;
+         ilog( "Undo journal: ${c} transactions in ${t} ms, ${r} trx/s, arena ${a} bytes",
+               ("c", trx_count)("t", elapsed.count() / 1000)
+               ("r", trx_count * 1000000 / std::max<int64_t>( elapsed.count(), 1 ))
+               ("a", journal.arena_capacity()) );
+         BOOST_CHECK_EQUAL( journal.savepoint_count(), 0u );
+      }
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
@@ -1313,4 +1313,130 @@ BOOST_FIXTURE_TEST_CASE( nonminimal_sig_test, database_fixture )
    }
 }
 
+BOOST_AUTO_TEST_CASE( precomputed_signature_keys )
+{
+   try
+   {
+      fc::ecc::private_key alice_key = fc::ecc::private_key::regenerate(fc::digest("alice"));
+      fc::ecc::private_key bob_key = fc::ecc::private_key::regenerate(fc::digest("bob"));
+
+      signed_transaction tx;
+      transfer_operation op;
+      op.amount = asset(1);
+      tx.operations.push_back( op );
+      tx.sign( alice_key, db.get_chain_id() );
+
+      tx.precompute_signature_keys( db.get_chain_id() );
+      BOOST_CHECK( tx.get_signature_keys( db.get_chain_id() ) == flat_set<public_key_type>( { alice_key.get_public_key() } ) );
+
+      // adding a signature or changing the transaction must not reuse the precomputed keys
+      tx.sign( bob_key, db.get_chain_id() );
+      BOOST_CHECK( tx.get_signature_keys( db.get_chain_id() ) ==
+                   flat_set<public_key_type>( { alice_key.get_public_key(), bob_key.get_public_key() } ) );
+      tx.precompute_signature_keys( db.get_chain_id() );
+      tx.operations.push_back( op );
+      BOOST_CHECK( tx.get_signature_keys( db.get_chain_id() ).size() == 2 );
+      BOOST_CHECK( tx.get_signature_keys( db.get_chain_id() ).count( alice_key.get_public_key() ) == 0 );
+
+      // a duplicate signature is reported both when the keys are precomputed and when they are used
+      tx.operations.pop_back();
+      tx.signatures.push_back( tx.signatures.back() );
+      GRAPHENE_CHECK_THROW( tx.precompute_signature_keys( db.get_chain_id() ), tx_duplicate_sig );
+      GRAPHENE_CHECK_THROW( tx.get_signature_keys( db.get_chain_id() ), tx_duplicate_sig );
+   }
+   catch(fc::exception& e)
+   {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( signature_cache_reuses_keys )
+{
+   try
+   {
+      fc::ecc::private_key alice_key = fc::ecc::private_key::regenerate(fc::digest("alice"));
+      signature_cache cache( 2 );
+
+      signed_transaction tx;
+      transfer_operation op;
+      op.amount = asset(1);
+      tx.operations.push_back( op );
+      tx.set_expiration( db.head_block_time() + 60 );
+      tx.sign( alice_key, db.get_chain_id() );
+
+      auto keys = tx.get_signature_keys( db.get_chain_id(), &cache );
+      BOOST_CHECK( keys.count( alice_key.get_public_key() ) == 1 );
+      BOOST_CHECK_EQUAL( cache.get_stats().misses, 1u );
+      BOOST_CHECK_EQUAL( cache.get_stats().size, 1u );
+
+      BOOST_CHECK( tx.get_signature_keys( db.get_chain_id(), &cache ) == keys );
+      BOOST_CHECK_EQUAL( cache.get_stats().hits, 1u );
+
+      // a different transaction signed by the same key is a different entry
+      tx.operations.push_back( op );
+      tx.signatures.clear();
+      tx.sign( alice_key, db.get_chain_id() );
+      tx.get_signature_keys( db.get_chain_id(), &cache );
+      BOOST_CHECK_EQUAL( cache.get_stats().misses, 2u );
+      BOOST_CHECK_EQUAL( cache.get_stats().size, 2u );
+
+      cache.remove_expired( tx.expiration );
+      BOOST_CHECK_EQUAL( cache.get_stats().size, 2u );
+      cache.remove_expired( tx.expiration + 1 );
+      BOOST_CHECK_EQUAL( cache.get_stats().size, 0u );
+   }
+   catch(fc::exception& e)
+   {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( account_member_index_follows_authority_changes )
+{
+   try
+   {
+      ACTORS( (alice)(bob) );
+      const auto& members = dynamic_cast<const primary_index<account_index>&>( db.get_index_type<account_index>() )
+                               .get_secondary_index<account_member_index>();
+      auto key_members = [&]( const public_key_type& key ) {
+         auto itr = members.account_to_key_memberships.find( key );
+         return itr == members.account_to_key_memberships.end() ? set<account_id_type>() : itr->second;
+      };
+      auto account_members = [&]( account_id_type account ) {
+         auto itr = members.account_to_account_memberships.find( account );
+         return itr == members.account_to_account_memberships.end() ? set<account_id_type>() : itr->second;
+      };
+      const public_key_type alice_key = alice_private_key.get_public_key();
+      const public_key_type new_key = generate_private_key( "alice2" ).get_public_key();
+      BOOST_CHECK( key_members( alice_key ).count( alice_id ) == 1 );
+
+      // a modification which leaves the authorities alone keeps the memberships
+      db.modify( alice_id( db ), []( account_object& a ) { a.cashback_vb.reset(); } );
+      BOOST_CHECK( key_members( alice_key ).count( alice_id ) == 1 );
+
+      db.modify( alice_id( db ), [&]( account_object& a ) {
+         a.active = authority( 1, new_key, 1, bob_id, 1 );
+      });
+      BOOST_CHECK( key_members( new_key ).count( alice_id ) == 1 );
+      BOOST_CHECK( account_members( bob_id ).count( alice_id ) == 1 );
+      // still referenced by the owner authority and the memo key
+      BOOST_CHECK( key_members( alice_key ).count( alice_id ) == 1 );
+
+      db.modify( alice_id( db ), [&]( account_object& a ) {
+         a.owner = authority( 1, new_key, 1 );
+         a.options.memo_key = new_key;
+      });
+      BOOST_CHECK( key_members( alice_key ).count( alice_id ) == 0 );
+      BOOST_CHECK( key_members( new_key ).count( alice_id ) == 1 );
+      BOOST_CHECK( account_members( bob_id ).count( alice_id ) == 1 );
+   }
+   catch(fc::exception& e)
+   {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -24,6 +24,7 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <graphene/app/database_api.hpp>
 #include <graphene/chain/database.hpp>
 #include <graphene/chain/exceptions.hpp>
 
@@ -126,6 +127,340 @@ BOOST_AUTO_TEST_CASE( block_database_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( block_database_range )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+
+      vector<signed_block> blocks;
+      signed_block b;
+      for( uint32_t i = 0; i < 6; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         bdb.store( b.id(), b );
+         blocks.push_back( b );
+      }
+      // a fork switch stores the replacement of block 4 at the end of the blocks file
+      signed_block replacement = blocks[3];
+      replacement.witness = witness_id_type(100);
+      bdb.store( replacement.id(), replacement );
+      blocks[3] = replacement;
+      bdb.remove( blocks[5].id() );
+
+      auto range = bdb.fetch_range( 1, 10 );
+      BOOST_REQUIRE_EQUAL( range.size(), 5u );
+      for( uint32_t i = 0; i < 5; ++i )
+         BOOST_CHECK( range[i].id() == blocks[i].id() );
+
+      range = bdb.fetch_range( 3, 2 );
+      BOOST_REQUIRE_EQUAL( range.size(), 2u );
+      BOOST_CHECK( range[0].id() == blocks[2].id() );
+      BOOST_CHECK( range[1].witness == witness_id_type(100) );
+
+      BOOST_CHECK( bdb.fetch_range( 0, 3 ).empty() );
+      BOOST_CHECK( bdb.fetch_range( 6, 3 ).empty() );
+      BOOST_CHECK( bdb.fetch_range( 100, 3 ).empty() );
+      BOOST_CHECK( bdb.fetch_range( 1, 0 ).empty() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_concurrent_readers )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+
+      const uint32_t block_count = 2000;
+      vector<signed_block> blocks;
+      signed_block b;
+      for( uint32_t i = 0; i < block_count; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         blocks.push_back( b );
+      }
+
+      std::atomic<uint32_t> stored( 0 );
+      std::atomic<uint32_t> mismatches( 0 );
+      vector< std::unique_ptr<fc::thread> > threads;
+      vector< fc::future<void> > readers_done;
+      for( uint32_t t = 0; t < 3; ++t )
+      {
+         threads.emplace_back( new fc::thread( "block_reader" ) );
+         readers_done.push_back( threads.back()->async( [&]() {
+            while( stored.load() < block_count )
+            {
+               const uint32_t known = stored.load();
+               if( known == 0 )
+                  continue;
+               const uint32_t num = 1 + known / 2;
+               auto block = bdb.fetch_by_number( num );
+               if( !block.valid() || block->id() != blocks[num-1].id() )
+                  ++mismatches;
+               for( const auto& r : bdb.fetch_range( num, 10 ) )
+                  if( r.id() != blocks[r.block_num()-1].id() )
+                     ++mismatches;
+            }
+         }, "read_blocks" ) );
+      }
+
+      for( const auto& block : blocks )
+      {
+         bdb.store( block.id(), block );
+         ++stored;
+      }
+      for( auto& f : readers_done )
+         f.wait();
+      BOOST_CHECK_EQUAL( mismatches.load(), 0u );
+
+      // the padding of the mapped index stays on close, open() skips it
+      bdb.close();
+      BOOST_CHECK_GE( fc::file_size( data_dir.path() / "index" ), sizeof(index_entry) * (block_count + 1) );
+      bdb.open( data_dir.path() );
+      BOOST_REQUIRE( bdb.last_id().valid() );
+      BOOST_CHECK( *bdb.last_id() == blocks.back().id() );
+      block_database_reader reader( data_dir.path() );
+      BOOST_CHECK( reader.fetch_by_number( block_count )->id() == blocks.back().id() );
+      optional<sealed_block> sealed = reader.fetch_sealed_by_number( block_count );
+      BOOST_REQUIRE( sealed.valid() );
+      BOOST_CHECK( sealed->id() == blocks.back().id() );
+      BOOST_CHECK( sealed->packed() == fc::raw::pack( blocks.back() ) );
+      BOOST_CHECK( reader.fetch_sealed( blocks.front().id() )->id() == blocks.front().id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_read_while_closing )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+
+      const uint32_t block_count = 100;
+      vector<signed_block> blocks;
+      signed_block b;
+      for( uint32_t i = 0; i < block_count; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         blocks.push_back( b );
+         bdb.store( b.id(), b );
+      }
+      // maps the index as it is now, the writer closing must not take any of it away
+      block_database_reader reader( data_dir.path() );
+
+      std::atomic<bool> done( false );
+      std::atomic<uint32_t> reads( 0 );
+      std::atomic<uint32_t> mismatches( 0 );
+      vector< std::unique_ptr<fc::thread> > threads;
+      vector< fc::future<void> > readers_done;
+      for( uint32_t t = 0; t < 3; ++t )
+      {
+         threads.emplace_back( new fc::thread( "block_reader" ) );
+         readers_done.push_back( threads.back()->async( [&,t]() {
+            for( uint32_t i = 0; !done.load(); ++i )
+            {
+               const uint32_t num = 1 + (i * 7 + t) % block_count;
+               // the block_database of the writer finds the block or, once closed, nothing
+               auto block = bdb.fetch_by_number( num );
+               if( block.valid() && block->id() != blocks[num-1].id() )
+                  ++mismatches;
+               for( const auto& r : bdb.fetch_range( num, 5 ) )
+                  if( r.id() != blocks[r.block_num()-1].id() )
+                     ++mismatches;
+               auto read = reader.fetch_by_number( num );
+               if( !read.valid() || read->id() != blocks[num-1].id() )
+                  ++mismatches;
+               ++reads;
+            }
+         }, "read_blocks" ) );
+      }
+
+      while( reads.load() < 100 )
+         fc::usleep( fc::milliseconds( 1 ) );
+      bdb.close();
+      BOOST_CHECK( !bdb.fetch_by_number( 1 ).valid() );
+      BOOST_CHECK( !bdb.last_id().valid() );
+      const uint32_t reads_at_close = reads.load();
+      while( reads.load() < reads_at_close + 100 )
+         fc::usleep( fc::milliseconds( 1 ) );
+      done = true;
+      for( auto& f : readers_done )
+         f.wait();
+      BOOST_CHECK_EQUAL( mismatches.load(), 0u );
+      BOOST_CHECK( reader.fetch_by_number( block_count )->id() == blocks.back().id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_cache )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+
+      vector<signed_block> blocks;
+      signed_block b;
+      for( uint32_t i = 0; i < 4; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         bdb.store( b.id(), b );
+         blocks.push_back( b );
+      }
+      const uint32_t block_size = fc::raw::pack_size( blocks[0] );
+      bdb.get_cache().set_capacity( 3 * block_size );
+
+      BOOST_CHECK( bdb.fetch_by_number( 1 )->id() == blocks[0].id() );
+      BOOST_CHECK( bdb.fetch_optional( blocks[0].id() )->id() == blocks[0].id() );
+      BOOST_CHECK( bdb.fetch_by_number( 1 )->id() == blocks[0].id() );
+      auto stats = bdb.get_cache().get_stats();
+      BOOST_CHECK_EQUAL( stats.misses, 1u );
+      BOOST_CHECK_EQUAL( stats.hits, 2u );
+      BOOST_CHECK_EQUAL( stats.size, 1u );
+
+      // block 2 is the least recently used once 4 is read, and is evicted
+      bdb.fetch_by_number( 2 );
+      bdb.fetch_by_number( 3 );
+      bdb.fetch_by_number( 1 );
+      bdb.fetch_by_number( 4 );
+      stats = bdb.get_cache().get_stats();
+      BOOST_CHECK_EQUAL( stats.size, 3u );
+      BOOST_CHECK_EQUAL( stats.evictions, 1u );
+      BOOST_CHECK_LE( stats.bytes, stats.capacity );
+      bdb.fetch_by_number( 1 );
+      BOOST_CHECK_EQUAL( bdb.get_cache().get_stats().hits, stats.hits + 1 );
+      bdb.fetch_by_number( 2 );
+      BOOST_CHECK_EQUAL( bdb.get_cache().get_stats().misses, stats.misses + 1 );
+
+      // neither a removed nor a replaced block is served from the cache
+      bdb.remove( blocks[3].id() );
+      BOOST_CHECK( !bdb.fetch_by_number( 4 ).valid() );
+      signed_block replacement = blocks[2];
+      replacement.witness = witness_id_type(100);
+      bdb.store( replacement.id(), replacement );
+      BOOST_CHECK( bdb.fetch_by_number( 3 )->witness == witness_id_type(100) );
+      BOOST_CHECK( !bdb.fetch_optional( blocks[2].id() ).valid() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( sealed_block_ids )
+{
+   try {
+      auto signing_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string("null_key") ) );
+
+      signed_block b;
+      b.previous = block_id_type( "0000000ab0c11b9e4a6bc7a3fd6f41d0e9a56a4e" );
+      b.witness = witness_id_type(3);
+      for( uint32_t i = 0; i < 3; ++i )
+      {
+         signed_transaction trx;
+         trx.expiration = fc::time_point_sec( 1000 + i );
+         transfer_operation t;
+         t.amount = asset( i + 1 );
+         trx.operations.push_back( t );
+         b.transactions.push_back( processed_transaction( trx ) );
+      }
+      b.transaction_merkle_root = b.calculate_merkle_root();
+      b.sign( signing_key );
+
+      const sealed_block sealed( b );
+      BOOST_CHECK( sealed.id() == b.id() );
+      BOOST_CHECK_EQUAL( sealed.block_num(), b.block_num() );
+      BOOST_CHECK( sealed.digest() == b.digest() );
+      BOOST_CHECK_EQUAL( sealed.packed_size(), fc::raw::pack_size( b ) );
+      for( uint32_t i = 0; i < b.transactions.size(); ++i )
+         BOOST_CHECK( sealed.transaction_id( i ) == b.transactions[i].id() );
+      BOOST_CHECK( sealed.validate_signee( signing_key.get_public_key() ) );
+      BOOST_CHECK( sealed->witness == b.witness );
+
+      // copies share the sealed block
+      const sealed_block copy = sealed;
+      BOOST_CHECK( &copy.block() == &sealed.block() );
+
+      fork_database fdb;
+      fdb.start_block( sealed );
+      BOOST_CHECK( fdb.head()->id == b.id() );
+      BOOST_CHECK( fdb.head()->previous_id() == b.previous );
+      BOOST_CHECK( &fdb.head()->data.block() == &sealed.block() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( sealed_block_bytes )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      signed_block b;
+      b.witness = witness_id_type(5);
+      signed_transaction trx;
+      trx.expiration = fc::time_point_sec( 1000 );
+      trx.operations.push_back( transfer_operation() );
+      b.transactions.push_back( processed_transaction( trx ) );
+      const vector<char> bytes = fc::raw::pack( b );
+
+      // a sealed block packs to the bytes it keeps, which are those the block packs to
+      const sealed_block sealed( b );
+      BOOST_CHECK( sealed.packed() == bytes );
+      BOOST_CHECK( fc::raw::pack( sealed ) == bytes );
+      BOOST_CHECK_EQUAL( fc::raw::pack_size( sealed ), bytes.size() );
+      const sealed_block unpacked = fc::raw::unpack<sealed_block>( bytes );
+      BOOST_CHECK( unpacked.packed() == bytes );
+      BOOST_CHECK( unpacked.id() == b.id() );
+      BOOST_CHECK( unpacked.transaction_id( 0 ) == trx.id() );
+
+      // bytes which unpack to the block without being what it packs to are not kept: the witness id follows the
+      // previous block id and the timestamp, here it is sent as a varint one byte longer than needed
+      vector<char> overlong = bytes;
+      const size_t witness_pos = sizeof(block_id_type) + sizeof(uint32_t);
+      BOOST_REQUIRE_EQUAL( overlong[witness_pos], 5 );
+      overlong[witness_pos] = char(0x85);
+      overlong.insert( overlong.begin() + witness_pos + 1, char(0) );
+      const sealed_block relayed = fc::raw::unpack<sealed_block>( overlong );
+      BOOST_CHECK( relayed.id() == b.id() );
+      BOOST_CHECK( relayed.packed() == bytes );
+
+      // the block database writes the sealed bytes and hands out the block it was given
+      block_database bdb;
+      bdb.open( data_dir.path() );
+      bdb.store( sealed );
+      auto fetched = bdb.fetch_sealed( b.id() );
+      BOOST_REQUIRE( fetched.valid() );
+      BOOST_CHECK( &fetched->block() == &sealed.block() );
+      bdb.get_cache().clear();
+      fetched = bdb.fetch_sealed_by_number( 1 );
+      BOOST_REQUIRE( fetched.valid() );
+      BOOST_CHECK( fetched->packed() == bytes );
+      BOOST_CHECK( bdb.fetch_by_number( 1 )->id() == b.id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( generate_empty_blocks )
 {
    try {
@@ -181,6 +516,185 @@ BOOST_AUTO_TEST_CASE( generate_empty_blocks )
    }
 }
 
+BOOST_AUTO_TEST_CASE( reindex_prefetch )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      block_id_type head_id;
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 50; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         head_id = db.head_block_id();
+         db.close( false );
+      }
+      {
+         // more blocks in flight than reader threads and blocks spread over all of them
+         database db;
+         db.set_reindex_prefetch( 3, 7 );
+         db.reindex( data_dir.path(), make_genesis() );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 50u );
+         BOOST_CHECK( db.head_block_id() == head_id );
+         db.close( false );
+      }
+      {
+         database db;
+         db.set_reindex_prefetch( 0, 0 );
+         db.reindex( data_dir.path(), make_genesis() );
+         BOOST_CHECK( db.head_block_id() == head_id );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( reindex_resumes_from_checkpoint )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      block_id_type head_id;
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 50; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         head_id = db.head_block_id();
+         db.close( false );
+      }
+      {
+         // interrupt the replay after checkpoints at blocks 10 and 20 have been written
+         database db;
+         db.set_reindex_checkpoint_interval( 10 );
+         db.applied_block.connect( [&]( const signed_block& b ) {
+            if( b.block_num() == 25 )
+               FC_THROW( "interrupted" );
+         });
+         BOOST_CHECK_THROW( db.reindex( data_dir.path(), make_genesis() ), fc::exception );
+      }
+      BOOST_CHECK( fc::exists( data_dir.path() / "reindex_checkpoint" ) );
+      {
+         database db;
+         uint32_t first_applied = 0;
+         db.applied_block.connect( [&]( const signed_block& b ) {
+            if( first_applied == 0 )
+               first_applied = b.block_num();
+         });
+         db.reindex( data_dir.path(), make_genesis() );
+         BOOST_CHECK_EQUAL( first_applied, 21u );
+         BOOST_CHECK( db.head_block_id() == head_id );
+         db.close( false );
+      }
+      BOOST_CHECK( !fc::exists( data_dir.path() / "reindex_checkpoint" ) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( open_persisted_state )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      block_id_type head_id;
+      {
+         database db;
+         db.set_state_persistence_interval( 5 );
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 60; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         BOOST_CHECK( db.get_dynamic_global_properties().last_irreversible_block_num > 5 );
+         head_id = db.head_block_id();
+         // not closed, so the object database is never saved as after a crash
+      }
+      {
+         database db;
+         BOOST_REQUIRE( db.has_persisted_state( data_dir.path() ) );
+         db.open(data_dir.path(), []{return genesis_state_type();});
+         BOOST_CHECK_EQUAL( db.head_block_num(), 60u );
+         BOOST_CHECK( db.head_block_id() == head_id );
+         db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         BOOST_CHECK_EQUAL( db.head_block_num(), 61u );
+         db.close();
+      }
+      BOOST_CHECK( !fc::exists( data_dir.path() / "state" ) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( reindex_after_persisted_state )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      block_id_type head_id;
+      {
+         database db;
+         db.set_state_persistence_interval( 5 );
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 60; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         head_id = db.head_block_id();
+         // not closed, the state persisted while running is left behind as after a crash
+      }
+      {
+         database db;
+         BOOST_REQUIRE( db.has_persisted_state( data_dir.path() ) );
+         db.reindex( data_dir.path(), make_genesis() );
+         BOOST_CHECK( !db.has_persisted_state( data_dir.path() ) );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 60u );
+         BOOST_CHECK( db.head_block_id() == head_id );
+         db.close();
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( parallel_open_and_flush )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      block_id_type head_id;
+      map< public_key_type, set<account_id_type> > key_memberships;
+      auto get_key_memberships = []( const database& db ) {
+         const auto& idx = dynamic_cast<const primary_index<account_index>&>( db.get_index_type<account_index>() );
+         return idx.get_secondary_index<account_member_index>().account_to_key_memberships;
+      };
+      {
+         database db;
+         db.set_io_threads( 4 );
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 20; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         db.close();
+         head_id = db.head_block_id();
+         key_memberships = get_key_memberships( db );
+      }
+      BOOST_CHECK( !key_memberships.empty() );
+      for( uint32_t threads : { 4u, 1u } )
+      {
+         database db;
+         db.set_io_threads( threads );
+         db.open(data_dir.path(), []{return genesis_state_type();});
+         BOOST_CHECK( db.head_block_id() == head_id );
+         BOOST_CHECK( get_key_memberships( db ) == key_memberships );
+         db.close();
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( undo_block )
 {
    try {
@@ -310,13 +824,13 @@ BOOST_AUTO_TEST_CASE( fork_db_tests )
         if( b.block_num() == 1800 )
            skipped_block = b;
         else
-           fdb.push_block( b );
+           fdb.push_block( sealed_block( b ) );
         prev = b;
      }
      auto head = fdb.head();
      FC_ASSERT( head && head->data.block_num() == 1799 );
 
-     fdb.push_block(skipped_block);
+     fdb.push_block( sealed_block( skipped_block ) );
      head = fdb.head();
      FC_ASSERT( head && head->data.block_num() == 2001, "", ("head",head->data.block_num()) );
   } FC_LOG_AND_RETHROW() 
@@ -550,6 +1064,301 @@ BOOST_AUTO_TEST_CASE( duplicate_transactions )
    }
 }
 
+BOOST_AUTO_TEST_CASE( pending_transactions_replayed )
+{
+   try {
+      fc::temp_directory dir1( graphene::utilities::temp_directory_path() ),
+                         dir2( graphene::utilities::temp_directory_path() );
+      database db1,
+               db2;
+      db1.open(dir1.path(), make_genesis);
+      db2.open(dir2.path(), make_genesis);
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      public_key_type init_account_pub_key  = init_account_priv_key.get_public_key();
+      const graphene::db::index& account_idx = db1.get_index(protocol_ids, account_object_type);
+
+      auto transfer = [&]( database& db, account_id_type from, account_id_type to, share_type amount ) {
+         signed_transaction trx;
+         set_expiration( db, trx );
+         transfer_operation t;
+         t.from = from;
+         t.to = to;
+         t.amount = asset(amount);
+         trx.operations.push_back(t);
+         trx.sign( init_account_priv_key, db.get_chain_id() );
+         PUSH_TX( db, trx, skip_sigs );
+         return trx.id();
+      };
+
+      signed_transaction trx;
+      set_expiration( db1, trx );
+      account_id_type nathan_id = account_idx.get_next_id();
+      account_id_type sam_id( nathan_id.instance.value + 1 );
+      account_id_type dan_id( nathan_id.instance.value + 2 );
+      account_id_type eve_id( nathan_id.instance.value + 3 );
+      for( string name : { "nathan", "sam", "dan", "eve" } )
+      {
+         account_create_operation cop;
+         cop.name = name;
+         cop.owner = authority(1, init_account_pub_key, 1);
+         cop.active = cop.owner;
+         trx.operations.push_back(cop);
+      }
+      trx.sign( init_account_priv_key, db1.get_chain_id() );
+      PUSH_TX( db1, trx, skip_sigs );
+      transfer( db1, account_id_type(), nathan_id, 1000 );
+      transfer( db1, account_id_type(), sam_id, 1000 );
+
+      auto b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      PUSH_BLOCK( db2, b, skip_sigs );
+      b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      PUSH_BLOCK( db2, b, skip_sigs );
+
+      // pending on db2 only
+      const transaction_id_type nathan_trx = transfer( db2, nathan_id, dan_id, 100 );
+      transfer( db2, sam_id, eve_id, 100 );
+
+      // balances are searched by account and asset, which counts as a read of those keys, not of the whole index
+      const pending_transaction_ptr nathan_pending = db2.get_pending_transaction_pool().find( nathan_trx );
+      BOOST_REQUIRE( nathan_pending );
+      const auto& reads = nathan_pending->reads;
+      BOOST_CHECK( !std::binary_search( reads.indexes.begin(), reads.indexes.end(),
+                                        std::make_pair( uint8_t(account_balance_object::space_id),
+                                                        uint8_t(account_balance_object::type_id) ) ) );
+      auto searched = [&reads]( const account_balance_object& balance ) {
+         const vector<char> packed = fc::raw::pack( balance );
+         return std::any_of( reads.searches.begin(), reads.searches.end(),
+                             [&packed]( const graphene::db::index_search& search ) {
+            return search.space_id == account_balance_object::space_id
+                   && search.type_id == account_balance_object::type_id
+                   && search.covers( packed.data(), packed.size() );
+         } );
+      };
+      const auto& balances = db2.get_index_type<account_balance_index>().indices().get<by_account_asset>();
+      BOOST_CHECK( searched( *balances.find( boost::make_tuple( nathan_id, asset_id_type() ) ) ) );
+      BOOST_CHECK( !searched( *balances.find( boost::make_tuple( sam_id, asset_id_type() ) ) ) );
+      BOOST_CHECK( std::binary_search( reads.objects.begin(), reads.objects.end(),
+                                       object_id_type( dynamic_global_property_id_type() ) ) );
+
+      // a block of a fork which does not become the longest leaves the state alone, both are replayed
+      db1.pop_block();
+      b = db1.generate_block( db1.get_slot_time(2), db1.get_scheduled_witness( 2 ), init_account_priv_key, skip_sigs );
+      pending_transaction_stats before = db2.get_pending_transaction_stats();
+      BOOST_CHECK( !db2.push_block( b, skip_sigs ) );
+      const pending_transaction_stats& after = db2.get_pending_transaction_stats();
+      BOOST_CHECK_EQUAL( after.replayed - before.replayed, 2u );
+      BOOST_CHECK_EQUAL( after.reevaluated - before.reevaluated, 0u );
+
+      // a block which is applied changes the head block fields of the dynamic globals, which do not count, and the
+      // balance of nathan: the transfer of nathan is evaluated again, the unrelated one of sam is replayed
+      transfer( db1, account_id_type(), nathan_id, 50 );
+      b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      before = db2.get_pending_transaction_stats();
+      PUSH_BLOCK( db2, b, skip_sigs );
+
+      BOOST_CHECK_EQUAL( after.replayed - before.replayed, 1u );
+      BOOST_CHECK_EQUAL( after.reevaluated - before.reevaluated, 1u );
+      BOOST_CHECK_EQUAL( db2.get_balance(nathan_id, asset_id_type()).amount.value, 950 );
+      BOOST_CHECK_EQUAL( db2.get_balance(sam_id, asset_id_type()).amount.value, 900 );
+      BOOST_CHECK_EQUAL( db2.get_balance(dan_id, asset_id_type()).amount.value, 100 );
+      BOOST_CHECK_EQUAL( db2.get_balance(eve_id, asset_id_type()).amount.value, 100 );
+
+      // both end up in the next block of db2
+      b = db2.generate_block( db2.get_slot_time(1), db2.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 2u );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( pending_transaction_pool_eviction )
+{
+   try {
+      pending_transaction_pool pool;
+      auto make = [&]( uint32_t n, share_type fee, uint32_t expiration ) {
+         auto tx = std::make_shared<pending_transaction>();
+         tx->trx.expiration = fc::time_point_sec( expiration );
+         tx->id = fc::ripemd160::hash( std::to_string( n ) );
+         tx->fee_payer = account_id_type( n % 2 );
+         tx->core_fees = fee;
+         tx->packed_size = 1024;
+         return tx;
+      };
+
+      BOOST_CHECK( pool.insert( make( 0, 10, 300 ) ).empty() );
+      const uint64_t entry_size = pool.memory_size();
+      pool.set_capacity( entry_size * 3 );
+      BOOST_CHECK( pool.insert( make( 1, 30, 100 ) ).empty() );
+      BOOST_CHECK( pool.insert( make( 2, 20, 200 ) ).empty() );
+      BOOST_CHECK_EQUAL( pool.size(), 3u );
+
+      // full, only a better paying transaction gets in and pushes the worst out
+      BOOST_CHECK( !pool.would_admit( *make( 3, 10, 400 ) ) );
+      BOOST_CHECK( pool.would_admit( *make( 3, 11, 400 ) ) );
+      auto evicted = pool.insert( make( 3, 40, 400 ) );
+      BOOST_REQUIRE_EQUAL( evicted.size(), 1u );
+      BOOST_CHECK( evicted[0]->id == make( 0, 0, 0 )->id );
+      BOOST_CHECK( !pool.find( evicted[0]->id ) );
+      BOOST_CHECK_EQUAL( pool.memory_size(), entry_size * 3 );
+
+      vector<share_type> fees;
+      for( const auto& tx : pool.index().get<pending_transaction_pool::by_priority>() )
+         fees.push_back( tx->core_fees );
+      BOOST_REQUIRE_EQUAL( fees.size(), 3u );
+      BOOST_CHECK( fees[0] == 40 && fees[1] == 30 && fees[2] == 20 );
+
+      BOOST_CHECK_EQUAL( pool.find_by_fee_payer( account_id_type(1) ).size(), 2u );
+
+      auto expired = pool.remove_expired( fc::time_point_sec( 250 ) );
+      BOOST_CHECK_EQUAL( expired.size(), 2u );
+      BOOST_CHECK_EQUAL( pool.memory_size(), entry_size );
+
+      auto released = pool.release();
+      BOOST_REQUIRE_EQUAL( released.size(), 1u );
+      BOOST_CHECK( released[0]->core_fees == 40 );
+      BOOST_CHECK( pool.empty() );
+      BOOST_CHECK_EQUAL( pool.memory_size(), 0u );
+
+      // a transaction larger than the whole pool is evicted right away, however much it pays
+      auto huge = make( 4, 1000000, 400 );
+      huge->packed_size = entry_size * 4;
+      evicted = pool.insert( huge );
+      BOOST_REQUIRE_EQUAL( evicted.size(), 1u );
+      BOOST_CHECK( evicted[0] == huge );
+      BOOST_CHECK( pool.empty() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( generate_block_by_fee )
+{
+   try {
+      fc::temp_directory dir( graphene::utilities::temp_directory_path() );
+      database db;
+      db.open(dir.path(), make_genesis);
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      public_key_type init_account_pub_key  = init_account_priv_key.get_public_key();
+      account_id_type nathan_id = db.get_index(protocol_ids, account_object_type).get_next_id();
+
+      signed_transaction trx;
+      set_expiration( db, trx );
+      account_create_operation cop;
+      cop.name = "nathan";
+      cop.owner = authority(1, init_account_pub_key, 1);
+      cop.active = cop.owner;
+      trx.operations.push_back(cop);
+      PUSH_TX( db, trx, skip_sigs );
+      db.generate_block( db.get_slot_time(1), db.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+
+      for( int64_t fee : { 0, 5, 50 } )
+      {
+         trx = signed_transaction();
+         set_expiration( db, trx );
+         transfer_operation t;
+         t.to = nathan_id;
+         t.amount = asset(100 + fee);
+         t.fee = asset(fee);
+         trx.operations.push_back(t);
+         PUSH_TX( db, trx, skip_sigs );
+      }
+
+      auto b = db.generate_block( db.get_slot_time(1), db.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      BOOST_REQUIRE_EQUAL( b.transactions.size(), 3u );
+      BOOST_CHECK( b.transactions[0].operations[0].get<transfer_operation>().fee.amount == 50 );
+      BOOST_CHECK( b.transactions[1].operations[0].get<transfer_operation>().fee.amount == 5 );
+      BOOST_CHECK( b.transactions[2].operations[0].get<transfer_operation>().fee.amount == 0 );
+      BOOST_CHECK_EQUAL( db.get_balance(nathan_id, asset_id_type()).amount.value, 355 );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( prepared_block_candidate )
+{
+   try {
+      fc::temp_directory dir( graphene::utilities::temp_directory_path() );
+      database db;
+      db.open(dir.path(), make_genesis);
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      public_key_type init_account_pub_key  = init_account_priv_key.get_public_key();
+      account_id_type nathan_id = db.get_index(protocol_ids, account_object_type).get_next_id();
+
+      signed_transaction trx;
+      set_expiration( db, trx );
+      account_create_operation cop;
+      cop.name = "nathan";
+      cop.owner = authority(1, init_account_pub_key, 1);
+      cop.active = cop.owner;
+      trx.operations.push_back(cop);
+      PUSH_TX( db, trx, skip_sigs );
+      db.generate_block( db.get_slot_time(1), db.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+
+      auto transfer = [&]( int64_t fee ) {
+         signed_transaction trx;
+         set_expiration( db, trx );
+         transfer_operation t;
+         t.to = nathan_id;
+         t.amount = asset(100);
+         t.fee = asset(fee);
+         trx.operations.push_back(t);
+         PUSH_TX( db, trx, skip_sigs );
+      };
+
+      const fc::time_point_sec when = db.get_slot_time(1);
+      const witness_id_type witness = db.get_scheduled_witness(1);
+      transfer( 0 );
+      db.prepare_block( when, witness, skip_sigs );
+      BOOST_CHECK( db.has_block_candidate( when, witness ) );
+      BOOST_CHECK( !db.has_block_candidate( db.get_slot_time(2), db.get_scheduled_witness(2) ) );
+
+      // joins the candidate behind the transaction already in it although it pays more
+      transfer( 5 );
+      BOOST_CHECK_EQUAL( db.get_balance(nathan_id, asset_id_type()).amount.value, 200 );
+
+      // one expiring before the candidate's slot is rejected rather than kept
+      {
+         signed_transaction expiring;
+         set_expiration( db, expiring );
+         expiring.set_expiration( when - 1 );
+         transfer_operation t;
+         t.to = nathan_id;
+         t.amount = asset(100);
+         expiring.operations.push_back(t);
+         GRAPHENE_REQUIRE_THROW( PUSH_TX( db, expiring, skip_sigs ), fc::exception );
+         BOOST_CHECK( !db.get_pending_transaction_pool().find( expiring.id() ) );
+      }
+
+      auto b = db.generate_block( when, witness, init_account_priv_key, skip_sigs );
+      BOOST_REQUIRE_EQUAL( b.transactions.size(), 2u );
+      BOOST_CHECK( b.transactions[0].operations[0].get<transfer_operation>().fee.amount == 0 );
+      BOOST_CHECK( b.transactions[1].operations[0].get<transfer_operation>().fee.amount == 5 );
+      BOOST_CHECK( !db.has_block_candidate( when, witness ) );
+      BOOST_CHECK_EQUAL( db.get_balance(nathan_id, asset_id_type()).amount.value, 200 );
+
+      // a candidate is dropped with the head block it was built on
+      transfer( 1 );
+      const fc::time_point_sec next_when = db.get_slot_time(1);
+      const witness_id_type next_witness = db.get_scheduled_witness(1);
+      db.prepare_block( next_when, next_witness, skip_sigs );
+      db.pop_block();
+      BOOST_CHECK( !db.has_block_candidate( next_when, next_witness ) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( tapos )
 {
    try {
@@ -1301,4 +2110,155 @@ BOOST_FIXTURE_TEST_CASE( miss_many_blocks, database_fixture )
    }
 }
 
+BOOST_FIXTURE_TEST_CASE( state_hash_follows_changes, database_fixture )
+{
+   try {
+      db.set_state_digest_history( 3 );
+      auto check_state_hashes = [&]() {
+         for( uint8_t space = 0; space < 4; ++space )
+            for( uint8_t type = 0; type < 255; ++type )
+            {
+               const graphene::db::index* idx = nullptr;
+               try { idx = &db.get_index( space, type ); } catch( const fc::exception& ) { continue; }
+               BOOST_CHECK( idx->state_hash() == idx->hash() );
+            }
+      };
+      check_state_hashes();
+
+      ACTORS( (alice)(bob) );
+      transfer( account_id_type(), alice_id, asset( 10000 ) );
+      generate_block();
+      const uint32_t first = db.head_block_num();
+      check_state_hashes();
+      auto digest = db.get_block_state_digest( first );
+      BOOST_REQUIRE( digest.valid() );
+      BOOST_CHECK( digest->block_id == db.head_block_id() );
+      BOOST_CHECK( digest->digest == db.compute_state_digest() );
+
+      // undoing changes reverts the hashes as well
+      const fc::sha256 before = db.compute_state_digest();
+      {
+         auto session = db._undo_db.start_undo_session();
+         db.adjust_balance( alice_id, asset( -500 ) );
+         db.adjust_balance( bob_id, asset( 500 ) );
+         BOOST_CHECK( db.compute_state_digest() != before );
+         check_state_hashes();
+      }
+      BOOST_CHECK( db.compute_state_digest() == before );
+      check_state_hashes();
+
+      generate_block();
+      generate_block();
+      generate_block();
+      check_state_hashes();
+      BOOST_CHECK( !db.get_block_state_digest( first ).valid() );
+      BOOST_CHECK( db.get_block_state_digest( db.head_block_num() ).valid() );
+
+      const uint32_t head = db.head_block_num();
+      db.pop_block();
+      BOOST_CHECK( !db.get_block_state_digest( head ).valid() );
+      BOOST_CHECK( db.get_block_state_digest( head - 1 ).valid() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( api_threads_read_while_blocks_are_applied, database_fixture )
+{
+   try {
+      ACTORS( (alice) );
+      generate_block();
+      db.enable_concurrent_reads();
+      db.enable_snapshots( db.head_block_num() );
+      graphene::app::api_thread_pool pool( db, 2 );
+      graphene::app::database_api db_api( db, &pool );
+
+      const uint32_t callers = 4;
+      const uint32_t calls_per_caller = 25;
+      vector< fc::future<void> > callers_done;
+      for( uint32_t c = 0; c < callers; ++c )
+         callers_done.push_back( fc::async( [&]() {
+            for( uint32_t i = 0; i < calls_per_caller; ++i )
+            {
+               auto accounts = db_api.get_accounts( { alice_id } );
+               BOOST_REQUIRE_EQUAL( accounts.size(), 1u );
+               BOOST_REQUIRE( accounts[0].valid() );
+               BOOST_CHECK_EQUAL( accounts[0]->name, "alice" );
+               BOOST_CHECK_LE( db_api.get_dynamic_global_properties().head_block_number, db.head_block_num() );
+               // read from a snapshot while the blocks are applied
+               auto full = db_api.get_full_accounts( { "alice" }, false );
+               BOOST_REQUIRE_EQUAL( full.count( "alice" ), 1u );
+               BOOST_CHECK( full["alice"].account.id == alice_id );
+               BOOST_CHECK_EQUAL( full["alice"].registrar_name, "committee-account" );
+            }
+         }, "api_caller" ) );
+
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         generate_block();
+         fc::yield();
+      }
+      for( auto& f : callers_done )
+         f.wait();
+
+      const auto stats = db_api.get_api_call_stats();
+      BOOST_CHECK_EQUAL( stats.threads, 2u );
+      BOOST_CHECK_EQUAL( stats.queue_depth, 0u );
+      BOOST_CHECK_GE( stats.max_queue_depth, 1u );
+      uint64_t calls = 0;
+      for( const auto& method : stats.methods )
+      {
+         calls += method.calls;
+         BOOST_CHECK_GE( method.total_latency_us, method.total_run_us );
+      }
+      BOOST_CHECK_EQUAL( calls, 3 * callers * calls_per_caller );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( get_blocks_and_irreversible_block_subscription, database_fixture )
+{
+   try {
+      generate_blocks( 20 );
+      graphene::app::database_api db_api( db );
+
+      const auto blocks = db_api.get_blocks( 1, 20 );
+      BOOST_REQUIRE_EQUAL( blocks.size(), 20u );
+      for( uint32_t i = 0; i < blocks.size(); ++i )
+         BOOST_CHECK( blocks[i].id() == db.fetch_block_by_number( i + 1 )->id() );
+      BOOST_CHECK_EQUAL( db_api.get_blocks( db.head_block_num() - 1, 5 ).size(), 2u );
+      BOOST_CHECK( db_api.get_blocks( db.head_block_num() + 1, 5 ).empty() );
+      GRAPHENE_REQUIRE_THROW( db_api.get_blocks( 1, 1001 ), fc::exception );
+
+      vector<uint32_t> received;
+      db_api.subscribe_to_irreversible_blocks( [&]( const fc::variant& v ) {
+         for( const auto& block : v.as< vector<signed_block> >() )
+            received.push_back( block.block_num() );
+      }, 3 );
+      for( uint32_t i = 0; i < 30; ++i )
+      {
+         generate_block();
+         fc::yield();
+      }
+      fc::yield();
+
+      const uint32_t last_irreversible = db.get_dynamic_global_properties().last_irreversible_block_num;
+      BOOST_REQUIRE_GE( last_irreversible, 3u );
+      BOOST_REQUIRE_EQUAL( received.size(), last_irreversible - 2 );
+      for( uint32_t i = 0; i < received.size(); ++i )
+         BOOST_CHECK_EQUAL( received[i], i + 3 );
+
+      db_api.cancel_all_subscriptions();
+      generate_blocks( 10 );
+      fc::yield();
+      BOOST_CHECK_EQUAL( received.size(), last_irreversible - 2 );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -27,6 +27,8 @@
 #include <graphene/chain/database.hpp>
 
 #include <graphene/chain/account_object.hpp>
+#include <graphene/chain/market_object.hpp>
+#include <graphene/utilities/tempdir.hpp>
 
 #include <fc/crypto/digest.hpp>
 
@@ -59,3 +61,312 @@ BOOST_AUTO_TEST_CASE( undo_test )
       throw;
    }
 }
+
+BOOST_AUTO_TEST_CASE( undo_merge_test )
+{
+   try {
+      database db;
+      const auto& bal_obj1 = db.create<account_balance_object>( [&]( account_balance_object& obj ){
+               obj.balance = 1;
+      });
+      const auto& bal_obj2 = db.create<account_balance_object>( [&]( account_balance_object& obj ){
+               obj.balance = 2;
+      });
+      auto id1 = bal_obj1.id;
+      auto id2 = bal_obj2.id;
+      auto next_id = db.get_index<account_balance_object>().get_next_id();
+
+      auto ses = db._undo_db.start_undo_session();
+      db.modify( bal_obj1, [&]( account_balance_object& obj ){ obj.balance = 10; } );
+      {
+         // modify again, remove and create in a nested session which is merged into the outer one
+         auto inner = db._undo_db.start_undo_session();
+         db.modify( db.get<account_balance_object>( id1 ), [&]( account_balance_object& obj ){ obj.balance = 11; } );
+         db.modify( db.get<account_balance_object>( id2 ), [&]( account_balance_object& obj ){ obj.balance = 20; } );
+         db.remove( db.get<account_balance_object>( id1 ) );
+         const auto& bal_obj3 = db.create<account_balance_object>( [&]( account_balance_object& obj ){
+                  obj.balance = 3;
+         });
+         db.remove( bal_obj3 );
+         inner.merge();
+      }
+      BOOST_CHECK( db.find<account_balance_object>( id1 ) == nullptr );
+      BOOST_CHECK( db._undo_db.head_changed_ids().size() == 2 );
+      ses.undo();
+
+      BOOST_CHECK( db.get<account_balance_object>( id1 ).balance == 1 );
+      BOOST_CHECK( db.get<account_balance_object>( id2 ).balance == 2 );
+      BOOST_CHECK( db.get_index<account_balance_object>().get_next_id() == next_id );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( retained_undo_journal )
+{
+   try {
+      database db;
+      const auto& bal_obj = db.create<account_balance_object>( [&]( account_balance_object& obj ){
+               obj.balance = 1;
+      });
+      auto id = bal_obj.id;
+      db._undo_db.set_max_size( 0 );
+
+      auto ses = db._undo_db.start_undo_session();
+      const uint64_t seq = db._undo_db.journal().next_seq();
+      db.modify( bal_obj, [&]( account_balance_object& obj ){ obj.balance = 2; } );
+      ses.commit();
+
+      // the savepoint falls out of the undo history, but its records stay until they are released
+      db._undo_db.retain_journal();
+      ses = db._undo_db.start_undo_session();
+      db.modify( db.get<account_balance_object>( id ), [&]( account_balance_object& obj ){ obj.balance = 3; } );
+      ses.commit();
+      BOOST_CHECK_EQUAL( db._undo_db.size(), 1u );
+      BOOST_REQUIRE( db._undo_db.journal().first_seq() <= seq );
+      vector<const graphene::db::undo_record*> records;
+      db._undo_db.journal().first_records_since( seq, records );
+      BOOST_REQUIRE_EQUAL( records.size(), 1u );
+      BOOST_CHECK( records[0]->id == id );
+      BOOST_CHECK( records[0]->kind == graphene::db::undo_record_kind::modified );
+
+      db._undo_db.release_journal();
+      BOOST_CHECK( db._undo_db.journal().first_seq() > seq );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( state_snapshots )
+{
+   try {
+      database db;
+      const auto& bal_obj = db.create<account_balance_object>( [&]( account_balance_object& obj ){
+               obj.owner = account_id_type(1);
+               obj.balance = 1;
+      });
+      const auto id = bal_obj.id;
+      db._undo_db.set_max_size( 0 );
+      db.enable_snapshots( 1 );
+      const uint64_t pinned = db._undo_db.journal().next_seq();
+      auto first = db.create_snapshot();
+      BOOST_CHECK( !first->live() );
+      BOOST_CHECK_EQUAL( first->block_num(), 1u );
+      BOOST_CHECK( db.create_snapshot() == first );
+
+      auto owned_by = []( const database& d, const graphene::db::state_snapshot& snapshot, account_id_type owner ) {
+         return snapshot.select<account_balance_object>( [&]( const std::function<bool(const account_balance_object&)>& visit ) {
+            const auto range = d.get_index_type<account_balance_index>().indices().get<by_account_asset>().equal_range( boost::make_tuple( owner ) );
+            for( auto itr = range.first; itr != range.second && visit( *itr ); ++itr );
+         }, [owner]( const account_balance_object& b ) { return b.owner == owner; } );
+      };
+
+      auto ses = db._undo_db.start_undo_session();
+      db.modify( bal_obj, [&]( account_balance_object& obj ){
+         obj.owner = account_id_type(2);
+         obj.balance = 2;
+      });
+      const auto other_id = db.create<account_balance_object>( [&]( account_balance_object& obj ){
+               obj.owner = account_id_type(1);
+               obj.balance = 5;
+      }).id;
+      ses.commit();
+      db.mark_snapshot_point( 2 );
+
+      // the savepoint of block 2 falls out of the undo history, the records the first snapshot reads stay
+      ses = db._undo_db.start_undo_session();
+      db.remove( db.get<account_balance_object>( other_id ) );
+      db.modify( db.get<account_balance_object>( id ), [&]( account_balance_object& obj ){ obj.balance = 3; } );
+      ses.commit();
+      BOOST_CHECK( db._undo_db.journal().first_seq() <= pinned );
+
+      BOOST_CHECK_EQUAL( first->get<account_balance_object>( id ).balance.value, 1 );
+      BOOST_CHECK( !first->find<account_balance_object>( other_id ) );
+      auto owned = owned_by( db, *first, account_id_type(1) );
+      BOOST_REQUIRE_EQUAL( owned.size(), 1u );
+      BOOST_CHECK( owned[0].id == id );
+      BOOST_CHECK( owned_by( db, *first, account_id_type(2) ).empty() );
+
+      auto second = db.create_snapshot();
+      BOOST_CHECK_EQUAL( second->block_num(), 2u );
+      BOOST_CHECK_EQUAL( second->get<account_balance_object>( id ).balance.value, 2 );
+      BOOST_REQUIRE( second->find<account_balance_object>( other_id ) );
+      BOOST_CHECK_EQUAL( second->get<account_balance_object>( other_id ).balance.value, 5 );
+      owned = owned_by( db, *second, account_id_type(1) );
+      BOOST_REQUIRE_EQUAL( owned.size(), 1u );
+      BOOST_CHECK( owned[0].id == other_id );
+
+      // undoing the changes a point was marked after drops the point and its snapshots
+      ses = db._undo_db.start_undo_session();
+      db.modify( db.get<account_balance_object>( id ), [&]( account_balance_object& obj ){ obj.balance = 4; } );
+      db.mark_snapshot_point( 3 );
+      auto undone = db.create_snapshot();
+      BOOST_CHECK_EQUAL( undone->get<account_balance_object>( id ).balance.value, 4 );
+      ses.undo();
+      BOOST_CHECK( !undone->valid() );
+      BOOST_CHECK_THROW( undone->find<account_balance_object>( id ), fc::exception );
+      BOOST_CHECK( second->valid() );
+      BOOST_CHECK_EQUAL( db.create_snapshot()->block_num(), 2u );
+
+      // once nothing pins them the records go with their savepoints
+      first.reset();
+      second.reset();
+      undone.reset();
+      ses = db._undo_db.start_undo_session();
+      ses.commit();
+      BOOST_CHECK( db._undo_db.journal().first_seq() > pinned );
+
+      // changes the undo history does not see leave nothing to take a snapshot of
+      db._undo_db.disable();
+      db.modify( db.get<account_balance_object>( id ), [&]( account_balance_object& obj ){ obj.balance = 6; } );
+      db._undo_db.enable();
+      BOOST_CHECK( db.create_snapshot()->live() );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( index_file_formats )
+{
+   try {
+      fc::temp_directory dir( graphene::utilities::temp_directory_path() );
+      const fc::path file = dir.path() / "2" / fc::to_string( account_balance_object::type_id );
+
+      graphene::db::object_database source;
+      source.add_index< primary_index<account_balance_index> >();
+      for( int64_t i = 1; i <= 3; ++i )
+         source.create<account_balance_object>( [&]( account_balance_object& obj ){
+            obj.owner = account_id_type( i );
+            obj.balance = i * 100;
+         });
+
+      auto check_loaded = [&]( graphene::db::object_database& loaded ) {
+         BOOST_CHECK( loaded.get_index<account_balance_object>().get_next_id()
+                      == source.get_index<account_balance_object>().get_next_id() );
+         for( int64_t i = 0; i < 3; ++i )
+         {
+            const auto& obj = loaded.get( account_balance_id_type( i ) );
+            BOOST_CHECK( obj.owner == account_id_type( i + 1 ) );
+            BOOST_CHECK_EQUAL( obj.balance.value, (i + 1) * 100 );
+         }
+         BOOST_CHECK( loaded.find( account_balance_id_type( 3 ) ) == nullptr );
+      };
+
+      // files written by save() carry a record count and fixed size length prefixes
+      source.flush( dir.path() );
+      {
+         graphene::db::object_database loaded;
+         loaded.add_index< primary_index<account_balance_index> >();
+         loaded.open( dir.path(), dir.path() );
+         check_loaded( loaded );
+      }
+
+      // files of the previous layout end with the last varint prefixed record
+      {
+         std::ofstream out( file.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+         fc::raw::pack( out, source.get_index<account_balance_object>().get_next_id() );
+         fc::raw::pack( out, fc::sha256::hash( std::string( "1.0" ) ) );
+         source.get_index<account_balance_object>().inspect_all_objects( [&]( const object& o ) {
+            fc::raw::pack( out, fc::raw::pack( static_cast<const account_balance_object&>( o ) ) );
+         });
+      }
+      {
+         graphene::db::object_database loaded;
+         loaded.add_index< primary_index<account_balance_index> >();
+         loaded.open( dir.path(), dir.path() );
+         check_loaded( loaded );
+      }
+
+      // a truncated file is reported instead of being loaded in part
+      fc::resize_file( file, fc::file_size( file ) - 1 );
+      {
+         graphene::db::object_database loaded;
+         loaded.add_index< primary_index<account_balance_index> >();
+         BOOST_CHECK_THROW( loaded.open( dir.path(), dir.path() ), fc::exception );
+      }
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( dense_lookup )
+{
+   try {
+      database db;
+      vector<account_balance_id_type> ids;
+      for( int64_t i = 0; i < 5; ++i )
+         ids.push_back( db.create<account_balance_object>( [&]( account_balance_object& obj ){
+            obj.balance = i;
+         }).id );
+
+      // removing the oldest objects moves the start of the table, undo puts them back in front of it
+      auto ses = db._undo_db.start_undo_session();
+      db.remove( db.get( ids[0] ) );
+      db.remove( db.get( ids[1] ) );
+      db.remove( db.get( ids[3] ) );
+      BOOST_CHECK( db.find( ids[0] ) == nullptr );
+      BOOST_CHECK( db.find( ids[1] ) == nullptr );
+      BOOST_CHECK( db.find( ids[3] ) == nullptr );
+      BOOST_CHECK_EQUAL( db.get( ids[2] ).balance.value, 2 );
+      BOOST_CHECK_EQUAL( db.get( ids[4] ).balance.value, 4 );
+      ses.undo();
+
+      for( int64_t i = 0; i < 5; ++i )
+         BOOST_CHECK_EQUAL( db.get( ids[i] ).balance.value, i );
+      BOOST_CHECK( db.find( account_balance_id_type( 5 ) ) == nullptr );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( node_pool_reuses_nodes )
+{
+   try {
+      database db;
+      auto pool_stats = [&]() -> node_pool_stats {
+         for( const auto& stats : db.get_node_pool_stats() )
+            if( stats.space_id == limit_order_object::space_id
+                && stats.type_id == limit_order_object::type_id )
+               return stats;
+         BOOST_FAIL( "no node pool for limit_order_object" );
+         return node_pool_stats();
+      };
+
+      const auto before = pool_stats();
+      vector<limit_order_id_type> ids;
+      for( uint32_t i = 0; i < 1000; ++i )
+         ids.push_back( db.create<limit_order_object>( [&]( limit_order_object& obj ){
+            obj.seller = account_id_type( i );
+         }).id );
+
+      const auto filled = pool_stats();
+      BOOST_CHECK_EQUAL( filled.live_nodes, before.live_nodes + 1000 );
+      BOOST_CHECK_GE( filled.capacity, filled.live_nodes );
+      BOOST_CHECK_EQUAL( filled.bytes, filled.capacity * filled.node_size );
+
+      // released nodes are handed out again instead of growing the pool
+      for( const auto& id : ids )
+         db.remove( db.get( id ) );
+      BOOST_CHECK_EQUAL( pool_stats().live_nodes, before.live_nodes );
+      for( uint32_t i = 0; i < 1000; ++i )
+         db.create<limit_order_object>( [&]( limit_order_object& obj ){
+            obj.seller = account_id_type( i );
+         });
+      BOOST_CHECK_EQUAL( pool_stats().live_nodes, before.live_nodes + 1000 );
+      BOOST_CHECK_EQUAL( pool_stats().capacity, filled.capacity );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}